@@ -0,0 +1,109 @@
+#include "RecordingCatalog.h"
+
+#include <string.h>
+
+static void putLE(uint8_t *out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t getLE(const uint8_t *in, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint32_t)in[i] << (8 * i);
+    return value;
+}
+
+void RecordingCatalog::clear() {
+    _count = 0;
+    _nextId = 1;
+}
+
+size_t RecordingCatalog::save(uint8_t *image, size_t capacity) const {
+    size_t length = IMAGE_HEADER + _count * sizeof(CatalogEntry);
+    if (capacity < length) return 0;
+    memcpy(image, "WCAT", 4);
+    putLE(image + 4, _nextId, 4);
+    putLE(image + 8, _count, 4);
+    memcpy(image + IMAGE_HEADER, _entries, _count * sizeof(CatalogEntry));
+    return length;
+}
+
+bool RecordingCatalog::load(const uint8_t *image, size_t length) {
+    clear();
+    if (length < IMAGE_HEADER || memcmp(image, "WCAT", 4) != 0) return false;
+    uint32_t nextId = getLE(image + 4, 4);
+    uint32_t count = getLE(image + 8, 4);
+    if (count > MAX_ENTRIES || length != IMAGE_HEADER + count * sizeof(CatalogEntry)) return false;
+    memcpy(_entries, image + IMAGE_HEADER, count * sizeof(CatalogEntry));
+    // Ids must be increasing and below the next one
+    for (uint32_t i = 0; i < count; i++) {
+        if (_entries[i].id >= nextId || (i > 0 && _entries[i].id <= _entries[i - 1].id)) return false;
+    }
+    _count = count;
+    _nextId = nextId;
+    return true;
+}
+
+CatalogEntry *RecordingCatalog::find(uint32_t id) {
+    for (size_t i = 0; i < _count; i++) {
+        if (_entries[i].id == id) return &_entries[i];
+    }
+    return NULL;
+}
+
+CatalogEntry *RecordingCatalog::add(uint32_t size, uint32_t crc32, uint32_t timestamp) {
+    if (_count == MAX_ENTRIES) return NULL;
+    CatalogEntry &entry = _entries[_count++];
+    entry.id = _nextId++;
+    entry.size = size;
+    entry.crc32 = crc32;
+    entry.timestamp = timestamp;
+    entry.flags = 0;
+    return &entry;
+}
+
+void RecordingCatalog::remove(size_t index) {
+    if (index >= _count) return;
+    memmove(&_entries[index], &_entries[index + 1], (_count - index - 1) * sizeof(CatalogEntry));
+    _count--;
+}
+
+int RecordingCatalog::evictionCandidate() const {
+    for (size_t i = 0; i < _count; i++) {
+        if (_entries[i].flags & FLAG_SYNCED) return i;
+    }
+    return _count ? 0 : -1;
+}
+
+bool RecordingCatalog::markSynced(uint32_t id) {
+    CatalogEntry *entry = find(id);
+    if (!entry) return false;
+    entry->flags |= FLAG_SYNCED;
+    return true;
+}
+
+int RecordingCatalog::nextUnsynced(uint32_t afterId) const {
+    for (size_t i = 0; i < _count; i++) {
+        if (_entries[i].id > afterId && !(_entries[i].flags & FLAG_SYNCED)) return i;
+    }
+    return -1;
+}
+
+size_t RecordingCatalog::unsyncedCount() const {
+    size_t unsynced = 0;
+    for (size_t i = 0; i < _count; i++) {
+        if (!(_entries[i].flags & FLAG_SYNCED)) unsynced++;
+    }
+    return unsynced;
+}
+
+size_t RecordingCatalog::page(size_t first, uint8_t *out, size_t capacity) const {
+    if (capacity < PAGE_HEADER) return 0;
+    if (first > _count) first = _count;
+    size_t entries = _count - first;
+    if (entries > PAGE_ENTRIES) entries = PAGE_ENTRIES;
+    if (entries > (capacity - PAGE_HEADER) / sizeof(CatalogEntry)) entries = (capacity - PAGE_HEADER) / sizeof(CatalogEntry);
+    putLE(out, _count, 2);
+    putLE(out + 2, first, 2);
+    memcpy(out + PAGE_HEADER, &_entries[first], entries * sizeof(CatalogEntry));
+    return PAGE_HEADER + entries * sizeof(CatalogEntry);
+}
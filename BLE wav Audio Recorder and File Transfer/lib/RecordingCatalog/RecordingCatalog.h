@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Index of the recordings kept on the card, served to BLE clients.
+//
+// Every recording gets an id that is never reused (the next id is persisted
+// with the entries, so it survives deleting everything). An entry holds what
+// a client needs to decide whether to fetch a file and to verify it: size,
+// CRC-32 of the whole file and a timestamp. A recording is "synced" once the
+// client has acknowledged it; batch transfers walk the unsynced entries in id
+// order and eviction prefers the oldest synced one.
+//
+// The catalog is persisted as one small image (magic, next id, entries) and
+// read over GATT in pages that fit one attribute value.
+// Plain C++ (no Arduino headers): file access stays with the caller.
+
+struct __attribute__((packed)) CatalogEntry {
+    uint32_t id;
+    uint32_t size;        // Whole file, header included
+    uint32_t crc32;       // CRC-32 (zlib polynomial) of the whole file
+    uint32_t timestamp;   // Unix time when the recording ended (seconds since boot if the clock was never set)
+    uint8_t flags;
+};
+
+class RecordingCatalog {
+public:
+    static const size_t MAX_ENTRIES = 64;
+    static const uint8_t FLAG_SYNCED = 0x01;
+    static const size_t IMAGE_HEADER = 12;                                      // "WCAT", next id, count
+    static const size_t MAX_IMAGE = IMAGE_HEADER + MAX_ENTRIES * sizeof(CatalogEntry);
+    static const size_t PAGE_HEADER = 4;                                        // Total entries, first index
+    static const size_t PAGE_ENTRIES = (512 - PAGE_HEADER) / sizeof(CatalogEntry);  // One ATT value
+
+    void clear();
+
+    // Persisted form; load() rejects anything that does not parse
+    size_t save(uint8_t *image, size_t capacity) const;
+    bool load(const uint8_t *image, size_t length);
+
+    // Oldest first
+    size_t count() const { return _count; }
+    const CatalogEntry &entry(size_t index) const { return _entries[index]; }
+    CatalogEntry *find(uint32_t id);
+    uint32_t nextId() const { return _nextId; }
+
+    // Takes the next id; NULL when full (evict first)
+    CatalogEntry *add(uint32_t size, uint32_t crc32, uint32_t timestamp);
+    void remove(size_t index);
+    // Oldest synced entry, else the oldest one; -1 when empty
+    int evictionCandidate() const;
+
+    bool markSynced(uint32_t id);
+    // First unsynced entry with an id above `afterId`; -1 if none
+    int nextUnsynced(uint32_t afterId) const;
+    size_t unsyncedCount() const;
+
+    // Entries from `first` on, as many as fit one page
+    size_t page(size_t first, uint8_t *out, size_t capacity) const;
+
+private:
+    CatalogEntry _entries[MAX_ENTRIES];
+    size_t _count = 0;
+    uint32_t _nextId = 1;
+};
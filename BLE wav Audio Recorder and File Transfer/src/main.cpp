@@ -1,8 +1,17 @@
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
+#include <NimBLEDevice.h>
+#if defined(CONFIG_NIMBLE_CPP_IDF)
+#include "host/ble_hs.h"
+#include "host/ble_l2cap.h"
+#else
+#include "nimble/nimble/host/include/host/ble_hs.h"
+#include "nimble/nimble/host/include/host/ble_l2cap.h"
+#endif
+#include "soc/soc_caps.h"
+#include "esp_rom_crc.h"
+#include <sys/time.h>
+#include <RecordingCatalog.h>
+#include <StallMonitor.h>
 #include "FS.h"
 #include "SPIFFS.h"
 #include "driver/i2s.h"
@@ -10,38 +19,211 @@
 // BLE Configuration
 #define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 #define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+#define L2CAP_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a9"  // PSM + SDU size for CoC clients
+#define INFO_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26aa"   // Size, CRC32 and start offset of the transfer
+#define CONTROL_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ab" // Client writes GET / SYNC / ACK / CAT / TIME
+#define CATALOG_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ac" // Recordings on the card, one page per read
 
-BLEServer *pServer = NULL;
-BLECharacteristic *pCharacteristic = NULL;
-BLEDescriptor *pDescr;
-BLE2902 *pBLE2902;
+// L2CAP connection-oriented channel (bulk file payload)
+#define L2CAP_PSM 0x0080         // Dynamic LE PSM, published through L2CAP_CHARACTERISTIC_UUID
+#define L2CAP_RX_MTU 512         // Largest SDU we accept (clients only send control bytes)
+#define COC_CHUNK_SIZE 2048      // Largest SDU we send per ble_l2cap_send()
+
+NimBLEServer *pServer = NULL;
+NimBLECharacteristic *pCharacteristic = NULL;
+NimBLECharacteristic *pL2capCharacteristic = NULL;
+NimBLECharacteristic *pInfoCharacteristic = NULL;
+NimBLECharacteristic *pControlCharacteristic = NULL;
+NimBLECharacteristic *pCatalogCharacteristic = NULL;
 bool deviceConnected = false, oldDeviceConnected = false, delayBeforeTransfer = true;
 unsigned long connectionTime = 0, startTime = 0, totalBytesSent = 0;
 
+// CoC channel state (written from the NimBLE host task)
+struct ble_l2cap_chan *cocChannel = NULL;
+volatile bool cocStalled = false;
+volatile uint16_t cocPeerSduSize = 0;
+uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE;
+
+// Per-connection throughput
+uint32_t connectionCount = 0;
+uint32_t cocBytesSent = 0, gattBytesSent = 0;
+bool transferReported = false;
+
+// Transfer requested through the control characteristic (set in the host task, applied in loop())
+struct TransferRequest {
+    volatile bool pending;
+    char path[48];
+    uint32_t offset;
+};
+TransferRequest transferRequest;
+bool transferActive = false, transferDone = false;
+bool infoSentOnCoc = true;  // false while an announcement waits for the CoC
+
+// Announced before the first payload byte (info characteristic, and first SDU on the CoC)
+struct __attribute__((packed)) TransferInfo {
+    char magic[4];        // "WAVI" (file follows) or "WAVD" (batch done, totalSize = files sent)
+    uint32_t totalSize;   // Whole file, not just the remainder
+    uint32_t crc32;       // CRC-32 (zlib polynomial) of the whole file
+    uint32_t offset;      // First byte that follows
+    uint32_t id;          // Catalog id, 0 for files outside the catalog
+};
+TransferInfo transferInfo;
+
+// CRC of the last file checked, so resumes do not re-read the whole file
+char crcPath[48] = "";
+uint32_t crcSize = 0, crcValue = 0;
+
+// Recordings on the card; the catalog characteristic shows the page starting at catalogPageFirst
+RecordingCatalog catalog;
+size_t catalogPageFirst = 0;
+volatile bool catalogPageRequested = false;
+volatile uint32_t catalogPageRequest = 0;
+
+// Batch mode: every unsynced recording back-to-back on one connection
+volatile bool syncRequested = false;
+bool batchActive = false;
+uint32_t batchLastId = 0, batchFiles = 0, batchBytes = 0;
+unsigned long batchStart = 0;
+
+// "ACK <id>" from the host task, applied to the catalog in loop()
+#define ACK_QUEUE_SIZE 16
+QueueHandle_t ackQueue = NULL;
+
 // WAV and I2S Configuration
-#define WAV_FILE_PATH "/recorded_audio.wav"
+#define RECORDING_PATH "/rec_%05u.wav"   // Numbered by catalog id
+#define CATALOG_PATH "/catalog.bin"
+#define MAX_RECORDINGS 4                  // About what the default SPIFFS partition holds
 #define I2S_NUM I2S_NUM_0
 #define I2S_BCK_IO 26
 #define I2S_WS_IO 25
 #define I2S_DATA_IO 22
 const size_t chunkSize = 512;
 const int sampleRate = 16000; // Adjusted for correct playback speed
+const unsigned long recordDuration = 10000; // 10 seconds
 const int bitsPerSample = 16;
 const int channelCount = 1;
 File wavFile;
 
+// Per-stage stall detection (in place of a long task watchdog timeout)
+#define CAPTURE_DEADLINE_MS 150   // One I2S read
+#define WRITER_DEADLINE_MS 1000   // One file write, or saving the catalog
+#define BLE_DEADLINE_MS 500       // One notification, SDU or file read of a transfer
+#define STALL_RESTART_MS 30000    // A stage stuck this long restarts the recorder
+StallMonitor stalls;
+int captureStage, writerStage, bleStage;
+
+void reportConnectionThroughput(const char *reason);
+bool startTransfer(const char *path, uint32_t offset);
+void recordingPath(char *path, uint32_t id);
+
 // BLE Callbacks
-class MyServerCallbacks : public BLEServerCallbacks {
-    void onConnect(BLEServer *pServer) {
+class MyServerCallbacks : public NimBLEServerCallbacks {
+    void onConnect(NimBLEServer *pServer, ble_gap_conn_desc *desc) {
         deviceConnected = true;
         connectionTime = millis();
         delayBeforeTransfer = true;
+        connHandle = desc->conn_handle;
+        connectionCount++;
+        cocBytesSent = gattBytesSent = 0;
+        transferReported = false;
+        transferActive = false;
+        transferDone = false;
+        batchActive = false;
+        infoSentOnCoc = true;
+
+        // Short connection interval and 251-byte link-layer packets (DLE) for bulk transfer
+        pServer->updateConnParams(desc->conn_handle, 6, 12, 0, 200);
+        ble_gap_set_data_len(desc->conn_handle, 251, 2120);
+#if SOC_BLE_50_SUPPORTED
+        // 2M PHY where the controller supports it (ESP32-S3/C3); the classic ESP32 stays on 1M
+        ble_gap_set_prefered_le_phy(desc->conn_handle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+#endif
     }
-    void onDisconnect(BLEServer *pServer) {
+    void onDisconnect(NimBLEServer *pServer) {
         deviceConnected = false;
+        connHandle = BLE_HS_CONN_HANDLE_NONE;
+        transferActive = false;  // a reconnecting client resumes with GET
+        batchActive = false;     // or starts over with SYNC; acknowledged files are skipped
+        if (!transferReported) reportConnectionThroughput("disconnected");
     }
 };
 
+// Control commands:
+//   "GET <path|id> [offset]"  (re)start a transfer at a byte offset
+//   "SYNC"                    send every unsynced recording back-to-back
+//   "ACK <id>"                the client has the recording and checked its CRC
+//   "CAT <index>"             catalog characteristic shows entries from <index> on
+//   "TIME <unix>"             set the clock used for recording timestamps
+class ControlCallbacks : public NimBLECharacteristicCallbacks {
+    void onWrite(NimBLECharacteristic *pCharacteristic) {
+        std::string value = pCharacteristic->getValue();
+        char path[sizeof(transferRequest.path)];
+        unsigned long number = 0;
+        if (sscanf(value.c_str(), "GET %47s %lu", path, &number) >= 1) {
+            if (path[0] == '/') {
+                strcpy(transferRequest.path, path);
+            } else {
+                recordingPath(transferRequest.path, strtoul(path, NULL, 10));
+            }
+            transferRequest.offset = number;
+            transferRequest.pending = true;
+        } else if (value == "SYNC") {
+            syncRequested = true;
+        } else if (sscanf(value.c_str(), "ACK %lu", &number) == 1) {
+            uint32_t id = number;
+            if (xQueueSend(ackQueue, &id, 0) != pdTRUE) Serial.printf("ACK %u dropped, queue full\n", id);
+        } else if (sscanf(value.c_str(), "CAT %lu", &number) == 1) {
+            catalogPageRequest = number;
+            catalogPageRequested = true;
+        } else if (sscanf(value.c_str(), "TIME %lu", &number) == 1) {
+            struct timeval now = {(time_t)number, 0};
+            settimeofday(&now, NULL);
+        } else {
+            Serial.printf("Unknown control command: %s\n", value.c_str());
+        }
+    }
+};
+
+// Callbacks live in static memory; NimBLE must not delete them
+MyServerCallbacks serverCallbacks;
+ControlCallbacks controlCallbacks;
+
+// Re-arm reception on the CoC; control stays on GATT, so incoming SDUs are dropped
+static void cocRecvReady(struct ble_l2cap_chan *chan) {
+    struct os_mbuf *sdu = os_msys_get_pkthdr(L2CAP_RX_MTU, 0);
+    if (sdu) ble_l2cap_recv_ready(chan, sdu);
+}
+
+// L2CAP CoC events from the NimBLE host task
+static int l2capEvent(struct ble_l2cap_event *event, void *arg) {
+    switch (event->type) {
+    case BLE_L2CAP_EVENT_COC_ACCEPT:
+        cocPeerSduSize = event->accept.peer_sdu_size;
+        cocRecvReady(event->accept.chan);
+        return 0;
+    case BLE_L2CAP_EVENT_COC_CONNECTED:
+        if (event->connect.status == 0) {
+            cocStalled = false;
+            cocChannel = event->connect.chan;
+            Serial.printf("L2CAP CoC connected (peer SDU %u bytes)\n", cocPeerSduSize);
+        }
+        return 0;
+    case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+        cocChannel = NULL;
+        Serial.println("L2CAP CoC disconnected");
+        return 0;
+    case BLE_L2CAP_EVENT_COC_DATA_RECEIVED:
+        os_mbuf_free_chain(event->receive.sdu_rx);
+        cocRecvReady(event->receive.chan);
+        return 0;
+    case BLE_L2CAP_EVENT_COC_TX_UNSTALLED:
+        cocStalled = false;
+        return 0;
+    default:
+        return 0;
+    }
+}
+
 // Configure I2S for audio recording
 void i2sConfig() {
     i2s_config_t i2s_config = {
@@ -65,11 +247,11 @@ void i2sConfig() {
 }
 
 // Record WAV file and save to SPIFFS
-void recordWavFile() {
-    wavFile = SPIFFS.open(WAV_FILE_PATH, FILE_WRITE);
+bool recordWavFile(const char *path) {
+    wavFile = SPIFFS.open(path, FILE_WRITE);
     if (!wavFile) {
         Serial.println("Failed to create WAV file");
-        return;
+        return false;
     }
 
     uint8_t wavHeader[44] = {0};
@@ -77,13 +259,16 @@ void recordWavFile() {
     uint8_t buffer[chunkSize];
     size_t bytesRead, totalDataSize = 0;
     unsigned long recordStart = millis();
-    unsigned long recordDuration = 10000; // 10 seconds
     unsigned long elapsedMillis = 0;
 
     Serial.println("Recording audio...");
     while (elapsedMillis < recordDuration) {
+        stalls.enter(captureStage, "i2s_read");
         i2s_read(I2S_NUM, buffer, chunkSize, &bytesRead, portMAX_DELAY);
+        stalls.leave(captureStage);
+        stalls.enter(writerStage, "file write");
         wavFile.write(buffer, bytesRead);
+        stalls.leave(writerStage);
         totalDataSize += bytesRead;
         elapsedMillis = millis() - recordStart;
     }
@@ -110,35 +295,320 @@ void recordWavFile() {
     wavFile.write(wavHeader, 44);
     wavFile.close();
     Serial.println(dataSize);
+    return true;
 }
 
-// Send next chunk of the WAV file over BLE
+// Print bytes/s for the current connection, split by transport
+void reportConnectionThroughput(const char *reason) {
+    unsigned long elapsedTime = millis() - startTime;
+    uint32_t bytes = cocBytesSent + gattBytesSent;
+    if (bytes == 0 || elapsedTime == 0) return;
+    float dataRate = (float)bytes / elapsedTime * 1000.0;
+    Serial.printf("Connection %u %s: %u bytes (CoC %u, GATT %u) in %lu ms, %.2f kB/sec\n",
+                  connectionCount, reason, bytes, cocBytesSent, gattBytesSent, elapsedTime, dataRate / 1024.0);
+    stalls.printReport(Serial);
+    transferReported = true;
+}
+
+// CRC-32 of a whole file, cached by path and size
+uint32_t fileCrc32(const char *path) {
+    File file = SPIFFS.open(path, "r");
+    if (!file) return 0;
+    uint32_t size = file.size();
+    if (strcmp(path, crcPath) == 0 && size == crcSize) {
+        file.close();
+        return crcValue;
+    }
+    static uint8_t buffer[4096];
+    uint32_t crc = 0;
+    size_t bytesRead;
+    while ((bytesRead = file.read(buffer, sizeof(buffer))) > 0) {
+        crc = esp_rom_crc32_le(crc, buffer, bytesRead);
+    }
+    file.close();
+    strlcpy(crcPath, path, sizeof(crcPath));
+    crcSize = size;
+    crcValue = crc;
+    return crc;
+}
+
+// Recording files are numbered by catalog id
+void recordingPath(char *path, uint32_t id) {
+    sprintf(path, RECORDING_PATH, (unsigned)id);
+}
+
+uint32_t recordingId(const char *path) {
+    unsigned id = 0;
+    return sscanf(path, "/rec_%u", &id) == 1 ? id : 0;
+}
+
+// Current catalog page on the catalog characteristic
+void publishCatalog() {
+    if (!pCatalogCharacteristic) return;
+    static uint8_t page[RecordingCatalog::PAGE_HEADER + RecordingCatalog::PAGE_ENTRIES * sizeof(CatalogEntry)];
+    size_t length = catalog.page(catalogPageFirst, page, sizeof(page));
+    pCatalogCharacteristic->setValue(page, length);
+    pCatalogCharacteristic->notify();
+}
+
+// Written next to the old copy and renamed, so a power loss leaves one intact
+void saveCatalog() {
+    static uint8_t image[RecordingCatalog::MAX_IMAGE];
+    size_t length = catalog.save(image, sizeof(image));
+    File file = SPIFFS.open(CATALOG_PATH ".tmp", FILE_WRITE);
+    stalls.enter(writerStage, "catalog save");
+    bool written = file && file.write(image, length) == length;
+    stalls.leave(writerStage);
+    if (file) file.close();
+    if (!written || (SPIFFS.exists(CATALOG_PATH) && !SPIFFS.remove(CATALOG_PATH)) ||
+        !SPIFFS.rename(CATALOG_PATH ".tmp", CATALOG_PATH)) {
+        Serial.println("Failed to save catalog");
+    }
+    publishCatalog();
+}
+
+bool loadCatalogFile(const char *path) {
+    static uint8_t image[RecordingCatalog::MAX_IMAGE];
+    if (!SPIFFS.exists(path)) return false;
+    File file = SPIFFS.open(path, "r");
+    if (!file) return false;
+    size_t length = file.read(image, sizeof(image));
+    file.close();
+    return catalog.load(image, length);
+}
+
+// Drops entries whose file is missing or has a different size
+void loadCatalog() {
+    if (!loadCatalogFile(CATALOG_PATH) && !loadCatalogFile(CATALOG_PATH ".tmp")) {
+        catalog.clear();
+        Serial.println("No catalog, starting a new one");
+        return;
+    }
+    bool changed = false;
+    for (size_t i = catalog.count(); i-- > 0;) {
+        char path[24];
+        recordingPath(path, catalog.entry(i).id);
+        File file = SPIFFS.exists(path) ? SPIFFS.open(path, "r") : File();
+        bool present = file && file.size() == catalog.entry(i).size;
+        if (file) file.close();
+        if (!present) {
+            Serial.printf("Recording %s is gone, removed from the catalog\n", path);
+            catalog.remove(i);
+            changed = true;
+        }
+    }
+    if (changed) saveCatalog();
+}
+
+// Deletes old recordings (synced ones first) until a new one fits
+void makeRoomForRecording() {
+    uint64_t needed = 44 + (uint64_t)recordDuration * sampleRate / 1000 * channelCount * (bitsPerSample / 8) +
+                      2 * RecordingCatalog::MAX_IMAGE;
+    bool changed = false;
+    while (catalog.count() > 0 &&
+           (catalog.count() >= MAX_RECORDINGS || (uint64_t)SPIFFS.totalBytes() - SPIFFS.usedBytes() < needed)) {
+        int index = catalog.evictionCandidate();
+        const CatalogEntry &entry = catalog.entry(index);
+        char path[24];
+        recordingPath(path, entry.id);
+        Serial.printf("Deleting %s recording %s to make room\n",
+                      entry.flags & RecordingCatalog::FLAG_SYNCED ? "synced" : "UNSYNCED", path);
+        SPIFFS.remove(path);
+        catalog.remove(index);
+        changed = true;
+    }
+    if (changed) saveCatalog();
+}
+
+// CRC and size go into the catalog so transfers never have to re-read the file for them
+void addRecording(const char *path) {
+    File file = SPIFFS.open(path, "r");
+    if (!file) return;
+    uint32_t size = file.size();
+    file.close();
+    uint32_t crc = fileCrc32(path);
+    catalog.add(size, crc, (uint32_t)time(NULL));
+    saveCatalog();
+    Serial.printf("Recording %s: %u bytes, CRC32 %08x\n", path, size, crc);
+}
+
+// Announce transferInfo on the info characteristic now and as the next CoC SDU
+void announceTransfer() {
+    pInfoCharacteristic->setValue((uint8_t *)&transferInfo, sizeof(transferInfo));
+    pInfoCharacteristic->notify();
+    infoSentOnCoc = false;
+}
+
+// Open a file at a byte offset and announce size, CRC and offset to the client
+bool startTransfer(const char *path, uint32_t offset) {
+    if (wavFile) wavFile.close();
+    memcpy(transferInfo.magic, "WAVI", 4);
+    transferInfo.totalSize = transferInfo.crc32 = transferInfo.offset = transferInfo.id = 0;
+
+    wavFile = SPIFFS.exists(path) ? SPIFFS.open(path, "r") : File();
+    if (!wavFile) {
+        Serial.printf("Requested file not found: %s\n", path);
+        // Size 0 tells the client the request failed
+        announceTransfer();
+        transferActive = false;
+        return false;
+    }
+    uint32_t size = wavFile.size();
+    CatalogEntry *entry = catalog.find(recordingId(path));
+    if (entry && entry->size != size) entry = NULL;
+    uint32_t crc = entry ? entry->crc32 : fileCrc32(path);
+    if (offset > size) offset = size;
+    wavFile.seek(offset);
+
+    transferInfo.totalSize = size;
+    transferInfo.crc32 = crc;
+    transferInfo.offset = offset;
+    transferInfo.id = entry ? entry->id : 0;
+    announceTransfer();
+
+    transferActive = true;
+    transferDone = false;
+    transferReported = false;
+    cocBytesSent = gattBytesSent = 0;
+    startTime = millis();
+    Serial.printf("Transfer %s from byte %u of %u (CRC32 %08x)\n", path, offset, size, crc);
+    return true;
+}
+
+// End of file on either transport
+void finishTransfer() {
+    wavFile.close();
+    transferActive = false;
+    transferDone = true;
+    batchBytes += cocBytesSent + gattBytesSent;
+    reportConnectionThroughput("transfer complete");
+}
+
+void startBatch() {
+    if (transferActive) {
+        wavFile.close();
+        transferActive = false;
+    }
+    batchActive = true;
+    batchLastId = batchFiles = batchBytes = 0;
+    batchStart = millis();
+    Serial.printf("Batch transfer of %u unsynced recording(s)...\n", catalog.unsyncedCount());
+}
+
+// Next unsynced recording, or the "WAVD" announcement once there is none left
+void continueBatch() {
+    int index = catalog.nextUnsynced(batchLastId);
+    if (index >= 0) {
+        char path[24];
+        batchLastId = catalog.entry(index).id;
+        recordingPath(path, batchLastId);
+        if (startTransfer(path, 0)) batchFiles++;
+        return;
+    }
+    batchActive = false;
+    memcpy(transferInfo.magic, "WAVD", 4);
+    transferInfo.totalSize = batchFiles;
+    transferInfo.crc32 = transferInfo.offset = transferInfo.id = 0;
+    announceTransfer();
+    unsigned long elapsedTime = millis() - batchStart;
+    Serial.printf("Batch complete: %u file(s), %u bytes in %lu ms, %.2f kB/sec\n", batchFiles, batchBytes, elapsedTime,
+                  elapsedTime ? batchBytes / 1024.0 / elapsedTime * 1000.0 : 0.0);
+}
+
+// Send WAV file over BLE notifications (fallback for clients without CoC)
 void sendNextChunk() {
-    if (!wavFile || !deviceConnected) return;
+    if (!transferActive || !deviceConnected) return;
 
     static uint8_t buffer[chunkSize];
+    stalls.enter(bleStage, "file read");
     size_t bytesRead = wavFile.read(buffer, chunkSize);
+    stalls.leave(bleStage);
     if (bytesRead > 0) {
         pCharacteristic->setValue(buffer, bytesRead);
+        stalls.enter(bleStage, "notify");
         pCharacteristic->notify();
+        stalls.leave(bleStage);
         totalBytesSent += bytesRead;
+        gattBytesSent += bytesRead;
         delay(180); //delay while sending the chunk
     } else {
         // Send a special marker to signal end of transfer
         const char *endMarker = "END_OF_FILE";
         pCharacteristic->setValue((uint8_t *)endMarker, strlen(endMarker));
+        stalls.enter(bleStage, "notify");
         pCharacteristic->notify();
-
-        wavFile.close();
-        unsigned long elapsedTime = millis() - startTime;
-        float dataRate = (float)totalBytesSent / elapsedTime * 1000.0;
-        Serial.printf("File transfer complete! Data Rate: %.2f kB/sec\n", dataRate / 1024.0);
+        stalls.leave(bleStage);
+        finishTransfer();
     }
     yield();
 }
 
+// Send the next SDU over the L2CAP CoC; credits pace the sender, no delays needed
+void sendNextCocChunk() {
+    if (!deviceConnected || !cocChannel || cocStalled) return;
+    if (!transferActive && infoSentOnCoc) return;
+
+    static uint8_t buffer[COC_CHUNK_SIZE];
+    size_t sduSize = cocPeerSduSize ? min((size_t)cocPeerSduSize, sizeof(buffer)) : sizeof(buffer);
+    struct os_mbuf *sdu = os_msys_get_pkthdr(sduSize, 0);
+    if (!sdu) return;  // mbuf pool busy, retry on the next loop
+
+    // The first SDU of every transfer repeats the announcement, so CoC clients
+    // can tell a restarted stream (or the next file of a batch) apart without
+    // ordering against GATT
+    if (!infoSentOnCoc) {
+        int rc = os_mbuf_append(sdu, &transferInfo, sizeof(transferInfo));
+        if (rc == 0) rc = ble_l2cap_send(cocChannel, sdu);
+        if (rc == 0 || rc == BLE_HS_ESTALLED) {
+            cocStalled = rc == BLE_HS_ESTALLED;
+            infoSentOnCoc = true;
+        } else {
+            os_mbuf_free_chain(sdu);
+        }
+        return;
+    }
+
+    stalls.enter(bleStage, "file read");
+    size_t bytesRead = wavFile.read(buffer, sduSize);
+    stalls.leave(bleStage);
+    bool endOfFile = bytesRead == 0;
+    if (endOfFile) {
+        const char *endMarker = "END_OF_FILE";
+        bytesRead = strlen(endMarker);
+        memcpy(buffer, endMarker, bytesRead);
+    }
+    if (os_mbuf_append(sdu, buffer, bytesRead) != 0) {
+        os_mbuf_free_chain(sdu);
+        if (!endOfFile) wavFile.seek(wavFile.position() - bytesRead);
+        return;
+    }
+
+    stalls.enter(bleStage, "ble_l2cap_send");
+    int rc = ble_l2cap_send(cocChannel, sdu);
+    stalls.leave(bleStage);
+    if (rc == 0 || rc == BLE_HS_ESTALLED) {
+        // ESTALLED: SDU queued, wait for BLE_L2CAP_EVENT_COC_TX_UNSTALLED before the next one
+        cocStalled = rc == BLE_HS_ESTALLED;
+        if (endOfFile) {
+            finishTransfer();
+        } else {
+            totalBytesSent += bytesRead;
+            cocBytesSent += bytesRead;
+        }
+    } else {
+        // Not accepted (e.g. previous SDU still in flight): rewind and retry
+        os_mbuf_free_chain(sdu);
+        if (!endOfFile) wavFile.seek(wavFile.position() - bytesRead);
+    }
+}
+
 void setup() {
     Serial.begin(115200);
+    captureStage = stalls.addStage("capture", CAPTURE_DEADLINE_MS);
+    writerStage = stalls.addStage("writer", WRITER_DEADLINE_MS);
+    bleStage = stalls.addStage("ble", BLE_DEADLINE_MS);
+    stalls.begin(STALL_RESTART_MS, &Serial);
+    ackQueue = xQueueCreate(ACK_QUEUE_SIZE, sizeof(uint32_t));
     if (!SPIFFS.begin(true)) {
         Serial.println("Failed to mount SPIFFS. Formatting...");
         if (!SPIFFS.format()) {
@@ -150,50 +620,118 @@ void setup() {
             return;
         }
     }
+    loadCatalog();
+    makeRoomForRecording();
     i2sConfig();
-    recordWavFile();
 
-    wavFile = SPIFFS.open("/recorded_audio.wav", "r");
-    if (!wavFile) {
-        Serial.println("Failed to open WAV file");
-        return;
-    }
-    Serial.println("WAV file opened successfully");
+    // Each boot adds a recording; older ones stay until evicted
+    char path[24];
+    recordingPath(path, catalog.nextId());
+    if (recordWavFile(path)) addRecording(path);
+    Serial.printf("Catalog: %u recording(s), %u unsynced\n", catalog.count(), catalog.unsyncedCount());
 
-    BLEDevice::init("ESP32-WAV-Transfer");
-    BLEDevice::setMTU(517);
-    pServer = BLEDevice::createServer();
-    pServer->setCallbacks(new MyServerCallbacks());
-    BLEService *pService = pServer->createService(SERVICE_UUID);
+    NimBLEDevice::init("ESP32-WAV-Transfer");
+    NimBLEDevice::setMTU(517);
+    pServer = NimBLEDevice::createServer();
+    pServer->setCallbacks(&serverCallbacks, false);
+    NimBLEService *pService = pServer->createService(SERVICE_UUID);
     pCharacteristic = pService->createCharacteristic(
         CHARACTERISTIC_UUID,
-        BLECharacteristic::PROPERTY_NOTIFY
+        NIMBLE_PROPERTY::NOTIFY
     );
-    pDescr = new BLEDescriptor((uint16_t)0x2901);
+    NimBLEDescriptor *pDescr = pCharacteristic->createDescriptor("2901", NIMBLE_PROPERTY::READ, 20);
     pDescr->setValue("WAV File Transfer");
-    pCharacteristic->addDescriptor(pDescr);
-    pBLE2902 = new BLE2902();
-    pBLE2902->setNotifications(true);
-    pCharacteristic->addDescriptor(pBLE2902);
+
+    // Publish the CoC PSM and our SDU size so clients can discover the bulk channel
+    uint16_t l2capInfo[2] = {L2CAP_PSM, COC_CHUNK_SIZE};
+    pL2capCharacteristic = pService->createCharacteristic(
+        L2CAP_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::READ
+    );
+    pL2capCharacteristic->setValue((uint8_t *)l2capInfo, sizeof(l2capInfo));
+
+    // Resume support: client asks for a file and offset, server announces size and CRC
+    pInfoCharacteristic = pService->createCharacteristic(
+        INFO_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+    );
+    pControlCharacteristic = pService->createCharacteristic(
+        CONTROL_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::WRITE
+    );
+    pControlCharacteristic->setCallbacks(&controlCallbacks);
+
+    // Recording list (id, size, CRC, timestamp, synced), paged with "CAT <index>"
+    pCatalogCharacteristic = pService->createCharacteristic(
+        CATALOG_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+    );
+    publishCatalog();
     pService->start();
-    BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
+
+    if (ble_l2cap_create_server(L2CAP_PSM, L2CAP_RX_MTU, l2capEvent, NULL) != 0) {
+        Serial.println("L2CAP CoC server unavailable, GATT transfer only");
+    }
+
+    NimBLEAdvertising *pAdvertising = NimBLEDevice::getAdvertising();
     pAdvertising->addServiceUUID(SERVICE_UUID);
     pAdvertising->setScanResponse(false);
     pAdvertising->setMinPreferred(0x0);
-    BLEDevice::startAdvertising();
+    NimBLEDevice::startAdvertising();
     Serial.println("Waiting for a client connection to start WAV transfer...");
 }
 
 void loop() {
+    uint32_t ackId;
+    bool acknowledged = false;
+    while (xQueueReceive(ackQueue, &ackId, 0) == pdTRUE) {
+        if (catalog.markSynced(ackId)) {
+            acknowledged = true;
+        } else {
+            Serial.printf("ACK for unknown recording %u\n", ackId);
+        }
+    }
+    if (acknowledged) saveCatalog();
+    if (catalogPageRequested) {
+        catalogPageRequested = false;
+        catalogPageFirst = catalogPageRequest;
+        publishCatalog();
+    }
+
     if (deviceConnected) {
+        if (transferRequest.pending) {
+            // Explicit request (resume): replaces whatever is in flight
+            transferRequest.pending = false;
+            delayBeforeTransfer = false;
+            batchActive = false;
+            startTransfer(transferRequest.path, transferRequest.offset);
+        }
+        if (syncRequested) {
+            syncRequested = false;
+            delayBeforeTransfer = false;
+            startBatch();
+        }
         if (delayBeforeTransfer && millis() - connectionTime >= 5000) {
             delayBeforeTransfer = false;
-            startTime = millis();
             Serial.println("Starting transfer...");
+            if (!transferActive && !transferDone && !batchActive) startBatch();
         }
-        if (!delayBeforeTransfer) {
-            sendNextChunk();
-            delay(100); //delay between chunks
+        if (cocChannel) {
+            // CoC client: start as soon as the channel is open
+            if (delayBeforeTransfer) {
+                delayBeforeTransfer = false;
+                Serial.println("Starting transfer over L2CAP CoC...");
+                if (!transferActive && !transferDone && !batchActive) startBatch();
+            }
+            // Next file once the previous one (and its END_OF_FILE) is out
+            if (batchActive && !transferActive && infoSentOnCoc) continueBatch();
+            sendNextCocChunk();
+        } else {
+            if (batchActive && !transferActive) continueBatch();
+            if (transferActive) {
+                sendNextChunk();
+                delay(100); //delay between chunks
+            }
         }
     }
     if (!deviceConnected && oldDeviceConnected) {
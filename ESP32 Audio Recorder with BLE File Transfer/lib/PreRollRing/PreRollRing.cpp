@@ -0,0 +1,45 @@
+#include "PreRollRing.h"
+
+#include <string.h>
+
+void PreRollRing::begin(uint8_t *storage, size_t capacity) {
+    _buffer = storage;
+    _capacity = capacity;
+    _head = 0;
+    _size = 0;
+}
+
+size_t PreRollRing::write(const uint8_t *data, size_t length) {
+    if (_capacity == 0) return length;
+    size_t lost = 0;
+    // Only the newest `capacity` bytes of a long write can stay
+    if (length > _capacity) {
+        lost = length - _capacity;
+        data += lost;
+        length = _capacity;
+    }
+    size_t free = _capacity - _size;
+    if (length > free) {
+        size_t overwritten = length - free;
+        _head = (_head + overwritten) % _capacity;
+        _size -= overwritten;
+        lost += overwritten;
+    }
+    size_t tail = (_head + _size) % _capacity;
+    size_t first = length < _capacity - tail ? length : _capacity - tail;
+    memcpy(_buffer + tail, data, first);
+    memcpy(_buffer, data + first, length - first);
+    _size += length;
+    return lost;
+}
+
+const uint8_t *PreRollRing::front(size_t &length) const {
+    length = _size < _capacity - _head ? _size : _capacity - _head;
+    return _buffer + _head;
+}
+
+void PreRollRing::pop(size_t length) {
+    if (length > _size) length = _size;
+    if (_capacity > 0) _head = (_head + length) % _capacity;
+    _size -= length;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The last few seconds of captured audio, kept while waiting for a trigger.
+//
+// Writes never block and never fail: once the ring is full the oldest bytes
+// are overwritten, and write() returns how many. After a trigger the same
+// ring becomes the queue in front of the file. Live chunks are appended
+// behind the pre-roll and everything leaves oldest first through
+// front()/pop(), so the file gets one continuous stream.
+//
+// The storage is the caller's (PSRAM or internal RAM). Keep the capacity and
+// every write a whole number of frames, so an overwrite never splits a sample.
+// Plain C++ (no Arduino headers).
+
+class PreRollRing {
+public:
+    void begin(uint8_t *storage, size_t capacity);
+
+    // Appends, overwriting the oldest bytes when full; returns the bytes lost
+    size_t write(const uint8_t *data, size_t length);
+
+    // Oldest bytes as one contiguous span (the rest follows after a pop)
+    const uint8_t *front(size_t &length) const;
+    void pop(size_t length);
+
+    size_t size() const { return _size; }
+    size_t capacity() const { return _capacity; }
+
+private:
+    uint8_t *_buffer = nullptr;
+    size_t _capacity = 0;
+    size_t _head = 0;  // Oldest byte
+    size_t _size = 0;
+};
@@ -1,27 +1,102 @@
 #include <Arduino.h>
 #include <SPI.h>
 #include <SD.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
+#include <NimBLEDevice.h>
+#if defined(CONFIG_NIMBLE_CPP_IDF)
+#include "host/ble_hs.h"
+#include "host/ble_l2cap.h"
+#else
+#include "nimble/nimble/host/include/host/ble_hs.h"
+#include "nimble/nimble/host/include/host/ble_l2cap.h"
+#endif
+#include "soc/soc_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_heap_caps.h"
+#include <sys/time.h>
+#include <RecordingCatalog.h>
+#include <StallMonitor.h>
+#include <PreRollRing.h>
 #include "driver/i2s.h"
 
 // SD Card Configuration
 const int chipSelect = 5;
-#define WAV_FILE_PATH "/recorded_audio.wav"
+#define RECORDING_PATH "/rec_%05u.wav"   // Numbered by catalog id
+#define CATALOG_PATH "/catalog.bin"
+#define MAX_RECORDINGS 64                 // Oldest (synced first) is deleted beyond this
 
 // BLE Configuration
 #define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 #define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+#define L2CAP_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a9"  // PSM + SDU size for CoC clients
+#define INFO_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26aa"   // Size, CRC32 and start offset of the transfer
+#define CONTROL_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ab" // Client writes GET / SYNC / ACK / CAT / TIME
+#define CATALOG_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ac" // Recordings on the card, one page per read
 
-BLEServer *pServer = NULL;
-BLECharacteristic *pCharacteristic = NULL;
-BLEDescriptor *pDescr;
-BLE2902 *pBLE2902;
+// L2CAP connection-oriented channel (bulk file payload)
+#define L2CAP_PSM 0x0080         // Dynamic LE PSM, published through L2CAP_CHARACTERISTIC_UUID
+#define L2CAP_RX_MTU 512         // Largest SDU we accept (clients only send control bytes)
+#define COC_CHUNK_SIZE 2048      // Largest SDU we send per ble_l2cap_send()
+
+NimBLEServer *pServer = NULL;
+NimBLECharacteristic *pCharacteristic = NULL;
+NimBLECharacteristic *pL2capCharacteristic = NULL;
+NimBLECharacteristic *pInfoCharacteristic = NULL;
+NimBLECharacteristic *pControlCharacteristic = NULL;
+NimBLECharacteristic *pCatalogCharacteristic = NULL;
 bool deviceConnected = false, oldDeviceConnected = false, delayBeforeTransfer = true;
 unsigned long connectionTime = 0, startTime = 0, totalBytesSent = 0;
 
+// CoC channel state (written from the NimBLE host task)
+struct ble_l2cap_chan *cocChannel = NULL;
+volatile bool cocStalled = false;
+volatile uint16_t cocPeerSduSize = 0;
+uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE;
+
+// Per-connection throughput
+uint32_t connectionCount = 0;
+uint32_t cocBytesSent = 0, gattBytesSent = 0;
+bool transferReported = false;
+
+// Transfer requested through the control characteristic (set in the host task, applied in loop())
+struct TransferRequest {
+    volatile bool pending;
+    char path[48];
+    uint32_t offset;
+};
+TransferRequest transferRequest;
+bool transferActive = false, transferDone = false;
+bool infoSentOnCoc = true;  // false while an announcement waits for the CoC
+
+// Announced before the first payload byte (info characteristic, and first SDU on the CoC)
+struct __attribute__((packed)) TransferInfo {
+    char magic[4];        // "WAVI" (file follows) or "WAVD" (batch done, totalSize = files sent)
+    uint32_t totalSize;   // Whole file, not just the remainder
+    uint32_t crc32;       // CRC-32 (zlib polynomial) of the whole file
+    uint32_t offset;      // First byte that follows
+    uint32_t id;          // Catalog id, 0 for files outside the catalog
+};
+TransferInfo transferInfo;
+
+// CRC of the last file checked, so resumes do not re-read the whole file
+char crcPath[48] = "";
+uint32_t crcSize = 0, crcValue = 0;
+
+// Recordings on the card; the catalog characteristic shows the page starting at catalogPageFirst
+RecordingCatalog catalog;
+size_t catalogPageFirst = 0;
+volatile bool catalogPageRequested = false;
+volatile uint32_t catalogPageRequest = 0;
+
+// Batch mode: every unsynced recording back-to-back on one connection
+volatile bool syncRequested = false;
+bool batchActive = false;
+uint32_t batchLastId = 0, batchFiles = 0, batchBytes = 0;
+unsigned long batchStart = 0;
+
+// "ACK <id>" from the host task, applied to the catalog in loop()
+#define ACK_QUEUE_SIZE 16
+QueueHandle_t ackQueue = NULL;
+
 // I2S Configuration
 #define I2S_NUM I2S_NUM_0
 #define I2S_BCK_IO 26
@@ -29,22 +104,163 @@ unsigned long connectionTime = 0, startTime = 0, totalBytesSent = 0;
 #define I2S_DATA_IO 22
 const size_t chunkSize = 512;
 const int sampleRate = 20000; // Adjust as needed
+const unsigned long recordDuration = 300000; // 5 minutes
 const int bitsPerSample = 16;
 const int channelCount = 1;
-File wavFile;
+File wavFile;    // The file being transferred
+File recordFile; // The file being recorded
+
+// Triggered recording: while waiting, every chunk goes into a RAM ring that
+// holds the last PRE_ROLL_SECONDS, and the recording starts with that pre-roll
+#define TRIGGER_RECORDING 1       // 0 = record at boot, as before
+#define PRE_ROLL_SECONDS 2        // 80 KB at 20 kHz; PSRAM if the board has it, else smaller if RAM is short
+#define TRIGGER_LEVEL 4000        // Peak sample that starts a recording (of 32767), 0 = off
+#define TRIGGER_PIN 0             // Active low (BOOT button), -1 = off; "TRIG" over BLE always works
+#define DRAIN_CHUNKS 8            // Ring bytes written per chunk read, in chunks: the pre-roll catches up at 8x
+#define IDLE_REPORT_MS 10000      // Idle cost of the ring printed this often while waiting
+PreRollRing preRoll;
+bool preRollEnabled = false;
+volatile bool triggerRequested = false;
+
+// While armed and recording, a capture task owns I2S and recordFile, so
+// loop() keeps serving BLE; loop() adds the recording to the catalog
+char recordPath[24];
+volatile bool recording = false;          // recordPath is still being written
+volatile bool recordingFinished = false;
+volatile bool recordingSaved = false;
+
+// Time spent keeping the ring while idle (copy and trigger checks, not the I2S read)
+struct IdleCost {
+    uint64_t cycles;
+    uint32_t chunks;
+    uint32_t worstCycles;
+    unsigned long since;
+};
+
+// Per-stage stall detection (in place of a long task watchdog timeout)
+#define CAPTURE_DEADLINE_MS 150   // One I2S read
+#define WRITER_DEADLINE_MS 1000   // One file write of the recording (recordTask)
+#define CATALOG_DEADLINE_MS 1000  // Saving the catalog (loop)
+#define BLE_DEADLINE_MS 500       // One notification, SDU or file read of a transfer
+#define STALL_RESTART_MS 30000    // A stage stuck this long restarts the recorder
+StallMonitor stalls;
+int captureStage, writerStage, catalogStage, bleStage;
+
+void reportConnectionThroughput(const char *reason);
+bool startTransfer(const char *path, uint32_t offset);
+void recordingPath(char *path, uint32_t id);
 
 // BLE Callbacks
-class MyServerCallbacks : public BLEServerCallbacks {
-    void onConnect(BLEServer *pServer) {
+class MyServerCallbacks : public NimBLEServerCallbacks {
+    void onConnect(NimBLEServer *pServer, ble_gap_conn_desc *desc) {
         deviceConnected = true;
         connectionTime = millis();
         delayBeforeTransfer = true;
+        connHandle = desc->conn_handle;
+        connectionCount++;
+        cocBytesSent = gattBytesSent = 0;
+        transferReported = false;
+        transferActive = false;
+        transferDone = false;
+        batchActive = false;
+        infoSentOnCoc = true;
+
+        // Short connection interval and 251-byte link-layer packets (DLE) for bulk transfer
+        pServer->updateConnParams(desc->conn_handle, 6, 12, 0, 200);
+        ble_gap_set_data_len(desc->conn_handle, 251, 2120);
+#if SOC_BLE_50_SUPPORTED
+        // 2M PHY where the controller supports it (ESP32-S3/C3); the classic ESP32 stays on 1M
+        ble_gap_set_prefered_le_phy(desc->conn_handle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+#endif
     }
-    void onDisconnect(BLEServer *pServer) {
+    void onDisconnect(NimBLEServer *pServer) {
         deviceConnected = false;
+        connHandle = BLE_HS_CONN_HANDLE_NONE;
+        transferActive = false;  // a reconnecting client resumes with GET
+        batchActive = false;     // or starts over with SYNC; acknowledged files are skipped
+        if (!transferReported) reportConnectionThroughput("disconnected");
     }
 };
 
+// Control commands:
+//   "GET <path|id> [offset]"  (re)start a transfer at a byte offset
+//   "SYNC"                    send every unsynced recording back-to-back
+//   "ACK <id>"                the client has the recording and checked its CRC
+//   "CAT <index>"             catalog characteristic shows entries from <index> on
+//   "TIME <unix>"             set the clock used for recording timestamps
+//   "TRIG"                    start the triggered recording
+class ControlCallbacks : public NimBLECharacteristicCallbacks {
+    void onWrite(NimBLECharacteristic *pCharacteristic) {
+        std::string value = pCharacteristic->getValue();
+        char path[sizeof(transferRequest.path)];
+        unsigned long number = 0;
+        if (sscanf(value.c_str(), "GET %47s %lu", path, &number) >= 1) {
+            if (path[0] == '/') {
+                strcpy(transferRequest.path, path);
+            } else {
+                recordingPath(transferRequest.path, strtoul(path, NULL, 10));
+            }
+            transferRequest.offset = number;
+            transferRequest.pending = true;
+        } else if (value == "SYNC") {
+            syncRequested = true;
+        } else if (sscanf(value.c_str(), "ACK %lu", &number) == 1) {
+            uint32_t id = number;
+            if (xQueueSend(ackQueue, &id, 0) != pdTRUE) Serial.printf("ACK %u dropped, queue full\n", id);
+        } else if (sscanf(value.c_str(), "CAT %lu", &number) == 1) {
+            catalogPageRequest = number;
+            catalogPageRequested = true;
+        } else if (sscanf(value.c_str(), "TIME %lu", &number) == 1) {
+            struct timeval now = {(time_t)number, 0};
+            settimeofday(&now, NULL);
+        } else if (value == "TRIG") {
+            triggerRequested = true;
+        } else {
+            Serial.printf("Unknown control command: %s\n", value.c_str());
+        }
+    }
+};
+
+// Callbacks live in static memory; NimBLE must not delete them
+MyServerCallbacks serverCallbacks;
+ControlCallbacks controlCallbacks;
+
+// Re-arm reception on the CoC; control stays on GATT, so incoming SDUs are dropped
+static void cocRecvReady(struct ble_l2cap_chan *chan) {
+    struct os_mbuf *sdu = os_msys_get_pkthdr(L2CAP_RX_MTU, 0);
+    if (sdu) ble_l2cap_recv_ready(chan, sdu);
+}
+
+// L2CAP CoC events from the NimBLE host task
+static int l2capEvent(struct ble_l2cap_event *event, void *arg) {
+    switch (event->type) {
+    case BLE_L2CAP_EVENT_COC_ACCEPT:
+        cocPeerSduSize = event->accept.peer_sdu_size;
+        cocRecvReady(event->accept.chan);
+        return 0;
+    case BLE_L2CAP_EVENT_COC_CONNECTED:
+        if (event->connect.status == 0) {
+            cocStalled = false;
+            cocChannel = event->connect.chan;
+            Serial.printf("L2CAP CoC connected (peer SDU %u bytes)\n", cocPeerSduSize);
+        }
+        return 0;
+    case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+        cocChannel = NULL;
+        Serial.println("L2CAP CoC disconnected");
+        return 0;
+    case BLE_L2CAP_EVENT_COC_DATA_RECEIVED:
+        os_mbuf_free_chain(event->receive.sdu_rx);
+        cocRecvReady(event->receive.chan);
+        return 0;
+    case BLE_L2CAP_EVENT_COC_TX_UNSTALLED:
+        cocStalled = false;
+        return 0;
+    default:
+        return 0;
+    }
+}
+
 // Configure I2S for audio recording
 void i2sConfig() {
     i2s_config_t i2s_config = {
@@ -67,22 +283,132 @@ void i2sConfig() {
     i2s_set_pin(I2S_NUM, &pin_config);
 }
 
-// Record audio and save as WAV on SD card
-void recordWavFile() {
-    wavFile = SD.open(WAV_FILE_PATH, FILE_WRITE);
-    if (!wavFile) {
+// Largest ring up to PRE_ROLL_SECONDS that fits, PSRAM first
+bool allocatePreRoll() {
+    const size_t frameBytes = channelCount * (bitsPerSample / 8);
+    size_t capacity = (size_t)PRE_ROLL_SECONDS * sampleRate * frameBytes;
+    uint8_t *storage = NULL;
+    bool inPsram = false;
+    while (!storage && capacity >= chunkSize) {
+        storage = (uint8_t *)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        inPsram = storage != NULL;
+        if (!storage) storage = (uint8_t *)heap_caps_malloc(capacity, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!storage) capacity = capacity / 2 / frameBytes * frameBytes;
+    }
+    if (!storage) {
+        Serial.println("No memory for the pre-roll ring, recording at boot without it");
+        return false;
+    }
+    preRoll.begin(storage, capacity);
+    Serial.printf("Pre-roll ring: %u bytes (%u ms) in %s\n", capacity,
+                  (unsigned)(capacity * 1000ULL / (sampleRate * frameBytes)), inPsram ? "PSRAM" : "internal RAM");
+    return true;
+}
+
+// Level, GPIO or TRIG; the chunk just read is already in the ring
+const char *triggerSource(const uint8_t *buffer, size_t length) {
+    if (triggerRequested) return "TRIG";
+#if TRIGGER_PIN >= 0
+    if (digitalRead(TRIGGER_PIN) == LOW) return "GPIO";
+#endif
+#if TRIGGER_LEVEL > 0
+    const int16_t *samples = (const int16_t *)buffer;
+    for (size_t i = 0; i < length / sizeof(int16_t); i++) {
+        if (abs(samples[i]) >= TRIGGER_LEVEL) return "level";
+    }
+#endif
+    return NULL;
+}
+
+void reportIdleCost(const IdleCost &cost) {
+    if (cost.chunks == 0) return;
+    uint32_t mhz = getCpuFreqMHz();
+    float elapsedCycles = (float)(millis() - cost.since) * mhz * 1000;
+    Serial.printf("Pre-roll idle: %u chunks, %.1f us per chunk (worst %.1f us), %.3f%% of one core\n",
+                  cost.chunks, (float)cost.cycles / cost.chunks / mhz, (float)cost.worstCycles / mhz,
+                  elapsedCycles > 0 ? 100.0f * cost.cycles / elapsedCycles : 0.0f);
+}
+
+// Captures into the ring until a trigger fires; the ring then holds the
+// pre-roll up to and including the chunk that fired it
+bool waitForTrigger() {
+    uint8_t buffer[chunkSize];
+    size_t bytesRead;
+    IdleCost cost = {0, 0, 0, millis()};
+    unsigned long lastReport = millis();
+    Serial.println("Waiting for a trigger (level, GPIO or TRIG)...");
+    while (true) {
+        stalls.enter(captureStage, "i2s_read");
+        esp_err_t result = i2s_read(I2S_NUM, buffer, chunkSize, &bytesRead, portMAX_DELAY);
+        stalls.leave(captureStage);
+        if (result != ESP_OK) {
+            Serial.printf("I2S read error: %d\n", result);
+            return false;
+        }
+
+        uint32_t start = ESP.getCycleCount();
+        preRoll.write(buffer, bytesRead);
+        const char *source = triggerSource(buffer, bytesRead);
+        uint32_t cycles = ESP.getCycleCount() - start;
+        cost.cycles += cycles;
+        cost.chunks++;
+        if (cycles > cost.worstCycles) cost.worstCycles = cycles;
+
+        if (source) {
+            triggerRequested = false;
+            Serial.printf("Triggered by %s after %lu ms\n", source, millis() - cost.since);
+            reportIdleCost(cost);
+            return true;
+        }
+        if (millis() - lastReport >= IDLE_REPORT_MS) {
+            lastReport = millis();
+            reportIdleCost(cost);
+        }
+    }
+}
+
+// Up to maxBytes of the oldest ring contents into the WAV file
+size_t writeFromRing(size_t maxBytes) {
+    size_t written = 0;
+    while (written < maxBytes && preRoll.size() > 0) {
+        size_t length;
+        const uint8_t *data = preRoll.front(length);
+        if (length > maxBytes - written) length = maxBytes - written;
+        stalls.enter(writerStage, "file write");
+        recordFile.write(data, length);
+        stalls.leave(writerStage);
+        preRoll.pop(length);
+        written += length;
+    }
+    return written;
+}
+
+// Record audio and save as WAV on SD card. With the pre-roll ring, the file
+// is opened first and then waits for the trigger, so nothing stands between
+// the trigger and the next I2S read. Live chunks queue behind the pre-roll in
+// the ring, which makes the hand-off gapless by construction.
+bool recordWavFile(const char *path) {
+    recordFile = SD.open(path, FILE_WRITE);
+    if (!recordFile) {
         Serial.println("Failed to create WAV file");
-        return;
+        return false;
     }
 
     // Prepare a blank WAV header placeholder
     uint8_t wavHeader[44] = {0};
-    wavFile.write(wavHeader, 44); // Reserve space for WAV header
+    recordFile.write(wavHeader, 44); // Reserve space for WAV header
+
+    if (preRollEnabled && !waitForTrigger()) {
+        recordFile.close();
+        SD.remove(path);
+        return false;
+    }
 
     uint8_t buffer[chunkSize];
     size_t bytesRead, totalDataSize = 0;
+    size_t preRollBytes = preRoll.size(), lostBytes = 0;
+    unsigned long caughtUp = 0;
     unsigned long recordStart = millis();
-    unsigned long recordDuration = 300000; // 60 seconds
     unsigned long lastTime = millis();
 
     Serial.println("Recording audio...");
@@ -90,20 +416,29 @@ void recordWavFile() {
         unsigned long loopStart = millis();
         
         // Read audio data from I2S
+        stalls.enter(captureStage, "i2s_read");
         esp_err_t result = i2s_read(I2S_NUM, buffer, chunkSize, &bytesRead, portMAX_DELAY);
+        stalls.leave(captureStage);
         if (result != ESP_OK) {
             Serial.printf("I2S read error: %d\n", result);
             break;
         }
         unsigned long readEnd = millis();
 
-        // Write audio data to the SD card
-        wavFile.write(buffer, bytesRead);
+        // Write audio data to the SD card; behind a trigger it goes through the
+        // ring, draining before the append so the full ring is not overwritten
+        if (preRollEnabled) {
+            totalDataSize += writeFromRing(DRAIN_CHUNKS * chunkSize);
+            if (!caughtUp && preRoll.size() == 0) caughtUp = millis();
+            lostBytes += preRoll.write(buffer, bytesRead);
+        } else {
+            stalls.enter(writerStage, "file write");
+            recordFile.write(buffer, bytesRead);
+            stalls.leave(writerStage);
+            totalDataSize += bytesRead;
+        }
         unsigned long writeEnd = millis();
 
-        // Accumulate total data size
-        totalDataSize += bytesRead;
-
         // Print timing for each operation
         //Serial.printf("Read time: %lu ms, Write time: %lu ms\n", readEnd - loopStart, writeEnd - readEnd);
 
@@ -113,10 +448,17 @@ void recordWavFile() {
             Serial.printf("Recording... %lu ms elapsed\n", millis() - recordStart);
         }
     }
+    if (preRollEnabled) {
+        totalDataSize += writeFromRing(preRoll.size());
+        const size_t bytesPerSecond = sampleRate * channelCount * (bitsPerSample / 8);
+        Serial.printf("Pre-roll: %u ms ahead of the trigger, caught up after %lu ms, %u bytes lost\n",
+                      (unsigned)(preRollBytes * 1000ULL / bytesPerSecond),
+                      caughtUp ? caughtUp - recordStart : millis() - recordStart, lostBytes);
+    }
     Serial.println("Recording complete");
 
     // Finalize WAV header
-    wavFile.seek(0); // Go back to the start of the file
+    recordFile.seek(0); // Go back to the start of the file
     uint32_t dataSize = totalDataSize; // Total audio data size
     uint32_t fileSize = dataSize + 36; // Total file size (header + data)
 
@@ -139,91 +481,483 @@ void recordWavFile() {
     memcpy(wavHeader + 40, &dataSize, 4);
 
     // Write WAV header
-    wavFile.write(wavHeader, 44);
-    wavFile.close();
+    recordFile.write(wavHeader, 44);
+    recordFile.close();
     Serial.printf("WAV file saved: %u bytes\n", totalDataSize);
+    return true;
 }
 
-// Send WAV file over BLE
+// Print bytes/s for the current connection, split by transport
+void reportConnectionThroughput(const char *reason) {
+    unsigned long elapsedTime = millis() - startTime;
+    uint32_t bytes = cocBytesSent + gattBytesSent;
+    if (bytes == 0 || elapsedTime == 0) return;
+    float dataRate = (float)bytes / elapsedTime * 1000.0;
+    Serial.printf("Connection %u %s: %u bytes (CoC %u, GATT %u) in %lu ms, %.2f kB/sec\n",
+                  connectionCount, reason, bytes, cocBytesSent, gattBytesSent, elapsedTime, dataRate / 1024.0);
+    stalls.printReport(Serial);
+    transferReported = true;
+}
+
+// CRC-32 of a whole file, cached by path and size
+uint32_t fileCrc32(const char *path) {
+    File file = SD.open(path, "r");
+    if (!file) return 0;
+    uint32_t size = file.size();
+    if (strcmp(path, crcPath) == 0 && size == crcSize) {
+        file.close();
+        return crcValue;
+    }
+    static uint8_t buffer[4096];
+    uint32_t crc = 0;
+    size_t bytesRead;
+    while ((bytesRead = file.read(buffer, sizeof(buffer))) > 0) {
+        crc = esp_rom_crc32_le(crc, buffer, bytesRead);
+    }
+    file.close();
+    strlcpy(crcPath, path, sizeof(crcPath));
+    crcSize = size;
+    crcValue = crc;
+    return crc;
+}
+
+// Recording files are numbered by catalog id
+void recordingPath(char *path, uint32_t id) {
+    sprintf(path, RECORDING_PATH, (unsigned)id);
+}
+
+uint32_t recordingId(const char *path) {
+    unsigned id = 0;
+    return sscanf(path, "/rec_%u", &id) == 1 ? id : 0;
+}
+
+// Current catalog page on the catalog characteristic
+void publishCatalog() {
+    if (!pCatalogCharacteristic) return;
+    static uint8_t page[RecordingCatalog::PAGE_HEADER + RecordingCatalog::PAGE_ENTRIES * sizeof(CatalogEntry)];
+    size_t length = catalog.page(catalogPageFirst, page, sizeof(page));
+    pCatalogCharacteristic->setValue(page, length);
+    pCatalogCharacteristic->notify();
+}
+
+// Written next to the old copy and renamed, so a power loss leaves one intact
+void saveCatalog() {
+    static uint8_t image[RecordingCatalog::MAX_IMAGE];
+    size_t length = catalog.save(image, sizeof(image));
+    File file = SD.open(CATALOG_PATH ".tmp", FILE_WRITE);
+    stalls.enter(catalogStage, "catalog save");
+    bool written = file && file.write(image, length) == length;
+    stalls.leave(catalogStage);
+    if (file) file.close();
+    if (!written || (SD.exists(CATALOG_PATH) && !SD.remove(CATALOG_PATH)) ||
+        !SD.rename(CATALOG_PATH ".tmp", CATALOG_PATH)) {
+        Serial.println("Failed to save catalog");
+    }
+    publishCatalog();
+}
+
+bool loadCatalogFile(const char *path) {
+    static uint8_t image[RecordingCatalog::MAX_IMAGE];
+    if (!SD.exists(path)) return false;
+    File file = SD.open(path, "r");
+    if (!file) return false;
+    size_t length = file.read(image, sizeof(image));
+    file.close();
+    return catalog.load(image, length);
+}
+
+// Drops entries whose file is missing or has a different size
+void loadCatalog() {
+    if (!loadCatalogFile(CATALOG_PATH) && !loadCatalogFile(CATALOG_PATH ".tmp")) {
+        catalog.clear();
+        Serial.println("No catalog, starting a new one");
+        return;
+    }
+    bool changed = false;
+    for (size_t i = catalog.count(); i-- > 0;) {
+        char path[24];
+        recordingPath(path, catalog.entry(i).id);
+        File file = SD.exists(path) ? SD.open(path, "r") : File();
+        bool present = file && file.size() == catalog.entry(i).size;
+        if (file) file.close();
+        if (!present) {
+            Serial.printf("Recording %s is gone, removed from the catalog\n", path);
+            catalog.remove(i);
+            changed = true;
+        }
+    }
+    if (changed) saveCatalog();
+}
+
+// Deletes old recordings (synced ones first) until a new one fits
+void makeRoomForRecording() {
+    uint64_t audioMillis = recordDuration + (TRIGGER_RECORDING ? PRE_ROLL_SECONDS * 1000 : 0);
+    uint64_t needed = 44 + audioMillis * sampleRate / 1000 * channelCount * (bitsPerSample / 8) +
+                      2 * RecordingCatalog::MAX_IMAGE;
+    bool changed = false;
+    while (catalog.count() > 0 &&
+           (catalog.count() >= MAX_RECORDINGS || (uint64_t)SD.totalBytes() - SD.usedBytes() < needed)) {
+        int index = catalog.evictionCandidate();
+        const CatalogEntry &entry = catalog.entry(index);
+        char path[24];
+        recordingPath(path, entry.id);
+        Serial.printf("Deleting %s recording %s to make room\n",
+                      entry.flags & RecordingCatalog::FLAG_SYNCED ? "synced" : "UNSYNCED", path);
+        SD.remove(path);
+        catalog.remove(index);
+        changed = true;
+    }
+    if (changed) saveCatalog();
+}
+
+// CRC and size go into the catalog so transfers never have to re-read the file for them
+void addRecording(const char *path) {
+    File file = SD.open(path, "r");
+    if (!file) return;
+    uint32_t size = file.size();
+    file.close();
+    uint32_t crc = fileCrc32(path);
+    catalog.add(size, crc, (uint32_t)time(NULL));
+    saveCatalog();
+    Serial.printf("Recording %s: %u bytes, CRC32 %08x\n", path, size, crc);
+}
+
+// Announce transferInfo on the info characteristic now and as the next CoC SDU
+void announceTransfer() {
+    pInfoCharacteristic->setValue((uint8_t *)&transferInfo, sizeof(transferInfo));
+    pInfoCharacteristic->notify();
+    infoSentOnCoc = false;
+}
+
+// Open a file at a byte offset and announce size, CRC and offset to the client
+bool startTransfer(const char *path, uint32_t offset) {
+    if (wavFile) wavFile.close();
+    memcpy(transferInfo.magic, "WAVI", 4);
+    transferInfo.totalSize = transferInfo.crc32 = transferInfo.offset = transferInfo.id = 0;
+
+    // Not the recording in progress: its size and CRC are not known yet
+    bool available = SD.exists(path) && !(recording && strcmp(path, recordPath) == 0);
+    wavFile = available ? SD.open(path, "r") : File();
+    if (!wavFile) {
+        Serial.printf("Requested file not found: %s\n", path);
+        // Size 0 tells the client the request failed
+        announceTransfer();
+        transferActive = false;
+        return false;
+    }
+    uint32_t size = wavFile.size();
+    CatalogEntry *entry = catalog.find(recordingId(path));
+    if (entry && entry->size != size) entry = NULL;
+    uint32_t crc = entry ? entry->crc32 : fileCrc32(path);
+    if (offset > size) offset = size;
+    wavFile.seek(offset);
+
+    transferInfo.totalSize = size;
+    transferInfo.crc32 = crc;
+    transferInfo.offset = offset;
+    transferInfo.id = entry ? entry->id : 0;
+    announceTransfer();
+
+    transferActive = true;
+    transferDone = false;
+    transferReported = false;
+    cocBytesSent = gattBytesSent = 0;
+    startTime = millis();
+    Serial.printf("Transfer %s from byte %u of %u (CRC32 %08x)\n", path, offset, size, crc);
+    return true;
+}
+
+// End of file on either transport
+void finishTransfer() {
+    wavFile.close();
+    transferActive = false;
+    transferDone = true;
+    batchBytes += cocBytesSent + gattBytesSent;
+    reportConnectionThroughput("transfer complete");
+}
+
+void startBatch() {
+    if (transferActive) {
+        wavFile.close();
+        transferActive = false;
+    }
+    batchActive = true;
+    batchLastId = batchFiles = batchBytes = 0;
+    batchStart = millis();
+    Serial.printf("Batch transfer of %u unsynced recording(s)...\n", catalog.unsyncedCount());
+}
+
+// Next unsynced recording, or the "WAVD" announcement once there is none left
+void continueBatch() {
+    int index = catalog.nextUnsynced(batchLastId);
+    if (index >= 0) {
+        char path[24];
+        batchLastId = catalog.entry(index).id;
+        recordingPath(path, batchLastId);
+        if (startTransfer(path, 0)) batchFiles++;
+        return;
+    }
+    batchActive = false;
+    memcpy(transferInfo.magic, "WAVD", 4);
+    transferInfo.totalSize = batchFiles;
+    transferInfo.crc32 = transferInfo.offset = transferInfo.id = 0;
+    announceTransfer();
+    unsigned long elapsedTime = millis() - batchStart;
+    Serial.printf("Batch complete: %u file(s), %u bytes in %lu ms, %.2f kB/sec\n", batchFiles, batchBytes, elapsedTime,
+                  elapsedTime ? batchBytes / 1024.0 / elapsedTime * 1000.0 : 0.0);
+}
+
+// Send WAV file over BLE notifications (fallback for clients without CoC)
 void sendNextChunk() {
-    if (!wavFile || !deviceConnected){
+    if (!transferActive || !deviceConnected){
         //Serial.println("No WAV file or device not connected");
         return;
     }
 
     static uint8_t buffer[chunkSize];
+    stalls.enter(bleStage, "file read");
     size_t bytesRead = wavFile.read(buffer, chunkSize);
+    stalls.leave(bleStage);
     if (bytesRead > 0) {
         pCharacteristic->setValue(buffer, bytesRead);
+        stalls.enter(bleStage, "notify");
         pCharacteristic->notify();
+        stalls.leave(bleStage);
         totalBytesSent += bytesRead;
+        gattBytesSent += bytesRead;
         delay(200); // Adjust for BLE throughput
     } else {
         // Send end marker
         const char *endMarker = "END_OF_FILE";
         pCharacteristic->setValue((uint8_t *)endMarker, strlen(endMarker));
+        stalls.enter(bleStage, "notify");
         pCharacteristic->notify();
-        wavFile.close();
-        unsigned long elapsedTime = millis() - startTime;
-        float dataRate = (float)totalBytesSent / elapsedTime * 1000.0;
-        Serial.printf("Transfer complete! Data Rate: %.2f kB/sec\n", dataRate / 1024.0);
+        stalls.leave(bleStage);
+        finishTransfer();
     }
     yield();
 }
 
-void setup() {
-    Serial.begin(115200);
-    if (!SD.begin(chipSelect)) {
-        Serial.println("Failed to initialize SD card");
+// Send the next SDU over the L2CAP CoC; credits pace the sender, no delays needed
+void sendNextCocChunk() {
+    if (!deviceConnected || !cocChannel || cocStalled) return;
+    if (!transferActive && infoSentOnCoc) return;
+
+    static uint8_t buffer[COC_CHUNK_SIZE];
+    size_t sduSize = cocPeerSduSize ? min((size_t)cocPeerSduSize, sizeof(buffer)) : sizeof(buffer);
+    struct os_mbuf *sdu = os_msys_get_pkthdr(sduSize, 0);
+    if (!sdu) return;  // mbuf pool busy, retry on the next loop
+
+    // The first SDU of every transfer repeats the announcement, so CoC clients
+    // can tell a restarted stream (or the next file of a batch) apart without
+    // ordering against GATT
+    if (!infoSentOnCoc) {
+        int rc = os_mbuf_append(sdu, &transferInfo, sizeof(transferInfo));
+        if (rc == 0) rc = ble_l2cap_send(cocChannel, sdu);
+        if (rc == 0 || rc == BLE_HS_ESTALLED) {
+            cocStalled = rc == BLE_HS_ESTALLED;
+            infoSentOnCoc = true;
+        } else {
+            os_mbuf_free_chain(sdu);
+        }
         return;
     }
-    i2sConfig();
-    recordWavFile();
 
-    wavFile = SD.open(WAV_FILE_PATH, "r");
-    if (!wavFile) {
-        Serial.println("Failed to open WAV file");
+    stalls.enter(bleStage, "file read");
+    size_t bytesRead = wavFile.read(buffer, sduSize);
+    stalls.leave(bleStage);
+    bool endOfFile = bytesRead == 0;
+    if (endOfFile) {
+        const char *endMarker = "END_OF_FILE";
+        bytesRead = strlen(endMarker);
+        memcpy(buffer, endMarker, bytesRead);
+    }
+    if (os_mbuf_append(sdu, buffer, bytesRead) != 0) {
+        os_mbuf_free_chain(sdu);
+        if (!endOfFile) wavFile.seek(wavFile.position() - bytesRead);
         return;
     }
 
-    BLEDevice::init("ESP32-WAV-Transfer");
-    BLEDevice::setMTU(517);
-    pServer = BLEDevice::createServer();
-    pServer->setCallbacks(new MyServerCallbacks());
-    BLEService *pService = pServer->createService(SERVICE_UUID);
+    stalls.enter(bleStage, "ble_l2cap_send");
+    int rc = ble_l2cap_send(cocChannel, sdu);
+    stalls.leave(bleStage);
+    if (rc == 0 || rc == BLE_HS_ESTALLED) {
+        // ESTALLED: SDU queued, wait for BLE_L2CAP_EVENT_COC_TX_UNSTALLED before the next one
+        cocStalled = rc == BLE_HS_ESTALLED;
+        if (endOfFile) {
+            finishTransfer();
+        } else {
+            totalBytesSent += bytesRead;
+            cocBytesSent += bytesRead;
+        }
+    } else {
+        // Not accepted (e.g. previous SDU still in flight): rewind and retry
+        os_mbuf_free_chain(sdu);
+        if (!endOfFile) wavFile.seek(wavFile.position() - bytesRead);
+    }
+}
+
+// Waits for the trigger and records, then hands the result to loop()
+void recordTask(void *parameter) {
+    recordingSaved = recordWavFile(recordPath);
+    recording = false;
+    recordingFinished = true;
+    vTaskDelete(NULL);
+}
+
+// Catalog entry for a finished recording
+void finishRecording(bool saved) {
+    if (saved) addRecording(recordPath);
+    Serial.printf("Catalog: %u recording(s), %u unsynced\n", catalog.count(), catalog.unsyncedCount());
+}
+
+// GATT service, CoC server and advertising
+void startBle() {
+    NimBLEDevice::init("ESP32-WAV-Transfer");
+    NimBLEDevice::setMTU(517);
+    pServer = NimBLEDevice::createServer();
+    pServer->setCallbacks(&serverCallbacks, false);
+    NimBLEService *pService = pServer->createService(SERVICE_UUID);
     pCharacteristic = pService->createCharacteristic(
         CHARACTERISTIC_UUID,
-        BLECharacteristic::PROPERTY_NOTIFY
+        NIMBLE_PROPERTY::NOTIFY
     );
-    pDescr = new BLEDescriptor((uint16_t)0x2901);
+    NimBLEDescriptor *pDescr = pCharacteristic->createDescriptor("2901", NIMBLE_PROPERTY::READ, 20);
     pDescr->setValue("WAV File Transfer");
-    pCharacteristic->addDescriptor(pDescr);
-    pBLE2902 = new BLE2902();
-    pBLE2902->setNotifications(true);
-    pCharacteristic->addDescriptor(pBLE2902);
+
+    // Publish the CoC PSM and our SDU size so clients can discover the bulk channel
+    uint16_t l2capInfo[2] = {L2CAP_PSM, COC_CHUNK_SIZE};
+    pL2capCharacteristic = pService->createCharacteristic(
+        L2CAP_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::READ
+    );
+    pL2capCharacteristic->setValue((uint8_t *)l2capInfo, sizeof(l2capInfo));
+
+    // Resume support: client asks for a file and offset, server announces size and CRC
+    pInfoCharacteristic = pService->createCharacteristic(
+        INFO_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+    );
+    pControlCharacteristic = pService->createCharacteristic(
+        CONTROL_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::WRITE
+    );
+    pControlCharacteristic->setCallbacks(&controlCallbacks);
+
+    // Recording list (id, size, CRC, timestamp, synced), paged with "CAT <index>"
+    pCatalogCharacteristic = pService->createCharacteristic(
+        CATALOG_CHARACTERISTIC_UUID,
+        NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+    );
+    publishCatalog();
     pService->start();
-    BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
+
+    if (ble_l2cap_create_server(L2CAP_PSM, L2CAP_RX_MTU, l2capEvent, NULL) != 0) {
+        Serial.println("L2CAP CoC server unavailable, GATT transfer only");
+    }
+
+    NimBLEAdvertising *pAdvertising = NimBLEDevice::getAdvertising();
     pAdvertising->addServiceUUID(SERVICE_UUID);
     pAdvertising->setScanResponse(false);
     pAdvertising->setMinPreferred(0x0);
-    BLEDevice::startAdvertising();
+    NimBLEDevice::startAdvertising();
     Serial.println("Waiting for a client connection to start WAV transfer...");
-    // pCharacteristic->addDescriptor(new BLE2902());
-    // pService->start();
-    // BLEDevice::startAdvertising();
-    // Serial.println("Waiting for client connection...");
+}
+
+void setup() {
+    Serial.begin(115200);
+    captureStage = stalls.addStage("capture", CAPTURE_DEADLINE_MS);
+    writerStage = stalls.addStage("writer", WRITER_DEADLINE_MS);
+    catalogStage = stalls.addStage("catalog", CATALOG_DEADLINE_MS);
+    bleStage = stalls.addStage("ble", BLE_DEADLINE_MS);
+    stalls.begin(STALL_RESTART_MS, &Serial);
+    ackQueue = xQueueCreate(ACK_QUEUE_SIZE, sizeof(uint32_t));
+    if (!SD.begin(chipSelect)) {
+        Serial.println("Failed to initialize SD card");
+        return;
+    }
+    loadCatalog();
+    makeRoomForRecording();
+    i2sConfig();
+#if TRIGGER_RECORDING
+#if TRIGGER_PIN >= 0
+    pinMode(TRIGGER_PIN, INPUT_PULLUP);
+#endif
+    // Before BLE takes its share of the heap
+    preRollEnabled = allocatePreRoll();
+#endif
+
+    // Each boot adds a recording; older ones stay until evicted
+    recordingPath(recordPath, catalog.nextId());
+
+    // TRIG needs BLE up while waiting, and loop() serves it meanwhile;
+    // otherwise BLE starts after the recording
+    if (preRollEnabled) {
+        startBle();
+        recording = true;
+        xTaskCreatePinnedToCore(recordTask, "record", 8192, NULL, 5, NULL, 1);
+        return;
+    }
+    finishRecording(recordWavFile(recordPath));
+    startBle();
 }
 
 void loop() {
+    if (recordingFinished) {
+        recordingFinished = false;
+        finishRecording(recordingSaved);
+    }
+
+    uint32_t ackId;
+    bool acknowledged = false;
+    while (xQueueReceive(ackQueue, &ackId, 0) == pdTRUE) {
+        if (catalog.markSynced(ackId)) {
+            acknowledged = true;
+        } else {
+            Serial.printf("ACK for unknown recording %u\n", ackId);
+        }
+    }
+    if (acknowledged) saveCatalog();
+    if (catalogPageRequested) {
+        catalogPageRequested = false;
+        catalogPageFirst = catalogPageRequest;
+        publishCatalog();
+    }
+
     if (deviceConnected) {
+        if (transferRequest.pending) {
+            // Explicit request (resume): replaces whatever is in flight
+            transferRequest.pending = false;
+            delayBeforeTransfer = false;
+            batchActive = false;
+            startTransfer(transferRequest.path, transferRequest.offset);
+        }
+        if (syncRequested) {
+            syncRequested = false;
+            delayBeforeTransfer = false;
+            startBatch();
+        }
         if (delayBeforeTransfer && millis() - connectionTime >= 5000) {
             delayBeforeTransfer = false;
-            startTime = millis();
             Serial.println("Starting transfer...");
+            if (!transferActive && !transferDone && !batchActive) startBatch();
         }
-        if (!delayBeforeTransfer) {
-            sendNextChunk();
-            delay(100); //delay between chunks
+        if (cocChannel) {
+            // CoC client: start as soon as the channel is open
+            if (delayBeforeTransfer) {
+                delayBeforeTransfer = false;
+                Serial.println("Starting transfer over L2CAP CoC...");
+                if (!transferActive && !transferDone && !batchActive) startBatch();
+            }
+            // Next file once the previous one (and its END_OF_FILE) is out
+            if (batchActive && !transferActive && infoSentOnCoc) continueBatch();
+            sendNextCocChunk();
+        } else {
+            if (batchActive && !transferActive) continueBatch();
+            if (transferActive) {
+                sendNextChunk();
+                delay(100); //delay between chunks
+            }
         }
     }
     if (!deviceConnected && oldDeviceConnected) {
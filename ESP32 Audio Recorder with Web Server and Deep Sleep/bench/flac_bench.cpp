@@ -0,0 +1,362 @@
+// Host check and benchmark of lib/FlacEncoder (pio run -e native, then
+// .pio/build/native/program [input.wav [output.flac]]). Encodes synthetic
+// signals and, if given, the first channel of a 16-bit WAV file; decodes
+// every stream again with a reference FLAC reader (CRC-8, CRC-16, MD5 and
+// sample checks) and reports the compression ratio and the encoder CPU time
+// per second of audio. A sink that fails part-way through a frame checks
+// that the patched header still matches the complete frames. The output
+// file can be checked with stock tools:
+//   flac -t output.flac
+//   flac -d -f output.flac -o decoded.wav
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "FlacEncoder.h"
+
+static const uint32_t SAMPLE_RATE = 44100;
+static const size_t SYNTHETIC_SAMPLES = 10 * SAMPLE_RATE + 1234;  // Odd tail: partial last frame
+static const int TIMING_RUNS = 5;
+
+static FlacEncoder encoder;  // 24 KB of state, global as on the device
+
+static uint64_t nowMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static bool appendToVector(const uint8_t *data, size_t length, void *context) {
+    std::vector<uint8_t> *out = (std::vector<uint8_t> *)context;
+    out->insert(out->end(), data, data + length);
+    return true;
+}
+
+// Feeds the encoder 4096-byte reads, as recordWavFile() does
+static bool encode(const std::vector<int16_t> &samples, std::vector<uint8_t> &out) {
+    out.clear();
+    if (!encoder.begin(SAMPLE_RATE, appendToVector, &out)) return false;
+    for (size_t i = 0; i < samples.size(); i += 2048) {
+        size_t n = samples.size() - i < 2048 ? samples.size() - i : 2048;
+        if (!encoder.add(&samples[i], n)) return false;
+    }
+    uint8_t header[FlacEncoder::HEADER_BYTES];
+    if (!encoder.finish(header)) return false;
+    memcpy(&out[0], header, sizeof(header));
+    return true;
+}
+
+// Reference reader for what the encoder emits: STREAMINFO, then frames with
+// CONSTANT, VERBATIM and FIXED subframes (mono, 16-bit)
+struct BitReader {
+    const uint8_t *data;
+    size_t size;
+    size_t bit;
+
+    uint32_t get(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; i++, bit++) {
+            if (bit / 8 >= size) throw "truncated stream";
+            value = (value << 1) | ((data[bit / 8] >> (7 - bit % 8)) & 1);
+        }
+        return value;
+    }
+    int32_t getSigned(int bits) {
+        uint32_t value = get(bits);
+        return value & (1u << (bits - 1)) ? (int32_t)(value - (1u << bits)) : (int32_t)value;
+    }
+    size_t byte() const { return bit / 8; }
+};
+
+static uint8_t referenceCrc8(const uint8_t *data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t referenceCrc16(const uint8_t *data, size_t length) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i] << 8;
+        for (int b = 0; b < 8; b++) crc = crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1;
+    }
+    return crc;
+}
+
+static void decode(const std::vector<uint8_t> &stream, std::vector<int16_t> &samples, uint64_t &totalSamples,
+                   uint32_t &sampleRate) {
+    BitReader in = {&stream[0], stream.size(), 0};
+    if (memcmp(&stream[0], "fLaC", 4) != 0) throw "missing fLaC marker";
+    in.bit = 32;
+    bool last = false;
+    while (!last) {
+        last = in.get(1);
+        uint32_t type = in.get(7), length = in.get(24);
+        if (type == 0) {
+            size_t start = in.byte();
+            in.get(16);
+            in.get(16);
+            in.get(24);
+            in.get(24);
+            sampleRate = in.get(20);
+            if (in.get(3) != 0 || in.get(5) != 15) throw "not mono 16-bit";
+            totalSamples = (uint64_t)in.get(4) << 32;
+            totalSamples |= in.get(32);
+            in.bit = (start + length) * 8;
+        } else {
+            in.bit += length * 8;
+        }
+    }
+
+    static const uint32_t rates[12] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000};
+    uint32_t expectedFrame = 0;
+    // Stops at the STREAMINFO total, like a player: a file cut short by a
+    // failed write ends in part of a frame
+    while (in.byte() < stream.size() && (!totalSamples || samples.size() < totalSamples)) {
+        size_t frameStart = in.byte();
+        if (in.get(15) != 0x7FFC || in.get(1) != 0) throw "lost frame sync";
+        uint32_t blockCode = in.get(4), rateCode = in.get(4);
+        if (in.get(4) != 0 || in.get(3) != 4 || in.get(1) != 0) throw "unexpected channel or sample size";
+        if (rateCode > 11 || (rateCode && rates[rateCode] != sampleRate)) throw "frame sample rate";
+        uint32_t lead = in.get(8), frame = lead;
+        int extra = 0;
+        if (lead & 0x80) {
+            while (extra < 6 && (lead & (0x40 >> extra))) extra++;
+            frame = lead & (0x3F >> extra);
+        }
+        for (int i = 0; i < extra; i++) {
+            uint32_t next = in.get(8);
+            if ((next & 0xC0) != 0x80) throw "bad frame number";
+            frame = (frame << 6) | (next & 0x3F);
+        }
+        if (frame != expectedFrame++) throw "frame number";
+        uint32_t blockSize = blockCode == 12 ? 4096 : blockCode == 7 ? in.get(16) + 1 : blockCode == 6 ? in.get(8) + 1 : 0;
+        if (!blockSize) throw "unexpected block size code";
+        if (referenceCrc8(&stream[frameStart], in.byte() - frameStart) != in.get(8)) throw "header CRC-8";
+
+        size_t base = samples.size();
+        samples.resize(base + blockSize);
+        int16_t *x = &samples[base];
+        if (in.get(1) != 0) throw "subframe padding";
+        uint32_t type = in.get(6);
+        if (in.get(1)) throw "wasted bits";
+        if (type == 0) {
+            int32_t value = in.getSigned(16);
+            for (uint32_t i = 0; i < blockSize; i++) x[i] = value;
+        } else if (type == 1) {
+            for (uint32_t i = 0; i < blockSize; i++) x[i] = in.getSigned(16);
+        } else if (type >= 8 && type <= 12) {
+            uint32_t order = type - 8;
+            for (uint32_t i = 0; i < order; i++) x[i] = in.getSigned(16);
+            if (in.get(2) != 0) throw "residual coding method";
+            uint32_t partitionOrder = in.get(4);
+            uint32_t partitionSize = blockSize >> partitionOrder;
+            uint32_t i = order;
+            for (uint32_t p = 0; p < (1u << partitionOrder); p++) {
+                uint32_t k = in.get(4);
+                if (k == 15) throw "escaped partition";
+                for (uint32_t n = p == 0 ? order : 0; n < partitionSize; n++, i++) {
+                    uint32_t q = 0;
+                    while (!in.get(1)) q++;
+                    uint32_t u = (q << k) | in.get(k);
+                    int32_t r = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+                    int32_t prediction = 0;
+                    switch (order) {
+                        case 1: prediction = x[i - 1]; break;
+                        case 2: prediction = 2 * x[i - 1] - x[i - 2]; break;
+                        case 3: prediction = 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3]; break;
+                        case 4: prediction = 4 * x[i - 1] - 6 * x[i - 2] + 4 * x[i - 3] - x[i - 4]; break;
+                    }
+                    int32_t value = prediction + r;
+                    if (value < -32768 || value > 32767) throw "sample out of range";
+                    x[i] = value;
+                }
+            }
+        } else {
+            throw "unexpected subframe type";
+        }
+        if (in.bit % 8) in.get(8 - in.bit % 8);
+        uint16_t crc = referenceCrc16(&stream[frameStart], in.byte() - frameStart);
+        if (in.get(16) != crc) throw "frame CRC-16";
+    }
+}
+
+static bool run(const char *name, const std::vector<int16_t> &samples, const char *outputPath) {
+    std::vector<uint8_t> stream;
+    uint64_t best = ~(uint64_t)0;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        uint64_t start = nowMicros();
+        if (!encode(samples, stream)) {
+            printf("FAIL %s: encoder\n", name);
+            return false;
+        }
+        uint64_t elapsed = nowMicros() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    std::vector<int16_t> decoded;
+    uint64_t totalSamples = 0;
+    uint32_t sampleRate = 0;
+    try {
+        decode(stream, decoded, totalSamples, sampleRate);
+    } catch (const char *error) {
+        printf("FAIL %s: %s\n", name, error);
+        return false;
+    }
+    if (sampleRate != SAMPLE_RATE || totalSamples != samples.size() || decoded != samples) {
+        printf("FAIL %s: decoded audio differs\n", name);
+        return false;
+    }
+    // The MD5 in STREAMINFO must match a fresh pass over the decoded samples
+    std::vector<uint8_t> check;
+    encoder.begin(SAMPLE_RATE, appendToVector, &check);
+    encoder.add(&decoded[0], decoded.size());
+    uint8_t header[FlacEncoder::HEADER_BYTES];
+    encoder.finish(header);
+    if (memcmp(header + 26, &stream[26], 16) != 0) {
+        printf("FAIL %s: MD5\n", name);
+        return false;
+    }
+
+    double seconds = (double)samples.size() / SAMPLE_RATE;
+    double pcmBytes = samples.size() * 2.0;
+    const uint32_t *counts = encoder.subframeCounts();
+    printf("%-22s %6.1f s  %8.0f -> %8u bytes  ratio %5.3f (%5.1f%% of PCM)  %6.0f us CPU per s of audio  "
+           "frames C%u V%u F%u/%u/%u/%u/%u\n",
+           name, seconds, pcmBytes, (unsigned)stream.size(), pcmBytes / stream.size(), 100 * stream.size() / pcmBytes,
+           best / seconds, counts[0], counts[1], counts[2], counts[3], counts[4], counts[5], counts[6]);
+
+    if (outputPath) {
+        FILE *f = fopen(outputPath, "wb");
+        if (!f || fwrite(&stream[0], 1, stream.size(), f) != stream.size()) {
+            printf("FAIL: cannot write %s\n", outputPath);
+            return false;
+        }
+        fclose(f);
+        printf("Wrote %s (MD5 ", outputPath);
+        for (int i = 0; i < 16; i++) printf("%02x", stream[26 + i]);
+        printf(")\n");
+    }
+    return true;
+}
+
+// Card full part-way through a frame: the sink takes what fits and fails.
+// The patched header must describe only the complete frames before it.
+struct FullCard {
+    std::vector<uint8_t> data;
+    size_t capacity;
+};
+
+static bool appendUntilFull(const uint8_t *data, size_t length, void *context) {
+    FullCard *card = (FullCard *)context;
+    size_t fits = card->capacity - card->data.size() < length ? card->capacity - card->data.size() : length;
+    card->data.insert(card->data.end(), data, data + fits);
+    return fits == length;
+}
+
+static bool runCardFull(const std::vector<int16_t> &samples) {
+    FullCard card;
+    card.capacity = 60000;
+    encoder.begin(SAMPLE_RATE, appendUntilFull, &card);
+    for (size_t i = 0; i < samples.size(); i += 2048) {
+        size_t n = samples.size() - i < 2048 ? samples.size() - i : 2048;
+        if (!encoder.add(&samples[i], n)) break;
+    }
+    uint8_t header[FlacEncoder::HEADER_BYTES];
+    if (encoder.finish(header)) {
+        printf("FAIL card full: the failed write was not reported\n");
+        return false;
+    }
+    memcpy(&card.data[0], header, sizeof(header));
+
+    std::vector<int16_t> decoded;
+    uint64_t totalSamples = 0;
+    uint32_t sampleRate = 0;
+    try {
+        decode(card.data, decoded, totalSamples, sampleRate);
+    } catch (const char *error) {
+        printf("FAIL card full: %s\n", error);
+        return false;
+    }
+    static const uint8_t noDigest[16] = {0};
+    if (totalSamples == 0 || totalSamples % FlacEncoder::BLOCK_SIZE != 0 || decoded.size() != totalSamples ||
+        !std::equal(decoded.begin(), decoded.end(), samples.begin()) || memcmp(header + 26, noDigest, 16) != 0) {
+        printf("FAIL card full: header does not match the frames written\n");
+        return false;
+    }
+    printf("%-22s %u of %u bytes written, %llu complete samples decoded, MD5 zero\n", "card full mid-frame",
+           (unsigned)card.data.size(), (unsigned)card.capacity, (unsigned long long)totalSamples);
+    return true;
+}
+
+// First channel of a 16-bit PCM WAV
+static bool readWav(const char *path, std::vector<int16_t> &samples) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t riff[12], chunk[8];
+    uint16_t channels = 0, bits = 0;
+    bool ok = fread(riff, 1, 12, f) == 12 && memcmp(riff, "RIFF", 4) == 0 && memcmp(riff + 8, "WAVE", 4) == 0;
+    while (ok && fread(chunk, 1, 8, f) == 8) {
+        uint32_t size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((uint32_t)chunk[7] << 24);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            ok = size >= 16 && fread(fmt, 1, 16, f) == 16;
+            channels = fmt[2] | (fmt[3] << 8);
+            bits = fmt[14] | (fmt[15] << 8);
+            fseek(f, size - 16 + (size & 1), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!channels || bits != 16) break;
+            std::vector<int16_t> frames(size / 2);
+            size_t read = fread(&frames[0], 2, frames.size(), f);
+            for (size_t i = 0; i + channels <= read; i += channels) samples.push_back(frames[i]);
+            fclose(f);
+            return true;
+        } else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fclose(f);
+    return false;
+}
+
+int main(int argc, char **argv) {
+    srand(1);
+    std::vector<int16_t> samples(SYNTHETIC_SAMPLES);
+    bool ok = true;
+
+    ok &= run("silence", samples, NULL);
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = (int16_t)(8000 * sin(2 * M_PI * 440 * i / SAMPLE_RATE) + rand() % 33 - 16);
+    }
+    ok &= run("440 Hz tone + noise", samples, NULL);
+    ok &= runCardFull(samples);
+
+    for (size_t i = 0; i < samples.size(); i++) samples[i] = (int16_t)rand();
+    ok &= run("full-scale white noise", samples, NULL);
+
+    // Clipped square wave with silent gaps: CONSTANT frames and extreme residuals
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = (i / 20000) % 2 ? 0 : (i / 50) % 2 ? 32767 : -32768;
+    }
+    ok &= run("square / silence", samples, NULL);
+
+    if (argc > 1) {
+        samples.clear();
+        if (!readWav(argv[1], samples) || samples.empty()) {
+            printf("FAIL: %s is not a 16-bit PCM WAV\n", argv[1]);
+            return 1;
+        }
+        ok &= run(argv[1], samples, argc > 2 ? argv[2] : NULL);
+    }
+
+    if (ok) printf("All streams decoded bit-exact (CRC-8, CRC-16 and MD5 verified)\n");
+    return ok ? 0 : 1;
+}
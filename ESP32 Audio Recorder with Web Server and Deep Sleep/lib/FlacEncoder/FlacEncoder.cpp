@@ -0,0 +1,426 @@
+#include "FlacEncoder.h"
+
+#include <string.h>
+
+// Subframe counters: CONSTANT, VERBATIM, then FIXED by order
+static const int COUNT_CONSTANT = 0;
+static const int COUNT_VERBATIM = 1;
+static const int COUNT_FIXED = 2;
+
+static uint16_t crc16Table[256];
+
+// CRC-16 polynomial x^16 + x^15 + x^2 + 1 over the whole frame
+static void initCrc16Table() {
+    if (crc16Table[1]) return;
+    for (int i = 0; i < 256; i++) {
+        uint16_t crc = i << 8;
+        for (int b = 0; b < 8; b++) crc = crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1;
+        crc16Table[i] = crc;
+    }
+}
+
+// CRC-8 polynomial x^8 + x^2 + x + 1 over the frame header only
+static uint8_t crc8(const uint8_t *data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+// Sample rates with a 4-bit code in the frame header; others use 0 (see STREAMINFO)
+static uint8_t sampleRateCode(uint32_t rate) {
+    switch (rate) {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+        default: return 0;
+    }
+}
+
+static inline uint32_t fold(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+bool FlacEncoder::begin(uint32_t sampleRate, Sink sink, void *context) {
+    initCrc16Table();
+    _sink = sink;
+    _context = context;
+    _sampleRate = sampleRate;
+    _totalSamples = 0;
+    _bytesWritten = 0;
+    _frameNumber = 0;
+    _minFrameBytes = 0xFFFFFFFF;
+    _maxFrameBytes = 0;
+    memset(_subframeCounts, 0, sizeof(_subframeCounts));
+    _failed = false;
+    _blockFill = 0;
+    _bits = 0;
+    _bitCount = 0;
+    _outputFill = 0;
+    _md5.begin();
+    memset(_digest, 0, sizeof(_digest));
+
+    // Placeholder, rewritten by the caller with the block from finish()
+    uint8_t header[HEADER_BYTES];
+    writeHeaderBlock(header);
+    for (size_t i = 0; i < HEADER_BYTES; i++) putByte(header[i]);
+    return flushOutput();
+}
+
+bool FlacEncoder::add(const int16_t *samples, size_t count) {
+    while (count && !_failed) {
+        size_t chunk = BLOCK_SIZE - _blockFill;
+        if (chunk > count) chunk = count;
+        memcpy(_block + _blockFill, samples, chunk * sizeof(int16_t));
+        _blockFill += chunk;
+        samples += chunk;
+        count -= chunk;
+        if (_blockFill == BLOCK_SIZE) encodeFrame();
+    }
+    return !_failed;
+}
+
+bool FlacEncoder::finish(uint8_t header[HEADER_BYTES]) {
+    if (_blockFill && !_failed) encodeFrame();
+    _md5.finish(_digest);
+    // The MD5 covers samples of the frame the sink refused; all zeros means "not computed"
+    if (_failed) memset(_digest, 0, sizeof(_digest));
+    writeHeaderBlock(header);
+    return !_failed;
+}
+
+bool FlacEncoder::encodeFrame() {
+    const size_t count = _blockFill;
+    uint64_t frameStart = _bytesWritten;
+
+    // The MD5 covers the samples as little-endian 16-bit words
+    uint8_t bytes[128];
+    for (size_t i = 0; i < count; i += 64) {
+        size_t n = count - i < 64 ? count - i : 64;
+        for (size_t j = 0; j < n; j++) {
+            bytes[2 * j] = (uint8_t)_block[i + j];
+            bytes[2 * j + 1] = (uint8_t)((uint16_t)_block[i + j] >> 8);
+        }
+        _md5.update(bytes, 2 * n);
+    }
+
+    // Frame header: fixed-blocksize stream, so frames are numbered
+    uint8_t header[16];
+    size_t length = 0;
+    header[length++] = 0xFF;
+    header[length++] = 0xF8;
+    uint8_t blockCode = count == BLOCK_SIZE ? 12 : 7;  // 12 = 4096, 7 = 16-bit size at the end
+    uint8_t rateCode = sampleRateCode(_sampleRate);
+    header[length++] = (blockCode << 4) | rateCode;
+    header[length++] = (0 << 4) | (4 << 1);  // Mono, 16 bits per sample
+    uint32_t n = _frameNumber;
+    if (n < 0x80) {
+        header[length++] = n;
+    } else {
+        int extra = n < 0x800 ? 1 : n < 0x10000 ? 2 : n < 0x200000 ? 3 : n < 0x4000000 ? 4 : 5;
+        header[length++] = (uint8_t)((0xFF00 >> (extra + 1)) | (n >> (6 * extra)));
+        for (int i = extra - 1; i >= 0; i--) header[length++] = 0x80 | ((n >> (6 * i)) & 0x3F);
+    }
+    if (blockCode == 7) {
+        header[length++] = (count - 1) >> 8;
+        header[length++] = (count - 1) & 0xFF;
+    }
+    header[length] = crc8(header, length);
+    length++;
+
+    _crc16 = 0;
+    for (size_t i = 0; i < length; i++) putByte(header[i]);
+
+    // Subframe
+    bool constant = true;
+    for (size_t i = 1; i < count && constant; i++) constant = _block[i] == _block[0];
+    if (constant) {
+        put(0x00, 8);
+        put((uint16_t)_block[0], 16);
+        _subframeCounts[COUNT_CONSTANT]++;
+    } else {
+        int order = count > MAX_ORDER ? bestOrder(count) : -1;
+        int partitionOrder = 0;
+        uint8_t parameters[1 << MAX_PARTITION_ORDER];
+        uint32_t verbatimBits = 16 * count;
+        uint32_t fixedBits = order < 0 ? verbatimBits : 16 * order + residualBits(order, count, partitionOrder, parameters);
+        if (fixedBits < verbatimBits) {
+            put((0x08 | order) << 1, 8);
+            for (int i = 0; i < order; i++) put((uint16_t)_block[i], 16);
+            writeResidual(order, count, partitionOrder, parameters);
+            _subframeCounts[COUNT_FIXED + order]++;
+        } else {
+            put(0x01 << 1, 8);
+            for (size_t i = 0; i < count; i++) put((uint16_t)_block[i], 16);
+            _subframeCounts[COUNT_VERBATIM]++;
+        }
+    }
+
+    // Footer
+    alignByte();
+    put(_crc16, 16);
+
+    // Each frame goes to the sink whole. A refused frame stays out of the
+    // totals, so STREAMINFO describes only the frames that are in the file
+    _blockFill = 0;
+    if (!flushOutput()) return false;
+
+    uint32_t frameBytes = (uint32_t)(_bytesWritten - frameStart);
+    if (frameBytes < _minFrameBytes) _minFrameBytes = frameBytes;
+    if (frameBytes > _maxFrameBytes) _maxFrameBytes = frameBytes;
+    _frameNumber++;
+    _totalSamples += count;
+    return true;
+}
+
+// Fixed predictor with the smallest summed residual magnitude
+int FlacEncoder::bestOrder(size_t count) {
+    const int16_t *x = _block;
+    uint64_t total[MAX_ORDER + 1] = {0};
+    for (size_t i = MAX_ORDER; i < count; i++) {
+        int32_t e0 = x[i];
+        int32_t e1 = e0 - x[i - 1];
+        int32_t e2 = e1 - (x[i - 1] - x[i - 2]);
+        int32_t e3 = e2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+        int32_t e4 = e3 - (x[i - 1] - 3 * x[i - 2] + 3 * x[i - 3] - x[i - 4]);
+        total[0] += e0 < 0 ? -e0 : e0;
+        total[1] += e1 < 0 ? -e1 : e1;
+        total[2] += e2 < 0 ? -e2 : e2;
+        total[3] += e3 < 0 ? -e3 : e3;
+        total[4] += e4 < 0 ? -e4 : e4;
+    }
+    int best = 0;
+    for (int order = 1; order <= MAX_ORDER; order++) {
+        if (total[order] < total[best]) best = order;
+    }
+    return best;
+}
+
+// Computes the residual of `order` and picks the partition order and Rice
+// parameters. The estimate count * (k + 1) + (sum >> k) per partition is an
+// upper bound of the coded size, since the sum of floors never exceeds the
+// floor of the sum.
+uint32_t FlacEncoder::residualBits(int order, size_t count, int &partitionOrder, uint8_t *parameters) {
+    const int16_t *x = _block;
+    int32_t *r = _residual;
+    switch (order) {
+        case 0:
+            for (size_t i = 0; i < count; i++) r[i] = x[i];
+            break;
+        case 1:
+            for (size_t i = 1; i < count; i++) r[i] = x[i] - x[i - 1];
+            break;
+        case 2:
+            for (size_t i = 2; i < count; i++) r[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+            break;
+        case 3:
+            for (size_t i = 3; i < count; i++) r[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+            break;
+        default:
+            for (size_t i = 4; i < count; i++) r[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+            break;
+    }
+
+    int maxOrder = 0;
+    while (maxOrder < MAX_PARTITION_ORDER && count % (2u << maxOrder) == 0 && (count >> (maxOrder + 1)) > (size_t)order) {
+        maxOrder++;
+    }
+
+    // Folded sums of the finest partitions, merged pairwise for each coarser order
+    uint64_t sums[1 << MAX_PARTITION_ORDER];
+    size_t partitions = (size_t)1 << maxOrder;
+    size_t partitionSize = count >> maxOrder;
+    for (size_t p = 0; p < partitions; p++) {
+        size_t start = p == 0 ? order : p * partitionSize;
+        uint64_t sum = 0;
+        for (size_t i = start; i < (p + 1) * partitionSize; i++) sum += fold(r[i]);
+        sums[p] = sum;
+    }
+
+    uint32_t bestBits = 0xFFFFFFFF;
+    for (int level = maxOrder; level >= 0; level--) {
+        partitions = (size_t)1 << level;
+        partitionSize = count >> level;
+        uint8_t levelParameters[1 << MAX_PARTITION_ORDER];
+        uint32_t bits = 2 + 4;
+        for (size_t p = 0; p < partitions; p++) {
+            uint32_t samples = p == 0 ? partitionSize - order : partitionSize;
+            uint64_t best = ~(uint64_t)0;
+            for (int k = 0; k <= MAX_RICE_PARAMETER; k++) {
+                uint64_t cost = (uint64_t)samples * (k + 1) + (sums[p] >> k);
+                if (cost < best) {
+                    best = cost;
+                    levelParameters[p] = k;
+                }
+            }
+            bits += 4 + (uint32_t)best;
+        }
+        if (bits < bestBits) {
+            bestBits = bits;
+            partitionOrder = level;
+            memcpy(parameters, levelParameters, partitions);
+        }
+        for (size_t p = 0; p < partitions / 2; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    return bestBits;
+}
+
+void FlacEncoder::writeResidual(int order, size_t count, int partitionOrder, const uint8_t *parameters) {
+    put(0, 2);  // Rice coding with 4-bit parameters
+    put(partitionOrder, 4);
+    size_t partitionSize = count >> partitionOrder;
+    for (size_t p = 0; p < ((size_t)1 << partitionOrder); p++) {
+        int k = parameters[p];
+        uint32_t mask = (1u << k) - 1;
+        put(k, 4);
+        size_t start = p == 0 ? order : p * partitionSize;
+        for (size_t i = start; i < (p + 1) * partitionSize; i++) {
+            uint32_t u = fold(_residual[i]);
+            uint32_t q = u >> k;
+            while (q >= 32) {
+                put(0, 32);
+                q -= 32;
+            }
+            if (q) put(0, q);
+            put((1u << k) | (u & mask), k + 1);
+        }
+    }
+}
+
+void FlacEncoder::writeHeaderBlock(uint8_t header[HEADER_BYTES]) {
+    memcpy(header, "fLaC", 4);
+    header[4] = 0x80;  // Last metadata block, type 0 (STREAMINFO)
+    header[5] = 0;
+    header[6] = 0;
+    header[7] = 34;
+    header[8] = header[10] = BLOCK_SIZE >> 8;
+    header[9] = header[11] = BLOCK_SIZE & 0xFF;
+    uint32_t minFrame = _frameNumber ? _minFrameBytes : 0;
+    for (int i = 0; i < 3; i++) {
+        header[12 + i] = minFrame >> (16 - 8 * i);
+        header[15 + i] = _maxFrameBytes >> (16 - 8 * i);
+    }
+    // Sample rate (20 bits), channels - 1 (3), bits per sample - 1 (5), total samples (36)
+    uint64_t packed = ((uint64_t)_sampleRate << 44) | ((uint64_t)(16 - 1) << 36) | (_totalSamples & 0xFFFFFFFFFULL);
+    for (int i = 0; i < 8; i++) header[18 + i] = packed >> (56 - 8 * i);
+    memcpy(header + 26, _digest, 16);
+}
+
+void FlacEncoder::put(uint32_t value, int bits) {
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    _bits = (_bits << bits) | (value & mask);
+    _bitCount += bits;
+    while (_bitCount >= 8) {
+        _bitCount -= 8;
+        putByte((uint8_t)(_bits >> _bitCount));
+    }
+}
+
+void FlacEncoder::putByte(uint8_t value) {
+    _crc16 = (_crc16 << 8) ^ crc16Table[(_crc16 >> 8) ^ value];
+    _output[_outputFill++] = value;
+    _bytesWritten++;
+    if (_outputFill == sizeof(_output)) flushOutput();
+}
+
+void FlacEncoder::alignByte() {
+    if (_bitCount) put(0, 8 - _bitCount);
+}
+
+bool FlacEncoder::flushOutput() {
+    if (_outputFill && !_failed && !_sink(_output, _outputFill, _context)) _failed = true;
+    _outputFill = 0;
+    return !_failed;
+}
+
+// RFC 1321
+
+static const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+static const uint8_t MD5_SHIFT[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+void FlacEncoder::Md5::begin() {
+    state[0] = 0x67452301;
+    state[1] = 0xefcdab89;
+    state[2] = 0x98badcfe;
+    state[3] = 0x10325476;
+    length = 0;
+}
+
+void FlacEncoder::Md5::update(const uint8_t *data, size_t size) {
+    size_t used = length % 64;
+    length += size;
+    while (size) {
+        size_t chunk = 64 - used < size ? 64 - used : size;
+        memcpy(buffer + used, data, chunk);
+        used += chunk;
+        data += chunk;
+        size -= chunk;
+        if (used == 64) {
+            transform(buffer);
+            used = 0;
+        }
+    }
+}
+
+void FlacEncoder::Md5::finish(uint8_t digest[16]) {
+    uint64_t bits = length * 8;
+    uint8_t pad[72] = {0x80};
+    size_t used = length % 64;
+    size_t padLength = used < 56 ? 56 - used : 120 - used;
+    for (int i = 0; i < 8; i++) pad[padLength + i] = bits >> (8 * i);
+    update(pad, padLength + 8);
+    for (int i = 0; i < 16; i++) digest[i] = state[i / 4] >> (8 * (i % 4));
+}
+
+void FlacEncoder::Md5::transform(const uint8_t block[64]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = block[4 * i] | (block[4 * i + 1] << 8) | (block[4 * i + 2] << 16) | ((uint32_t)block[4 * i + 3] << 24);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        int s = MD5_SHIFT[(i / 16) * 4 + i % 4];
+        f += a + MD5_K[i] + m[g];
+        a = d;
+        d = c;
+        c = b;
+        b += (f << s) | (f >> (32 - s));
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming lossless encoder for 16-bit mono PCM, writing a standard FLAC
+// stream that stock decoders (flac, ffmpeg, browsers) play back bit-exact.
+//
+// Each 4096-sample frame is coded on its own with the cheapest of:
+//   CONSTANT  - every sample equal (silence)
+//   FIXED     - order 0..4 polynomial predictor, residual Rice-coded in
+//               2^p partitions, each with its own Rice parameter
+//   VERBATIM  - raw samples, when prediction does not pay
+// The predictor order is picked from the summed residual magnitudes and the
+// partition order and Rice parameters from a bit-count estimate that is
+// never below the real size, so a frame is never larger than VERBATIM.
+//
+// Frames go straight to the sink through a small staging buffer. The
+// STREAMINFO block at the start of the stream (total samples, frame sizes,
+// MD5 of the audio) is only known at the end: begin() emits a placeholder
+// and finish() returns the final block for the caller to write back at
+// offset 0, the same way the WAV header is patched. After a sink failure
+// the block still describes the frames written before it (with the MD5 left
+// zero), so a partial recording stays decodable.
+// Plain C++ (no Arduino headers) so it also builds on the host.
+
+class FlacEncoder {
+public:
+    static const uint32_t BLOCK_SIZE = 4096;
+    static const size_t HEADER_BYTES = 42;        // "fLaC" + STREAMINFO
+    static const int MAX_ORDER = 4;
+    static const int MAX_PARTITION_ORDER = 6;
+    static const int MAX_RICE_PARAMETER = 14;     // 15 is the escape code
+
+    // Returns false to abort (e.g. card full)
+    typedef bool (*Sink)(const uint8_t *data, size_t length, void *context);
+
+    bool begin(uint32_t sampleRate, Sink sink, void *context);
+    bool add(const int16_t *samples, size_t count);
+    // Encodes the partial last frame and fills in the final header; false if any write failed
+    bool finish(uint8_t header[HEADER_BYTES]);
+
+    uint64_t totalSamples() const { return _totalSamples; }
+    uint64_t bytesWritten() const { return _bytesWritten; }
+    uint32_t frames() const { return _frameNumber; }
+    // Frames per subframe type: CONSTANT, VERBATIM, FIXED order 0..4
+    const uint32_t *subframeCounts() const { return _subframeCounts; }
+
+private:
+    struct Md5 {
+        uint32_t state[4];
+        uint64_t length;
+        uint8_t buffer[64];
+        void begin();
+        void update(const uint8_t *data, size_t length);
+        void finish(uint8_t digest[16]);
+        void transform(const uint8_t block[64]);
+    };
+
+    bool encodeFrame();
+    void writeHeaderBlock(uint8_t header[HEADER_BYTES]);
+    int bestOrder(size_t count);
+    uint32_t residualBits(int order, size_t count, int &partitionOrder, uint8_t *parameters);
+    void writeResidual(int order, size_t count, int partitionOrder, const uint8_t *parameters);
+
+    // Bit writer over the staging buffer; keeps the frame CRC-16
+    void put(uint32_t value, int bits);
+    void putByte(uint8_t value);
+    void alignByte();
+    bool flushOutput();
+
+    Sink _sink;
+    void *_context;
+    uint32_t _sampleRate;
+    uint64_t _totalSamples;
+    uint64_t _bytesWritten;
+    uint32_t _frameNumber;
+    uint32_t _minFrameBytes;
+    uint32_t _maxFrameBytes;
+    uint32_t _subframeCounts[2 + MAX_ORDER + 1];
+    bool _failed;
+    Md5 _md5;
+    uint8_t _digest[16];
+
+    int16_t _block[BLOCK_SIZE];
+    size_t _blockFill;
+    int32_t _residual[BLOCK_SIZE];
+
+    uint64_t _bits;      // Pending bits, right-aligned
+    int _bitCount;
+    uint16_t _crc16;
+    uint8_t _output[512];
+    size_t _outputFill;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// PCM WAV header that grows into RF64 (EBU Tech 3306) past 4 GB.
+//
+// The header is written up front with a 28-byte JUNK chunk between "WAVE"
+// and "fmt ", and filled in once the data size is known. While every size
+// fits in 32 bits the result is a plain RIFF/WAVE file (readers skip JUNK).
+// Beyond that the same bytes are rewritten in place as RF64: the JUNK chunk
+// becomes "ds64" holding the 64-bit RIFF size, data size and sample count,
+// and the 32-bit fields are set to 0xFFFFFFFF. Only offset 0 is ever
+// rewritten, so the writer never has to seek past the first 4 GB.
+// Plain C++ (no Arduino headers) so it also builds on the host.
+//
+// Layout (little-endian):
+//   "RIFF"/"RF64" size "WAVE" | "JUNK"/"ds64" 28 | "fmt " 16 | "data" size | samples
+
+namespace wav {
+
+const size_t HEADER_BYTES = 80;
+const uint64_t MAX_RIFF_SIZE = 0xFFFFFFFF;
+
+inline void putLE(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+// True when `dataSize` bytes of samples need the RF64 form
+inline bool needsRf64(uint64_t dataSize) {
+    return dataSize + HEADER_BYTES - 8 > MAX_RIFF_SIZE;
+}
+
+// Fills the header for `dataSize` bytes of samples; call with 0 for the placeholder
+inline void fillHeader(uint8_t header[HEADER_BYTES], uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample,
+                       uint64_t dataSize) {
+    uint16_t blockAlign = channels * (bitsPerSample / 8);
+    uint64_t riffSize = dataSize + HEADER_BYTES - 8;
+    bool rf64 = needsRf64(dataSize);
+
+    memset(header, 0, HEADER_BYTES);
+    memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+    putLE(header + 4, rf64 ? MAX_RIFF_SIZE : riffSize, 4);
+    memcpy(header + 8, "WAVE", 4);
+
+    memcpy(header + 12, rf64 ? "ds64" : "JUNK", 4);
+    putLE(header + 16, 28, 4);
+    if (rf64) {
+        putLE(header + 20, riffSize, 8);
+        putLE(header + 28, dataSize, 8);
+        putLE(header + 36, dataSize / blockAlign, 8);  // Sample frames
+        putLE(header + 44, 0, 4);                      // No table of other 64-bit chunk sizes
+    }
+
+    memcpy(header + 48, "fmt ", 4);
+    putLE(header + 52, 16, 4);
+    putLE(header + 56, 1, 2);  // PCM
+    putLE(header + 58, channels, 2);
+    putLE(header + 60, sampleRate, 4);
+    putLE(header + 64, (uint64_t)sampleRate * blockAlign, 4);
+    putLE(header + 68, blockAlign, 2);
+    putLE(header + 70, bitsPerSample, 2);
+
+    memcpy(header + 72, "data", 4);
+    putLE(header + 76, rf64 ? MAX_RIFF_SIZE : dataSize, 4);
+}
+
+} // namespace wav
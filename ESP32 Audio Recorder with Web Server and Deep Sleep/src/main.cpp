@@ -6,17 +6,23 @@
 #include "driver/i2s.h"
 #include "esp_task_wdt.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_private/esp_clk.h"
+#include "freertos/stream_buffer.h"
+#include "FlacEncoder.h"
+#include "WavHeader.h"
+#include <WiFiSupervisor.h>
 
 // SD Card Configuration
 const int chipSelect = 5;
-String lastRecordedFile = "";  // Stores the most recent file name
+char lastRecordedFile[24] = "";  // Stores the most recent file name
 
 // Wi-Fi Configuration
 const char *ssid = "ESP32-WAV-AP";
 const char *password = "12345678";
 AsyncWebServer server(80);
 
-bool stopServer = false;
+volatile bool stopServer = false;
 bool sdInitialized = false;
 
 // I2S Configuration
@@ -30,6 +36,52 @@ const int bitsPerSample = 16;
 const int channelCount = 1;
 File wavFile;
 
+// Fast wake: capture starts first and fills a RAM buffer while the SD card mounts
+#define EARLY_BUFFER_SIZE (64 * 1024)  // ~740 ms of audio at 44.1 kHz mono 16-bit
+#define RECORD_SECONDS 60  // WAV files past 4 GB (~13.5 h here) are written as RF64
+StreamBufferHandle_t captureStream;
+volatile bool capturing = false;
+volatile uint32_t droppedBytes = 0;  // Lost when the RAM buffer was full
+
+// Lossless compression: FLAC decodes bit-exact to the same PCM, typically in 35-65% of the space
+#define RECORD_FLAC 1
+#if RECORD_FLAC
+#define RECORD_EXTENSION ".flac"
+#define RECORD_MIME "audio/flac"
+FlacEncoder flacEncoder;       // ~25 KB of frame state, kept off the loop task stack
+uint32_t flacWriteMicros = 0;  // Time spent in SD writes from the encoder
+
+// Encoded frames go straight to the open file
+bool writeFlacToFile(const uint8_t *data, size_t length, void *context) {
+    uint32_t started = micros();
+    bool written = ((File *)context)->write(data, length) == length;
+    flacWriteMicros += micros() - started;
+    return written;
+}
+#else
+#define RECORD_EXTENSION ".wav"
+#define RECORD_MIME "audio/wav"
+#endif
+
+// Boot phase timestamps in microseconds since app start
+struct BootTiming {
+    uint32_t cycle;
+    int32_t wakeOverhead;    // Timer wake -> app start (ROM + bootloader), -1 if not a timer wake
+    uint32_t i2sStarted;
+    uint32_t firstSample;
+    uint32_t storageMounted;
+    uint32_t fileOpened;
+    uint32_t recordingDone;
+    uint32_t serverStarted;
+};
+BootTiming bootTiming;
+
+// Kept across deep sleep
+RTC_DATA_ATTR BootTiming lastBoot;
+RTC_DATA_ATTR uint64_t sleepStartRtc = 0;   // RTC clock when the last sleep began
+RTC_DATA_ATTR uint64_t sleepDurationUs = 0;
+RTC_DATA_ATTR int nextFileNumber = 0;       // 0 = unknown, search the card
+
 // Convert seconds to microseconds for deep sleep time (54 minutes)
 uint64_t sleep_time_us = 10ULL * 60 * 1000000;
 
@@ -40,7 +92,9 @@ unsigned long serverStartTime;
 void enterDeepSleep() {
     Serial.println("Entering deep sleep for 20 seconds...");
     delay(100);
-    esp_sleep_enable_timer_wakeup(20 * 1000000);
+    sleepDurationUs = 20 * 1000000;
+    sleepStartRtc = esp_clk_rtc_time();
+    esp_sleep_enable_timer_wakeup(sleepDurationUs);
     esp_deep_sleep_start();
 }
 void i2sConfig() {
@@ -51,8 +105,8 @@ void i2sConfig() {
         .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
         .communication_format = I2S_COMM_FORMAT_STAND_I2S,
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = 1024
+        .dma_buf_count = 32,
+        .dma_buf_len = 256  // Short DMA buffers: the first block is ready ~6 ms after start
     };
     i2s_driver_install(I2S_NUM, &i2s_config, 0, NULL);
     i2s_pin_config_t pin_config = {
@@ -65,13 +119,15 @@ void i2sConfig() {
 }
 
 void recordWavFile() {
-    // Generate a unique filename
-    int fileNumber = 1;
-    String fileName;
-    do {
-        fileName = "/record_" + String(fileNumber) + ".wav";
+    // Generate a unique filename; the number from the last cycle is checked once
+    int fileNumber = nextFileNumber > 0 ? nextFileNumber : 1;
+    char fileName[24];
+    snprintf(fileName, sizeof(fileName), "/record_%d" RECORD_EXTENSION, fileNumber);
+    if (nextFileNumber > 0 && SD.exists(fileName)) fileNumber = 1;  // Card was changed
+    while (SD.exists(fileName)) { // Keep checking until we find an unused filename
         fileNumber++;
-    } while (SD.exists(fileName)); // Keep checking until we find an unused filename
+        snprintf(fileName, sizeof(fileName), "/record_%d" RECORD_EXTENSION, fileNumber);
+    }
 
     // Open the new file
     wavFile = SD.open(fileName, FILE_WRITE);
@@ -79,61 +135,138 @@ void recordWavFile() {
         Serial.println("Failed to create WAV file");
         enterDeepSleep();
     }
-
-    uint8_t wavHeader[44] = {0};
-    wavFile.write(wavHeader, 44);  // Reserve space for the WAV header
-
-    uint8_t buffer[chunkSize];
-    size_t bytesRead, totalDataSize = 0;
-    unsigned long recordStart = millis();
-    unsigned long recordDuration = 1 * 60 * 1000;  // 1 minute
-
-    Serial.println("Recording audio...");
-    while ((millis() - recordStart) < recordDuration) {
+    bootTiming.fileOpened = esp_timer_get_time();
+
+#if RECORD_FLAC
+    flacEncoder.begin(sampleRate, writeFlacToFile, &wavFile);  // Writes a placeholder header
+    flacWriteMicros = 0;
+    uint32_t flacMicros = 0;
+#else
+    // Reserve the header, with room for the RF64 ds64 chunk
+    uint8_t wavHeader[wav::HEADER_BYTES];
+    wav::fillHeader(wavHeader, sampleRate, channelCount, bitsPerSample, 0);
+    wavFile.write(wavHeader, sizeof(wavHeader));
+#endif
+
+    // Duration by sample count; the buffered audio from before the mount comes first
+    static int16_t buffer[2048];
+    const uint64_t recordBytes = (uint64_t)RECORD_SECONDS * sampleRate * channelCount * (bitsPerSample / 8);
+    uint64_t totalDataSize = 0;
+    size_t bytesRead;
+
+    Serial.printf("Recording audio... (%u bytes already buffered)\n", xStreamBufferBytesAvailable(captureStream));
+    while (totalDataSize < recordBytes) {
         esp_task_wdt_reset();  // Reset watchdog timer periodically
 
-        esp_err_t result = i2s_read(I2S_NUM, buffer, chunkSize, &bytesRead, portMAX_DELAY);
-        if (result != ESP_OK || bytesRead == 0) {
+        size_t request = recordBytes - totalDataSize < sizeof(buffer) ? recordBytes - totalDataSize : sizeof(buffer);
+        bytesRead = xStreamBufferReceive(captureStream, buffer, request, pdMS_TO_TICKS(1000));
+        if (bytesRead == 0) {
             Serial.println("Error reading from I2S");
             enterDeepSleep();
         }
-        wavFile.write(buffer, bytesRead);
+#if RECORD_FLAC
+        uint32_t started = micros();
+        bool written = flacEncoder.add(buffer, bytesRead / 2);
+        flacMicros += micros() - started;
+        if (!written) {
+            // Keep the frames already written: finish() below describes just those
+            Serial.println("SD write failed (card full or file size limit), closing the recording");
+            break;
+        }
+#else
+        if (wavFile.write((const uint8_t *)buffer, bytesRead) != bytesRead) {
+            // Keep what was written: the header below still matches it
+            Serial.println("SD write failed (card full or file size limit), closing the recording");
+            break;
+        }
+#endif
         totalDataSize += bytesRead;
     }
+    capturing = false;  // Capture task exits after its current read
+    bootTiming.recordingDone = esp_timer_get_time();
     Serial.println("Recording complete");
-
-    // Write WAV header
+    if (droppedBytes) Serial.printf("RAM buffer overflowed while mounting: %u bytes lost\n", droppedBytes);
+
+#if RECORD_FLAC
+    // Rewrite the header now that the totals and the MD5 are known
+    uint8_t flacHeader[FlacEncoder::HEADER_BYTES];
+    uint32_t started = micros();
+    bool encoded = flacEncoder.finish(flacHeader);
+    flacMicros += micros() - started;
+    wavFile.seek(0);
+    wavFile.write(flacHeader, sizeof(flacHeader));
+    wavFile.close();
+    uint64_t fileSize = flacEncoder.bytesWritten();
+    uint32_t encodeMicros = flacMicros - flacWriteMicros;
+    Serial.printf("FLAC file saved: %s (%llu bytes, %.1f%% of %llu PCM bytes)%s\n", fileName, fileSize,
+                  100.0f * fileSize / totalDataSize, totalDataSize, encoded ? "" : ", WRITE FAILED");
+    Serial.printf("Encoding: %u ms CPU for %d s of audio (%.2f%% of one core), SD writes %u ms\n",
+                  encodeMicros / 1000, RECORD_SECONDS, encodeMicros / (RECORD_SECONDS * 1e4f), flacWriteMicros / 1000);
+#else
+    // Final header: plain WAV, or RF64 if the data passed 4 GB
+    wav::fillHeader(wavHeader, sampleRate, channelCount, bitsPerSample, totalDataSize);
     wavFile.seek(0);
-    uint32_t dataSize = totalDataSize;
-    uint32_t fileSize = dataSize + 36;
-    memcpy(wavHeader, "RIFF", 4);
-    memcpy(wavHeader + 4, &fileSize, 4);
-    memcpy(wavHeader + 8, "WAVEfmt ", 8);
-    uint32_t subchunk1Size = 16;
-    memcpy(wavHeader + 16, &subchunk1Size, 4);
-    uint16_t audioFormat = 1;
-    memcpy(wavHeader + 20, &audioFormat, 2);
-    memcpy(wavHeader + 22, &channelCount, 2);
-    memcpy(wavHeader + 24, &sampleRate, 4);
-    uint32_t byteRate = sampleRate * channelCount * (bitsPerSample / 8);
-    memcpy(wavHeader + 28, &byteRate, 4);
-    uint16_t blockAlign = channelCount * (bitsPerSample / 8);
-    memcpy(wavHeader + 32, &blockAlign, 2);
-    memcpy(wavHeader + 34, &bitsPerSample, 2);
-    memcpy(wavHeader + 36, "data", 4);
-    memcpy(wavHeader + 40, &dataSize, 4);
-
-    wavFile.write(wavHeader, 44);
+    wavFile.write(wavHeader, sizeof(wavHeader));
     wavFile.close();
-    Serial.printf("WAV file saved: %s (%u bytes)\n", fileName.c_str(), totalDataSize + 44);
+    Serial.printf("%s file saved: %s (%llu bytes)\n", wav::needsRf64(totalDataSize) ? "RF64" : "WAV", fileName,
+                  totalDataSize + wav::HEADER_BYTES);
+#endif
 
     // Store the last recorded file name
-    lastRecordedFile = fileName;
-    Serial.printf("Last recorded file: %s\n", lastRecordedFile.c_str());
+    strcpy(lastRecordedFile, fileName);
+    nextFileNumber = fileNumber + 1;
+    Serial.printf("Last recorded file: %s\n", lastRecordedFile);
+}
+
+// Reads I2S into the RAM stream buffer from the first moment after wake
+void captureTask(void *parameter) {
+    static uint8_t buffer[1024];
+    size_t bytesRead;
+    while (capturing) {
+        esp_err_t result = i2s_read(I2S_NUM, buffer, sizeof(buffer), &bytesRead, portMAX_DELAY);
+        if (result != ESP_OK || bytesRead == 0) {
+            Serial.println("Error reading from I2S");
+            enterDeepSleep();
+        }
+        if (!bootTiming.firstSample) bootTiming.firstSample = esp_timer_get_time();
+        droppedBytes += bytesRead - xStreamBufferSend(captureStream, buffer, bytesRead, 0);
+    }
+    vTaskDelete(NULL);
+}
+
+void reportBootTiming(const char *label, const BootTiming &t) {
+    Serial.printf("%s (cycle %u): wake overhead %d us, I2S started %u us, first sample %u us, "
+                  "SD mounted %u us, file opened %u us, recording done %u ms, server up %u ms\n",
+                  label, t.cycle, t.wakeOverhead, t.i2sStarted, t.firstSample,
+                  t.storageMounted, t.fileOpened, t.recordingDone / 1000, t.serverStarted / 1000);
+}
+
+unsigned long confirmTime = 0;  // When /confirm came, for the confirm-to-sleep latency
+
+void startAccessPoint() {
+    WiFi.softAP(ssid, password,6);
+    WiFi.softAPConfig(IPAddress(192,168,4,1), IPAddress(192,168,4,1), IPAddress(255,255,255,0));
 }
 
+// AP restarts and Wi-Fi counters (lib/WiFiSupervisor)
+WiFiSupervisor wifiSupervisor(startAccessPoint, stopServer);
+
 void setup() {
+    // Capture first: everything below runs while audio is already buffering
+    captureStream = xStreamBufferCreate(EARLY_BUFFER_SIZE, 1);
+    i2sConfig();
+    capturing = true;
+    xTaskCreatePinnedToCore(captureTask, "capture", 4096, NULL, 5, NULL, 1);
+    bootTiming.i2sStarted = esp_timer_get_time();
+
+    bootTiming.cycle = lastBoot.cycle + 1;
+    bootTiming.wakeOverhead = -1;
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && sleepStartRtc) {
+        bootTiming.wakeOverhead = (int32_t)(esp_clk_rtc_time() - sleepStartRtc - sleepDurationUs - esp_timer_get_time());
+    }
+
     Serial.begin(115200);
+    if (lastBoot.cycle) reportBootTiming("Previous boot", lastBoot);
 
      // Increase the watchdog timeout to 1200 seconds/20 min
      esp_task_wdt_init(1200, true);
@@ -147,7 +280,7 @@ void setup() {
         }
         Serial.println("Retrying SD initialization...");
         SD.end();  // Reset SD interface
-        delay(500);
+        delay(100);  // Short: the RAM buffer only covers ~740 ms
     }
     
     // If SD initialization failed after 3 attempts, go to deep sleep
@@ -155,11 +288,10 @@ void setup() {
         Serial.println("Failed to initialize SD card. Entering deep sleep...");
         enterDeepSleep();
     }
-    i2sConfig();
+    bootTiming.storageMounted = esp_timer_get_time();
     recordWavFile();
 
-    WiFi.softAP(ssid, password,6);
-    WiFi.softAPConfig(IPAddress(192,168,4,1), IPAddress(192,168,4,1), IPAddress(255,255,255,0));
+    wifiSupervisor.begin();
     Serial.println("Wi-Fi AP started");
     Serial.print("IP address: ");
     Serial.println(WiFi.softAPIP());
@@ -178,16 +310,16 @@ void setup() {
             enterDeepSleep();
         }
 
+        unsigned long lastChunk = millis();
         AsyncWebServerResponse *response = request->beginChunkedResponse(
-            "audio/wav",
-            [file](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
-                size_t bytesToRead = file.available() ? min(maxLen, static_cast<size_t>(file.available())) : 0;
-                if (bytesToRead) {
-                    file.read(buffer, bytesToRead);
-                } else {
-                    file.close();
-                }
-                return bytesToRead;
+            RECORD_MIME,
+            [file, lastChunk](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+                wifiSupervisor.chunkSent(millis() - lastChunk);
+                lastChunk = millis();
+                // Read to end of file rather than trusting available(), which is a 32-bit int
+                size_t bytesRead = file.read(buffer, maxLen);
+                if (!bytesRead) file.close();
+                return bytesRead;
             });
 
         response->addHeader("Connection", "close");
@@ -195,6 +327,7 @@ void setup() {
     });
 
     server.on("/confirm", HTTP_GET, [](AsyncWebServerRequest *request) {
+        confirmTime = millis();
         Serial.println("Received confirmation from client. Stopping server...");
         stopServer = true;
         request->send(200, "text/plain", "Server shutting down");
@@ -202,6 +335,9 @@ void setup() {
 
     server.begin();
     Serial.println("Server started");
+    bootTiming.serverStarted = esp_timer_get_time();
+    reportBootTiming("Boot timing", bootTiming);
+    lastBoot = bootTiming;
 
     serverStartTime = millis();
 }
@@ -209,7 +345,7 @@ void setup() {
 void loop() {
 
     esp_task_wdt_reset();  // Prevent watchdog reset
-    delay(1000);  // Wait 1 second before checking again
+    delay(10);  // Yield; Wi-Fi and shutdown are event driven
 
     // Check if 3 minutes have passed without receiving confirmation
     if (millis() - serverStartTime >= CONFIRMATION_TIMEOUT) {
@@ -217,17 +353,11 @@ void loop() {
         stopServer = true;
     }
 
-    // Monitor the Wi-Fi connection status
-    if (WiFi.status() != WL_CONNECTED) {
-        //Serial.println("Wi-Fi not connected. Trying to reconnect...");
-        WiFi.softAP(ssid, password,6);  // Reinitialize AP mode
-        WiFi.softAPConfig(IPAddress(192,168,4,1), IPAddress(192,168,4,1), IPAddress(255,255,255,0));
-        delay(5000);  // Wait for the connection
-    }
+    wifiSupervisor.poll();
 
     if (stopServer) {
         Serial.println("Shutting down server...");
-        delay(1000);  // Wait a moment before shutting down
+        delay(100);  // Let the /confirm response go out
         server.end();
         WiFi.softAPdisconnect(true);
         WiFi.disconnect(true);
@@ -238,8 +368,13 @@ void loop() {
             Serial.println("AP is down");
         }
         Serial.println("Server stopped. Entering deep sleep...");
+        wifiSupervisor.printReport(Serial);
+        if (confirmTime) Serial.printf("Confirm-to-sleep latency: %lu ms\n", millis() - confirmTime);
+        Serial.flush();
 
         // Set deep sleep time
+       sleepDurationUs = sleep_time_us;
+       sleepStartRtc = esp_clk_rtc_time();
        esp_sleep_enable_timer_wakeup(sleep_time_us);
 
         // Deep Sleep (Wake-up only on power reset)
@@ -0,0 +1,42 @@
+#include "CtrCipher.h"
+
+#include <string.h>
+
+static void counterBlock(const uint8_t nonce[CtrCipher::NONCE_BYTES], uint64_t index, uint8_t block[16]) {
+    memcpy(block, nonce, CtrCipher::NONCE_BYTES);
+    for (int i = 15; i >= 8; i--) {
+        block[i] = (uint8_t)index;
+        index >>= 8;
+    }
+}
+
+CtrCipher::CtrCipher() : _keyCheck(0) {
+    mbedtls_aes_init(&_aes);
+}
+
+CtrCipher::~CtrCipher() {
+    mbedtls_aes_free(&_aes);
+}
+
+bool CtrCipher::setKey(const uint8_t key[KEY_BYTES]) {
+    if (mbedtls_aes_setkey_enc(&_aes, key, KEY_BYTES * 8) != 0) return false;
+    uint8_t zero[16] = {0}, check[16];
+    mbedtls_aes_crypt_ecb(&_aes, MBEDTLS_AES_ENCRYPT, zero, check);
+    memcpy(&_keyCheck, check, sizeof(_keyCheck));
+    return true;
+}
+
+void CtrCipher::apply(const uint8_t nonce[NONCE_BYTES], uint64_t offset, uint8_t *data, size_t length) {
+    if (!length) return;
+    uint8_t counter[16], stream[16];
+    size_t streamOffset = offset % 16;
+    counterBlock(nonce, offset / 16, counter);
+    if (streamOffset) {
+        // Starting mid-block: mbedTLS continues from a keystream block it
+        // already has, so produce that one and step the counter past it
+        mbedtls_aes_crypt_ecb(&_aes, MBEDTLS_AES_ENCRYPT, counter, stream);
+        counterBlock(nonce, offset / 16 + 1, counter);
+    }
+    // One call per chunk: the whole chunk goes to the peripheral in one go
+    mbedtls_aes_crypt_ctr(&_aes, length, &streamOffset, counter, stream, data, data);
+}
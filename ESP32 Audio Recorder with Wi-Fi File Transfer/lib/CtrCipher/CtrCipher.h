@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mbedtls/aes.h"
+
+// AES-256-CTR with random access into the keystream.
+//
+// The counter block of a stream is its 8-byte nonce followed by the 64-bit
+// big-endian index of the 16-byte block, so byte N of a stream is always
+// XORed with the same keystream byte no matter where a call starts. That
+// makes a chunk of any length at any offset encryptable on its own (capture
+// blocks, split at segment boundaries) and decryptable on its own (HTTP
+// range requests).
+//
+// Built on the mbedTLS AES API: on the ESP32 (CONFIG_MBEDTLS_HARDWARE_AES,
+// on in the Arduino core) those calls run on the AES peripheral; on the host
+// they are plain mbedTLS, which the native bench uses as the reference.
+// After setKey() the context is only read, so one instance can be shared by
+// the writer task and the web server.
+
+class CtrCipher {
+public:
+    static const size_t KEY_BYTES = 32;
+    static const size_t NONCE_BYTES = 8;
+
+    CtrCipher();
+    ~CtrCipher();
+
+    bool setKey(const uint8_t key[KEY_BYTES]);
+
+    // First 4 bytes of the all-zero block encrypted, stored with each file
+    // to tell which key it needs without revealing the key
+    uint32_t keyCheck() const { return _keyCheck; }
+
+    // Encrypts or decrypts (the same operation) `length` bytes in place,
+    // where `offset` is the position of data[0] in the stream
+    void apply(const uint8_t nonce[NONCE_BYTES], uint64_t offset, uint8_t *data, size_t length);
+
+private:
+    mbedtls_aes_context _aes;
+    uint32_t _keyCheck;
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Min/max/RMS pyramid built while recording, so a waveform can be drawn
+// without reading the audio. Each level summarises a fixed number of samples
+// per entry. The finest level is streamed to a sink as it fills; the coarser
+// levels are small and stay in RAM until the recording is closed.
+// Plain C++ (no Arduino headers) so it also builds on the host.
+//
+// Overview file layout (little-endian):
+//   Header | level 0 entries | level 1 entries | level 2 entries
+
+namespace overview {
+
+const int LEVELS = 3;
+const uint32_t SAMPLES_PER_ENTRY[LEVELS] = {256, 4096, 65536};
+
+struct __attribute__((packed)) Entry {
+    int16_t min;
+    int16_t max;
+    uint16_t rms;
+};
+
+struct __attribute__((packed)) LevelInfo {
+    uint32_t samplesPerEntry;
+    uint32_t entryCount;
+    uint32_t offset;  // Byte offset of the first entry in the overview file
+};
+
+struct __attribute__((packed)) Header {
+    char magic[4];        // "OVW1"
+    uint32_t sampleRate;
+    uint32_t totalSamples;
+    uint32_t clipCount;   // Samples at 16-bit full scale
+    uint16_t peak;        // Largest |sample|
+    uint16_t levelCount;
+    LevelInfo levels[LEVELS];
+};
+
+struct Accumulator {
+    int16_t min;
+    int16_t max;
+    uint64_t sumSquares;
+    uint32_t count;
+
+    void reset() {
+        min = 32767;
+        max = -32768;
+        sumSquares = 0;
+        count = 0;
+    }
+
+    void merge(const Accumulator &other) {
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+        sumSquares += other.sumSquares;
+        count += other.count;
+    }
+
+    Entry entry() const {
+        Entry e;
+        e.min = min;
+        e.max = max;
+        e.rms = count ? (uint16_t)sqrtf((float)sumSquares / count) : 0;
+        return e;
+    }
+};
+
+// MaxCoarse bounds the RAM kept for levels 1 and 2 (entries per level)
+template <size_t MaxCoarse>
+class Builder {
+public:
+    typedef void (*Sink)(const Entry *entries, size_t count, void *context);
+
+    void begin(uint32_t sampleRate, Sink sink, void *context) {
+        _sampleRate = sampleRate;
+        _sink = sink;
+        _context = context;
+        _totalSamples = 0;
+        _clipCount = 0;
+        _peak = 0;
+        _fineCount = 0;
+        _pending = 0;
+        for (int l = 0; l < LEVELS; l++) _acc[l].reset();
+        for (int l = 0; l < LEVELS - 1; l++) _coarseCount[l] = 0;
+    }
+
+    void add(const int16_t *samples, size_t count) {
+        Accumulator &acc = _acc[0];
+        for (size_t i = 0; i < count; i++) {
+            int16_t s = samples[i];
+            if (s < acc.min) acc.min = s;
+            if (s > acc.max) acc.max = s;
+            acc.sumSquares += (uint32_t)((int32_t)s * s);
+            uint16_t magnitude = s < 0 ? (uint16_t)(-(int32_t)s) : (uint16_t)s;
+            if (magnitude > _peak) _peak = magnitude;
+            if (magnitude >= 32767) _clipCount++;
+            if (++acc.count == SAMPLES_PER_ENTRY[0]) closeEntry(0);
+        }
+        _totalSamples += count;
+    }
+
+    // Flush partial entries and the streamed level, then fill in the header
+    void finish(Header &header, uint32_t firstOffset) {
+        for (int l = 0; l < LEVELS; l++) {
+            if (_acc[l].count) closeEntry(l);
+        }
+        flush();
+
+        header.magic[0] = 'O';
+        header.magic[1] = 'V';
+        header.magic[2] = 'W';
+        header.magic[3] = '1';
+        header.sampleRate = _sampleRate;
+        header.totalSamples = _totalSamples;
+        header.clipCount = _clipCount;
+        header.peak = _peak;
+        header.levelCount = LEVELS;
+        uint32_t offset = firstOffset;
+        for (int l = 0; l < LEVELS; l++) {
+            header.levels[l].samplesPerEntry = SAMPLES_PER_ENTRY[l];
+            header.levels[l].entryCount = l == 0 ? _fineCount : _coarseCount[l - 1];
+            header.levels[l].offset = offset;
+            offset += header.levels[l].entryCount * sizeof(Entry);
+        }
+    }
+
+    const Entry *coarse(int level) const { return _coarse[level - 1]; }
+    size_t coarseCount(int level) const { return _coarseCount[level - 1]; }
+    uint32_t clipCount() const { return _clipCount; }
+    uint16_t peak() const { return _peak; }
+
+private:
+    static const size_t PENDING = 64;  // Level 0 entries per sink call
+
+    void closeEntry(int level) {
+        Accumulator &acc = _acc[level];
+        if (level == 0) {
+            _fine[_pending++] = acc.entry();
+            _fineCount++;
+            if (_pending == PENDING) flush();
+        } else if (_coarseCount[level - 1] < MaxCoarse) {
+            _coarse[level - 1][_coarseCount[level - 1]++] = acc.entry();
+        }
+        if (level + 1 < LEVELS) {
+            Accumulator &parent = _acc[level + 1];
+            parent.merge(acc);
+            if (parent.count >= SAMPLES_PER_ENTRY[level + 1]) closeEntry(level + 1);
+        }
+        acc.reset();
+    }
+
+    void flush() {
+        if (_pending && _sink) _sink(_fine, _pending, _context);
+        _pending = 0;
+    }
+
+    uint32_t _sampleRate;
+    Sink _sink;
+    void *_context;
+    uint32_t _totalSamples;
+    uint32_t _clipCount;
+    uint16_t _peak;
+    uint32_t _fineCount;
+    size_t _pending;
+    Accumulator _acc[LEVELS];
+    Entry _fine[PENDING];
+    Entry _coarse[LEVELS - 1][MaxCoarse];
+    size_t _coarseCount[LEVELS - 1];
+};
+
+} // namespace overview
@@ -0,0 +1,226 @@
+#include "RtpAudio.h"
+
+#include <string.h>
+
+namespace rtp {
+
+static const int16_t STEP_SIZES[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t INDEX_STEPS[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+static void putBE16(uint8_t *at, uint16_t value) {
+    at[0] = value >> 8;
+    at[1] = value;
+}
+
+static void putBE32(uint8_t *at, uint32_t value) {
+    putBE16(at, value >> 16);
+    putBE16(at + 2, value);
+}
+
+static uint16_t getBE16(const uint8_t *at) { return (uint16_t)(at[0] << 8 | at[1]); }
+
+static uint32_t getBE32(const uint8_t *at) { return (uint32_t)getBE16(at) << 16 | getBE16(at + 2); }
+
+// Applies one 4-bit code to the state and returns the new sample
+static int16_t adpcmStep(AdpcmState &state, uint8_t code) {
+    int32_t step = STEP_SIZES[state.index];
+    int32_t delta = step >> 3;
+    if (code & 4) delta += step;
+    if (code & 2) delta += step >> 1;
+    if (code & 1) delta += step >> 2;
+    int32_t predicted = state.predicted + (code & 8 ? -delta : delta);
+    if (predicted > 32767) predicted = 32767;
+    if (predicted < -32768) predicted = -32768;
+    int index = state.index + INDEX_STEPS[code & 7];
+    state.index = index < 0 ? 0 : index > 88 ? 88 : index;
+    state.predicted = predicted;
+    return predicted;
+}
+
+static uint8_t adpcmCode(AdpcmState &state, int16_t sample) {
+    int32_t step = STEP_SIZES[state.index];
+    int32_t difference = sample - state.predicted;
+    uint8_t code = 0;
+    if (difference < 0) {
+        code = 8;
+        difference = -difference;
+    }
+    if (difference >= step) {
+        code |= 4;
+        difference -= step;
+    }
+    if (difference >= step >> 1) {
+        code |= 2;
+        difference -= step >> 1;
+    }
+    if (difference >= step >> 2) code |= 1;
+    adpcmStep(state, code);  // Track what the decoder will reconstruct
+    return code;
+}
+
+void adpcmEncode(AdpcmState &state, const int16_t *samples, size_t count, uint8_t *out) {
+    for (size_t i = 0; i < count; i += 2) {
+        uint8_t high = adpcmCode(state, samples[i]);
+        uint8_t low = i + 1 < count ? adpcmCode(state, samples[i + 1]) : 0;
+        out[i / 2] = high << 4 | low;
+    }
+}
+
+void adpcmDecode(AdpcmState &state, const uint8_t *in, size_t count, int16_t *samples) {
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = adpcmStep(state, i & 1 ? in[i / 2] & 0x0F : in[i / 2] >> 4);
+    }
+}
+
+bool Packetizer::begin(Encoding encoding, uint32_t sampleRate, size_t samplesPerPacket, uint32_t ssrc,
+                       uint16_t sequence, uint32_t timestamp, Sink sink, void *context) {
+    samplesPerPacket = (samplesPerPacket + 1) & ~(size_t)1;
+    if (samplesPerPacket == 0 || samplesPerPacket > MAX_PACKET_SAMPLES) return false;
+    _encoding = encoding;
+    _sampleRate = sampleRate;
+    _samplesPerPacket = samplesPerPacket;
+    _payloadType = rtp::payloadType(encoding, sampleRate);
+    _ssrc = ssrc;
+    _sequence = sequence;
+    _timestamp = timestamp;
+    _marker = true;  // First packet of the stream
+    _sink = sink;
+    _context = context;
+    _adpcm.predicted = 0;
+    _adpcm.index = 0;
+    _pendingCount = 0;
+    _packets = 0;
+    return true;
+}
+
+void Packetizer::push(const int16_t *samples, size_t count, int64_t endMicros) {
+    for (size_t i = 0; i < count;) {
+        if (_pendingCount == 0) {
+            _firstMicros = endMicros - (int64_t)(count - 1 - i) * 1000000 / _sampleRate;
+        }
+        size_t length = _samplesPerPacket - _pendingCount;
+        if (length > count - i) length = count - i;
+        memcpy(_pending + _pendingCount, samples + i, length * sizeof(int16_t));
+        _pendingCount += length;
+        i += length;
+        if (_pendingCount == _samplesPerPacket) emit();
+    }
+}
+
+void Packetizer::skip(uint32_t samples) {
+    if (_pendingCount) emit();
+    _timestamp += samples;
+    _marker = true;
+}
+
+void Packetizer::emit() {
+    uint8_t *at = _packet;
+    at[0] = 0x90;  // Version 2, extension present
+    at[1] = (_marker ? 0x80 : 0) | _payloadType;
+    putBE16(at + 2, _sequence);
+    putBE32(at + 4, _timestamp);
+    putBE32(at + 8, _ssrc);
+    at += HEADER_SIZE;
+
+    memset(at, 0, EXTENSION_SIZE);
+    at[0] = 0xBE;
+    at[1] = 0xDE;
+    putBE16(at + 2, (EXTENSION_SIZE - 4) / 4);
+    at[4] = CAPTURE_TIME_ID << 4 | 7;  // 8 bytes of data
+    putBE32(at + 5, (uint32_t)((uint64_t)_firstMicros >> 32));
+    putBE32(at + 9, (uint32_t)_firstMicros);
+    at += EXTENSION_SIZE;
+
+    if (_encoding == L16) {
+        for (size_t i = 0; i < _pendingCount; i++) putBE16(at + 2 * i, (uint16_t)_pending[i]);
+        at += 2 * _pendingCount;
+    } else {
+        putBE16(at, (uint16_t)_adpcm.predicted);
+        at[2] = _adpcm.index;
+        at[3] = 0;
+        adpcmEncode(_adpcm, _pending, _pendingCount, at + DVI4_STATE_SIZE);
+        at += DVI4_STATE_SIZE + (_pendingCount + 1) / 2;
+    }
+
+    if (_sink) _sink(_packet, at - _packet, _context);
+    _sequence++;
+    _timestamp += _pendingCount;
+    _marker = false;
+    _pendingCount = 0;
+    _packets++;
+}
+
+bool parse(const uint8_t *data, size_t length, Packet &packet) {
+    if (length < HEADER_SIZE || (data[0] >> 6) != 2) return false;
+    size_t offset = HEADER_SIZE + 4 * (data[0] & 0x0F);  // Skip CSRCs
+    if (offset > length) return false;
+    packet.marker = data[1] & 0x80;
+    packet.payloadType = data[1] & 0x7F;
+    packet.sequence = getBE16(data + 2);
+    packet.timestamp = getBE32(data + 4);
+    packet.ssrc = getBE32(data + 8);
+    packet.hasCaptureMicros = false;
+
+    if (data[0] & 0x10) {
+        if (offset + 4 > length) return false;
+        const uint8_t *extension = data + offset;
+        size_t extensionLength = 4 + 4 * getBE16(extension + 2);
+        if (offset + extensionLength > length) return false;
+        if (extension[0] == 0xBE && extension[1] == 0xDE) {
+            // One-byte elements: ID (4 bits), length - 1 (4 bits), data
+            for (size_t i = 4; i < extensionLength;) {
+                uint8_t id = extension[i] >> 4;
+                size_t elementLength = (extension[i] & 0x0F) + 1;
+                if (extension[i] == 0) {
+                    i++;  // Padding
+                    continue;
+                }
+                if (id == 15 || i + 1 + elementLength > extensionLength) break;
+                if (id == CAPTURE_TIME_ID && elementLength == 8) {
+                    packet.captureMicros = (int64_t)((uint64_t)getBE32(extension + i + 1) << 32 |
+                                                     getBE32(extension + i + 5));
+                    packet.hasCaptureMicros = true;
+                }
+                i += 1 + elementLength;
+            }
+        }
+        offset += extensionLength;
+    }
+
+    if (data[0] & 0x20) {
+        uint8_t padding = data[length - 1];
+        if (padding == 0 || offset + padding > length) return false;
+        length -= padding;
+    }
+    packet.payload = data + offset;
+    packet.payloadLength = length - offset;
+    return true;
+}
+
+size_t sampleCount(const Packet &packet, Encoding encoding) {
+    if (encoding == L16) return packet.payloadLength / 2;
+    return packet.payloadLength > DVI4_STATE_SIZE ? (packet.payloadLength - DVI4_STATE_SIZE) * 2 : 0;
+}
+
+size_t decode(const Packet &packet, Encoding encoding, int16_t *samples, size_t maxSamples) {
+    size_t count = sampleCount(packet, encoding);
+    if (count > maxSamples) count = maxSamples;
+    if (encoding == L16) {
+        for (size_t i = 0; i < count; i++) samples[i] = (int16_t)getBE16(packet.payload + 2 * i);
+    } else if (count) {
+        AdpcmState state;
+        state.predicted = (int16_t)getBE16(packet.payload);
+        state.index = packet.payload[2] > 88 ? 88 : packet.payload[2];
+        adpcmDecode(state, packet.payload + DVI4_STATE_SIZE, count, samples);
+    }
+    return count;
+}
+
+} // namespace rtp
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// RTP (RFC 3550) packetizer and parser for live mono audio.
+//
+// Payloads are L16 (big-endian 16-bit PCM, static PT 11 at 44.1 kHz mono)
+// or DVI4 (IMA ADPCM, RFC 3551 4.5.1, 4:1) on dynamic PT 96. Every packet
+// carries a one-byte header extension (RFC 8285) with the sender's uptime
+// in microseconds when the first sample of the packet was captured, so a
+// receiver whose clock offset is known (ClockProbe) can measure the
+// latency from capture to arrival.
+//
+// Sequence numbers count packets, with no gaps on the sender side: a gap
+// at the receiver is network loss. Timestamps count samples, including
+// samples the capture lost: a timestamp jump with a contiguous sequence
+// number is a capture gap, and that packet has the marker bit set.
+// Plain C++ so the recorder and the host receiver share it.
+
+namespace rtp {
+
+enum Encoding { L16, DVI4 };
+
+const uint8_t PT_L16_44100_MONO = 11;
+const uint8_t PT_DYNAMIC = 96;
+const size_t HEADER_SIZE = 12;
+const size_t EXTENSION_SIZE = 16;       // 0xBEDE profile, one 8-byte element, padding
+const uint8_t CAPTURE_TIME_ID = 1;      // Extension element ID of the capture time
+const size_t DVI4_STATE_SIZE = 4;       // Predicted value, step index, reserved
+const size_t MAX_PACKET_SAMPLES = 1024;
+const size_t MAX_PACKET_SIZE = HEADER_SIZE + EXTENSION_SIZE + MAX_PACKET_SAMPLES * 2;
+
+inline uint8_t payloadType(Encoding encoding, uint32_t sampleRate) {
+    return encoding == L16 && sampleRate == 44100 ? PT_L16_44100_MONO : PT_DYNAMIC;
+}
+
+// Encoder or decoder state; its value at the start of a packet goes in
+// the DVI4 payload header, so every packet decodes on its own
+struct AdpcmState {
+    int16_t predicted;
+    uint8_t index;
+};
+
+// Two samples per byte, first sample in the high nibble (RFC 3551)
+void adpcmEncode(AdpcmState &state, const int16_t *samples, size_t count, uint8_t *out);
+void adpcmDecode(AdpcmState &state, const uint8_t *in, size_t count, int16_t *samples);
+
+// NTP-style offset probe between a receiver and the recorder's uptime
+// clock, on the port after the RTP port. The receiver sends it with
+// clientMicros set; the recorder fills in its receive and send times and
+// echoes it back. Little-endian.
+struct __attribute__((packed)) ClockProbe {
+    char magic[4];                 // "RTPC"
+    uint64_t clientMicros;         // Receiver clock at send
+    uint64_t serverReceiveMicros;  // Recorder uptime at receipt
+    uint64_t serverSendMicros;     // Recorder uptime at reply
+};
+
+class Packetizer {
+public:
+    typedef void (*Sink)(const uint8_t *packet, size_t length, void *context);
+
+    // samplesPerPacket is rounded up to an even count (DVI4 packs pairs)
+    bool begin(Encoding encoding, uint32_t sampleRate, size_t samplesPerPacket, uint32_t ssrc,
+               uint16_t sequence, uint32_t timestamp, Sink sink, void *context);
+
+    // Adds captured samples, the last of which was captured at `endMicros`;
+    // each completed packet goes to the sink right away
+    void push(const int16_t *samples, size_t count, int64_t endMicros);
+
+    // `samples` were lost before the next push: sends what is pending as a
+    // short packet, advances the timestamp and marks the next packet
+    void skip(uint32_t samples);
+
+    size_t samplesPerPacket() const { return _samplesPerPacket; }
+    uint8_t payloadType() const { return _payloadType; }
+    uint32_t ssrc() const { return _ssrc; }
+    uint32_t packets() const { return _packets; }
+
+private:
+    void emit();
+
+    Encoding _encoding;
+    uint32_t _sampleRate;
+    size_t _samplesPerPacket;
+    uint8_t _payloadType;
+    uint32_t _ssrc;
+    uint16_t _sequence;
+    uint32_t _timestamp;
+    bool _marker;
+    Sink _sink;
+    void *_context;
+    AdpcmState _adpcm;
+    int16_t _pending[MAX_PACKET_SAMPLES];
+    size_t _pendingCount;
+    int64_t _firstMicros;  // Capture time of _pending[0]
+    uint32_t _packets;
+    uint8_t _packet[MAX_PACKET_SIZE];
+};
+
+struct Packet {
+    bool marker;
+    uint8_t payloadType;
+    uint16_t sequence;
+    uint32_t timestamp;
+    uint32_t ssrc;
+    bool hasCaptureMicros;
+    int64_t captureMicros;
+    const uint8_t *payload;
+    size_t payloadLength;
+};
+
+bool parse(const uint8_t *data, size_t length, Packet &packet);
+
+// Samples in the payload, or 0 if it is malformed
+size_t sampleCount(const Packet &packet, Encoding encoding);
+
+// Decodes up to maxSamples; returns the samples written
+size_t decode(const Packet &packet, Encoding encoding, int16_t *samples, size_t maxSamples);
+
+} // namespace rtp
@@ -2,21 +2,38 @@
 #include <SPI.h>
 #include <SD.h>
 #include <WiFi.h>
+#include <AsyncUDP.h>
 #include <ESPAsyncWebServer.h>
 #include "driver/i2s.h"
-#include "esp_task_wdt.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "Overview.h"
+#include "CtrCipher.h"
+#include "RtpAudio.h"
+#include <Preferences.h>
+#include "bootloader_random.h"
+#include <SystemProfiler.h>
+#include <StallMonitor.h>
+#include <WiFiSupervisor.h>
 
 // SD Card Configuration
 const int chipSelect = 5;
-String lastRecordedFile = "";  // Stores the most recent file name
 
 // Wi-Fi Configuration
 const char *ssid = "ESP32-WAV-AP";
 const char *password = "12345678";
 AsyncWebServer server(80);
 
-bool stopServer = false;
+// Live monitoring: captured audio is multicast as RTP on the AP network,
+// one packet stream for any number of listeners (see /stream.sdp)
+#define RTP_STREAM 1
+#define RTP_ENCODING rtp::DVI4    // rtp::DVI4 (IMA ADPCM, ~200 kbit/s) or rtp::L16 (~730 kbit/s)
+#define RTP_PACKET_MS 10          // Audio per packet
+#define RTP_PORT 5004             // Clock probes from receivers on RTP_PORT + 1
+const IPAddress rtpGroup(239, 69, 0, 1);
+
+volatile bool stopServer = false;
 bool sdInitialized = false;
 
 // I2S Configuration
@@ -24,11 +41,185 @@ bool sdInitialized = false;
 #define I2S_BCK_IO 26
 #define I2S_WS_IO 25
 #define I2S_DATA_IO 22
-const size_t chunkSize = 600;
 const int sampleRate = 44100;
 const int bitsPerSample = 16;
 const int channelCount = 1;
+const int bytesPerFrame = channelCount * (bitsPerSample / 8);
+#if RTP_STREAM
+#define I2S_DMA_BUF_LEN 256       // Short buffers: a packet leaves as soon as its samples are in
+#else
+#define I2S_DMA_BUF_LEN 1024      // Frames per DMA buffer; an RX overflow discards one buffer
+#endif
+#define I2S_DMA_BUF_COUNT (8192 / I2S_DMA_BUF_LEN)  // ~186 ms of DMA buffering either way
+#define I2S_EVENT_QUEUE_LEN 16
+QueueHandle_t i2sEvents;          // Driver events (I2S_EVENT_RX_Q_OVF on DMA overflow)
+
+// Record-while-serving: capture fills RAM blocks, the writer task drains them to SD
+#define CAPTURE_BLOCK_SIZE 4096   // Bytes per I2S read / SD write
+#define CAPTURE_BLOCK_COUNT 12    // ~550 ms of audio buffered while the SD is busy
+#if RTP_STREAM
+#define CAPTURE_SLICE_SIZE (I2S_DMA_BUF_LEN * bytesPerFrame)  // Blocks are read one DMA buffer at a time
+#else
+#define CAPTURE_SLICE_SIZE CAPTURE_BLOCK_SIZE
+#endif
+#define SEGMENT_SECONDS 30        // Length of each downloadable recording
+#define DOWNLOAD_READ_SIZE 4096   // Max bytes read from SD per download chunk
+#define MAX_LISTED_SEGMENTS 32    // Completed segments listed by /list
+#define STOP_MARKER 0xFF          // Sent through the block queue to end the recording
+#define MAX_GAPS_PER_SEGMENT 64   // Overrun map entries stored in each WAV
+
+// Causes of lost samples
+#define LOSS_DMA_OVERFLOW 0x01    // I2S driver discarded a DMA buffer
+#define LOSS_WRITER_BEHIND 0x02   // No free capture block, read into scratch
+
+struct CaptureBlock {
+    size_t length;
+    uint32_t lostSamples;  // Samples missing just before this block
+    uint32_t lossCause;    // LOSS_* bits
+    int64_t lossMicros;    // Uptime when the loss was detected
+    int64_t readMicros;    // Uptime when the read completed (last sample)
+    uint8_t data[CAPTURE_BLOCK_SIZE];
+};
+CaptureBlock captureBlocks[CAPTURE_BLOCK_COUNT];
+QueueHandle_t freeBlocks;    // Block indices ready for capture
+QueueHandle_t filledBlocks;  // Block indices waiting for the SD card
+SemaphoreHandle_t sdMutex;   // Owns the SD/SPI bus
+SemaphoreHandle_t recordingStopped;
+volatile bool capturing = false;
+
+const uint32_t segmentDataSize = SEGMENT_SECONDS * sampleRate * bytesPerFrame;  // Exact, blocks are split at the boundary
 File wavFile;
+int nextFileNumber = 1;
+volatile int recordingFileNumber = 0;  // Segment being written (not downloadable yet)
+volatile int lastFileNumber = 0;       // Most recent completed segment
+
+struct Segment {
+    int number;
+    uint32_t size;
+    uint16_t peak;
+    uint32_t clipCount;
+    uint32_t lostSamples;
+    uint32_t gapCount;
+    uint32_t crc;        // CRC-32 of the file as /download serves it (decrypted)
+};
+
+// Per-segment timing and overrun map, written as bext + LIST/INFO chunks at close
+struct Gap {
+    uint32_t sample;   // Position in the segment where samples are missing
+    uint32_t lost;
+    uint32_t cause;    // LOSS_* bits
+    uint32_t millis;   // Uptime when detected
+};
+struct SegmentMeta {
+    uint64_t timelineStart;  // Samples captured or lost since recording start
+    int64_t startMicros;     // Uptime of the first sample
+    time_t startTime;        // Wall clock at open, 0 if the clock is not set
+    uint32_t lostSamples;
+    uint32_t gapCount;       // Only the first MAX_GAPS_PER_SEGMENT are mapped
+    Gap gaps[MAX_GAPS_PER_SEGMENT];
+    uint8_t nonce[CtrCipher::NONCE_BYTES];
+    uint32_t bodyCrc;        // CRC-32 of the served bytes after the header: plain data, then metadata chunks
+};
+SegmentMeta segmentMeta;
+
+// Broadcast Wave "bext" chunk (EBU Tech 3285)
+struct __attribute__((packed)) BextChunk {
+    char id[4];
+    uint32_t size;
+    char description[256];
+    char originator[32];
+    char originatorReference[32];
+    char originationDate[10];  // yyyy-mm-dd
+    char originationTime[8];   // hh:mm:ss
+    uint32_t timeReferenceLow; // First sample, counted from midnight (or recording start)
+    uint32_t timeReferenceHigh;
+    uint16_t version;
+    uint8_t umid[64];
+    int16_t loudness[5];
+    uint8_t reserved[180];
+};
+
+// Encryption at rest: the data chunk of every WAV is AES-256-CTR encrypted
+// as it is written, and /download decrypts on the fly (ranges included).
+// The key is kept in NVS, never on the card.
+#define ENCRYPT_RECORDINGS 1
+#define CIPHER_NVS_NAMESPACE "recorder"
+#if ENCRYPT_RECORDINGS
+#define WAV_HEADER_SIZE 68        // RIFF, fmt, aesc and data chunk headers
+#else
+#define WAV_HEADER_SIZE 44
+#endif
+
+// Between fmt and data; players skip it as an unknown chunk
+struct __attribute__((packed)) CipherChunk {
+    char id[4];                   // "aesc"
+    uint32_t size;
+    uint8_t nonce[CtrCipher::NONCE_BYTES];
+    uint32_t keyCheck;            // CtrCipher::keyCheck() of the key used
+    uint32_t version;             // 1 = AES-256-CTR over the data chunk payload
+};
+CtrCipher cipher;
+uint32_t cipherBoot = 0;          // Boot count from NVS, first half of every nonce
+uint32_t cipherSegments = 0;      // Segments opened this boot, second half
+
+// Where the encrypted bytes of a file are, read from its header
+struct CipherRange {
+    bool encrypted;
+    uint8_t nonce[CtrCipher::NONCE_BYTES];
+    uint32_t start;  // File offset of the first data byte
+    uint32_t end;
+};
+Segment completedSegments[MAX_LISTED_SEGMENTS];
+int completedCount = 0;
+portMUX_TYPE segmentsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Counters reported over serial on every segment and by /stats
+struct RecorderStats {
+    uint32_t segments;
+    uint32_t blocksWritten;
+    uint32_t overruns;          // Blocks dropped because the writer fell behind
+    uint32_t minFreeBlocks;
+    uint32_t maxWriteMicros;
+    uint64_t bytesWritten;
+    uint32_t readDeferrals;     // Download chunks postponed in favour of capture writes
+    uint32_t downloads;
+    uint64_t downloadBytes;
+    uint32_t downloadMillis;
+    uint32_t dmaOverflows;      // I2S_EVENT_RX_Q_OVF events
+    uint32_t lostSamples;       // From both kinds of overrun
+    uint32_t maxCryptMicros;    // Slowest encryption of one written span
+};
+RecorderStats stats = {0, 0, 0, CAPTURE_BLOCK_COUNT, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// Waveform overview written next to each segment (/record_N.ovw)
+#define OVERVIEW_COARSE_ENTRIES (SEGMENT_SECONDS * sampleRate / 4096 + 2)
+typedef overview::Builder<OVERVIEW_COARSE_ENTRIES> OverviewBuilder;
+OverviewBuilder overviewBuilder;
+File overviewFile;
+
+// Runtime profile (per-task CPU, stacks, heap, ISR load) at /profile
+#define PROFILE_INTERVAL_MS 5000
+#define PROFILE_TO_SERIAL 0       // 1 = also print the profile every interval
+SystemProfiler profiler;
+
+// Per-stage stall detection: each stage marks its blocking calls, and one
+// that overruns its deadline is reported with the call it is stuck in
+#define CAPTURE_DEADLINE_MS 150   // Inside the ~186 ms of DMA buffering
+#define WRITER_DEADLINE_MS 500    // About what the capture block pool covers
+#define NETWORK_DEADLINE_MS 500   // SD access from the web server task
+#define LOOP_DEADLINE_MS 1000
+#define STALL_RESTART_MS 30000    // A stage stuck this long restarts the recorder
+StallMonitor stalls;
+int captureStage, writerStage, networkStage, loopStage;
+
+#if RTP_STREAM
+#define RTP_PACKET_SAMPLES (sampleRate * RTP_PACKET_MS / 1000)
+AsyncUDP rtpUdp;                  // Multicast sender
+AsyncUDP probeUdp;                // Clock probes
+rtp::Packetizer rtpPacketizer;    // Fed by the capture task
+volatile bool rtpStreaming = false;
+uint32_t rtpSendFailures = 0;
+#endif
 
 // Convert seconds to microseconds for deep sleep time (50 minutes)
 uint64_t sleep_time_us = 40ULL * 60 * 1000000;
@@ -51,10 +242,10 @@ void i2sConfig() {
         .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
         .communication_format = I2S_COMM_FORMAT_STAND_I2S,
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = 1024
+        .dma_buf_count = I2S_DMA_BUF_COUNT,
+        .dma_buf_len = I2S_DMA_BUF_LEN
     };
-    i2s_driver_install(I2S_NUM, &i2s_config, 0, NULL);
+    i2s_driver_install(I2S_NUM, &i2s_config, I2S_EVENT_QUEUE_LEN, &i2sEvents);
     i2s_pin_config_t pin_config = {
         .bck_io_num = I2S_BCK_IO,
         .ws_io_num = I2S_WS_IO,
@@ -64,48 +255,73 @@ void i2sConfig() {
     i2s_set_pin(I2S_NUM, &pin_config);
 }
 
-void recordWavFile() {
-    // Generate a unique filename
-    int fileNumber = 1;
-    String fileName;
-    do {
-        fileName = "/record_" + String(fileNumber) + ".wav";
-        fileNumber++;
-    } while (SD.exists(fileName)); // Keep checking until we find an unused filename
+// SD bus arbiter: capture writes always win. A download read only gets the
+// bus when no captured block is waiting, and never waits for it.
+bool sdTryAcquireForRead() {
+    if (uxQueueMessagesWaiting(filledBlocks) > 0) return false;
+    return xSemaphoreTake(sdMutex, 0) == pdTRUE;
+}
 
-    // Open the new file
-    wavFile = SD.open(fileName, FILE_WRITE);
-    if (!wavFile) {
-        Serial.println("Failed to create WAV file");
-        enterDeepSleep();
-    }
+void sdRelease() {
+    xSemaphoreGive(sdMutex);
+}
 
-    uint8_t wavHeader[44] = {0};
-    wavFile.write(wavHeader, 44);  // Reserve space for the WAV header
+void segmentFileName(char *name, size_t size, int number) {
+    snprintf(name, size, "/record_%d.wav", number);
+}
 
-    uint8_t buffer[chunkSize];
-    size_t bytesRead, totalDataSize = 0;
-    unsigned long recordStart = millis();
-    unsigned long recordDuration = 0.5*60*1000;  // 5 minutes
+void overviewFileName(char *name, size_t size, int number) {
+    snprintf(name, size, "/record_%d.ovw", number);
+}
 
-    Serial.println("Recording audio...");
-    while ((millis() - recordStart) < recordDuration) {
-        esp_task_wdt_reset();  // Reset watchdog timer periodically
+// Level 0 entries go straight to the overview file as they complete
+void writeOverviewEntries(const overview::Entry *entries, size_t count, void *context) {
+    overviewFile.write((const uint8_t *)entries, count * sizeof(overview::Entry));
+}
 
-        esp_err_t result = i2s_read(I2S_NUM, buffer, chunkSize, &bytesRead, portMAX_DELAY);
-        if (result != ESP_OK || bytesRead == 0) {
-            Serial.println("Error reading from I2S");
-            enterDeepSleep();
-        }
-        wavFile.write(buffer, bytesRead);
-        totalDataSize += bytesRead;
+// CRC-32 of A followed by B from the CRCs of both parts (zlib's crc32_combine):
+// appends lengthB zero bits to crcA through the CRC's GF(2) shift operator
+static uint32_t gf2MatrixTimes(const uint32_t *matrix, uint32_t vector) {
+    uint32_t sum = 0;
+    for (; vector; vector >>= 1, matrix++) {
+        if (vector & 1) sum ^= *matrix;
     }
-    Serial.println("Recording complete");
+    return sum;
+}
 
-    // Write WAV header
-    wavFile.seek(0);
-    uint32_t dataSize = totalDataSize;
-    uint32_t fileSize = dataSize + 36;
+static void gf2MatrixSquare(uint32_t *square, const uint32_t *matrix) {
+    for (int n = 0; n < 32; n++) square[n] = gf2MatrixTimes(matrix, matrix[n]);
+}
+
+uint32_t crc32Combine(uint32_t crcA, uint32_t crcB, uint32_t lengthB) {
+    uint32_t even[32], odd[32];
+    if (lengthB == 0) return crcA;
+    odd[0] = 0xedb88320;  // One zero bit
+    for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+    gf2MatrixSquare(even, odd);  // Two zero bits
+    gf2MatrixSquare(odd, even);  // Four
+    do {
+        gf2MatrixSquare(even, odd);  // One zero byte on the first pass, then doubling
+        if (lengthB & 1) crcA = gf2MatrixTimes(even, crcA);
+        lengthB >>= 1;
+        if (!lengthB) break;
+        gf2MatrixSquare(odd, even);
+        if (lengthB & 1) crcA = gf2MatrixTimes(odd, crcA);
+        lengthB >>= 1;
+    } while (lengthB);
+    return crcA ^ crcB;
+}
+
+// Metadata chunks are part of the served body; keep their CRC
+void writeTracked(File &file, const void *data, size_t length) {
+    segmentMeta.bodyCrc = esp_rom_crc32_le(segmentMeta.bodyCrc, (const uint8_t *)data, length);
+    file.write((const uint8_t *)data, length);
+}
+
+// trailingSize: bytes of chunks after the data chunk. Returns the header's CRC-32.
+uint32_t writeWavHeader(File &file, uint32_t dataSize, uint32_t trailingSize = 0) {
+    uint8_t wavHeader[WAV_HEADER_SIZE];
+    uint32_t fileSize = dataSize + WAV_HEADER_SIZE - 8 + trailingSize;
     memcpy(wavHeader, "RIFF", 4);
     memcpy(wavHeader + 4, &fileSize, 4);
     memcpy(wavHeader + 8, "WAVEfmt ", 8);
@@ -120,24 +336,727 @@ void recordWavFile() {
     uint16_t blockAlign = channelCount * (bitsPerSample / 8);
     memcpy(wavHeader + 32, &blockAlign, 2);
     memcpy(wavHeader + 34, &bitsPerSample, 2);
-    memcpy(wavHeader + 36, "data", 4);
-    memcpy(wavHeader + 40, &dataSize, 4);
+#if ENCRYPT_RECORDINGS
+    CipherChunk chunk;
+    memcpy(chunk.id, "aesc", 4);
+    chunk.size = sizeof(chunk) - 8;
+    memcpy(chunk.nonce, segmentMeta.nonce, sizeof(chunk.nonce));
+    chunk.keyCheck = cipher.keyCheck();
+    chunk.version = 1;
+    memcpy(wavHeader + 36, &chunk, sizeof(chunk));
+#endif
+    memcpy(wavHeader + WAV_HEADER_SIZE - 8, "data", 4);
+    memcpy(wavHeader + WAV_HEADER_SIZE - 4, &dataSize, 4);
+    file.write(wavHeader, WAV_HEADER_SIZE);
+    return esp_rom_crc32_le(0, wavHeader, WAV_HEADER_SIZE);
+}
+
+#if ENCRYPT_RECORDINGS
+// Runs before i2sConfig(): the entropy source borrows the I2S and ADC
+// peripherals while the key is generated on first boot
+bool loadCipherKey() {
+    uint8_t key[CtrCipher::KEY_BYTES];
+    Preferences preferences;
+    preferences.begin(CIPHER_NVS_NAMESPACE, false);
+    if (preferences.getBytes("aes_key", key, sizeof(key)) != sizeof(key)) {
+        bootloader_random_enable();
+        esp_fill_random(key, sizeof(key));
+        bootloader_random_disable();
+        preferences.putBytes("aes_key", key, sizeof(key));
+        Serial.println("Generated a new recording key");
+    }
+    // Nonces count instead of being drawn at random, so they never repeat
+    // under one key: boot number and segment number within the boot
+    cipherBoot = preferences.getUInt("boots", 0) + 1;
+    preferences.putUInt("boots", cipherBoot);
+    preferences.end();
+
+    bool loaded = cipher.setKey(key);
+    memset(key, 0, sizeof(key));
+    Serial.printf("Recording key check %08x, boot %u\n", cipher.keyCheck(), cipherBoot);
+    return loaded;
+}
+#endif
+
+// Decrypts the part of `buffer` (file bytes from `position`) that lies in
+// the data chunk
+void decryptRange(const CipherRange &range, uint32_t position, uint8_t *buffer, size_t length) {
+    if (!range.encrypted) return;
+    uint32_t from = position > range.start ? position : range.start;
+    uint32_t to = position + length < range.end ? position + length : range.end;
+    if (from >= to) return;
+    cipher.apply(range.nonce, from - range.start, buffer + (from - position), to - from);
+}
+
+// Caller holds the SD bus
+bool openSegment(uint64_t timeline, int64_t firstSampleMicros) {
+    char fileName[24];
+    segmentFileName(fileName, sizeof(fileName), nextFileNumber);
+    wavFile = SD.open(fileName, FILE_WRITE);
+    if (!wavFile) {
+        Serial.println("Failed to create WAV file");
+        return false;
+    }
+    uint8_t wavHeader[WAV_HEADER_SIZE] = {0};
+    wavFile.write(wavHeader, WAV_HEADER_SIZE);  // Reserve space for the WAV header
+
+    overviewFileName(fileName, sizeof(fileName), nextFileNumber);
+    overviewFile = SD.open(fileName, FILE_WRITE);
+    if (overviewFile) {
+        overview::Header header = {};
+        overviewFile.write((const uint8_t *)&header, sizeof(header));  // Filled in at close
+    }
+    overviewBuilder.begin(sampleRate, writeOverviewEntries, NULL);
+
+    time_t now = time(NULL);
+    segmentMeta.timelineStart = timeline;
+    segmentMeta.startMicros = firstSampleMicros;
+    segmentMeta.startTime = now > 1600000000 ? now : 0;
+    segmentMeta.lostSamples = 0;
+    segmentMeta.gapCount = 0;
+    segmentMeta.bodyCrc = 0;
+    cipherSegments++;
+    memcpy(segmentMeta.nonce, &cipherBoot, 4);
+    memcpy(segmentMeta.nonce + 4, &cipherSegments, 4);
+    recordingFileNumber = nextFileNumber++;
+    return true;
+}
+
+void noteGap(uint32_t sample, const CaptureBlock &block) {
+    if (segmentMeta.gapCount < MAX_GAPS_PER_SEGMENT) {
+        Gap &gap = segmentMeta.gaps[segmentMeta.gapCount];
+        gap.sample = sample;
+        gap.lost = block.lostSamples;
+        gap.cause = block.lossCause;
+        gap.millis = block.lossMicros / 1000;
+    }
+    segmentMeta.gapCount++;
+    segmentMeta.lostSamples += block.lostSamples;
+    stats.lostSamples += block.lostSamples;
+    Serial.printf("Capture gap in record_%d.wav at sample %u: %u samples lost (%s%s)\n",
+                  recordingFileNumber, sample, block.lostSamples,
+                  block.lossCause & LOSS_DMA_OVERFLOW ? "DMA overflow " : "",
+                  block.lossCause & LOSS_WRITER_BEHIND ? "writer behind" : "");
+}
+
+// bext (start time, sample count) and LIST/INFO with the overrun map in
+// ICMT, appended after the data chunk. Returns the bytes written.
+uint32_t writeMetadataChunks(File &file, uint32_t samples) {
+    static BextChunk bext;
+    memset(&bext, 0, sizeof(bext));
+    memcpy(bext.id, "bext", 4);
+    bext.size = sizeof(bext) - 8;
+    snprintf(bext.description, sizeof(bext.description),
+             "samples=%u lost=%u gaps=%u start_us=%lld timeline=%llu",
+             samples, segmentMeta.lostSamples, segmentMeta.gapCount,
+             segmentMeta.startMicros, segmentMeta.timelineStart);
+    strncpy(bext.originator, "ESP32 WAV Recorder", sizeof(bext.originator));
+    snprintf(bext.originatorReference, sizeof(bext.originatorReference), "record_%d", recordingFileNumber);
+    uint64_t reference = segmentMeta.timelineStart;
+    if (segmentMeta.startTime) {
+        char text[12];
+        struct tm tm;
+        localtime_r(&segmentMeta.startTime, &tm);
+        strftime(text, sizeof(text), "%Y-%m-%d", &tm);
+        memcpy(bext.originationDate, text, sizeof(bext.originationDate));
+        strftime(text, sizeof(text), "%H:%M:%S", &tm);
+        memcpy(bext.originationTime, text, sizeof(bext.originationTime));
+        reference = (uint64_t)(tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec) * sampleRate;
+    }
+    bext.timeReferenceLow = (uint32_t)reference;
+    bext.timeReferenceHigh = (uint32_t)(reference >> 32);
+    bext.version = 1;
+    writeTracked(file, &bext, sizeof(bext));
+
+    static char map[MAX_GAPS_PER_SEGMENT * 80 + 64];
+    size_t length = snprintf(map, sizeof(map), "samples=%u lost=%u gaps=%u\n",
+                             samples, segmentMeta.lostSamples, segmentMeta.gapCount);
+    uint32_t mapped = min(segmentMeta.gapCount, (uint32_t)MAX_GAPS_PER_SEGMENT);
+    for (uint32_t i = 0; i < mapped; i++) {
+        const Gap &gap = segmentMeta.gaps[i];
+        length += snprintf(map + length, sizeof(map) - length, "gap sample=%u lost=%u cause=%s%s uptime_ms=%u\n",
+                           gap.sample, gap.lost, gap.cause & LOSS_DMA_OVERFLOW ? "dma" : "",
+                           gap.cause & LOSS_WRITER_BEHIND ? (gap.cause & LOSS_DMA_OVERFLOW ? "+writer" : "writer") : "",
+                           gap.millis);
+    }
+    uint32_t textSize = length + 1;                 // NUL terminated
+    uint32_t paddedSize = (textSize + 1) & ~1u;     // Chunks are word aligned
+    map[length + 1] = 0;
+    uint32_t listSize = 4 + 8 + paddedSize;
+    writeTracked(file, "LIST", 4);
+    writeTracked(file, &listSize, 4);
+    writeTracked(file, "INFOICMT", 8);
+    writeTracked(file, &textSize, 4);
+    writeTracked(file, map, paddedSize);
+    return sizeof(bext) + 8 + listSize;
+}
+
+void reportStats() {
+    uint32_t kbps = stats.downloadMillis ? (uint32_t)(stats.downloadBytes / stats.downloadMillis) : 0;
+    Serial.printf("Segments %u, overruns %u, DMA overflows %u, lost samples %u, min free blocks %u, "
+                  "max SD write %u us, max encrypt %u us, downloads %u (%llu bytes, %u kB/sec), deferred reads %u\n",
+                  stats.segments, stats.overruns, stats.dmaOverflows, stats.lostSamples, stats.minFreeBlocks,
+                  stats.maxWriteMicros, stats.maxCryptMicros, stats.downloads, stats.downloadBytes, kbps,
+                  stats.readDeferrals);
+}
 
-    wavFile.write(wavHeader, 44);
+// Caller holds the SD bus
+void closeSegment(uint32_t dataSize) {
+    uint32_t metadataSize = writeMetadataChunks(wavFile, dataSize / bytesPerFrame);
+    wavFile.seek(0);
+    uint32_t headerCrc = writeWavHeader(wavFile, dataSize, metadataSize);
     wavFile.close();
-    Serial.printf("WAV file saved: %s (%u bytes)\n", fileName.c_str(), totalDataSize + 44);
 
-    // Store the last recorded file name
-    lastRecordedFile = fileName;
-    Serial.printf("Last recorded file: %s\n", lastRecordedFile.c_str());
+    overview::Header header;
+    overviewBuilder.finish(header, sizeof(header));
+    if (overviewFile) {
+        for (int level = 1; level < overview::LEVELS; level++) {
+            overviewFile.write((const uint8_t *)overviewBuilder.coarse(level),
+                               overviewBuilder.coarseCount(level) * sizeof(overview::Entry));
+        }
+        overviewFile.seek(0);
+        overviewFile.write((const uint8_t *)&header, sizeof(header));
+        overviewFile.close();
+    }
+
+    char fileName[24];
+    segmentFileName(fileName, sizeof(fileName), recordingFileNumber);
+    Serial.printf("WAV file saved: %s (%u samples, %u lost in %u gaps, peak %u, %u clipped samples)\n",
+                  fileName, dataSize / bytesPerFrame, segmentMeta.lostSamples, segmentMeta.gapCount,
+                  header.peak, header.clipCount);
+
+    portENTER_CRITICAL(&segmentsMux);
+    Segment &segment = completedSegments[completedCount % MAX_LISTED_SEGMENTS];
+    segment.number = recordingFileNumber;
+    segment.size = dataSize + WAV_HEADER_SIZE + metadataSize;
+    segment.peak = header.peak;
+    segment.clipCount = header.clipCount;
+    segment.lostSamples = segmentMeta.lostSamples;
+    segment.gapCount = segmentMeta.gapCount;
+    segment.crc = crc32Combine(headerCrc, segmentMeta.bodyCrc, dataSize + metadataSize);
+    completedCount++;
+    lastFileNumber = recordingFileNumber;
+    recordingFileNumber = 0;
+    portEXIT_CRITICAL(&segmentsMux);
+
+    stats.segments++;
+    reportStats();
+}
+
+#if RTP_STREAM
+// Runs in the capture task: one send per packet, whatever the listener count
+void sendRtpPacket(const uint8_t *packet, size_t length, void *context) {
+    if (rtpUdp.writeTo(packet, length, rtpGroup, RTP_PORT, TCPIP_ADAPTER_IF_AP) != length) rtpSendFailures++;
+}
+#endif
+
+// Samples lost since the last queued block
+struct PendingLoss {
+    uint32_t samples;
+    uint32_t cause;    // LOSS_* bits
+    int64_t micros;    // Uptime when the loss was detected
+};
+
+// Each RX queue overflow is one DMA buffer the driver discarded before a
+// read could collect it
+void collectOverflows(PendingLoss &loss, int64_t now) {
+    i2s_event_t event;
+    while (xQueueReceive(i2sEvents, &event, 0) == pdTRUE) {
+        if (event.type != I2S_EVENT_RX_Q_OVF) continue;
+        if (!loss.samples) loss.micros = now;
+        loss.samples += I2S_DMA_BUF_LEN * channelCount;
+        loss.cause |= LOSS_DMA_OVERFLOW;
+        stats.dmaOverflows++;
+#if RTP_STREAM
+        if (rtpStreaming) rtpPacketizer.skip(I2S_DMA_BUF_LEN * channelCount);
+#endif
+    }
+}
+
+// Fills one capture block, CAPTURE_SLICE_SIZE bytes per read. Each slice
+// goes to the RTP packetizer as soon as it is in, so live packets do not
+// wait for the whole block. Returns 0 if the I2S read failed.
+size_t readCaptureBlock(uint8_t *buffer, PendingLoss &loss, int64_t &readMicros) {
+    size_t length = 0;
+    while (length < CAPTURE_BLOCK_SIZE) {
+        size_t bytesRead = 0;
+        size_t slice = min((size_t)CAPTURE_SLICE_SIZE, (size_t)(CAPTURE_BLOCK_SIZE - length));
+        stalls.enter(captureStage, "i2s_read");
+        esp_err_t result = i2s_read(I2S_NUM, buffer + length, slice, &bytesRead, portMAX_DELAY);
+        stalls.leave(captureStage);
+        if (result != ESP_OK || bytesRead == 0) return 0;
+        readMicros = esp_timer_get_time();
+        collectOverflows(loss, readMicros);
+#if RTP_STREAM
+        if (rtpStreaming) rtpPacketizer.push((const int16_t *)(buffer + length), bytesRead / 2, readMicros);
+#endif
+        length += bytesRead;
+    }
+    return length;
+}
+
+// Reads I2S into free blocks; never touches the SD card. Samples lost to a
+// DMA overflow or a full block pool are reported with the next queued block.
+void captureTask(void *parameter) {
+    static uint8_t scratch[CAPTURE_BLOCK_SIZE];
+    PendingLoss loss = {0, 0, 0};
+    uint8_t index;
+    xQueueReset(i2sEvents);  // Overflows from before capture started are not gaps
+    while (capturing) {
+        UBaseType_t freeCount = uxQueueMessagesWaiting(freeBlocks);
+        if (freeCount < stats.minFreeBlocks) stats.minFreeBlocks = freeCount;
+
+        if (xQueueReceive(freeBlocks, &index, 0) != pdTRUE) {
+            // Writer is behind: keep the DMA drained (and the live stream
+            // going) and drop this block
+            if (!loss.samples) loss.micros = esp_timer_get_time();
+            int64_t readMicros;
+            size_t bytesRead = readCaptureBlock(scratch, loss, readMicros);
+            loss.samples += bytesRead / bytesPerFrame;
+            loss.cause |= LOSS_WRITER_BEHIND;
+            stats.overruns++;
+            continue;
+        }
+        CaptureBlock &block = captureBlocks[index];
+        block.length = readCaptureBlock(block.data, loss, block.readMicros);
+        if (block.length == 0) {
+            Serial.println("Error reading from I2S");
+            enterDeepSleep();
+        }
+        block.lostSamples = loss.samples;
+        block.lossCause = loss.cause;
+        block.lossMicros = loss.micros;
+        loss.samples = 0;
+        loss.cause = 0;
+        xQueueSend(filledBlocks, &index, portMAX_DELAY);
+    }
+    index = STOP_MARKER;
+    xQueueSend(filledBlocks, &index, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+// Drains filled blocks to SD and rotates segments at an exact sample count
+void writerTask(void *parameter) {
+    uint32_t segmentBytes = 0;
+    uint64_t timeline = 0;  // Samples captured or lost since recording start
+    uint8_t index;
+    for (;;) {
+        xQueueReceive(filledBlocks, &index, portMAX_DELAY);
+        // Blocking take: a download read holds the bus for one chunk at most
+        stalls.enter(writerStage, "SD bus");
+        xSemaphoreTake(sdMutex, portMAX_DELAY);
+        if (index == STOP_MARKER) {
+            stalls.enter(writerStage, "segment close");
+            if (wavFile) closeSegment(segmentBytes);
+            stalls.leave(writerStage);
+            sdRelease();
+            xSemaphoreGive(recordingStopped);
+            vTaskDelete(NULL);
+        }
+
+        CaptureBlock &block = captureBlocks[index];
+        unsigned long writeStart = micros();
+        timeline += block.lostSamples;
+        for (size_t offset = 0; offset < block.length;) {
+            if (!wavFile) {
+                int64_t blockMicros = (int64_t)(block.length - offset) / bytesPerFrame * 1000000 / sampleRate;
+                stalls.enter(writerStage, "segment open");
+                if (!openSegment(timeline, block.readMicros - blockMicros)) {
+                    sdRelease();
+                    enterDeepSleep();
+                }
+            }
+            if (offset == 0 && block.lostSamples) noteGap(segmentBytes / bytesPerFrame, block);
+
+            // Split the block where the segment reaches its exact length
+            size_t length = min(block.length - offset, (size_t)(segmentDataSize - segmentBytes));
+            overviewBuilder.add((const int16_t *)(block.data + offset), length / 2);
+            segmentMeta.bodyCrc = esp_rom_crc32_le(segmentMeta.bodyCrc, block.data + offset, length);
+#if ENCRYPT_RECORDINGS
+            // In place, after the overview has seen the plain samples
+            unsigned long cryptStart = micros();
+            cipher.apply(segmentMeta.nonce, segmentBytes, block.data + offset, length);
+            uint32_t cryptMicros = micros() - cryptStart;
+            if (cryptMicros > stats.maxCryptMicros) stats.maxCryptMicros = cryptMicros;
+#endif
+            stalls.enter(writerStage, "SD write");
+            wavFile.write(block.data + offset, length);
+            segmentBytes += length;
+            timeline += length / bytesPerFrame;
+            offset += length;
+            if (segmentBytes == segmentDataSize) {
+                stalls.enter(writerStage, "segment close");
+                closeSegment(segmentBytes);
+                segmentBytes = 0;
+            }
+        }
+        uint32_t writeMicros = micros() - writeStart;
+        if (writeMicros > stats.maxWriteMicros) stats.maxWriteMicros = writeMicros;
+        stats.bytesWritten += block.length;
+        stats.blocksWritten++;
+        stalls.leave(writerStage);
+        xQueueSend(freeBlocks, &index, portMAX_DELAY);
+        sdRelease();
+    }
+}
+
+void startRecording() {
+    freeBlocks = xQueueCreate(CAPTURE_BLOCK_COUNT, sizeof(uint8_t));
+    filledBlocks = xQueueCreate(CAPTURE_BLOCK_COUNT + 1, sizeof(uint8_t));
+    recordingStopped = xSemaphoreCreateBinary();
+    for (uint8_t i = 0; i < CAPTURE_BLOCK_COUNT; i++) {
+        xQueueSend(freeBlocks, &i, 0);
+    }
+
+    // Find the first unused file number once; later segments just count up
+    char fileName[24];
+    do {
+        segmentFileName(fileName, sizeof(fileName), nextFileNumber);
+        if (!SD.exists(fileName)) break;
+        nextFileNumber++;
+    } while (true);
+
+    capturing = true;
+    // Capture above the writer and the web server so the DMA is always drained
+    xTaskCreatePinnedToCore(captureTask, "capture", 4096, NULL, 5, NULL, 1);
+    xTaskCreatePinnedToCore(writerTask, "sd_writer", 4096, NULL, 4, NULL, 1);
+    Serial.printf("Recording audio in %d-second segments...\n", SEGMENT_SECONDS);
+}
+
+// Finalize the segment in progress before power-down
+void stopRecording() {
+    capturing = false;
+    if (xSemaphoreTake(recordingStopped, pdMS_TO_TICKS(5000)) != pdTRUE) {
+        Serial.println("Writer did not finish the last segment");
+    }
+    Serial.println("Recording complete");
+}
+
+unsigned long confirmTime = 0;  // When /confirm came, for the confirm-to-sleep latency
+
+void startAccessPoint() {
+    WiFi.softAP(ssid, password);
+}
+
+// AP restarts and Wi-Fi counters (lib/WiFiSupervisor)
+WiFiSupervisor wifiSupervisor(startAccessPoint, stopServer);
+
+#if RTP_STREAM
+// After the AP is up. Random SSRC, sequence and timestamp origins (RFC 3550).
+void startRtpStream() {
+    rtpPacketizer.begin(RTP_ENCODING, sampleRate, RTP_PACKET_SAMPLES, esp_random(), esp_random(), esp_random(),
+                        sendRtpPacket, NULL);
+    // Clock probes are stamped and echoed from the UDP callback, so
+    // loop() adds no delay to the round trip
+    if (probeUdp.listen(RTP_PORT + 1)) {
+        probeUdp.onPacket([](AsyncUDPPacket &packet) {
+            int64_t received = esp_timer_get_time();
+            rtp::ClockProbe probe;
+            if (packet.length() != sizeof(probe) || memcmp(packet.data(), "RTPC", 4) != 0) return;
+            memcpy(&probe, packet.data(), sizeof(probe));
+            probe.serverReceiveMicros = received;
+            probe.serverSendMicros = esp_timer_get_time();
+            packet.write((const uint8_t *)&probe, sizeof(probe));
+        });
+    }
+    rtpStreaming = true;
+    Serial.printf("RTP stream on %s:%u, %s, %u samples per packet\n", rtpGroup.toString().c_str(), RTP_PORT,
+                  RTP_ENCODING == rtp::L16 ? "L16" : "DVI4", rtpPacketizer.samplesPerPacket());
+}
+
+// Session description for players: ffplay -protocol_whitelist http,tcp,udp,rtp -i http://192.168.4.1/stream.sdp
+void handleSdp(AsyncWebServerRequest *request) {
+    char sdp[384];
+    uint8_t payloadType = rtpPacketizer.payloadType();
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\no=- %u 1 IN IP4 %s\r\ns=ESP32 live audio\r\nc=IN IP4 %s/1\r\nt=0 0\r\n"
+             "m=audio %u RTP/AVP %u\r\na=rtpmap:%u %s/%u/1\r\na=ptime:%u\r\na=recvonly\r\n",
+             rtpPacketizer.ssrc(), WiFi.softAPIP().toString().c_str(), rtpGroup.toString().c_str(), RTP_PORT,
+             payloadType, payloadType, RTP_ENCODING == rtp::L16 ? "L16" : "DVI4", sampleRate,
+             (unsigned)(rtpPacketizer.samplesPerPacket() * 1000 / sampleRate));
+    request->send(200, "application/sdp", sdp);
+}
+#endif
+
+// Single "bytes=first-last" range, either end open. Returns 0 when there is
+// no usable range (serve the whole file), -1 when it is unsatisfiable.
+int parseRange(const String &header, uint32_t size, uint32_t &first, uint32_t &last) {
+    unsigned long from, to;
+    const char *spec = header.c_str();
+    if (strncmp(spec, "bytes=", 6) != 0 || strchr(spec, ',')) return 0;
+    spec += 6;
+    if (*spec == '-') {
+        if (sscanf(spec + 1, "%lu", &to) != 1 || to == 0) return -1;
+        first = to < size ? size - to : 0;  // Suffix: the last `to` bytes
+        last = size - 1;
+    } else {
+        int fields = sscanf(spec, "%lu-%lu", &from, &to);
+        if (fields < 1) return 0;
+        if (from >= size) return -1;
+        first = from;
+        last = fields == 2 && to < size - 1 ? to : size - 1;
+        if (last < first) return 0;
+    }
+    return 1;
+}
+
+// The bus is the writer's: handlers run in async_tcp, which must not wait for it
+void sendSdBusy(AsyncWebServerRequest *request) {
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "SD card busy");
+    response->addHeader("Retry-After", "1");
+    request->send(response);
+}
+
+void handleDownload(AsyncWebServerRequest *request) {
+    int number = lastFileNumber;
+    if (request->hasParam("id")) {
+        number = request->getParam("id")->value().toInt();
+    }
+    if (number <= 0) {
+        request->send(404, "text/plain", "No completed recording yet");
+        return;
+    }
+    if (number == recordingFileNumber) {
+        request->send(409, "text/plain", "Segment still recording");
+        return;
+    }
+
+    char fileName[24];
+    segmentFileName(fileName, sizeof(fileName), number);
+    if (!sdTryAcquireForRead()) {
+        sendSdBusy(request);
+        return;
+    }
+    stalls.enter(networkStage, "SD open");
+    File file = SD.open(fileName, "r");
+    CipherRange range = {false};
+#if ENCRYPT_RECORDINGS
+    // The header tells whether (and with which nonce) the data is encrypted
+    uint8_t header[WAV_HEADER_SIZE];
+    bool keyMismatch = false;
+    if (file && file.read(header, sizeof(header)) == sizeof(header) && memcmp(header + 36, "aesc", 4) == 0) {
+        CipherChunk chunk;
+        uint32_t dataSize;
+        memcpy(&chunk, header + 36, sizeof(chunk));
+        memcpy(&dataSize, header + WAV_HEADER_SIZE - 4, 4);
+        keyMismatch = chunk.keyCheck != cipher.keyCheck();
+        range.encrypted = true;
+        memcpy(range.nonce, chunk.nonce, sizeof(range.nonce));
+        range.start = sizeof(header);
+        range.end = range.start + dataSize;
+    }
+#endif
+    uint32_t size = file ? file.size() : 0;
+    stalls.leave(networkStage);
+    sdRelease();
+    if (!file) {
+        request->send(404, "text/plain", "File not found");
+        Serial.println("File not found");
+        return;
+    }
+#if ENCRYPT_RECORDINGS
+    if (keyMismatch) {
+        file.close();
+        request->send(403, "text/plain", "Recorded with a different key");
+        return;
+    }
+#endif
+
+    // Resumed and partial downloads: decryption starts at any byte
+    uint32_t first = 0, last = size - 1;
+    int ranged = request->hasHeader("Range") ? parseRange(request->header("Range"), size, first, last) : 0;
+    if (ranged < 0 || size == 0) {
+        file.close();
+        AsyncWebServerResponse *response = request->beginResponse(416, "text/plain", "Range not satisfiable");
+        response->addHeader("Content-Range", String("bytes */") + size);
+        request->send(response);
+        return;
+    }
+    uint32_t length = last - first + 1;
+
+    unsigned long downloadStart = millis();
+    unsigned long lastChunk = millis();
+    AsyncWebServerResponse *response = request->beginResponse(
+        "audio/wav", length,
+        [file, range, first, length, downloadStart, lastChunk](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+            wifiSupervisor.chunkSent(millis() - lastChunk);
+            lastChunk = millis();
+            if (!sdTryAcquireForRead()) {
+                stats.readDeferrals++;
+                return RESPONSE_TRY_AGAIN;
+            }
+            stalls.enter(networkStage, "SD read");
+            if (index == 0) file.seek(first);  // Past the header read above, or to the range start
+            size_t bytesRead = file.read(buffer, min(min(maxLen, (size_t)DOWNLOAD_READ_SIZE), (size_t)(length - index)));
+            bool done = bytesRead == 0 || index + bytesRead >= length;
+            if (done) file.close();
+            stalls.leave(networkStage);
+            sdRelease();
+            decryptRange(range, first + index, buffer, bytesRead);
+
+            if (done) {
+                uint32_t sent = index + bytesRead;
+                uint32_t elapsed = millis() - downloadStart;
+                stats.downloads++;
+                stats.downloadBytes += sent;
+                stats.downloadMillis += elapsed;
+                Serial.printf("Download complete: %u bytes in %u ms, %u kB/sec (deferred reads so far: %u)\n",
+                              sent, elapsed, elapsed ? sent / elapsed : 0, stats.readDeferrals);
+            }
+            return bytesRead;
+        });
+
+    if (ranged) {
+        response->setCode(206);
+        char contentRange[48];
+        snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u", first, last, size);
+        response->addHeader("Content-Range", contentRange);
+    }
+    response->addHeader("Accept-Ranges", "bytes");
+    response->addHeader("Connection", "close");
+    request->send(response);
+}
+
+void handleList(AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->print("{\"device\":\"");
+    response->print(WiFi.softAPmacAddress());
+    response->print("\",\"recording\":");
+    response->print(recordingFileNumber);
+    response->print(",\"segments\":[");
+
+    portENTER_CRITICAL(&segmentsMux);
+    Segment listed[MAX_LISTED_SEGMENTS];
+    int count = min(completedCount, MAX_LISTED_SEGMENTS);
+    for (int i = 0; i < count; i++) {
+        listed[i] = completedSegments[(completedCount - count + i) % MAX_LISTED_SEGMENTS];
+    }
+    portEXIT_CRITICAL(&segmentsMux);
+
+    for (int i = 0; i < count; i++) {
+        response->printf("%s{\"id\":%d,\"file\":\"/record_%d.wav\",\"size\":%u,\"crc\":\"%08x\",\"peak\":%u,"
+                         "\"clips\":%u,\"lost\":%u,\"gaps\":%u}",
+                         i ? "," : "", listed[i].number, listed[i].number, listed[i].size, listed[i].crc,
+                         listed[i].peak, listed[i].clipCount, listed[i].lostSamples, listed[i].gapCount);
+    }
+    response->print("]}");
+    request->send(response);
+}
+
+// GET /recordings/{id}/overview?level=0..2
+// Returns the overview header followed by the entries of one level
+void handleRecordings(AsyncWebServerRequest *request) {
+    int number = 0;
+    char tail[16] = "";
+    if (sscanf(request->url().c_str(), "/recordings/%d/%15s", &number, tail) != 2 || strcmp(tail, "overview") != 0) {
+        request->send(404, "text/plain", "Not found");
+        return;
+    }
+    int level = request->hasParam("level") ? request->getParam("level")->value().toInt() : 1;
+    if (level < 0 || level >= overview::LEVELS) {
+        request->send(400, "text/plain", "Invalid level");
+        return;
+    }
+    if (number <= 0 || number == recordingFileNumber) {
+        request->send(409, "text/plain", "Segment still recording");
+        return;
+    }
+
+    char fileName[24];
+    overviewFileName(fileName, sizeof(fileName), number);
+    if (!sdTryAcquireForRead()) {
+        sendSdBusy(request);
+        return;
+    }
+    stalls.enter(networkStage, "SD open");
+    File file = SD.open(fileName, "r");
+    overview::Header header;
+    bool valid = file && file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header.magic, "OVW1", 4) == 0;
+    if (valid) file.seek(header.levels[level].offset);
+    stalls.leave(networkStage);
+    sdRelease();
+    if (!valid) {
+        request->send(404, "text/plain", "No overview for this recording");
+        return;
+    }
+
+    size_t entriesLength = header.levels[level].entryCount * sizeof(overview::Entry);
+    AsyncWebServerResponse *response = request->beginResponse(
+        "application/octet-stream", sizeof(header) + entriesLength,
+        [file, header](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+            if (index < sizeof(header)) {
+                size_t length = min(maxLen, sizeof(header) - index);
+                memcpy(buffer, (const uint8_t *)&header + index, length);
+                return length;
+            }
+            if (!sdTryAcquireForRead()) {
+                stats.readDeferrals++;
+                return RESPONSE_TRY_AGAIN;
+            }
+            stalls.enter(networkStage, "SD read");
+            size_t bytesRead = file.read(buffer, min(maxLen, (size_t)DOWNLOAD_READ_SIZE));
+            stalls.leave(networkStage);
+            sdRelease();
+            return bytesRead;
+        });
+    response->addHeader("X-Overview-Level", String(level));
+    request->send(response);
+}
+
+// Segment list with a waveform per segment, drawn from the level 1 overview
+const char indexPage[] PROGMEM = R"rawliteral(<!DOCTYPE html>
+<html><head><meta name="viewport" content="width=device-width"><title>ESP32 WAV Recorder</title></head>
+<body><h1>ESP32 WAV Recorder</h1><div id="list"></div>
+<script>
+fetch('/list').then(r => r.json()).then(d => d.segments.reverse().forEach(s => {
+  const div = document.createElement('div');
+  div.innerHTML = `<p><a href="/download?id=${s.id}">record_${s.id}.wav</a> (${s.size} bytes, peak ${s.peak}, ${s.clips} clipped, ${s.lost} samples lost in ${s.gaps} gaps)</p><canvas width="600" height="80"></canvas>`;
+  document.getElementById('list').appendChild(div);
+  fetch(`/recordings/${s.id}/overview?level=1`).then(r => r.arrayBuffer()).then(b => {
+    const v = new DataView(b), n = v.getUint32(36, true), off = 56;
+    const c = div.querySelector('canvas').getContext('2d'), w = 600 / Math.max(n, 1);
+    for (let i = 0; i < n; i++) {
+      const lo = v.getInt16(off + i * 6, true), hi = v.getInt16(off + i * 6 + 2, true);
+      c.fillRect(i * w, 40 - hi * 40 / 32768, Math.max(w, 1), Math.max((hi - lo) * 40 / 32768, 1));
+    }
+  });
+}));
+</script></body></html>)rawliteral";
+
+void handleStats(AsyncWebServerRequest *request) {
+    char json[576];
+#if RTP_STREAM
+    uint32_t rtpPackets = rtpPacketizer.packets();
+#else
+    uint32_t rtpPackets = 0, rtpSendFailures = 0;
+#endif
+    uint32_t kbps = stats.downloadMillis ? (uint32_t)(stats.downloadBytes / stats.downloadMillis) : 0;
+    snprintf(json, sizeof(json),
+             "{\"segments\":%u,\"blocksWritten\":%u,\"bytesWritten\":%llu,\"overruns\":%u,"
+             "\"minFreeBlocks\":%u,\"maxWriteMicros\":%u,\"readDeferrals\":%u,"
+             "\"downloads\":%u,\"downloadBytes\":%llu,\"downloadKBps\":%u,"
+             "\"dmaOverflows\":%u,\"lostSamples\":%u,\"maxCryptMicros\":%u,"
+             "\"rtpPackets\":%u,\"rtpSendFailures\":%u,\"stalls\":",
+             stats.segments, stats.blocksWritten, stats.bytesWritten, stats.overruns,
+             stats.minFreeBlocks, stats.maxWriteMicros, stats.readDeferrals,
+             stats.downloads, stats.downloadBytes, kbps, stats.dmaOverflows, stats.lostSamples,
+             stats.maxCryptMicros, rtpPackets, rtpSendFailures);
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->print(json);
+    stalls.printJson(*response);
+    response->print("}");
+    request->send(response);
 }
 
 void setup() {
     Serial.begin(115200);
 
-     // Increase the watchdog timeout to 1200 seconds/20 min
-     esp_task_wdt_init(1200, true);
-     esp_task_wdt_add(NULL);
+    captureStage = stalls.addStage("capture", CAPTURE_DEADLINE_MS);
+    writerStage = stalls.addStage("writer", WRITER_DEADLINE_MS);
+    networkStage = stalls.addStage("network", NETWORK_DEADLINE_MS);
+    loopStage = stalls.addStage("loop", LOOP_DEADLINE_MS);
+    stalls.begin(STALL_RESTART_MS, &Serial);
 
      for (int i = 0; i < 3; i++) {
         if (SD.begin(chipSelect)) {
@@ -149,63 +1068,64 @@ void setup() {
         SD.end();  // Reset SD interface
         delay(500);
     }
-    
+
     // If SD initialization failed after 3 attempts, go to deep sleep
     if (!sdInitialized) {
         Serial.println("Failed to initialize SD card. Entering deep sleep...");
         enterDeepSleep();
     }
+    sdMutex = xSemaphoreCreateMutex();
+#if ENCRYPT_RECORDINGS
+    if (!loadCipherKey()) {
+        Serial.println("Failed to load the recording key. Entering deep sleep...");
+        enterDeepSleep();
+    }
+#endif
     i2sConfig();
-    recordWavFile();
+    startRecording();
 
-    WiFi.softAP(ssid, password);
+    wifiSupervisor.begin();
     Serial.println("Wi-Fi AP started");
     Serial.print("IP address: ");
     Serial.println(WiFi.softAPIP());
+#if RTP_STREAM
+    startRtpStream();
+#endif
 
-    server.on("/download", HTTP_GET, [](AsyncWebServerRequest *request) {
-        if (!SD.exists(lastRecordedFile)) {
-            request->send(404, "text/plain", "File not found");
-            Serial.println("File not found");
-            enterDeepSleep();
-        }
-
-        File file = SD.open(lastRecordedFile, "r");
-        if (!file) {
-            request->send(500, "text/plain", "Failed to open file");
-            Serial.println("Failed to open file");
-            enterDeepSleep();
-        }
-
-        AsyncWebServerResponse *response = request->beginChunkedResponse(
-            "audio/wav",
-            [file](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
-                size_t bytesToRead = file.available() ? min(maxLen, static_cast<size_t>(file.available())) : 0;
-                if (bytesToRead) {
-                    file.read(buffer, bytesToRead);
-                } else {
-                    file.close();
-                }
-                return bytesToRead;
-            });
-
-        response->addHeader("Connection", "close");
+    // Latest completed segment, or a specific one with ?id=N
+    server.on("/download", HTTP_GET, handleDownload);
+    server.on("/list", HTTP_GET, handleList);
+    server.on("/stats", HTTP_GET, handleStats);
+    server.on("/recordings", HTTP_GET, handleRecordings);
+#if RTP_STREAM
+    server.on("/stream.sdp", HTTP_GET, handleSdp);
+#endif
+    server.on("/profile", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        profiler.printJson(*response);
         request->send(response);
     });
+    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send_P(200, "text/html", indexPage);
+    });
 
     server.on("/confirm", HTTP_GET, [](AsyncWebServerRequest *request) {
+        confirmTime = millis();
         Serial.println("Received confirmation from client. Stopping server...");
         stopServer = true;
         request->send(200, "text/plain", "Server shutting down");
-    });   
+    });
+
+    profiler.begin(PROFILE_INTERVAL_MS, PROFILE_TO_SERIAL ? &Serial : NULL);
 
     server.begin();
+    serverStartTime = millis();
     Serial.println("Server started");
 }
 
 void loop() {
 
-    esp_task_wdt_reset();  // Prevent watchdog reset
+    stalls.enter(loopStage, "loop");  // Heartbeat
 
     // Check if 5 minutes have passed without receiving confirmation
     if (millis() - serverStartTime >= CONFIRMATION_TIMEOUT) {
@@ -213,16 +1133,19 @@ void loop() {
         stopServer = true;
     }
 
-    // Monitor the Wi-Fi connection status
-    if (WiFi.status() != WL_CONNECTED) {
-        //Serial.println("Wi-Fi not connected. Trying to reconnect...");
-        WiFi.softAP(ssid, password);  // Reinitialize AP mode
-        delay(5000);  // Wait for the connection
-    }
+    wifiSupervisor.poll();
+    delay(10);  // Yield; Wi-Fi and shutdown are event driven
 
     if (stopServer) {
         Serial.println("Shutting down server...");
-        delay(1000);  // Wait a moment before shutting down
+        // Waits up to 5 s for the last segment by design; a slow close is
+        // the writer stage's to report. The rest is bounded
+        stalls.leave(loopStage);
+        stopRecording();
+        reportStats();
+        stalls.printReport(Serial);
+        profiler.printReport(Serial);
+        delay(100);  // Let the /confirm response go out
         server.end();
         WiFi.softAPdisconnect(true);
         WiFi.disconnect(true);
@@ -233,6 +1156,9 @@ void loop() {
             Serial.println("AP is down");
         }
         Serial.println("Server stopped. Entering deep sleep...");
+        wifiSupervisor.printReport(Serial);
+        if (confirmTime) Serial.printf("Confirm-to-sleep latency: %lu ms\n", millis() - confirmTime);
+        Serial.flush();
 
         // Set deep sleep time
        esp_sleep_enable_timer_wakeup(sleep_time_us);
@@ -240,4 +1166,4 @@ void loop() {
         // Deep Sleep (Wake-up only on power reset)
         esp_deep_sleep_start();
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include "WiFiLink.h"
+
+// Latest recording over ESPAsyncWebServer; the same routes as
+// SyncHttpTransport, served from the async_tcp task while loop() stays free.
+
+template <class Storage>
+class AsyncHttpTransport {
+public:
+    static constexpr const char *NAME = "async-http";
+    static constexpr uint32_t POLL_MS = 10;  // Requests are handled in the async_tcp task
+
+    explicit AsyncHttpTransport(Storage &storage) : _storage(storage), _server(80) {}
+
+    bool begin(const char *path) {
+        _path = path;
+        if (!startWiFi()) return false;
+        _server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+            request->send(200, "text/html", "<h1>ESP32 WAV Recorder</h1><a href='/download'>Download Recorded WAV</a>");
+        });
+        _server.on("/download", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            if (!_storage.fs().exists(_path)) {
+                request->send(404, "text/plain", "File not found");
+                return;
+            }
+            AsyncWebServerResponse *response = request->beginResponse(_storage.fs(), _path, "audio/wav", true);
+            response->addHeader("Connection", "close");
+            request->send(response);
+            _downloads++;
+        });
+        _server.on("/confirm", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            _confirmed = true;
+            request->send(200, "text/plain", "Server shutting down");
+        });
+        _server.begin();
+        return true;
+    }
+
+    void poll() {}
+    bool confirmed() const { return _confirmed; }
+    uint32_t downloads() const { return _downloads; }
+
+    void end() {
+        delay(100);  // Let the /confirm response go out
+        _server.end();
+        stopWiFi();
+    }
+
+private:
+    Storage &_storage;
+    AsyncWebServer _server;
+    const char *_path = "";
+    volatile bool _confirmed = false;  // Set in the async_tcp task
+    volatile uint32_t _downloads = 0;
+};
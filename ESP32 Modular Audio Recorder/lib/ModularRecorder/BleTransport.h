@@ -0,0 +1,187 @@
+#pragma once
+
+#include <NimBLEDevice.h>
+#include "esp_rom_crc.h"
+
+// Latest recording over BLE notifications: the GATT subset of the BLE
+// projects' protocol, with the same UUIDs, so their clients can fetch it.
+//
+//   data     (notify)        file chunks, then "END_OF_FILE"
+//   info     (read, notify)  "WAVI", size, CRC-32, offset and id 0, sent before the first chunk
+//   control  (write)         "GET <path|id> [offset]" (re)starts a transfer, "ACK" confirms it
+//
+// GET follows the other BLE projects: a path, or an id N for /record_N.wav,
+// then an optional byte offset ("GET 3 12000", "GET /record_3.wav 1000").
+// A bare "GET" restarts the latest recording. A file that does not exist
+// is announced with size 0. Without a GET, the latest recording starts
+// AUTO_START_MS after a client connects.
+// There is no L2CAP CoC, catalog or batch sync here.
+
+#ifndef BLE_DEVICE_NAME
+#define BLE_DEVICE_NAME "ESP32-WAV-Transfer"
+#endif
+
+template <class Storage>
+class BleTransport : public NimBLEServerCallbacks, public NimBLECharacteristicCallbacks {
+public:
+    static constexpr const char *NAME = "ble";
+    static constexpr uint32_t POLL_MS = 5;
+    static constexpr const char *SERVICE_UUID = "4fafc201-1fb5-459e-8fcc-c5c9c331914b";
+    static constexpr const char *DATA_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a8";
+    static constexpr const char *INFO_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26aa";
+    static constexpr const char *CONTROL_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26ab";
+    static const size_t CHUNK_SIZE = 500;      // Fits one notification at MTU 517
+    static const uint32_t CHUNK_GAP_MS = 20;   // Notifications have no flow control
+    static const uint32_t AUTO_START_MS = 5000;
+
+    explicit BleTransport(Storage &storage) : _storage(storage) {}
+
+    bool begin(const char *path) {
+        _path = path;
+        NimBLEDevice::init(BLE_DEVICE_NAME);
+        NimBLEDevice::setMTU(517);
+        _server = NimBLEDevice::createServer();
+        _server->setCallbacks(this, false);
+        NimBLEService *service = _server->createService(SERVICE_UUID);
+        _data = service->createCharacteristic(DATA_UUID, NIMBLE_PROPERTY::NOTIFY);
+        _info = service->createCharacteristic(INFO_UUID, NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+        NimBLECharacteristic *control = service->createCharacteristic(CONTROL_UUID, NIMBLE_PROPERTY::WRITE);
+        control->setCallbacks(this);
+        service->start();
+
+        NimBLEAdvertising *advertising = NimBLEDevice::getAdvertising();
+        advertising->addServiceUUID(SERVICE_UUID);
+        advertising->setScanResponse(false);
+        NimBLEDevice::startAdvertising();
+        Serial.printf("BLE advertising as %s\n", BLE_DEVICE_NAME);
+        return true;
+    }
+
+    void poll() {
+        if (!_connected) {
+            if (_file) _file.close();
+            return;
+        }
+        if (_requested) {
+            _requested = false;
+            start(_requestPath, _requestOffset);
+        } else if (!_file && !_sent && millis() - _connectedAt >= AUTO_START_MS) {
+            start(_path, 0);
+        }
+        if (_file && millis() - _lastChunk >= CHUNK_GAP_MS) sendChunk();
+    }
+
+    bool confirmed() const { return _confirmed; }
+    uint32_t downloads() const { return _downloads; }
+
+    void end() {
+        if (_file) _file.close();
+        NimBLEDevice::deinit(true);
+    }
+
+    // NimBLE host task
+    void onConnect(NimBLEServer *) {
+        _connectedAt = millis();
+        _sent = false;
+        _connected = true;
+    }
+
+    void onDisconnect(NimBLEServer *) {
+        _connected = false;
+        NimBLEDevice::startAdvertising();
+    }
+
+    void onWrite(NimBLECharacteristic *characteristic) {
+        std::string value = characteristic->getValue();
+        char path[sizeof(_requestPath)];
+        unsigned long offset = 0;
+        if (sscanf(value.c_str(), "GET %47s %lu", path, &offset) >= 1) {
+            if (path[0] == '/') {
+                strcpy(_requestPath, path);
+            } else {
+                snprintf(_requestPath, sizeof(_requestPath), "/record_%lu.wav", strtoul(path, NULL, 10));
+            }
+            _requestOffset = offset;
+            _requested = true;
+        } else if (value == "GET") {
+            snprintf(_requestPath, sizeof(_requestPath), "%s", _path);
+            _requestOffset = 0;
+            _requested = true;
+        } else if (value.compare(0, 3, "ACK") == 0) {
+            _confirmed = true;
+        }
+    }
+
+private:
+    struct __attribute__((packed)) TransferInfo {
+        char magic[4];
+        uint32_t totalSize;
+        uint32_t crc32;
+        uint32_t offset;
+        uint32_t id;
+    };
+
+    void start(const char *path, uint32_t offset) {
+        if (_file) _file.close();
+        TransferInfo info = {{'W', 'A', 'V', 'I'}, 0, 0, 0, 0};
+        _file = _storage.fs().exists(path) ? _storage.fs().open(path, "r") : File();
+        if (_file) {
+            info.totalSize = _file.size();
+            info.crc32 = fileCrc(strcmp(path, _path) == 0);
+            info.offset = offset < info.totalSize ? offset : info.totalSize;
+            _file.seek(info.offset);
+        }
+        // Size 0 tells the client the request failed
+        _info->setValue((uint8_t *)&info, sizeof(info));
+        _info->notify();
+        _lastChunk = millis();
+        Serial.printf("BLE transfer of %s from byte %u of %u\n", path, info.offset, info.totalSize);
+    }
+
+    void sendChunk() {
+        static uint8_t buffer[CHUNK_SIZE];
+        size_t length = _file.read(buffer, sizeof(buffer));
+        if (length > 0) {
+            _data->setValue(buffer, length);
+        } else {
+            _data->setValue((const uint8_t *)"END_OF_FILE", 11);
+            _file.close();
+            _sent = true;
+            _downloads++;
+        }
+        _data->notify();
+        _lastChunk = millis();
+    }
+
+    // CRC-32 of the whole file; cached for the latest recording, the one resumes ask for
+    uint32_t fileCrc(bool latest) {
+        if (latest && _crcValid) return _crc;
+        static uint8_t buffer[4096];
+        uint32_t crc = 0;
+        size_t length;
+        while ((length = _file.read(buffer, sizeof(buffer))) > 0) crc = esp_rom_crc32_le(crc, buffer, length);
+        if (latest) {
+            _crc = crc;
+            _crcValid = true;
+        }
+        return crc;
+    }
+
+    Storage &_storage;
+    const char *_path = "";
+    NimBLEServer *_server = NULL;
+    NimBLECharacteristic *_data = NULL;
+    NimBLECharacteristic *_info = NULL;
+    File _file;
+    uint32_t _crc = 0;
+    bool _crcValid = false;
+    bool _sent = false;          // Whole file out on this connection
+    unsigned long _lastChunk = 0;
+    volatile bool _connected = false;
+    volatile unsigned long _connectedAt = 0;
+    volatile bool _requested = false;
+    char _requestPath[48] = "";
+    volatile uint32_t _requestOffset = 0;
+    volatile bool _confirmed = false;
+    uint32_t _downloads = 0;
+};
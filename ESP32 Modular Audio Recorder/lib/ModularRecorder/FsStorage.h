@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Recordings on an Arduino file system. The backend mounts it:
+//
+//   struct Backend {
+//       static constexpr const char *NAME;
+//       static bool mount();
+//       static void unmount();
+//       static fs::FS &fs();
+//   };
+//
+// SdBackend.h, LittleFsBackend.h and SpiffsBackend.h are the three the
+// recorder projects used. Each pulls in only its own file system library.
+
+template <class Backend>
+class FsStorage {
+public:
+    static constexpr const char *NAME = Backend::NAME;
+    static const int MOUNT_ATTEMPTS = 3;
+
+    bool begin() {
+        for (int i = 0; i < MOUNT_ATTEMPTS; i++) {
+            if (Backend::mount()) return true;
+            Serial.printf("Retrying %s mount...\n", NAME);
+            Backend::unmount();
+            delay(100);
+        }
+        return false;
+    }
+
+    fs::FS &fs() { return Backend::fs(); }
+
+    // First unused /record_N.wav into `path`; returns N. With RECORDING_PATH
+    // set, every boot records over that one file instead.
+    int nextRecording(char *path, size_t size) {
+#ifdef RECORDING_PATH
+        snprintf(path, size, "%s", RECORDING_PATH);
+        return 1;
+#else
+        int number = 1;
+        snprintf(path, size, "/record_%d.wav", number);
+        while (fs().exists(path)) snprintf(path, size, "/record_%d.wav", ++number);
+        return number;
+#endif
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+#include "driver/i2s.h"
+#include <I2SKernels.h>
+
+// I2S microphone on the legacy driver, LEFT slot only. Samples always come
+// out as 16-bit mono PCM; the slot format decides how they are read.
+
+// 16-bit slots, read straight into the caller's buffer
+struct Pcm16Slots {
+    typedef int16_t Slot;
+    static constexpr const char *NAME = "pcm16";
+    static constexpr int SHIFT = 0;
+};
+
+// SPH0645LMH: 32-bit slots, shifted down as in the Web Interface project
+struct Sph0645Slots {
+    typedef int32_t Slot;
+    static constexpr const char *NAME = "sph0645";
+    static constexpr int SHIFT = 11;
+};
+
+template <class Format>
+class I2sMicrophone {
+public:
+    typedef typename Format::Slot Slot;
+    static constexpr const char *NAME = Format::NAME;
+    static const size_t BLOCK_SAMPLES = 512;  // Most samples per read()
+
+    I2sMicrophone(i2s_port_t port, int bck, int ws, int data) : _port(port), _bck(bck), _ws(ws), _data(data) {}
+
+    bool begin(uint32_t sampleRate) {
+        i2s_config_t config = {
+            .mode = i2s_mode_t(I2S_MODE_MASTER | I2S_MODE_RX),
+            .sample_rate = sampleRate,
+            .bits_per_sample = sizeof(Slot) == 4 ? I2S_BITS_PER_SAMPLE_32BIT : I2S_BITS_PER_SAMPLE_16BIT,
+            .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+            .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+            .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+            .dma_buf_count = 8,
+            .dma_buf_len = 256,
+        };
+        if (i2s_driver_install(_port, &config, 0, NULL) != ESP_OK) return false;
+        i2s_pin_config_t pins = {
+            .bck_io_num = _bck,
+            .ws_io_num = _ws,
+            .data_out_num = I2S_PIN_NO_CHANGE,
+            .data_in_num = _data,
+        };
+        return i2s_set_pin(_port, &pins) == ESP_OK;
+    }
+
+    // Blocks until `count` samples (at most BLOCK_SAMPLES) are in; returns the samples read
+    size_t read(int16_t *samples, size_t count) {
+        if (count > BLOCK_SAMPLES) count = BLOCK_SAMPLES;
+        size_t bytesRead = 0;
+        if constexpr (sizeof(Slot) == sizeof(int16_t)) {
+            i2s_read(_port, samples, count * sizeof(int16_t), &bytesRead, portMAX_DELAY);
+            return bytesRead / sizeof(int16_t);
+        } else {
+            i2s_read(_port, _slots, count * sizeof(Slot), &bytesRead, portMAX_DELAY);
+            size_t read = bytesRead / sizeof(Slot);
+            i2s_kernels::convert32to16(_slots, samples, read, Format::SHIFT);
+            return read;
+        }
+    }
+
+    void end() { i2s_driver_uninstall(_port); }
+
+private:
+    i2s_port_t _port;
+    int _bck, _ws, _data;
+    Slot _slots[sizeof(Slot) == sizeof(int16_t) ? 1 : BLOCK_SAMPLES];  // 32-bit reads only
+};
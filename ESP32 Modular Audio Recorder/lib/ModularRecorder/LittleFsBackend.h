@@ -0,0 +1,11 @@
+#pragma once
+
+#include <LittleFS.h>
+
+// LittleFS on the "spiffs" partition, formatted on the first mount
+struct LittleFsBackend {
+    static constexpr const char *NAME = "littlefs";
+    static bool mount() { return LittleFS.begin(true); }
+    static void unmount() { LittleFS.end(); }
+    static fs::FS &fs() { return LittleFS; }
+};
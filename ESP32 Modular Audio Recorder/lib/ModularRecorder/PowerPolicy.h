@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+#include "esp_sleep.h"
+
+// What happens once the recording is served. A policy with SLEEPS false
+// compiles the whole sleep path out of Recorder.
+
+// Record once, then keep serving until reset
+struct AlwaysOn {
+    static constexpr const char *NAME = "always-on";
+    static constexpr bool SLEEPS = false;
+    static constexpr uint32_t SERVE_TIMEOUT_MS = 0;
+    static void sleep() {}
+};
+
+// Serve until the client confirms or the timeout passes, then deep sleep;
+// every wake records a new file, like the deep sleep and auto shutdown projects
+template <uint32_t SleepSeconds, uint32_t ServeTimeoutSeconds>
+struct DeepSleepCycle {
+    static constexpr const char *NAME = "deep-sleep";
+    static constexpr bool SLEEPS = true;
+    static constexpr uint32_t SERVE_TIMEOUT_MS = ServeTimeoutSeconds * 1000;
+
+    static void sleep() {
+        Serial.printf("Entering deep sleep for %u seconds...\n", SleepSeconds);
+        Serial.flush();
+        esp_sleep_enable_timer_wakeup((uint64_t)SleepSeconds * 1000000);
+        esp_deep_sleep_start();
+    }
+};
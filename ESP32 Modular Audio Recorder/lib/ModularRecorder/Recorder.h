@@ -0,0 +1,133 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "esp_timer.h"
+#include <WavHeader.h>
+#include "RecorderOptions.h"
+
+// The record -> store -> serve cycle the recorder projects each had their
+// own copy of, composed from components chosen at compile time (see
+// src/main.cpp and RecorderOptions.h):
+//
+//   Microphone  I2sMicrophone<Pcm16Slots | Sph0645Slots>
+//   Storage     FsStorage<SdBackend | LittleFsBackend | SpiffsBackend>
+//   Transport   SyncHttpTransport | AsyncHttpTransport | BleTransport
+//   Power       AlwaysOn | DeepSleepCycle<sleep s, serve timeout s>
+//
+// There are no virtual calls; the components are template parameters, and
+// `if constexpr` on their traits drops the paths a configuration does not
+// use. Boot timing is printed as one "Boot [env]: ..." line, which
+// tools/boot_report.py collects next to the build sizes.
+
+struct BootTiming {
+    int64_t i2sStarted;      // Microseconds since app start
+    int64_t storageMounted;
+    int64_t firstBlock;      // First block of samples in the file
+    int64_t recordingDone;
+    int64_t transportUp;
+};
+
+template <class Microphone, class Storage, template <class> class Transport, class Power>
+class Recorder {
+public:
+    Recorder(Microphone &microphone, uint32_t sampleRate, uint32_t recordSeconds)
+        : _microphone(microphone), _transport(_storage), _sampleRate(sampleRate), _recordSeconds(recordSeconds) {}
+
+    void setup() {
+        Serial.printf("Recorder [%s]: mic %s, storage %s, transport %s, power %s\n", RECORDER_ENV,
+                      Microphone::NAME, Storage::NAME, Transport<Storage>::NAME, Power::NAME);
+        if (!_microphone.begin(_sampleRate)) return fail("I2S initialization failed");
+        _boot.i2sStarted = esp_timer_get_time();
+        if (!_storage.begin()) return fail("Storage mount failed");
+        _boot.storageMounted = esp_timer_get_time();
+        if (!record()) return fail("Recording failed");
+        _microphone.end();
+        if (!_transport.begin(_path)) return fail("Transport failed to start");
+        _boot.transportUp = esp_timer_get_time();
+        reportBoot();
+        _servingSince = millis();
+        _serving = true;
+    }
+
+    void loop() {
+        if (!_serving) {
+            delay(1000);  // Setup failed and the policy does not sleep
+            return;
+        }
+        _transport.poll();
+        if constexpr (Power::SLEEPS) {
+            bool timedOut = millis() - _servingSince >= Power::SERVE_TIMEOUT_MS;
+            if (_transport.confirmed() || timedOut) {
+                Serial.printf("%s after %u download(s), stopping %s\n", timedOut ? "No confirmation" : "Confirmed",
+                              _transport.downloads(), Transport<Storage>::NAME);
+                _transport.end();
+                Power::sleep();
+            }
+        }
+        delay(Transport<Storage>::POLL_MS);
+    }
+
+private:
+    bool record() {
+        _storage.nextRecording(_path, sizeof(_path));
+        File file = _storage.fs().open(_path, FILE_WRITE);
+        if (!file) return false;
+
+        // Placeholder header, with room for RF64
+        uint8_t header[wav::HEADER_BYTES];
+        wav::fillHeader(header, _sampleRate, 1, 16, 0);
+        file.write(header, sizeof(header));
+
+        // Length by sample count, so any block size gives the exact duration
+        static int16_t block[Microphone::BLOCK_SAMPLES];
+        const uint64_t total = (uint64_t)_sampleRate * _recordSeconds;
+        uint64_t recorded = 0;
+        Serial.printf("Recording %u s to %s...\n", _recordSeconds, _path);
+        while (recorded < total) {
+            size_t want = total - recorded < Microphone::BLOCK_SAMPLES ? total - recorded : Microphone::BLOCK_SAMPLES;
+            size_t got = _microphone.read(block, want);
+            if (got == 0) break;
+            size_t bytes = got * sizeof(int16_t);
+            if (file.write((const uint8_t *)block, bytes) != bytes) {
+                Serial.println("Write failed (storage full?), closing the recording");
+                break;
+            }
+            if (!_boot.firstBlock) _boot.firstBlock = esp_timer_get_time();
+            recorded += got;
+        }
+        _boot.recordingDone = esp_timer_get_time();
+
+        uint64_t dataSize = recorded * sizeof(int16_t);
+        wav::fillHeader(header, _sampleRate, 1, 16, dataSize);
+        file.seek(0);
+        file.write(header, sizeof(header));
+        file.close();
+        Serial.printf("Saved %s (%llu bytes)\n", _path, dataSize + wav::HEADER_BYTES);
+        return recorded > 0;
+    }
+
+    // Transport start is timed from the end of the recording, so the
+    // recording length does not hide it
+    void reportBoot() {
+        Serial.printf("Boot [%s]: i2s %.1f ms, storage %.1f ms, first block %.1f ms, transport %.1f ms, free heap %u\n",
+                      RECORDER_ENV, _boot.i2sStarted / 1000.0, _boot.storageMounted / 1000.0,
+                      _boot.firstBlock / 1000.0, (_boot.transportUp - _boot.recordingDone) / 1000.0,
+                      ESP.getFreeHeap());
+    }
+
+    void fail(const char *what) {
+        Serial.println(what);
+        if constexpr (Power::SLEEPS) Power::sleep();
+    }
+
+    Microphone &_microphone;
+    Storage _storage;
+    Transport<Storage> _transport;
+    uint32_t _sampleRate;
+    uint32_t _recordSeconds;
+    char _path[24] = "";
+    BootTiming _boot = {};
+    unsigned long _servingSince = 0;
+    bool _serving = false;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+// Component ids for the RECORDER_* build flags, set per env in platformio.ini:
+//
+//   -DRECORDER_MIC=MIC_SPH0645 -DRECORDER_STORAGE=STORAGE_SD
+//   -DRECORDER_TRANSPORT=TRANSPORT_ASYNC_HTTP -DRECORDER_POWER=POWER_DEEP_SLEEP
+//
+// src/main.cpp includes only the headers of the chosen components, so the
+// others, and the libraries they use, are never compiled.
+
+#define MIC_PCM16 1             // 16-bit slots, as most of the projects read the mic
+#define MIC_SPH0645 2           // 32-bit slots, 18 valid bits at the top
+
+#define STORAGE_SD 1            // SPI SD card
+#define STORAGE_LITTLEFS 2      // Flash, "spiffs" partition
+#define STORAGE_SPIFFS 3
+
+#define TRANSPORT_SYNC_HTTP 1   // WebServer on the soft AP
+#define TRANSPORT_ASYNC_HTTP 2  // ESPAsyncWebServer on the soft AP
+#define TRANSPORT_BLE 3         // NimBLE GATT notifications
+
+#define POWER_ALWAYS_ON 1       // Record once, then serve until reset
+#define POWER_DEEP_SLEEP 2      // Serve until confirmed or timed out, sleep, record again on wake
+
+#ifndef RECORDER_MIC
+#define RECORDER_MIC MIC_PCM16
+#endif
+#ifndef RECORDER_STORAGE
+#define RECORDER_STORAGE STORAGE_SD
+#endif
+#ifndef RECORDER_TRANSPORT
+#define RECORDER_TRANSPORT TRANSPORT_ASYNC_HTTP
+#endif
+#ifndef RECORDER_POWER
+#define RECORDER_POWER POWER_DEEP_SLEEP
+#endif
+#ifndef RECORDER_ENV
+#define RECORDER_ENV "custom"   // Set to the env name by tools/size_report.py
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <SPI.h>
+#include <SD.h>
+
+#ifndef SD_CHIP_SELECT
+#define SD_CHIP_SELECT 5
+#endif
+
+// SPI SD card, same wiring as the SD projects
+struct SdBackend {
+    static constexpr const char *NAME = "sd";
+    static bool mount() { return SD.begin(SD_CHIP_SELECT); }
+    static void unmount() { SD.end(); }
+    static fs::FS &fs() { return SD; }
+};
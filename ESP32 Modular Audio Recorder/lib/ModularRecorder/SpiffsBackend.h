@@ -0,0 +1,11 @@
+#pragma once
+
+#include <SPIFFS.h>
+
+// SPIFFS, formatted on the first mount
+struct SpiffsBackend {
+    static constexpr const char *NAME = "spiffs";
+    static bool mount() { return SPIFFS.begin(true); }
+    static void unmount() { SPIFFS.end(); }
+    static fs::FS &fs() { return SPIFFS; }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <WebServer.h>
+#include "WiFiLink.h"
+
+// Latest recording over the synchronous WebServer. Each download is served
+// from poll(), so nothing else runs while it streams.
+//
+//   /          link to the recording
+//   /download  the recording
+//   /confirm   client has it (the power policy may sleep now)
+//
+// Transport interface, shared with AsyncHttpTransport and BleTransport:
+// begin(path), poll(), confirmed(), downloads(), end(), and the NAME and
+// POLL_MS traits.
+
+template <class Storage>
+class SyncHttpTransport {
+public:
+    static constexpr const char *NAME = "sync-http";
+    static constexpr uint32_t POLL_MS = 1;  // handleClient() returns at once when idle
+
+    explicit SyncHttpTransport(Storage &storage) : _storage(storage), _server(80) {}
+
+    bool begin(const char *path) {
+        _path = path;
+        if (!startWiFi()) return false;
+        _server.on("/", HTTP_GET, [this]() {
+            _server.send(200, "text/html", "<h1>ESP32 WAV Recorder</h1><a href='/download'>Download Recorded WAV</a>");
+        });
+        _server.on("/download", HTTP_GET, [this]() { download(); });
+        _server.on("/confirm", HTTP_GET, [this]() {
+            _confirmed = true;
+            _server.send(200, "text/plain", "Server shutting down");
+        });
+        _server.begin();
+        return true;
+    }
+
+    void poll() { _server.handleClient(); }
+    bool confirmed() const { return _confirmed; }
+    uint32_t downloads() const { return _downloads; }
+
+    void end() {
+        _server.stop();
+        stopWiFi();
+    }
+
+private:
+    void download() {
+        File file = _storage.fs().open(_path, "r");
+        if (!file) {
+            _server.send(404, "text/plain", "File not found");
+            return;
+        }
+        _server.streamFile(file, "audio/wav");
+        file.close();
+        _downloads++;
+    }
+
+    Storage &_storage;
+    WebServer _server;
+    const char *_path = "";
+    bool _confirmed = false;
+    uint32_t _downloads = 0;
+};
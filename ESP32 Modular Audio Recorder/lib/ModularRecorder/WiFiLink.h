@@ -0,0 +1,52 @@
+#pragma once
+
+#include <WiFi.h>
+
+// Network for the HTTP transports. By default a soft AP with the
+// credentials and address the other projects use. With WIFI_STA_SSID set,
+// the recorder joins that network instead, like the I2S Audio Recorder
+// with Web Server did, and prints the address it gets. All of these can be
+// set as build flags.
+#ifndef AP_SSID
+#define AP_SSID "ESP32-WAV-AP"
+#endif
+#ifndef AP_PASSWORD
+#define AP_PASSWORD "12345678"
+#endif
+#ifndef AP_CHANNEL
+#define AP_CHANNEL 6
+#endif
+#ifndef WIFI_STA_PASSWORD
+#define WIFI_STA_PASSWORD ""
+#endif
+#ifndef WIFI_STA_TIMEOUT_MS
+#define WIFI_STA_TIMEOUT_MS 20000   // Give up and report the transport as failed
+#endif
+
+inline bool startWiFi() {
+#ifdef WIFI_STA_SSID
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_STA_SSID, WIFI_STA_PASSWORD);
+    Serial.printf("Connecting to Wi-Fi %s...\n", WIFI_STA_SSID);
+    unsigned long started = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        if (millis() - started >= WIFI_STA_TIMEOUT_MS) return false;
+        delay(100);
+    }
+    Serial.printf("Connected to Wi-Fi %s, IP address: %s\n", WIFI_STA_SSID, WiFi.localIP().toString().c_str());
+#else
+    if (!WiFi.softAP(AP_SSID, AP_PASSWORD, AP_CHANNEL)) return false;
+    WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
+    Serial.printf("Wi-Fi AP %s started, IP address: %s\n", AP_SSID, WiFi.softAPIP().toString().c_str());
+#endif
+    return true;
+}
+
+inline void stopWiFi() {
+#ifdef WIFI_STA_SSID
+    WiFi.disconnect(true);
+#else
+    WiFi.softAPdisconnect(true);
+#endif
+    WiFi.mode(WIFI_OFF);
+}
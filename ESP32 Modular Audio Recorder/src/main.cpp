@@ -0,0 +1,76 @@
+#include <Arduino.h>
+#include <RecorderOptions.h>
+#include <Recorder.h>
+#include <PowerPolicy.h>
+#include <I2sMicrophone.h>
+#include <FsStorage.h>
+
+// One firmware for the recorder projects: the RECORDER_* build flags of the
+// env (platformio.ini) pick the components below, and only their headers
+// and libraries are compiled. See lib/ModularRecorder/RecorderOptions.h.
+
+#if RECORDER_STORAGE == STORAGE_SD
+#include <SdBackend.h>
+typedef FsStorage<SdBackend> Storage;
+#elif RECORDER_STORAGE == STORAGE_LITTLEFS
+#include <LittleFsBackend.h>
+typedef FsStorage<LittleFsBackend> Storage;
+#elif RECORDER_STORAGE == STORAGE_SPIFFS
+#include <SpiffsBackend.h>
+typedef FsStorage<SpiffsBackend> Storage;
+#else
+#error "Unknown RECORDER_STORAGE"
+#endif
+
+#if RECORDER_TRANSPORT == TRANSPORT_SYNC_HTTP
+#include <SyncHttpTransport.h>
+template <class S> using Transport = SyncHttpTransport<S>;
+#elif RECORDER_TRANSPORT == TRANSPORT_ASYNC_HTTP
+#include <AsyncHttpTransport.h>
+template <class S> using Transport = AsyncHttpTransport<S>;
+#elif RECORDER_TRANSPORT == TRANSPORT_BLE
+#include <BleTransport.h>
+template <class S> using Transport = BleTransport<S>;
+#else
+#error "Unknown RECORDER_TRANSPORT"
+#endif
+
+#if RECORDER_MIC == MIC_PCM16
+typedef I2sMicrophone<Pcm16Slots> Microphone;
+#elif RECORDER_MIC == MIC_SPH0645
+typedef I2sMicrophone<Sph0645Slots> Microphone;
+#else
+#error "Unknown RECORDER_MIC"
+#endif
+
+// Deep sleep: 10 minutes between recordings, 5 minutes to fetch each one
+#if RECORDER_POWER == POWER_ALWAYS_ON
+typedef AlwaysOn Power;
+#elif RECORDER_POWER == POWER_DEEP_SLEEP
+typedef DeepSleepCycle<10 * 60, 5 * 60> Power;
+#else
+#error "Unknown RECORDER_POWER"
+#endif
+
+// I2S Configuration
+#define I2S_BCK_IO 26
+#define I2S_WS_IO 25
+#define I2S_DATA_IO 22
+#ifndef SAMPLE_RATE
+#define SAMPLE_RATE 44100
+#endif
+#ifndef RECORD_SECONDS
+#define RECORD_SECONDS 10
+#endif
+
+Microphone microphone(I2S_NUM_0, I2S_BCK_IO, I2S_WS_IO, I2S_DATA_IO);
+Recorder<Microphone, Storage, Transport, Power> recorder(microphone, SAMPLE_RATE, RECORD_SECONDS);
+
+void setup() {
+    Serial.begin(115200);
+    recorder.setup();
+}
+
+void loop() {
+    recorder.loop();
+}
@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+# Collects the "Boot [env]: ..." lines from serial logs into sizes.csv and
+# prints the table of every configuration:
+#
+#   pio run -e pcm16-sd-ble -t upload && pio device monitor | tee boot.log
+#   python3 tools/boot_report.py boot.log
+#
+# The last boot line of each env wins.
+
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import configurations
+
+BOOT_LINE = re.compile(r"Boot \[([^\]]+)\]: i2s ([\d.]+) ms, storage ([\d.]+) ms, first block ([\d.]+) ms, "
+                       r"transport ([\d.]+) ms, free heap (\d+)")
+
+
+def main(paths):
+    csv_path = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "sizes.csv"))
+    found = 0
+    for path in paths:
+        with open(path, errors="replace") as f:
+            for line in f:
+                match = BOOT_LINE.search(line)
+                if not match:
+                    continue
+                env = match.group(1)
+                configurations.update(csv_path, env, dict(zip(configurations.BOOT_FIELDS, match.groups()[1:])))
+                found += 1
+    print("%d boot line(s) read\n" % found)
+    print(configurations.table(csv_path))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,42 @@
+# sizes.csv: one row per env with its build sizes (tools/size_report.py,
+# written by every build) and boot timing (tools/boot_report.py, from a
+# serial log). Each script fills its own columns and keeps the others.
+
+import csv
+import os
+
+SIZE_FIELDS = ["image", "text", "data", "bss"]
+BOOT_FIELDS = ["i2s_ms", "storage_ms", "first_block_ms", "transport_ms", "free_heap"]
+FIELDS = ["env"] + SIZE_FIELDS + BOOT_FIELDS
+
+
+def load(path):
+    rows = {}
+    if os.path.exists(path):
+        with open(path, newline="") as f:
+            for row in csv.DictReader(f):
+                rows[row["env"]] = row
+    return rows
+
+
+def save(path, rows):
+    with open(path, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=FIELDS, restval="")
+        writer.writeheader()
+        for name in sorted(rows):
+            writer.writerow({field: rows[name].get(field, "") for field in FIELDS})
+
+
+def update(path, env, values):
+    rows = load(path)
+    row = rows.setdefault(env, {"env": env})
+    row.update(values)
+    save(path, rows)
+
+
+def table(path):
+    rows = load(path)
+    lines = ["| " + " | ".join(FIELDS) + " |", "|" + "---|" * len(FIELDS)]
+    for name in sorted(rows):
+        lines.append("| " + " | ".join(rows[name].get(field, "") for field in FIELDS) + " |")
+    return "\n".join(lines)
@@ -0,0 +1,29 @@
+# Extra script for every env (extra_scripts = pre:tools/size_report.py).
+# Passes the env name to the firmware for its "Boot [env]" line, and after
+# each build records the image size and the text/data/bss sections of the
+# configuration in sizes.csv.
+
+import os
+import subprocess
+import sys
+
+Import("env")
+
+TOOLS = os.path.join(env.subst("$PROJECT_DIR"), "tools")
+sys.path.insert(0, TOOLS)
+import configurations
+
+env.Append(CPPDEFINES=[("RECORDER_ENV", env.StringifyMacro(env["PIOENV"]))])
+
+
+def record_size(source, target, env):
+    image = os.path.getsize(target[0].get_abspath())
+    # Berkeley format: text data bss dec hex filename
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-B", source[0].get_abspath()], text=True)
+    text, data, bss = output.splitlines()[1].split()[:3]
+    sizes = {"image": str(image), "text": text, "data": data, "bss": bss}
+    configurations.update(os.path.join(env.subst("$PROJECT_DIR"), "sizes.csv"), env["PIOENV"], sizes)
+    print("Size [%s]: image %s bytes, text %s, data %s, bss %s" % (env["PIOENV"], image, text, data, bss))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", record_size)
@@ -0,0 +1,123 @@
+#include "StallMonitor.h"
+
+#include "esp_system.h"
+
+#define LAST_STALL_MAGIC 0x53544C4C  // "STLL"
+
+// Survives esp_restart(), so the next boot can say which stage was stuck
+struct LastStall {
+    uint32_t magic;
+    char stage[16];
+    char call[32];
+    uint32_t stalledMs;
+};
+RTC_NOINIT_ATTR static LastStall lastStall;
+
+int StallMonitor::addStage(const char *name, uint32_t deadlineMs) {
+    if (_stageCount == MAX_STAGES) return -1;
+    Stage &stage = _stages[_stageCount];
+    memset(&stage, 0, sizeof(stage));
+    stage.name = name;
+    stage.deadlineMs = deadlineMs;
+    return _stageCount++;
+}
+
+bool StallMonitor::begin(uint32_t restartMs, Print *log) {
+    _restartMs = restartMs;
+    _log = log;
+    if (lastStall.magic == LAST_STALL_MAGIC && esp_reset_reason() == ESP_RST_SW && _log) {
+        lastStall.stage[sizeof(lastStall.stage) - 1] = 0;
+        lastStall.call[sizeof(lastStall.call) - 1] = 0;
+        _log->printf("Restarted after a stall: %s blocked in %s for %u ms\n", lastStall.stage, lastStall.call,
+                     lastStall.stalledMs);
+    }
+    lastStall.magic = 0;
+    // Above the recorders' capture task, so a busy capture cannot hide its own stall
+    return xTaskCreate(task, "stall_monitor", 3072, this, configMAX_PRIORITIES - 2, NULL) == pdPASS;
+}
+
+void StallMonitor::task(void *parameter) {
+    StallMonitor *self = (StallMonitor *)parameter;
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(CHECK_MS));
+        self->check();
+    }
+}
+
+void StallMonitor::check() {
+    uint32_t now = millis();
+    for (int i = 0; i < _stageCount; i++) {
+        Stage &stage = _stages[i];
+        const char *call = stage.call;
+        uint32_t since = stage.since;
+        uint32_t calls = stage.calls;
+
+        if (stage.stalledCall) {
+            uint32_t stalledMs = now - stage.stalledSince;
+            if (call && calls == stage.stalledCall) {
+                if (_restartMs && stalledMs >= _restartMs) restart(stage, stalledMs);
+                continue;
+            }
+            // Moved on; the stall lasted until about now
+            if (stalledMs > stage.longestMs) {
+                stage.longestMs = stalledMs;
+                stage.longestCall = stage.stalledName;
+            }
+            stage.stalledCall = 0;
+            if (_log) _log->printf("Stall over: %s spent %u ms in %s\n", stage.name, stalledMs, stage.stalledName);
+        }
+
+        if (!call || now - since <= stage.deadlineMs) continue;
+        stage.stalls++;
+        stage.stalledCall = calls;
+        stage.stalledName = call;
+        stage.stalledSince = since;
+        if (_log) {
+            _log->printf("Stall: %s blocked in %s for %u ms (deadline %u ms)\n", stage.name, call, now - since,
+                         stage.deadlineMs);
+        }
+    }
+}
+
+void StallMonitor::restart(const Stage &stage, uint32_t stalledMs) {
+    lastStall.magic = LAST_STALL_MAGIC;
+    strlcpy(lastStall.stage, stage.name, sizeof(lastStall.stage));
+    strlcpy(lastStall.call, stage.stalledName, sizeof(lastStall.call));
+    lastStall.stalledMs = stalledMs;
+    if (_log) {
+        _log->printf("Restarting: %s blocked in %s for %u ms\n", stage.name, stage.stalledName, stalledMs);
+        _log->flush();
+    }
+    esp_restart();
+}
+
+uint32_t StallMonitor::totalStalls() const {
+    uint32_t total = 0;
+    for (int i = 0; i < _stageCount; i++) total += _stages[i].stalls;
+    return total;
+}
+
+void StallMonitor::printReport(Print &out) {
+    out.print("Stalls:");
+    for (int i = 0; i < _stageCount; i++) {
+        const Stage &stage = _stages[i];
+        out.printf("%s %s %u", i ? "," : "", stage.name, stage.stalls);
+        if (stage.longestCall) out.printf(" (longest %u ms in %s)", stage.longestMs, stage.longestCall);
+    }
+    out.println();
+}
+
+void StallMonitor::printJson(Print &out) {
+    uint32_t now = millis();
+    out.print("[");
+    for (int i = 0; i < _stageCount; i++) {
+        const Stage &stage = _stages[i];
+        uint32_t stalledMs = stage.stalledCall ? now - stage.stalledSince : 0;
+        out.printf("%s{\"stage\":\"%s\",\"deadlineMs\":%u,\"stalls\":%u,\"longestMs\":%u,\"longestCall\":\"%s\","
+                   "\"stalledMs\":%u}",
+                   i ? "," : "", stage.name, stage.deadlineMs, stage.stalls, stage.longestMs,
+                   stage.longestCall ? stage.longestCall : "", stalledMs);
+    }
+    out.print("]");
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Per-stage stall detection, in place of one long task watchdog timeout.
+//
+// Each stage of a firmware (capture, SD writer, network, BLE, ...) marks the
+// blocking call it is about to make with enter() and clears it with leave().
+// A stage that is a loop rather than a call can call enter() once per
+// iteration as a heartbeat. A monitor task checks every CHECK_MS: a stage
+// that has been in the same call for longer than its deadline is reported
+// once as stalled (stage, call, time so far), and again with the total when
+// it moves on. /stats-style counters keep the stall count and the longest
+// stall per stage.
+//
+// A stage still stalled after `restartMs` restarts the chip. The stall is
+// kept in RTC memory and begin() prints it on the next boot.
+//
+// Link it from another project with `lib_extra_dirs = ../ESP32 System Viewer/lib`:
+//
+//   StallMonitor stalls;
+//   int writer = stalls.addStage("writer", 500);   // Before begin()
+//   stalls.begin(30000, &Serial);
+//   stalls.enter(writer, "SD write"); file.write(...); stalls.leave(writer);
+
+class StallMonitor {
+public:
+    static const int MAX_STAGES = 6;
+    static const uint32_t CHECK_MS = 50;
+
+    struct Stage {
+        const char *name;
+        uint32_t deadlineMs;
+        // Written by the stage's task
+        const char *volatile call;   // NULL while not in a blocking call
+        volatile uint32_t since;     // millis() at enter()
+        volatile uint32_t calls;     // enter() count, tells a new call from the same one
+        // Written by the monitor
+        uint32_t stalledCall;        // `calls` of the call reported as stalled, 0 if none
+        const char *stalledName;
+        uint32_t stalledSince;
+        uint32_t stalls;
+        uint32_t longestMs;
+        const char *longestCall;
+    };
+
+    // Returns the stage index for enter()/leave(), -1 when full
+    int addStage(const char *name, uint32_t deadlineMs);
+
+    // Starts the monitor task; restartMs 0 never restarts
+    bool begin(uint32_t restartMs, Print *log);
+
+    // `call` must be a string literal (it is kept, not copied). It is set
+    // last, so the monitor never pairs it with a stale `since`.
+    inline void enter(int stage, const char *call) {
+        Stage &s = _stages[stage];
+        s.since = millis();
+        s.calls = s.calls + 1;
+        s.call = call;
+    }
+    inline void leave(int stage) { _stages[stage].call = NULL; }
+
+    // Stalls so far, all stages
+    uint32_t totalStalls() const;
+
+    void printReport(Print &out);
+    // [{"stage":...,"deadlineMs":...,"stalls":...,"longestMs":...,"longestCall":...,"stalledMs":...}, ...]
+    void printJson(Print &out);
+
+private:
+    static void task(void *parameter);
+    void check();
+    void restart(const Stage &stage, uint32_t stalledMs);
+
+    Stage _stages[MAX_STAGES];
+    int _stageCount = 0;
+    uint32_t _restartMs = 0;
+    Print *_log = NULL;
+};
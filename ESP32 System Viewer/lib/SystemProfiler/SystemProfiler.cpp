@@ -0,0 +1,272 @@
+#include "SystemProfiler.h"
+
+#include "esp_heap_caps.h"
+#include "esp_freertos_hooks.h"
+
+#define PROBE_GAP_CYCLES 50     // A longer gap between two cycle counter reads is an interrupt
+#define ISR_LOAD_SMOOTHING 0.25f
+#define IDLE_GAP_CYCLES 2000    // A longer gap between two idle hook calls is time spent elsewhere
+
+// Idle time per core without run-time stats, written only by that core's idle
+// task. 32-bit cycle counts wrap after ~17 s at 240 MHz, so sampling
+// intervals must stay below that.
+static volatile uint32_t idleCycles[portNUM_PROCESSORS];
+static volatile uint32_t idleLastCall[portNUM_PROCESSORS];
+
+// Returning false keeps the idle task looping (no WAITI), so the gaps
+// between calls can be timed
+static bool IRAM_ATTR idleHook() {
+    int core = xPortGetCoreID();
+    uint32_t now = ESP.getCycleCount();
+    uint32_t gap = now - idleLastCall[core];
+    if (gap < IDLE_GAP_CYCLES) idleCycles[core] += gap;
+    idleLastCall[core] = now;
+    return false;
+}
+
+// Cycles taken from the calling task by interrupts during `window` cycles.
+// Runs from IRAM so cache misses are not counted as interrupts.
+static uint32_t IRAM_ATTR measureStolenCycles(uint32_t window) {
+    uint32_t start = ESP.getCycleCount();
+    uint32_t last = start;
+    uint32_t stolen = 0;
+    while (last - start < window) {
+        uint32_t now = ESP.getCycleCount();
+        if (now - last > PROBE_GAP_CYCLES) stolen += now - last;
+        last = now;
+    }
+    return stolen;
+}
+
+bool SystemProfiler::begin(uint32_t intervalMs, Print *log) {
+    _intervalMs = intervalMs;
+    _log = log;
+    _taskCount = 0;
+    _heapCount = 0;
+    _lastTotalRunTime = 0;
+    _samples = 0;
+    _sampleMicros = 0;
+    _lock = xSemaphoreCreateMutex();
+    if (!_lock) return false;
+
+    _lastSampleMicros = micros();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        _isrLoad[core] = 0;
+        _coreLoad[core] = 0;
+        _lastIdleCycles[core] = idleCycles[core];
+        if (!runtimeStatsAvailable() && esp_register_freertos_idle_hook_for_cpu(idleHook, core) != ESP_OK) {
+            return false;
+        }
+        if (xTaskCreatePinnedToCore(probeTask, "isr_probe", 2048, this, configMAX_PRIORITIES - 1,
+                                    &_probes[core], core) != pdPASS) {
+            return false;
+        }
+    }
+    sample();
+    return xTaskCreate(task, "profiler", 4096, this, 1, NULL) == pdPASS;
+}
+
+bool SystemProfiler::runtimeStatsAvailable() const {
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SystemProfiler::task(void *parameter) {
+    SystemProfiler *self = (SystemProfiler *)parameter;
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(self->_intervalMs));
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            xTaskNotifyGive(self->_probes[core]);
+        }
+        self->sample();
+        if (self->_log) self->printReport(*self->_log);
+    }
+}
+
+void SystemProfiler::probeTask(void *parameter) {
+    SystemProfiler *self = (SystemProfiler *)parameter;
+    int core = xPortGetCoreID();
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t window = PROBE_MICROS * ESP.getCpuFreqMHz();
+        float load = measureStolenCycles(window) * 100.0f / window;
+        // A 1 ms window sees only a few interrupts, so smooth across intervals
+        self->_isrLoad[core] += (load - self->_isrLoad[core]) * ISR_LOAD_SMOOTHING;
+    }
+}
+
+void SystemProfiler::sample() {
+    uint32_t start = micros();
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    sampleTasks();
+    sampleCores();
+    sampleHeaps();
+    _samples++;
+    _sampleMicros = micros() - start;
+    xSemaphoreGive(_lock);
+}
+
+void SystemProfiler::sampleTasks() {
+#if configUSE_TRACE_FACILITY
+    static TaskStatus_t status[MAX_TASKS];
+    static TaskSample next[MAX_TASKS];
+    uint32_t totalRunTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(status, MAX_TASKS, &totalRunTime);
+    uint32_t elapsed = totalRunTime - _lastTotalRunTime;
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        TaskSample &task = next[i];
+        strncpy(task.name, status[i].pcTaskName, sizeof(task.name) - 1);
+        task.name[sizeof(task.name) - 1] = 0;
+        task.handle = status[i].xHandle;
+        task.priority = status[i].uxCurrentPriority;
+#if configTASKLIST_INCLUDE_COREID
+        task.core = status[i].xCoreID == tskNO_AFFINITY ? -1 : (int)status[i].xCoreID;
+#else
+        task.core = -1;
+#endif
+        task.stackFree = status[i].usStackHighWaterMark;
+#if configGENERATE_RUN_TIME_STATS
+        task.runTime = status[i].ulRunTimeCounter;
+        // Tasks seen for the first time are measured since boot
+        uint32_t previous = 0;
+        uint32_t window = totalRunTime;
+        for (size_t j = 0; j < _taskCount; j++) {
+            if (_tasks[j].handle == task.handle) {
+                previous = _tasks[j].runTime;
+                window = elapsed;
+                break;
+            }
+        }
+        task.cpu = window ? (task.runTime - previous) * 100.0f / window : 0;
+#else
+        task.runTime = 0;
+        task.cpu = -1;
+#endif
+        // Busiest first
+        size_t k = i;
+        while (k > 0 && next[k - 1].cpu < task.cpu) k--;
+        if (k != i) {
+            TaskSample moved = task;
+            memmove(&next[k + 1], &next[k], (i - k) * sizeof(TaskSample));
+            next[k] = moved;
+        }
+    }
+    memcpy(_tasks, next, count * sizeof(TaskSample));
+    _taskCount = count;
+    _lastTotalRunTime = totalRunTime;
+#endif
+}
+
+void SystemProfiler::sampleCores() {
+    uint32_t now = micros();
+    uint32_t elapsed = now - _lastSampleMicros;
+    _lastSampleMicros = now;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (runtimeStatsAvailable()) {
+            // IDLE0, IDLE1: the idle task pinned to each core
+            char idleName[8];
+            snprintf(idleName, sizeof(idleName), "IDLE%d", core);
+            for (size_t i = 0; i < _taskCount; i++) {
+                if (strcmp(_tasks[i].name, idleName) == 0) _coreLoad[core] = 100 - _tasks[i].cpu;
+            }
+        } else {
+            uint32_t idle = idleCycles[core];
+            float window = (float)elapsed * ESP.getCpuFreqMHz();
+            float load = window ? 100 - (idle - _lastIdleCycles[core]) * 100.0f / window : 0;
+            _coreLoad[core] = load < 0 ? 0 : load;
+            _lastIdleCycles[core] = idle;
+        }
+    }
+}
+
+void SystemProfiler::sampleHeaps() {
+    static const struct {
+        const char *name;
+        uint32_t caps;
+    } kinds[HEAP_KINDS] = {
+        {"default", MALLOC_CAP_8BIT},
+        {"internal", MALLOC_CAP_INTERNAL},
+        {"dma", MALLOC_CAP_DMA},
+        {"psram", MALLOC_CAP_SPIRAM},
+    };
+    _heapCount = 0;
+    for (size_t i = 0; i < HEAP_KINDS; i++) {
+        size_t total = heap_caps_get_total_size(kinds[i].caps);
+        if (!total) continue;  // No PSRAM fitted
+        HeapSample &heap = _heaps[_heapCount++];
+        heap.name = kinds[i].name;
+        heap.caps = kinds[i].caps;
+        heap.total = total;
+        heap.free = heap_caps_get_free_size(kinds[i].caps);
+        heap.largest = heap_caps_get_largest_free_block(kinds[i].caps);
+        heap.minFree = heap_caps_get_minimum_free_size(kinds[i].caps);
+    }
+}
+
+// Share of the free memory that cannot be allocated in one block
+uint8_t SystemProfiler::fragmentation(const HeapSample &heap) const {
+    return heap.free ? 100 - heap.largest * 100 / heap.free : 0;
+}
+
+void SystemProfiler::printReport(Print &out) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    out.printf("===== Profile #%u (sampled in %u us) =====\n", _samples, _sampleMicros);
+    out.print("CPU load:");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        out.printf(" core %d %.1f%%", core, _coreLoad[core]);
+    }
+    out.println(runtimeStatsAvailable() ? "" : " (idle hook; no run-time stats, so no CPU per task)");
+    out.println("Task              Core Prio   CPU%  Stack free");
+    for (size_t i = 0; i < _taskCount; i++) {
+        const TaskSample &task = _tasks[i];
+        if (task.cpu < 0) {
+            out.printf("%-16s %5d %4u %6s %11u\n", task.name, task.core, task.priority, "-", task.stackFree);
+        } else {
+            out.printf("%-16s %5d %4u %6.1f %11u\n", task.name, task.core, task.priority, task.cpu, task.stackFree);
+        }
+    }
+    out.print("ISR load:");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        out.printf(" core %d %.1f%%", core, _isrLoad[core]);
+    }
+    out.println();
+    out.println("Heap          total     free  largest  min free  frag");
+    for (size_t i = 0; i < _heapCount; i++) {
+        const HeapSample &heap = _heaps[i];
+        out.printf("%-9s %9u %8u %8u %9u %4u%%\n", heap.name, heap.total, heap.free, heap.largest,
+                   heap.minFree, fragmentation(heap));
+    }
+    xSemaphoreGive(_lock);
+}
+
+void SystemProfiler::printJson(Print &out) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    out.printf("{\"uptimeMs\":%lu,\"samples\":%u,\"intervalMs\":%u,\"sampleMicros\":%u,\"runtimeStats\":%s,\"tasks\":[",
+               millis(), _samples, _intervalMs, _sampleMicros, runtimeStatsAvailable() ? "true" : "false");
+    for (size_t i = 0; i < _taskCount; i++) {
+        const TaskSample &task = _tasks[i];
+        out.printf("%s{\"name\":\"%s\",\"core\":%d,\"priority\":%u,\"cpu\":%.1f,\"stackFree\":%u}",
+                   i ? "," : "", task.name, task.core, task.priority, task.cpu, task.stackFree);
+    }
+    out.print("],\"coreLoad\":[");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        out.printf("%s%.1f", core ? "," : "", _coreLoad[core]);
+    }
+    out.print("],\"isrLoad\":[");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        out.printf("%s%.1f", core ? "," : "", _isrLoad[core]);
+    }
+    out.print("],\"heaps\":[");
+    for (size_t i = 0; i < _heapCount; i++) {
+        const HeapSample &heap = _heaps[i];
+        out.printf("%s{\"name\":\"%s\",\"total\":%u,\"free\":%u,\"largest\":%u,\"minFree\":%u,\"fragmentation\":%u}",
+                   i ? "," : "", heap.name, heap.total, heap.free, heap.largest, heap.minFree, fragmentation(heap));
+    }
+    out.print("]}");
+    xSemaphoreGive(_lock);
+}
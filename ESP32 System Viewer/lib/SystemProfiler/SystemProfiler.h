@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Periodic runtime profile of the whole firmware: per-task CPU share from the
+// FreeRTOS run-time stats, CPU load per core, stack high-water marks, heap
+// free vs largest free block per capability, and ISR load per core.
+//
+// The stock Arduino-ESP32 core is built without run-time stats, so per-task
+// CPU is then unavailable (reported as -1). Core load still works: an idle
+// hook on each core times its idle loop with the cycle counter, and any gap
+// longer than one loop pass was spent elsewhere. The hook keeps the idle
+// task out of WAITI, so cores do not doze while this fallback is active.
+// With run-time stats, core load is 100% minus the IDLE<core> task's share.
+//
+// ISR load is measured by a probe task pinned to each core at the highest
+// priority: it spins for PROBE_MICROS reading the cycle counter, and any gap
+// between two reads can only be an interrupt. The probe blocks its core for
+// that window once per interval, which the DMA buffers of the recorders cover.
+//
+// Link it from another project with `lib_extra_dirs = ../ESP32 System Viewer/lib`:
+//
+//   SystemProfiler profiler;
+//   profiler.begin(1000, &Serial);          // Sample every second, log to serial
+//   server.on("/profile", ...)              // profiler.printJson(response)
+
+class SystemProfiler {
+public:
+    static const size_t MAX_TASKS = 32;  // uxTaskGetSystemState returns nothing if there are more
+    static const size_t HEAP_KINDS = 4;
+    static const uint32_t PROBE_MICROS = 1000;
+
+    struct TaskSample {
+        char name[configMAX_TASK_NAME_LEN];
+        TaskHandle_t handle;
+        int core;                // -1 = not pinned
+        UBaseType_t priority;
+        float cpu;               // Percent of one core over the last interval, -1 without run-time stats
+        uint32_t stackFree;      // High-water mark, bytes never used
+        uint32_t runTime;        // Run-time counter at the last sample
+    };
+
+    struct HeapSample {
+        const char *name;
+        uint32_t caps;
+        size_t total;
+        size_t free;
+        size_t largest;          // Largest allocatable block
+        size_t minFree;          // Low-water mark since boot
+    };
+
+    // Starts the sampling task; with `log` set a report is printed every interval
+    bool begin(uint32_t intervalMs = 1000, Print *log = NULL);
+
+    // One sampling pass (the task calls this every interval)
+    void sample();
+
+    void printReport(Print &out);
+    void printJson(Print &out);
+
+    // False when the core was built without FreeRTOS run-time stats
+    bool runtimeStatsAvailable() const;
+
+private:
+    static void task(void *parameter);
+    static void probeTask(void *parameter);
+    void sampleTasks();
+    void sampleCores();
+    void sampleHeaps();
+    uint8_t fragmentation(const HeapSample &heap) const;
+
+    uint32_t _intervalMs;
+    Print *_log;
+    SemaphoreHandle_t _lock;
+    TaskHandle_t _probes[portNUM_PROCESSORS];
+    volatile float _isrLoad[portNUM_PROCESSORS];
+    float _coreLoad[portNUM_PROCESSORS];        // Percent busy over the last interval
+    uint32_t _lastIdleCycles[portNUM_PROCESSORS];
+    uint32_t _lastSampleMicros;
+    TaskSample _tasks[MAX_TASKS];
+    size_t _taskCount;
+    HeapSample _heaps[HEAP_KINDS];
+    size_t _heapCount;
+    uint32_t _lastTotalRunTime;
+    uint32_t _samples;
+    uint32_t _sampleMicros;      // Cost of the last sampling pass
+};
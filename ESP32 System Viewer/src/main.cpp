@@ -1,4 +1,16 @@
 #include <Arduino.h>
+#include <WiFi.h>
+#include <WebServer.h>
+#include <StreamString.h>
+#include <SystemProfiler.h>
+
+// Live profile over serial and http://192.168.4.1/profile
+#define PROFILE_INTERVAL_MS 2000
+const char *ssid = "ESP32-Profiler";
+const char *password = "12345678";
+
+SystemProfiler profiler;
+WebServer server(80);
 
 void setup() {
   Serial.begin(115200);
@@ -29,8 +41,23 @@ void setup() {
   Serial.printf("Flash Size: %u bytes\n", ESP.getFlashChipSize());
   Serial.printf("Flash Speed: %u Hz\n", ESP.getFlashChipSpeed());
   Serial.printf("Flash Mode: %s\n", ESP.getFlashChipMode() == FM_QIO ? "QIO" : "DIO");
+
+  // Runtime profile
+  WiFi.softAP(ssid, password);
+  server.on("/profile", HTTP_GET, []() {
+    StreamString json;
+    profiler.printJson(json);
+    server.send(200, "application/json", json);
+  });
+  server.begin();
+  if (!profiler.begin(PROFILE_INTERVAL_MS, &Serial)) {
+    Serial.println("Profiler failed to start");
+  }
+  Serial.printf("\nProfiling every %d ms, JSON at http://%s/profile\n", PROFILE_INTERVAL_MS,
+                WiFi.softAPIP().toString().c_str());
 }
 
 void loop() {
-  // Nothing to do in the loop
+  server.handleClient();
+  delay(2);
 }
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <LittleFS.h>
+#include <WebServer.h>
+#include <driver/i2s.h>
+#include "esp_timer.h"
+#include "Hal.h"
+
+// ESP32 side of the HAL. Header-only and included from main.cpp alone, so
+// the native env never sees the Arduino headers.
+
+// I2S microphone, 16-bit mono on the LEFT slot
+class EspI2SSource : public hal::AudioSource {
+public:
+    EspI2SSource(i2s_port_t port, int sck, int ws, int sd, int dmaBufferLength)
+        : _port(port), _sck(sck), _ws(ws), _sd(sd), _dmaBufferLength(dmaBufferLength) {}
+
+    bool begin(uint32_t sampleRate) {
+        i2s_config_t i2s_config = {
+            .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
+            .sample_rate = sampleRate,
+            .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+            .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+            .communication_format = I2S_COMM_FORMAT_I2S,
+            .intr_alloc_flags = 0,
+            .dma_buf_count = 8,
+            .dma_buf_len = _dmaBufferLength,
+            .use_apll = false,
+        };
+        if (i2s_driver_install(_port, &i2s_config, 0, NULL) != ESP_OK) return false;
+
+        i2s_pin_config_t pin_config = {
+            .bck_io_num = _sck,
+            .ws_io_num = _ws,
+            .data_out_num = I2S_PIN_NO_CHANGE,
+            .data_in_num = _sd,
+        };
+        return i2s_set_pin(_port, &pin_config) == ESP_OK;
+    }
+
+    size_t read(int16_t *samples, size_t count) {
+        size_t bytesRead = 0;
+        i2s_read(_port, samples, count * sizeof(int16_t), &bytesRead, portMAX_DELAY);
+        return bytesRead / sizeof(int16_t);
+    }
+
+private:
+    i2s_port_t _port;
+    int _sck, _ws, _sd;
+    int _dmaBufferLength;
+};
+
+class EspLittleFSStorage : public hal::Storage {
+public:
+    static const int MAX_FILES = 4;
+
+    bool begin() { return LittleFS.begin(true); }
+
+    int open(const char *path, Mode mode) {
+        for (int i = 0; i < MAX_FILES; i++) {
+            if (_files[i]) continue;
+            _files[i] = LittleFS.open(path, mode == WRITE ? FILE_WRITE : FILE_READ);
+            return _files[i] ? i : -1;
+        }
+        return -1;
+    }
+
+    size_t read(int file, void *data, size_t length) { return _files[file].read((uint8_t *)data, length); }
+    size_t write(int file, const void *data, size_t length) { return _files[file].write((const uint8_t *)data, length); }
+    bool seek(int file, uint32_t position) { return _files[file].seek(position); }
+    uint32_t size(int file) { return _files[file].size(); }
+    void close(int file) { _files[file].close(); }
+
+private:
+    File _files[MAX_FILES];
+};
+
+// Synchronous WebServer; responses go out with a known Content-Length
+class EspHttpServer : public hal::HttpServer, public hal::HttpResponse {
+public:
+    EspHttpServer() : _server(80) {}
+
+    bool on(const char *path, hal::HttpHandler handler, void *context) {
+        _server.on(path, HTTP_GET, [this, handler, context]() { handler(*this, context); });
+        return true;
+    }
+
+    bool begin(uint16_t port) {
+        _server.begin(port);
+        return true;
+    }
+
+    void handleClient() { _server.handleClient(); }
+
+    void begin(int code, const char *contentType, uint32_t contentLength) {
+        _server.setContentLength(contentLength);
+        _server.send(code, contentType, "");
+    }
+
+    size_t write(const void *data, size_t length) {
+        _server.sendContent((const char *)data, length);
+        return length;
+    }
+
+private:
+    WebServer _server;
+};
+
+class EspNetwork : public hal::Network {
+public:
+    bool startAccessPoint(const char *ssid, const char *password) {
+        if (!WiFi.softAP(ssid, password)) return false;
+        WiFi.softAPIP().toString().toCharArray(_address, sizeof(_address));
+        return true;
+    }
+
+    const char *address() { return _address; }
+
+private:
+    char _address[16] = "";
+};
+
+class EspSystem : public hal::System {
+public:
+    uint64_t micros() { return esp_timer_get_time(); }
+    void log(const char *text) { Serial.println(text); }
+};
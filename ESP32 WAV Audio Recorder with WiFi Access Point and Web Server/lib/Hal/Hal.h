@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Thin hardware abstraction between the recorder logic (lib/RecorderApp)
+// and the platform. EspHal.h implements it on the ESP32 (I2S, LittleFS,
+// WebServer, soft AP); HostHal.h implements it on Linux with a WAV replay
+// source, a directory-backed store and a socket HTTP server, so the whole
+// record -> store -> serve flow runs in the native env.
+// Plain C++, no Arduino headers.
+
+namespace hal {
+
+// Blocking 16-bit mono PCM source, like i2s_read()
+class AudioSource {
+public:
+    virtual ~AudioSource() {}
+    virtual bool begin(uint32_t sampleRate) = 0;
+    // Returns the samples read (count unless the source failed)
+    virtual size_t read(int16_t *samples, size_t count) = 0;
+};
+
+// File store with integer handles; paths are absolute ("/audio.wav")
+class Storage {
+public:
+    enum Mode { READ, WRITE };  // WRITE creates or truncates
+
+    virtual ~Storage() {}
+    virtual bool begin() = 0;
+    virtual int open(const char *path, Mode mode) = 0;  // -1 on failure
+    virtual size_t read(int file, void *data, size_t length) = 0;
+    virtual size_t write(int file, const void *data, size_t length) = 0;
+    virtual bool seek(int file, uint32_t position) = 0;
+    virtual uint32_t size(int file) = 0;
+    virtual void close(int file) = 0;
+};
+
+// Response of one request: a status line and headers, then the body
+class HttpResponse {
+public:
+    virtual ~HttpResponse() {}
+    virtual void begin(int code, const char *contentType, uint32_t contentLength) = 0;
+    virtual size_t write(const void *data, size_t length) = 0;
+
+    void send(int code, const char *contentType, const char *text) {
+        size_t length = strlen(text);
+        begin(code, contentType, length);
+        write(text, length);
+    }
+};
+
+typedef void (*HttpHandler)(HttpResponse &response, void *context);
+
+// GET routes only, served from handleClient()
+class HttpServer {
+public:
+    static const size_t MAX_ROUTES = 8;
+
+    virtual ~HttpServer() {}
+    virtual bool on(const char *path, HttpHandler handler, void *context) = 0;
+    virtual bool begin(uint16_t port) = 0;
+    virtual void handleClient() = 0;
+};
+
+class Network {
+public:
+    virtual ~Network() {}
+    virtual bool startAccessPoint(const char *ssid, const char *password) = 0;
+    virtual const char *address() = 0;
+};
+
+class System {
+public:
+    virtual ~System() {}
+    virtual uint64_t micros() = 0;
+    virtual void log(const char *text) = 0;  // One line, no newline
+};
+
+struct Platform {
+    AudioSource &audio;
+    Storage &storage;
+    HttpServer &http;
+    Network &network;
+    System &system;
+};
+
+} // namespace hal
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "Hal.h"
+
+// Linux fakes for the HAL, used by the native env. Header-only and included
+// from the native entry point alone.
+
+inline uint64_t hostMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+inline void hostSleepMicros(uint64_t micros) {
+    if (!micros) return;
+    struct timespec delay = {(time_t)(micros / 1000000), (long)(micros % 1000000) * 1000};
+    nanosleep(&delay, NULL);
+}
+
+// Replays a 16-bit PCM WAV as the microphone: first channel only, linearly
+// resampled to the requested rate, looping at the end. speed 1 paces reads
+// like a real I2S port, 10 runs ten times faster, 0 as fast as possible.
+class WavReplaySource : public hal::AudioSource {
+public:
+    WavReplaySource(const char *path, double speed) : _path(path), _speed(speed), _pcm(NULL), _frames(0) {}
+    ~WavReplaySource() { delete[] _pcm; }
+
+    bool begin(uint32_t sampleRate) {
+        FILE *file = fopen(_path, "rb");
+        if (!file) return false;
+        bool loaded = load(file);
+        fclose(file);
+        if (!loaded) return false;
+        _rate = sampleRate;
+        _step = (double)_sourceRate / sampleRate;
+        _position = 0;
+        _produced = 0;
+        _start = hostMicros();
+        return true;
+    }
+
+    size_t read(int16_t *samples, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            size_t index = (size_t)_position;
+            double fraction = _position - index;
+            int16_t a = _pcm[index % _frames];
+            int16_t b = _pcm[(index + 1) % _frames];
+            samples[i] = (int16_t)(a + (b - a) * fraction);
+            _position += _step;
+            if (_position >= _frames) _position -= _frames;
+        }
+        _produced += count;
+        if (_speed > 0) {
+            // Block until the samples would have arrived from the DMA
+            uint64_t due = _start + (uint64_t)(_produced * 1e6 / (_rate * _speed));
+            uint64_t now = hostMicros();
+            if (due > now) hostSleepMicros(due - now);
+        }
+        return count;
+    }
+
+    uint32_t sourceRate() const { return _sourceRate; }
+    uint16_t sourceChannels() const { return _sourceChannels; }
+
+private:
+    bool load(FILE *file) {
+        char id[4];
+        uint32_t size;
+        if (fread(id, 1, 4, file) != 4 || memcmp(id, "RIFF", 4) != 0) return false;
+        fseek(file, 12, SEEK_SET);
+        uint16_t bits = 0;
+        _sourceChannels = 0;
+        while (fread(id, 1, 4, file) == 4 && fread(&size, 4, 1, file) == 1) {
+            if (memcmp(id, "fmt ", 4) == 0) {
+                uint8_t format[16];
+                if (size < 16 || fread(format, 1, 16, file) != 16) return false;
+                memcpy(&_sourceChannels, format + 2, 2);
+                memcpy(&_sourceRate, format + 4, 4);
+                memcpy(&bits, format + 14, 2);
+                fseek(file, size - 16 + (size & 1), SEEK_CUR);
+            } else if (memcmp(id, "data", 4) == 0) {
+                if (bits != 16 || _sourceChannels == 0) return false;
+                size_t frameBytes = 2 * _sourceChannels;
+                _frames = size / frameBytes;
+                if (_frames < 2) return false;
+                int16_t *frames = new int16_t[(size_t)_frames * _sourceChannels];
+                _frames = fread(frames, frameBytes, _frames, file);
+                _pcm = new int16_t[_frames];
+                for (size_t i = 0; i < _frames; i++) _pcm[i] = frames[i * _sourceChannels];
+                delete[] frames;
+                return _frames >= 2;
+            } else {
+                fseek(file, size + (size & 1), SEEK_CUR);
+            }
+        }
+        return false;
+    }
+
+    const char *_path;
+    double _speed;
+    int16_t *_pcm;
+    size_t _frames;
+    uint32_t _sourceRate;
+    uint16_t _sourceChannels;
+    uint32_t _rate;
+    double _step;
+    double _position;
+    uint64_t _produced;
+    uint64_t _start;
+};
+
+// Files under a host directory, with injectable latency per call and per KB
+// to stand in for a slow card or flash
+class DirectoryStorage : public hal::Storage {
+public:
+    static const int MAX_FILES = 4;
+
+    explicit DirectoryStorage(const char *root) : _root(root), _opMicros(0), _perKBMicros(0) {
+        memset(_files, 0, sizeof(_files));
+    }
+
+    void setLatency(uint32_t opMicros, uint32_t perKBMicros) {
+        _opMicros = opMicros;
+        _perKBMicros = perKBMicros;
+    }
+
+    // Creates the root and any missing parents
+    bool begin() {
+        char path[256];
+        snprintf(path, sizeof(path), "%s", _root);
+        for (char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+            *slash = 0;
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) return false;
+            *slash = '/';
+        }
+        return mkdir(path, 0755) == 0 || errno == EEXIST;
+    }
+
+    int open(const char *path, Mode mode) {
+        char fullPath[256];
+        snprintf(fullPath, sizeof(fullPath), "%s%s", _root, path);
+        for (int i = 0; i < MAX_FILES; i++) {
+            if (_files[i]) continue;
+            _files[i] = fopen(fullPath, mode == WRITE ? "w+b" : "rb");
+            return _files[i] ? i : -1;
+        }
+        return -1;
+    }
+
+    size_t read(int file, void *data, size_t length) {
+        delay(length);
+        return fread(data, 1, length, _files[file]);
+    }
+
+    size_t write(int file, const void *data, size_t length) {
+        delay(length);
+        return fwrite(data, 1, length, _files[file]);
+    }
+
+    bool seek(int file, uint32_t position) { return fseek(_files[file], position, SEEK_SET) == 0; }
+
+    uint32_t size(int file) {
+        long position = ftell(_files[file]);
+        fseek(_files[file], 0, SEEK_END);
+        long end = ftell(_files[file]);
+        fseek(_files[file], position, SEEK_SET);
+        return end;
+    }
+
+    void close(int file) {
+        fclose(_files[file]);
+        _files[file] = NULL;
+    }
+
+private:
+    void delay(size_t length) { hostSleepMicros(_opMicros + (uint64_t)_perKBMicros * length / 1024); }
+
+    const char *_root;
+    uint32_t _opMicros;
+    uint32_t _perKBMicros;
+    FILE *_files[MAX_FILES];
+};
+
+// Minimal HTTP/1.1 server on a TCP socket: one request per connection,
+// GET routes only, served one at a time from handleClient()
+class SocketHttpServer : public hal::HttpServer, public hal::HttpResponse {
+public:
+    SocketHttpServer() : _listener(-1), _client(-1), _routeCount(0) {}
+    ~SocketHttpServer() {
+        if (_listener >= 0) ::close(_listener);
+    }
+
+    bool on(const char *path, hal::HttpHandler handler, void *context) {
+        if (_routeCount == MAX_ROUTES) return false;
+        _routes[_routeCount].path = path;
+        _routes[_routeCount].handler = handler;
+        _routes[_routeCount].context = context;
+        _routeCount++;
+        return true;
+    }
+
+    bool begin(uint16_t port) {
+        _listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (_listener < 0) return false;
+        int reuse = 1;
+        setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(_listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(_listener, 4) != 0) {
+            return false;
+        }
+        fcntl(_listener, F_SETFL, O_NONBLOCK);  // handleClient() must not block
+        return true;
+    }
+
+    void handleClient() {
+        _client = accept(_listener, NULL, NULL);
+        if (_client < 0) return;
+        fcntl(_client, F_SETFL, 0);
+
+        // Request line and headers; the body (if any) is ignored
+        char request[1024];
+        size_t length = 0;
+        while (length < sizeof(request) - 1) {
+            ssize_t received = recv(_client, request + length, sizeof(request) - 1 - length, 0);
+            if (received <= 0) break;
+            length += received;
+            request[length] = 0;
+            if (strstr(request, "\r\n\r\n")) break;
+        }
+        request[length] = 0;
+
+        char method[8] = "", path[256] = "";
+        sscanf(request, "%7s %255s", method, path);
+        char *query = strchr(path, '?');
+        if (query) *query = 0;
+        const Route *route = NULL;
+        for (size_t i = 0; i < _routeCount; i++) {
+            if (strcmp(_routes[i].path, path) == 0) route = &_routes[i];
+        }
+        if (strcmp(method, "GET") != 0 || !route) {
+            send(404, "text/plain", "Not found");
+        } else {
+            route->handler(*this, route->context);
+        }
+        ::close(_client);
+        _client = -1;
+    }
+
+    void begin(int code, const char *contentType, uint32_t contentLength) {
+        char header[256];
+        int length = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                              code, code == 200 ? "OK" : "Error", contentType, contentLength);
+        write(header, length);
+    }
+
+    size_t write(const void *data, size_t length) {
+        const uint8_t *bytes = (const uint8_t *)data;
+        size_t sent = 0;
+        while (sent < length) {
+            ssize_t result = ::send(_client, bytes + sent, length - sent, MSG_NOSIGNAL);
+            if (result <= 0) break;  // Client went away
+            sent += result;
+        }
+        return sent;
+    }
+
+private:
+    struct Route {
+        const char *path;
+        hal::HttpHandler handler;
+        void *context;
+    };
+
+    int _listener;
+    int _client;
+    Route _routes[MAX_ROUTES];
+    size_t _routeCount;
+};
+
+class HostNetwork : public hal::Network {
+public:
+    bool startAccessPoint(const char *ssid, const char *) {
+        printf("[sim] Access point %s up (loopback)\n", ssid);
+        return true;
+    }
+
+    const char *address() { return "127.0.0.1"; }
+};
+
+class HostSystem : public hal::System {
+public:
+    uint64_t micros() { return hostMicros(); }
+    void log(const char *text) {
+        printf("%s\n", text);
+        fflush(stdout);
+    }
+};
@@ -0,0 +1,159 @@
+#include "RecorderApp.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static const uint32_t WAV_HEADER_SIZE = 44;
+
+static void putLE(uint8_t *at, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) at[i] = (uint8_t)(value >> (8 * i));
+}
+
+// 16-bit mono PCM header for `dataSize` bytes of samples
+static void fillWavHeader(uint8_t *header, uint32_t sampleRate, uint32_t dataSize) {
+    memcpy(header, "RIFF", 4);
+    putLE(header + 4, dataSize + 36, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLE(header + 16, 16, 4);              // PCM header size
+    putLE(header + 20, 1, 2);               // PCM format
+    putLE(header + 22, 1, 2);               // Mono
+    putLE(header + 24, sampleRate, 4);
+    putLE(header + 28, sampleRate * 2, 4);  // Byte rate
+    putLE(header + 32, 2, 2);               // Block align
+    putLE(header + 34, 16, 2);              // Bits per sample
+    memcpy(header + 36, "data", 4);
+    putLE(header + 40, dataSize, 4);
+}
+
+RecorderApp::RecorderApp(hal::Platform &platform, const RecorderConfig &config)
+    : _platform(platform), _config(config) {
+    if (_config.blockSamples > MAX_BLOCK_SAMPLES) _config.blockSamples = MAX_BLOCK_SAMPLES;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool RecorderApp::begin(const char *ssid, const char *password) {
+    if (!_platform.storage.begin()) {
+        logf("Storage initialization failed!");
+        return false;
+    }
+    logf("Setting up Access Point...");
+    if (!_platform.network.startAccessPoint(ssid, password)) {
+        logf("Access Point failed to start!");
+        return false;
+    }
+    logf("Access Point started! IP Address: %s", _platform.network.address());
+    if (!_platform.audio.begin(_config.sampleRate)) {
+        logf("Audio source initialization failed!");
+        return false;
+    }
+    return true;
+}
+
+bool RecorderApp::record() {
+    logf("Recording audio...");
+    int file = _platform.storage.open(_config.fileName, hal::Storage::WRITE);
+    if (file < 0) {
+        logf("Failed to open file!");
+        return false;
+    }
+
+    uint32_t total = _config.sampleRate * _config.recordSeconds;
+    uint8_t header[WAV_HEADER_SIZE];
+    fillWavHeader(header, _config.sampleRate, total * sizeof(int16_t));
+    bool ok = timedWrite(file, header, sizeof(header));
+
+    // Count samples rather than reads, so any block size gives exact length
+    uint64_t start = _platform.system.micros();
+    uint32_t recorded = 0;
+    while (ok && recorded < total) {
+        size_t want = total - recorded < _config.blockSamples ? total - recorded : _config.blockSamples;
+        size_t got = _platform.audio.read(_block, want);
+        if (got == 0) break;
+        ok = timedWrite(file, _block, got * sizeof(int16_t));
+        recorded += got;
+    }
+    _stats.recordMicros = _platform.system.micros() - start;
+    _stats.samplesRecorded = recorded;
+
+    // Patch the sizes if the source stopped early
+    if (recorded != total) {
+        fillWavHeader(header, _config.sampleRate, recorded * sizeof(int16_t));
+        _platform.storage.seek(file, 0);
+        timedWrite(file, header, sizeof(header));
+    }
+    _platform.storage.close(file);
+    logf("Recording complete. %u samples saved as %s", recorded, _config.fileName);
+    return ok && recorded == total;
+}
+
+bool RecorderApp::timedWrite(int file, const void *data, size_t length) {
+    uint64_t start = _platform.system.micros();
+    size_t written = _platform.storage.write(file, data, length);
+    uint64_t elapsed = _platform.system.micros() - start;
+    _stats.writeMicros += elapsed;
+    if (elapsed > _stats.maxWriteMicros) _stats.maxWriteMicros = elapsed;
+    return written == length;
+}
+
+bool RecorderApp::serve(uint16_t port) {
+    _platform.http.on("/", handleRoot, this);
+    _platform.http.on("/download", handleDownload, this);
+    if (!_platform.http.begin(port)) {
+        logf("HTTP server failed to start!");
+        return false;
+    }
+    logf("HTTP server started on port %u.", port);
+    return true;
+}
+
+void RecorderApp::handleRoot(hal::HttpResponse &response, void *) {
+    response.send(200, "text/html", "<h1>ESP32 WAV Recorder</h1><a href='/download'>Download Recorded WAV</a>");
+}
+
+void RecorderApp::handleDownload(hal::HttpResponse &response, void *context) {
+    ((RecorderApp *)context)->download(response);
+}
+
+void RecorderApp::download(hal::HttpResponse &response) {
+    int file = _platform.storage.open(_config.fileName, hal::Storage::READ);
+    if (file < 0) {
+        response.send(404, "text/plain", "File not found!");
+        return;
+    }
+    uint64_t start = _platform.system.micros();
+    uint32_t remaining = _platform.storage.size(file);
+    response.begin(200, "audio/wav", remaining);
+    while (remaining) {
+        size_t length = remaining < DOWNLOAD_CHUNK ? remaining : DOWNLOAD_CHUNK;
+        length = _platform.storage.read(file, _chunk, length);
+        if (length == 0) break;
+        size_t sent = response.write(_chunk, length);
+        _stats.bytesServed += sent;
+        if (sent != length) break;  // Client went away
+        remaining -= length;
+    }
+    _platform.storage.close(file);
+    _stats.serveMicros += _platform.system.micros() - start;
+    _stats.downloads++;
+}
+
+void RecorderApp::report() {
+    double recordSeconds = _stats.recordMicros / 1e6;
+    double audioSeconds = (double)_stats.samplesRecorded / _config.sampleRate;
+    logf("Record: %.2f s of audio in %.2f s (%.1fx real time)", audioSeconds, recordSeconds,
+         recordSeconds > 0 ? audioSeconds / recordSeconds : 0.0);
+    logf("Storage: %.1f ms writing, slowest write %.2f ms, %.0f KB/s", _stats.writeMicros / 1e3,
+         _stats.maxWriteMicros / 1e3,
+         _stats.writeMicros ? _stats.samplesRecorded * 2.0 / 1024 / (_stats.writeMicros / 1e6) : 0.0);
+    logf("Serve: %u downloads, %.1f KB, %.0f KB/s", _stats.downloads, _stats.bytesServed / 1024.0,
+         _stats.serveMicros ? _stats.bytesServed / 1024.0 / (_stats.serveMicros / 1e6) : 0.0);
+}
+
+void RecorderApp::logf(const char *format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    _platform.system.log(line);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Hal.h"
+
+// The recorder's record -> store -> serve flow, written against the HAL so
+// the same code runs on the ESP32 and in the native env.
+
+struct RecorderConfig {
+    uint32_t sampleRate;
+    uint32_t recordSeconds;
+    const char *fileName;
+    size_t blockSamples;  // Samples per read and per file write
+};
+
+struct RecorderStats {
+    uint32_t samplesRecorded;
+    uint64_t recordMicros;    // Wall time of the whole recording
+    uint64_t writeMicros;     // Time spent in storage writes
+    uint64_t maxWriteMicros;  // Slowest single write
+    uint32_t downloads;
+    uint64_t bytesServed;
+    uint64_t serveMicros;     // Time spent streaming downloads
+};
+
+class RecorderApp {
+public:
+    static const size_t MAX_BLOCK_SAMPLES = 1024;
+    static const size_t DOWNLOAD_CHUNK = 4096;
+
+    RecorderApp(hal::Platform &platform, const RecorderConfig &config);
+
+    bool begin(const char *ssid, const char *password);
+    bool record();
+    bool serve(uint16_t port);
+    void poll() { _platform.http.handleClient(); }
+    void report();
+
+    const RecorderStats &stats() const { return _stats; }
+
+private:
+    static void handleRoot(hal::HttpResponse &response, void *context);
+    static void handleDownload(hal::HttpResponse &response, void *context);
+    void download(hal::HttpResponse &response);
+    bool timedWrite(int file, const void *data, size_t length);
+    void logf(const char *format, ...);
+
+    hal::Platform &_platform;
+    RecorderConfig _config;
+    RecorderStats _stats;
+    int16_t _block[MAX_BLOCK_SAMPLES];
+    uint8_t _chunk[DOWNLOAD_CHUNK];
+};
@@ -0,0 +1,130 @@
+// Host build of the recorder (pio run -e native): the same RecorderApp as
+// src/main.cpp, on the Linux fakes from lib/Hal/HostHal.h.
+//
+//   program [wav] [--speed X] [--latency-us OP,PER_KB] [--port N] [--selftest N]
+//
+// The WAV is replayed as the microphone. --speed 1 paces it like the real
+// I2S port, 0 runs as fast as possible. --latency-us adds a delay to every
+// storage call plus one per KB. --selftest downloads the recording N times
+// over loopback, prints the throughput and exits; otherwise the server runs
+// until interrupted.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "HostHal.h"
+#include "RecorderApp.h"
+
+#define SAMPLE_RATE 32000
+#define BUFFER_SIZE 1024
+#define RECORD_TIME 5 // seconds
+
+static const char *DEFAULT_WAV = "../ESP32 WAV Audio Recorder with Web Server/data/recorded_audio.wav";
+static const char *STORAGE_ROOT = ".pio/sim_fs";
+
+struct SelfTest {
+    uint16_t port;
+    int downloads;
+    uint64_t bytes;
+    bool done;
+};
+
+// Plays the browser: fetches /download and counts the body bytes
+static void *downloadClient(void *argument) {
+    SelfTest *test = (SelfTest *)argument;
+    for (int i = 0; i < test->downloads; i++) {
+        int client = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(test->port);
+        if (connect(client, (struct sockaddr *)&address, sizeof(address)) != 0) {
+            close(client);
+            break;
+        }
+        const char request[] = "GET /download HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        send(client, request, sizeof(request) - 1, 0);
+        char buffer[8192];
+        ssize_t received;
+        bool body = false;
+        char tail[4] = {0};
+        while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0) {
+            for (ssize_t j = 0; j < received; j++) {
+                if (body) {
+                    test->bytes += received - j;
+                    break;
+                }
+                memmove(tail, tail + 1, 3);
+                tail[3] = buffer[j];
+                body = memcmp(tail, "\r\n\r\n", 4) == 0;
+            }
+        }
+        close(client);
+    }
+    test->done = true;
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    const char *wavPath = DEFAULT_WAV;
+    double speed = 1;
+    unsigned opLatency = 0, perKBLatency = 0;
+    uint16_t port = 8080;
+    int selfTest = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--latency-us") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%u,%u", &opLatency, &perKBLatency);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--selftest") == 0 && i + 1 < argc) {
+            selfTest = atoi(argv[++i]);
+        } else {
+            wavPath = argv[i];
+        }
+    }
+
+    WavReplaySource audioSource(wavPath, speed);
+    DirectoryStorage storage(STORAGE_ROOT);
+    storage.setLatency(opLatency, perKBLatency);
+    SocketHttpServer server;
+    HostNetwork network;
+    HostSystem hostSystem;
+    hal::Platform platform = {audioSource, storage, server, network, hostSystem};
+
+    RecorderConfig config = {SAMPLE_RATE, RECORD_TIME, "/audio.wav", BUFFER_SIZE / 2};
+    RecorderApp app(platform, config);
+
+    if (!app.begin("ESP32_Audio_Recorder", "12345678")) {
+        fprintf(stderr, "Could not start (replay file %s)\n", wavPath);
+        return 1;
+    }
+    printf("[sim] Replaying %s (%u Hz, %u ch) at %gx\n", wavPath, audioSource.sourceRate(),
+           audioSource.sourceChannels(), speed);
+    if (!app.record() || !app.serve(port)) return 1;
+
+    if (selfTest > 0) {
+        SelfTest test = {port, selfTest, 0, false};
+        pthread_t client;
+        pthread_create(&client, NULL, downloadClient, &test);
+        while (!test.done) {
+            app.poll();
+            hostSleepMicros(100);
+        }
+        pthread_join(client, NULL);
+        app.report();
+        uint64_t expected = (uint64_t)selfTest * (44 + app.stats().samplesRecorded * 2);
+        printf("[sim] Client received %llu of %llu bytes\n", (unsigned long long)test.bytes,
+               (unsigned long long)expected);
+        return test.bytes == expected ? 0 : 1;
+    }
+
+    printf("[sim] Serving on http://127.0.0.1:%u/ (Ctrl+C to stop)\n", port);
+    for (;;) {
+        app.poll();
+        hostSleepMicros(1000);
+    }
+}
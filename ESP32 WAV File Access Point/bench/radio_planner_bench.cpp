@@ -0,0 +1,153 @@
+// Host check of lib/RadioPlanner (pio run -e native, then
+// .pio/build/native/program [survey.log ...]). Replays channel surveys and
+// station traces through the same decision code the AP runs.
+//
+// Surveys are the "Survey: ch N rssi R" lines the firmware prints at boot;
+// pass serial logs as arguments to see what each would have chosen. The
+// built-in surveys and the TX power trace are checked against the expected
+// decisions.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "RadioPlanner.h"
+
+static const uint8_t CANDIDATES[] = {1, 6, 11};  // As in the firmware
+static const size_t CANDIDATE_COUNT = sizeof(CANDIDATES);
+static const uint8_t PREFERRED_CHANNEL = 6;
+
+struct Survey {
+    const char *name;
+    const char *log;
+    uint8_t expected;
+};
+
+// Same format as the firmware's serial log
+static const Survey SURVEYS[] = {
+    {"apartment, channel 6 crowded",
+     "Survey: ch 6 rssi -48\nSurvey: ch 6 rssi -61\nSurvey: ch 6 rssi -67\nSurvey: ch 6 rssi -72\n"
+     "Survey: ch 1 rssi -70\nSurvey: ch 1 rssi -83\nSurvey: ch 11 rssi -88\n", 11},
+    {"quiet 6", "Survey: ch 1 rssi -55\nSurvey: ch 11 rssi -60\nSurvey: ch 11 rssi -74\n", 6},
+    {"nothing in range", "", 6},
+    {"strong neighbour on 3",
+     "Survey: ch 3 rssi -40\nSurvey: ch 11 rssi -84\nSurvey: ch 11 rssi -86\nSurvey: ch 11 rssi -90\n", 11},
+    {"everything busy, 1 least",
+     "Survey: ch 1 rssi -78\nSurvey: ch 1 rssi -80\nSurvey: ch 6 rssi -52\nSurvey: ch 11 rssi -58\n"
+     "Survey: ch 11 rssi -62\nSurvey: ch 9 rssi -66\n", 1},
+};
+
+static std::vector<radio::ScanResult> parseSurvey(FILE *in) {
+    std::vector<radio::ScanResult> results;
+    char line[256];
+    while (fgets(line, sizeof(line), in)) {
+        const char *text = strstr(line, "Survey: ch ");
+        unsigned channel;
+        int rssi;
+        if (text && sscanf(text, "Survey: ch %u rssi %d", &channel, &rssi) == 2 && channel >= 1 && channel <= 13) {
+            radio::ScanResult result = {(uint8_t)channel, (int8_t)rssi};
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+static std::vector<radio::ScanResult> parseSurvey(const char *log) {
+    FILE *in = fmemopen((void *)log, strlen(log) + 1, "r");
+    std::vector<radio::ScanResult> results = parseSurvey(in);
+    fclose(in);
+    return results;
+}
+
+static uint8_t choose(const char *name, const std::vector<radio::ScanResult> &results) {
+    radio::ChannelScore scores[CANDIDATE_COUNT];
+    uint8_t channel = radio::pickChannel(results.empty() ? NULL : &results[0], results.size(), CANDIDATES,
+                                         CANDIDATE_COUNT, PREFERRED_CHANNEL, scores);
+    printf("%-30s %2u networks ->  channel %2u  (", name, (unsigned)results.size(), channel);
+    for (size_t i = 0; i < CANDIDATE_COUNT; i++) {
+        printf("%sch %u: %u networks, load %.2f", i ? "; " : "", scores[i].channel, scores[i].networks,
+               scores[i].load);
+    }
+    printf(")\n");
+    return channel;
+}
+
+struct TraceStep {
+    int intervals;
+    size_t stations;
+    int rssi;
+    float retries;
+    const char *what;
+};
+
+// Pi on the bench next to the recorder, a retry burst, then carried away
+static const TraceStep TRACE[] = {
+    {2, 0, 0, 0, "no station"},
+    {40, 1, -45, 0.0f, "station at 1 m"},
+    {1, 1, -45, 0.30f, "retry burst"},
+    {10, 1, -45, 0.0f, "calm again"},
+    {1, 1, -75, 0.0f, "station moved away"},
+    {10, 1, -75, 0.05f, "far, some retries"},
+    {1, 0, 0, 0, "station left"},
+};
+
+static bool checkTrace() {
+    radio::TxPowerController tx;
+    bool ok = true;
+    printf("\nTX power trace (interval: stations, weakest RSSI, retry share -> power, estimated downlink)\n");
+    int interval = 0;
+    for (size_t s = 0; s < sizeof(TRACE) / sizeof(TRACE[0]); s++) {
+        const TraceStep &step = TRACE[s];
+        float before = tx.powerDbm();
+        for (int i = 0; i < step.intervals; i++, interval++) {
+            bool changed = tx.update(step.stations, step.rssi, step.retries);
+            if (changed || i == 0 || i == step.intervals - 1) {
+                printf("%3d: %u, %4d dBm, %.2f -> %4.1f dBm", interval, (unsigned)step.stations, step.rssi,
+                       step.retries, tx.powerDbm());
+                if (step.stations) printf(", downlink %d dBm", tx.downlinkRssi(step.rssi));
+                printf("%s%s\n", i == 0 ? "   " : "", i == 0 ? step.what : "");
+            }
+            // Never leave a connected station below the target
+            if (step.stations && tx.downlinkRssi(step.rssi) < radio::TxPowerController::TARGET_RSSI &&
+                tx.power() != radio::TxPowerController::LEVELS[0]) {
+                printf("FAIL: station left below target at interval %d\n", interval);
+                ok = false;
+            }
+        }
+        if (!step.stations && tx.power() != radio::TxPowerController::LEVELS[0]) {
+            printf("FAIL: not at full power without stations\n");
+            ok = false;
+        }
+        if (step.retries > radio::TxPowerController::HIGH_RETRY && tx.powerDbm() <= before) {
+            printf("FAIL: retry burst did not raise the power\n");
+            ok = false;
+        }
+        if (s == 1 && tx.powerDbm() > 8.5f) {
+            printf("FAIL: still at %.1f dBm for a station at -45 dBm\n", tx.powerDbm());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(SURVEYS) / sizeof(SURVEYS[0]); i++) {
+        uint8_t channel = choose(SURVEYS[i].name, parseSurvey(SURVEYS[i].log));
+        if (channel != SURVEYS[i].expected) {
+            printf("FAIL: expected channel %u\n", SURVEYS[i].expected);
+            ok = false;
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *in = fopen(argv[i], "r");
+        if (!in) {
+            perror(argv[i]);
+            return 1;
+        }
+        choose(argv[i], parseSurvey(in));
+        fclose(in);
+    }
+    if (!checkTrace()) ok = false;
+    printf("\n%s\n", ok ? "All decisions as expected" : "Some decisions were wrong");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include "RadioPlanner.h"
+
+#include <math.h>
+
+namespace radio {
+
+const int8_t TxPowerController::LEVELS[LEVEL_COUNT] = {78, 76, 74, 68, 60, 52, 44, 34, 28, 20, 8};
+constexpr float TxPowerController::HIGH_RETRY;
+constexpr float TxPowerController::LOW_RETRY;
+
+float channelOverlap(uint8_t a, uint8_t b) {
+    // Channel centres are 5 MHz apart; the transmit mask is about 22 MHz wide
+    int distance = a > b ? a - b : b - a;
+    float overlap = 1.0f - distance * 5 / 22.0f;
+    return overlap > 0 ? overlap : 0.0f;
+}
+
+uint8_t pickChannel(const ScanResult *results, size_t count, const uint8_t *candidates, size_t candidateCount,
+                    uint8_t preferred, ChannelScore *scores) {
+    uint8_t best = preferred;
+    float bestLoad = -1;
+    for (size_t c = 0; c < candidateCount; c++) {
+        ChannelScore &score = scores[c];
+        score.channel = candidates[c];
+        score.networks = 0;
+        score.load = 0;
+        for (size_t i = 0; i < count; i++) {
+            float overlap = channelOverlap(candidates[c], results[i].channel);
+            if (overlap == 0) continue;
+            score.networks++;
+            score.load += overlap * powf(10.0f, results[i].rssi / 10.0f) * 1e6f;  // nW
+        }
+        // Ties go to the preferred channel, then to the earlier candidate
+        if (bestLoad < 0 || score.load < bestLoad || (score.load == bestLoad && score.channel == preferred)) {
+            best = score.channel;
+            bestLoad = score.load;
+        }
+    }
+    return best;
+}
+
+int TxPowerController::downlinkRssi(int uplinkRssi) const {
+    return uplinkRssi + LEVELS[_level] / 4 - STATION_TX_DBM;
+}
+
+bool TxPowerController::update(size_t stations, int weakestRssi, float retryShare) {
+    size_t level = _level;
+    if (stations == 0) {
+        level = 0;
+        _calm = 0;
+    } else {
+        // Lowest power that still gives the weakest station target + margin
+        int neededQuarterDbm = (STATION_TX_DBM + TARGET_RSSI + MARGIN_DB - weakestRssi) * 4;
+        size_t wanted = 0;
+        while (wanted + 1 < LEVEL_COUNT && LEVELS[wanted + 1] >= neededQuarterDbm) wanted++;
+
+        if (retryShare > HIGH_RETRY) {
+            if (level > 0) level--;
+            if (wanted < level) level = wanted;
+            _calm = 0;
+        } else if (wanted < level && downlinkRssi(weakestRssi) < TARGET_RSSI) {
+            level = wanted;  // Below target: straight up
+            _calm = 0;
+        } else if (wanted > level) {
+            // Stronger than needed: one step down after a few calm intervals
+            _calm = retryShare < LOW_RETRY ? _calm + 1 : 0;
+            if (_calm >= CALM_INTERVALS) {
+                level++;
+                _calm = 0;
+            }
+        } else {
+            _calm = 0;
+        }
+    }
+    bool changed = level != _level;
+    _level = level;
+    return changed;
+}
+
+} // namespace radio
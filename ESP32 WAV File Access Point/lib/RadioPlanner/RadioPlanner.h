@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Channel and TX power decisions for the soft AP, kept apart from the Wi-Fi
+// calls so they can be replayed on the host (bench/radio_planner_bench.cpp).
+//
+// Channel: a survey scan at startup lists the networks in range. Each one
+// loads every candidate channel it overlaps (channels 5 apart, like 1, 6 and
+// 11, do not overlap), weighted by overlap and by received power, so one
+// strong neighbour counts for more than a few distant ones. The least loaded
+// candidate wins; the preferred channel keeps ties.
+//
+// TX power: the AP hears each station's uplink, which does not change with
+// our own power. The downlink at the station is estimated as that RSSI plus
+// our power minus a typical station's. Power goes up at once when the
+// weakest station's estimate falls below the target (plus margin) or the
+// retry share of the last interval is high, and down one step at a time
+// after a few calm intervals. With no station connected it stays at maximum,
+// so a distant client can still join.
+// Plain C++ (no Arduino headers).
+
+namespace radio {
+
+struct ScanResult {
+    uint8_t channel;
+    int8_t rssi;       // dBm
+};
+
+struct ChannelScore {
+    uint8_t channel;
+    uint8_t networks;  // Networks overlapping this channel
+    float load;        // Sum of overlap x received power, nW
+};
+
+// Scores every candidate into `scores` (candidateCount entries) and returns
+// the chosen channel
+uint8_t pickChannel(const ScanResult *results, size_t count, const uint8_t *candidates, size_t candidateCount,
+                    uint8_t preferred, ChannelScore *scores);
+
+// Share of the spectrum that channels `a` and `b` (1-13) have in common (0..1)
+float channelOverlap(uint8_t a, uint8_t b);
+
+class TxPowerController {
+public:
+    // Quarter-dBm steps, as esp_wifi_set_max_tx_power() and Arduino's wifi_power_t use
+    static const size_t LEVEL_COUNT = 11;
+    static const int8_t LEVELS[LEVEL_COUNT];  // Highest first
+
+    static const int TARGET_RSSI = -65;       // Downlink needed for the top rates, dBm
+    static const int MARGIN_DB = 6;           // Above the target before stepping down
+    static const int STATION_TX_DBM = 17;     // Typical phone / laptop / Pi uplink power
+    static const int CALM_INTERVALS = 3;      // Intervals with few retries before a step down
+    static constexpr float HIGH_RETRY = 0.10f;
+    static constexpr float LOW_RETRY = 0.02f;
+
+    TxPowerController() : _level(0), _calm(0) {}
+
+    // One interval: connected stations, the weakest one's RSSI as heard by
+    // the AP, and the share of retried (or slow) transfers. Returns true if
+    // the power changed.
+    bool update(size_t stations, int weakestRssi, float retryShare);
+
+    int8_t power() const { return LEVELS[_level]; }  // Quarter dBm
+    float powerDbm() const { return LEVELS[_level] / 4.0f; }
+    // Estimated RSSI at a station heard at `uplinkRssi`, at the current power
+    int downlinkRssi(int uplinkRssi) const;
+
+private:
+    size_t _level;  // Index into LEVELS
+    int _calm;
+};
+
+} // namespace radio
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Fixed-capacity building blocks for a server that must not touch the heap
+// once it is running: the storage of every object lives in static memory, so
+// long uptimes cannot fragment the heap through request handling.
+// Not thread-safe: use each instance from one task (here the async_tcp task).
+
+// String with inline storage; appends that do not fit are truncated and
+// reported through the return value
+template <size_t Capacity>
+class FixedString {
+public:
+    FixedString() { clear(); }
+
+    void clear() {
+        _length = 0;
+        _text[0] = 0;
+    }
+
+    bool append(const char *text) {
+        size_t length = strlen(text);
+        size_t room = Capacity - 1 - _length;
+        bool fits = length <= room;
+        if (!fits) length = room;
+        memcpy(_text + _length, text, length);
+        _length += length;
+        _text[_length] = 0;
+        return fits;
+    }
+
+    bool appendf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        size_t room = Capacity - _length;
+        int written = vsnprintf(_text + _length, room, format, args);
+        va_end(args);
+        if (written < 0) return false;
+        bool fits = (size_t)written < room;
+        _length += fits ? written : room - 1;
+        return fits;
+    }
+
+    bool startsWith(const char *prefix) const { return strncmp(_text, prefix, strlen(prefix)) == 0; }
+    bool endsWith(const char *suffix) const {
+        size_t length = strlen(suffix);
+        return length <= _length && strcmp(_text + _length - length, suffix) == 0;
+    }
+
+    const char *c_str() const { return _text; }
+    size_t length() const { return _length; }
+    bool empty() const { return _length == 0; }
+    static size_t capacity() { return Capacity - 1; }
+
+private:
+    char _text[Capacity];
+    size_t _length;
+};
+
+// Slots for up to Count objects of type T. acquire() returns raw storage for
+// placement new (or a class operator new); NULL when every slot is taken.
+template <typename T, size_t Count>
+class ObjectPool {
+public:
+    ObjectPool() : _inUse(0), _peak(0), _exhausted(0) {
+        memset(_used, 0, sizeof(_used));
+    }
+
+    void *acquire() {
+        for (size_t i = 0; i < Count; i++) {
+            if (_used[i]) continue;
+            _used[i] = true;
+            if (++_inUse > _peak) _peak = _inUse;
+            return _slots[i].bytes;
+        }
+        _exhausted++;
+        return NULL;
+    }
+
+    void release(void *object) {
+        for (size_t i = 0; i < Count; i++) {
+            if (_slots[i].bytes != object) continue;
+            _used[i] = false;
+            _inUse--;
+            return;
+        }
+    }
+
+    // Slot number of an object from this pool, -1 if it is not one
+    int indexOf(const void *object) const {
+        for (size_t i = 0; i < Count; i++) {
+            if (_slots[i].bytes == object) return i;
+        }
+        return -1;
+    }
+
+    size_t inUse() const { return _inUse; }
+    size_t peak() const { return _peak; }
+    uint32_t exhausted() const { return _exhausted; }  // acquire() calls that failed
+    static size_t capacity() { return Count; }
+
+private:
+    union Slot {
+        uint8_t bytes[sizeof(T)];
+        long double alignLongDouble;
+        void *alignPointer;
+        uint64_t alignInteger;
+    };
+    Slot _slots[Count];
+    bool _used[Count];
+    size_t _inUse;
+    size_t _peak;
+    uint32_t _exhausted;
+};
+
+// Bump allocator for scratch memory that lives as long as one request;
+// reset() frees everything at once
+template <size_t Size>
+class BumpArena {
+public:
+    BumpArena() : _used(0), _highWater(0) {}
+
+    void *allocate(size_t size, size_t align = sizeof(void *)) {
+        size_t start = (_used + align - 1) & ~(align - 1);
+        if (start + size > Size) return NULL;
+        _used = start + size;
+        if (_used > _highWater) _highWater = _used;
+        return _memory + start;
+    }
+
+    char *allocateText(size_t size) { return (char *)allocate(size, 1); }
+
+    void reset() { _used = 0; }
+    size_t used() const { return _used; }
+    size_t highWater() const { return _highWater; }
+
+private:
+    uint8_t _memory[Size] __attribute__((aligned(8)));
+    size_t _used;
+    size_t _highWater;
+};
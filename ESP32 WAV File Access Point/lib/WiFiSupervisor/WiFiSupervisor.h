@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Soft AP supervisor for the projects that serve recordings over their own
+// AP. The AP is started once; Wi-Fi events (in the Wi-Fi event task) only
+// count what happened, and poll() from loop() restarts the AP only after it
+// has really gone down (an AP_STOP event, or AP mode is gone), at most once
+// every RESTART_BACKOFF_MS. loop() never blocks on Wi-Fi, so in-flight
+// downloads keep their AP.
+//
+//   WiFiSupervisor wifi(startAccessPoint, stopServer);
+//   wifi.begin();                  // setup(): event handler, then the AP
+//   wifi.poll();                   // loop()
+//   wifi.chunkSent(gapMs);         // every download chunk
+//   wifi.printReport(Serial);      // before sleep
+class WiFiSupervisor {
+public:
+    static const uint32_t RESTART_BACKOFF_MS = 2000;  // Minimum time between AP restarts
+    static const uint32_t DOWNLOAD_STALL_MS = 2000;   // Gap between download chunks counted as a stall
+
+    // `startAp` brings the AP up; once `stopped` is set it stays down
+    WiFiSupervisor(void (*startAp)(), const volatile bool &stopped)
+        : _startAp(startAp), _stopped(stopped), _restartPending(false), _stops(0), _joins(0), _leaves(0),
+          _restarts(0), _downloadStalls(0), _lastStart(0) {}
+
+    void begin() {
+        WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) { onEvent(event); });
+        start();
+    }
+
+    void poll() {
+        if (_stopped) return;
+        if (!(WiFi.getMode() & WIFI_MODE_AP)) _restartPending = true;
+        if (!_restartPending || millis() - _lastStart < RESTART_BACKOFF_MS) return;
+        _restartPending = false;
+        _restarts++;
+        Serial.printf("AP down, restarting (restart %u)\n", _restarts);
+        start();
+    }
+
+    // Time since the previous chunk of the same download
+    void chunkSent(uint32_t gapMs) {
+        if (gapMs > DOWNLOAD_STALL_MS) _downloadStalls++;
+    }
+
+    void printReport(Print &out) {
+        out.printf("Wi-Fi: AP restarts %u, AP stops %u, stations joined %u / left %u, download stalls %u\n",
+                   _restarts, _stops, _joins, _leaves, _downloadStalls);
+    }
+
+private:
+    void start() {
+        _startAp();
+        _lastStart = millis();
+    }
+
+    // Runs in the Wi-Fi event task: only record what happened
+    void onEvent(WiFiEvent_t event) {
+        switch (event) {
+            case ARDUINO_EVENT_WIFI_AP_STOP:
+                _stops++;
+                if (!_stopped) _restartPending = true;
+                break;
+            case ARDUINO_EVENT_WIFI_AP_STACONNECTED:
+                _joins++;
+                break;
+            case ARDUINO_EVENT_WIFI_AP_STADISCONNECTED:
+                _leaves++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void (*_startAp)();
+    const volatile bool &_stopped;
+    volatile bool _restartPending;
+    volatile uint32_t _stops, _joins, _leaves;
+    uint32_t _restarts;
+    volatile uint32_t _downloadStalls;  // Counted from the web server task
+    unsigned long _lastStart;
+};
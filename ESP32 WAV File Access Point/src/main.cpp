@@ -5,21 +5,44 @@
 #include <ESPAsyncWebServer.h>
 #include "esp_task_wdt.h"
 #include "esp_sleep.h"
+#include "esp_heap_caps.h"
+#include "esp_wifi.h"
+#include <StaticPool.h>
+#include <RadioPlanner.h>
+#include <WiFiSupervisor.h>
 
 // SD Card Configuration
 const int chipSelect = 5;
-String lastRecordedFile = "";  // Stores the most recent file name
+FixedString<32> lastRecordedFile;  // Stores the most recent file name
 
 // Wi-Fi Configuration
 const char *ssid = "ESP32-WAV-AP";
 const char *password = "12345678";
-const int wifi_channel = 6;    // Fixed WiFi channel
-const int wifi_power = 20;     // WiFi power level in dBm (max 20)
+#define SURVEY_CHANNEL 1       // 1 = scan at boot and take the least occupied candidate channel
+#define ADAPT_TX_POWER 1       // 1 = follow the stations' RSSI and retries, 0 = fixed 19.5 dBm
+#define MAX_SURVEY_NETWORKS 48
+#define TX_POWER_INTERVAL_MS 2000
+#define SLOW_CHUNK_MS 200      // Gap between download chunks counted as a retry
+const uint8_t preferred_channel = 6;              // Without a survey, and on ties
+const uint8_t candidate_channels[] = {1, 6, 11};  // Non-overlapping
+uint8_t wifi_channel = preferred_channel;
+radio::TxPowerController txPower;
 AsyncWebServer server(80);
 const size_t transfer_chunk_size = 16384; // Define a fixed chunk size (matching the Raspberry Pi client)
-bool stopServer = false;
+volatile bool stopServer = false;
 bool sdInitialized = false;
 
+// No heap in steady state: every response comes from a fixed pool, carries a
+// per-request scratch arena, and downloads use file handles opened at boot
+#define RESPONSE_SLOTS 4          // Concurrent requests (downloads included)
+#define REQUEST_ARENA_SIZE 512    // Scratch bytes per request
+#define RUN_SOAK_TEST 0           // 1 = send SOAK_REQUESTS to ourselves at boot and report the heap
+#define SOAK_REQUESTS 10000
+
+// Benchmarks that take one link out of a download each (see /bench)
+#define BENCH_DEFAULT_MB 8
+#define BENCH_MAX_MB 64
+
 // Convert seconds to microseconds for deep sleep time (54 minutes)
 uint64_t sleep_time_us = 10ULL * 60 * 1000000;
 
@@ -42,37 +65,354 @@ void findLastWavFile() {
     }
     
     File file;
-    String lastFileName = "";
     int highestNumber = 0;
     
     while (file = root.openNextFile()) {
-        String fileName = String(file.name());
-        if (fileName.endsWith(".wav") && fileName.startsWith("record_")) {
-            // Extract the file number
-            int underscorePos = fileName.indexOf('_');
-            int dotPos = fileName.lastIndexOf('.');
-            if (underscorePos != -1 && dotPos != -1) {
-                String numberStr = fileName.substring(underscorePos + 1, dotPos);
-                int fileNumber = numberStr.toInt();
-                if (fileNumber > highestNumber) {
-                    highestNumber = fileNumber;
-                    lastFileName = fileName;
-                }
-            }
+        // record_<N>.wav
+        int fileNumber = 0;
+        char extension[5] = "";
+        if (sscanf(file.name(), "record_%d.%4s", &fileNumber, extension) == 2 &&
+            strcmp(extension, "wav") == 0 && fileNumber > highestNumber) {
+            highestNumber = fileNumber;
         }
         file.close();
     }
     
     root.close();
     
-    if (lastFileName != "") {
-        lastRecordedFile = "/" + lastFileName;
+    lastRecordedFile.clear();
+    if (highestNumber > 0) {
+        lastRecordedFile.appendf("/record_%d.wav", highestNumber);
         Serial.printf("Last recorded file found: %s\n", lastRecordedFile.c_str());
     } else {
         Serial.println("No WAV files found");
     }
 }
 
+unsigned long confirmTime = 0;  // When /confirm came, for the confirm-to-sleep latency
+
+// Download counters for the TX power controller (per interval) and the report
+volatile uint32_t downloadChunks = 0, slowChunks = 0;
+uint32_t downloads = 0, downloadMillis = 0;
+uint64_t downloadBytes = 0;
+int weakestRssi = 0;
+size_t stationCount = 0;
+unsigned long lastTxPowerUpdate = 0;
+
+// Last run of each benchmark: network from RAM, SD without network, upload sink
+struct BenchResult {
+    uint64_t bytes;
+    uint32_t millis;
+    uint32_t slowestMs;  // Longest gap between chunks (network, upload) or longest read (SD)
+};
+BenchResult benchNetwork, benchSd, benchUpload;
+volatile uint32_t sdBenchRequest = 0;  // Bytes; set by /bench/sd, run from loop()
+volatile bool sdBenchRunning = false;
+unsigned long uploadStart = 0, uploadLastChunk = 0;
+
+void reportBench(const char *name, const BenchResult &result) {
+    Serial.printf("Bench %s: %llu bytes in %u ms, %.2f MB/s, slowest chunk %u ms\n", name, result.bytes,
+                  result.millis, result.millis ? result.bytes / 1000.0 / result.millis : 0.0, result.slowestMs);
+}
+
+// Least occupied candidate channel from one scan; "Survey:" lines can be
+// replayed with bench/radio_planner_bench.cpp
+void surveyChannel() {
+    static radio::ScanResult results[MAX_SURVEY_NETWORKS];
+    radio::ChannelScore scores[sizeof(candidate_channels)];
+    WiFi.mode(WIFI_STA);
+    int found = WiFi.scanNetworks(false, true, false, 120);  // Hidden networks too, 120 ms per channel
+    size_t count = 0;
+    for (int i = 0; i < found && count < MAX_SURVEY_NETWORKS; i++) {
+        results[count].channel = WiFi.channel(i);
+        results[count].rssi = WiFi.RSSI(i);
+        Serial.printf("Survey: ch %u rssi %d %s\n", results[count].channel, results[count].rssi, WiFi.SSID(i).c_str());
+        count++;
+    }
+    WiFi.scanDelete();
+    WiFi.mode(WIFI_OFF);
+    wifi_channel = radio::pickChannel(results, count, candidate_channels, sizeof(candidate_channels),
+                                      preferred_channel, scores);
+    Serial.printf("Channel %u chosen from %u networks (", wifi_channel, count);
+    for (size_t i = 0; i < sizeof(candidate_channels); i++) {
+        Serial.printf("%sch %u: %u, load %.2f", i ? "; " : "", scores[i].channel, scores[i].networks, scores[i].load);
+    }
+    Serial.println(")");
+}
+
+void startAccessPoint() {
+    WiFi.softAP(ssid, password, wifi_channel);
+    WiFi.setTxPower((wifi_power_t)txPower.power());  // Full power until a station is measured
+    WiFi.softAPConfig(IPAddress(192,168,4,1), IPAddress(192,168,4,1), IPAddress(255,255,255,0));
+}
+
+// AP restarts and Wi-Fi counters (lib/WiFiSupervisor)
+WiFiSupervisor wifiSupervisor(startAccessPoint, stopServer);
+
+// Every TX_POWER_INTERVAL_MS: weakest station's RSSI and the share of slow
+// download chunks (a stand-in for retries, which the driver does not report
+// per station) drive the TX power
+void adaptTxPower() {
+    if (millis() - lastTxPowerUpdate < TX_POWER_INTERVAL_MS) return;
+    lastTxPowerUpdate = millis();
+    wifi_sta_list_t stations;
+    stationCount = 0;
+    weakestRssi = 0;
+    if (esp_wifi_ap_get_sta_list(&stations) == ESP_OK) {
+        for (int i = 0; i < stations.num; i++) {
+            if (stationCount == 0 || stations.sta[i].rssi < weakestRssi) weakestRssi = stations.sta[i].rssi;
+            stationCount++;
+        }
+    }
+    uint32_t chunks = downloadChunks, slow = slowChunks;
+    downloadChunks = 0;
+    slowChunks = 0;
+    float retryShare = chunks ? (float)slow / chunks : 0.0f;
+#if ADAPT_TX_POWER
+    if (txPower.update(stationCount, weakestRssi, retryShare)) {
+        WiFi.setTxPower((wifi_power_t)txPower.power());
+        Serial.printf("TX power %.1f dBm (%u station(s), weakest %d dBm, downlink ~%d dBm, %u/%u slow chunks)\n",
+                      txPower.powerDbm(), stationCount, weakestRssi, txPower.downlinkRssi(weakestRssi), slow, chunks);
+    }
+#endif
+}
+
+void reportWiFiStats() {
+    wifiSupervisor.printReport(Serial);
+    Serial.printf("Radio: channel %u, TX power %.1f dBm, %u download(s), %llu bytes, %u kB/sec\n", wifi_channel,
+                  txPower.powerDbm(), downloads, downloadBytes, downloadMillis ? (uint32_t)(downloadBytes / downloadMillis) : 0);
+}
+
+// Response for every route. The object lives in responsePool (the server's
+// new/delete of responses lands there), scratch memory comes from its arena,
+// and a download streams the file handle that belongs to its slot.
+class PooledResponse : public AsyncAbstractResponse {
+public:
+    static void *operator new(size_t size) noexcept;
+    static void operator delete(void *object);
+
+    PooledResponse()
+        : _text(NULL), _sent(0), _file(NULL), _synthetic(false), _start(millis()), _lastChunk(millis()),
+          _counted(false), _slowestMs(0) {}
+    ~PooledResponse();
+
+    BumpArena<REQUEST_ARENA_SIZE> &arena() { return _arena; }
+    void text(int code, const char *contentType, const char *text);
+    bool file();  // False if this slot has no open file
+    void synthetic(uint32_t bytes);  // Benchmark pattern, no SD
+
+    bool _sourceValid() const { return true; }
+    size_t _fillBuffer(uint8_t *buffer, size_t maxLen);
+
+private:
+    BumpArena<REQUEST_ARENA_SIZE> _arena;
+    const char *_text;
+    size_t _sent;
+    File *_file;
+    bool _synthetic;
+    unsigned long _start;
+    unsigned long _lastChunk;
+    bool _counted;  // Download added to the throughput totals
+    uint32_t _slowestMs;
+};
+
+ObjectPool<PooledResponse, RESPONSE_SLOTS> responsePool;
+File slotFiles[RESPONSE_SLOTS];  // Opened once at boot, never closed
+size_t arenaHighWater = 0;
+
+// Heap low-water marks over all requests
+struct HeapWatch {
+    uint32_t requests;
+    size_t minFree;
+    size_t minLargest;
+};
+HeapWatch heapWatch = {0, SIZE_MAX, SIZE_MAX};
+
+void *PooledResponse::operator new(size_t size) noexcept {
+    return responsePool.acquire();
+}
+
+void PooledResponse::operator delete(void *object) {
+    responsePool.release(object);
+}
+
+PooledResponse::~PooledResponse() {
+    if (_arena.highWater() > arenaHighWater) arenaHighWater = _arena.highWater();
+    if (_synthetic && !_counted) Serial.printf("Bench network: client left after %u bytes\n", _sent);
+}
+
+void PooledResponse::text(int code, const char *contentType, const char *text) {
+    _code = code;
+    _contentType = contentType;
+    _text = text;
+    _contentLength = strlen(text);
+}
+
+bool PooledResponse::file() {
+    File &file = slotFiles[responsePool.indexOf(this)];
+    if (!file) return false;
+    file.seek(0);
+    _file = &file;
+    _code = 200;
+    _contentType = "audio/wav";
+    _contentLength = file.size();
+    return true;
+}
+
+void PooledResponse::synthetic(uint32_t bytes) {
+    _synthetic = true;
+    _code = 200;
+    _contentType = "application/octet-stream";
+    _contentLength = bytes;
+}
+
+size_t PooledResponse::_fillBuffer(uint8_t *buffer, size_t maxLen) {
+    if (_synthetic) {
+        // Same chunk size as a download, filled from RAM instead of the card
+        uint32_t gap = millis() - _lastChunk;
+        if (gap > _slowestMs) _slowestMs = gap;
+        _lastChunk = millis();
+        size_t length = min(min(transfer_chunk_size, maxLen), _contentLength - _sent);
+        memset(buffer, (uint8_t)(_sent / transfer_chunk_size), length);
+        _sent += length;
+        if (!_counted && _sent >= _contentLength) {
+            _counted = true;
+            benchNetwork = {_sent, (uint32_t)(millis() - _start), _slowestMs};
+            reportBench("network", benchNetwork);
+        }
+        return length;
+    }
+    if (_file) {
+        unsigned long gap = millis() - _lastChunk;
+        wifiSupervisor.chunkSent(gap);
+        if (gap > SLOW_CHUNK_MS) slowChunks++;
+        downloadChunks++;
+        _lastChunk = millis();
+        // Limit reading to our fixed chunk size
+        size_t length = _file->read(buffer, min(transfer_chunk_size, maxLen));
+        _sent += length;
+        if (!_counted && (length == 0 || _sent >= _contentLength)) {
+            _counted = true;
+            uint32_t elapsed = millis() - _start;
+            downloads++;
+            downloadBytes += _sent;
+            downloadMillis += elapsed;
+            Serial.printf("Download complete: %u bytes in %u ms, %u kB/sec (channel %u, TX %.1f dBm, weakest station %d dBm)\n",
+                          _sent, elapsed, elapsed ? _sent / elapsed : 0, wifi_channel, txPower.powerDbm(), weakestRssi);
+        }
+        return length;
+    }
+    size_t length = min(maxLen, _contentLength - _sent);
+    memcpy(buffer, _text + _sent, length);
+    _sent += length;
+    return length;
+}
+
+// Fixed text through the pool; the server's own response is the fallback when the pool is full
+void sendText(AsyncWebServerRequest *request, int code, const char *text) {
+    PooledResponse *response = new PooledResponse();
+    if (!response) {
+        request->send(code, "text/plain", text);
+        return;
+    }
+    response->text(code, "text/plain", text);
+    request->send(response);
+}
+
+void noteRequest() {
+    heapWatch.requests++;
+    size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (freeHeap < heapWatch.minFree) heapWatch.minFree = freeHeap;
+    if (largest < heapWatch.minLargest) heapWatch.minLargest = largest;
+}
+
+void reportHeap() {
+    Serial.printf("Heap after %u requests: free %u (min %u), largest block %u (min %u), "
+                  "pool peak %u/%u, pool full %u, arena high water %u\n",
+                  heapWatch.requests, heap_caps_get_free_size(MALLOC_CAP_8BIT), heapWatch.minFree,
+                  heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), heapWatch.minLargest,
+                  responsePool.peak(), RESPONSE_SLOTS, responsePool.exhausted(), arenaHighWater);
+}
+
+// Megabytes from ?mb=, BENCH_DEFAULT_MB without it
+uint32_t benchBytes(AsyncWebServerRequest *request) {
+    long mb = request->hasParam("mb") ? request->getParam("mb")->value().toInt() : BENCH_DEFAULT_MB;
+    if (mb < 1) mb = 1;
+    if (mb > BENCH_MAX_MB) mb = BENCH_MAX_MB;
+    return mb * 1000000;
+}
+
+// Reads the latest recording in download-sized chunks, rewinding at the end,
+// with no network involved. Runs in loop(), so the async_tcp task never waits on it.
+void runSdBench(uint32_t bytes) {
+    static uint8_t buffer[transfer_chunk_size];
+    File file = SD.open(lastRecordedFile.c_str(), "r");
+    if (!file || file.size() == 0) {
+        Serial.println("Bench SD: no recording to read");
+        sdBenchRunning = false;
+        return;
+    }
+    BenchResult result = {0, 0, 0};
+    unsigned long start = millis();
+    while (result.bytes < bytes) {
+        unsigned long readStart = millis();
+        size_t length = file.read(buffer, min((uint64_t)transfer_chunk_size, bytes - result.bytes));
+        uint32_t readMs = millis() - readStart;
+        if (readMs > result.slowestMs) result.slowestMs = readMs;
+        if (length == 0) {
+            if (file.position() == 0) break;  // Read error
+            file.seek(0);
+            continue;
+        }
+        result.bytes += length;
+        esp_task_wdt_reset();
+    }
+    result.millis = millis() - start;
+    file.close();
+    benchSd = result;
+    sdBenchRunning = false;
+    reportBench("SD", benchSd);
+}
+
+#if RUN_SOAK_TEST
+// Requests to our own server over loopback: mostly /heap, every 8th a
+// download dropped after 8 KB (client abort), every 500th a full download.
+// The client side allocates too, but frees everything per request.
+void soakTask(void *parameter) {
+    static uint8_t sink[1024];
+    size_t largestAtStart = 0;
+    uint32_t failures = 0;
+    delay(1000);
+    for (int i = 1; i <= SOAK_REQUESTS; i++) {
+        WiFiClient client;
+        if (!client.connect(IPAddress(127, 0, 0, 1), 80)) {
+            failures++;
+            delay(10);
+            continue;
+        }
+        client.printf("GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n", i % 8 ? "/heap" : "/download");
+        size_t limit = i % 500 == 0 ? SIZE_MAX : 8192;
+        size_t received = 0;
+        unsigned long start = millis();
+        while ((client.connected() || client.available()) && received < limit && millis() - start < 10000) {
+            int length = client.read(sink, sizeof(sink));
+            if (length > 0) {
+                received += length;
+            } else {
+                delay(1);
+            }
+        }
+        client.stop();
+        if (i == 100) largestAtStart = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+        if (i % 1000 == 0) reportHeap();
+    }
+    Serial.printf("Soak done: %d requests, %u failed to connect, largest block %u after 100 requests, %u now\n",
+                  SOAK_REQUESTS, failures, largestAtStart, heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    vTaskDelete(NULL);
+}
+#endif
+
 void setup() {
     Serial.begin(115200);
 
@@ -99,56 +439,156 @@ void setup() {
     
     // Find the last recorded WAV file
     findLastWavFile();
+    // One handle per response slot: downloads never open or close files
+    for (int i = 0; i < RESPONSE_SLOTS && !lastRecordedFile.empty(); i++) {
+        slotFiles[i] = SD.open(lastRecordedFile.c_str(), "r");
+    }
 
-    // Configure WiFi with fixed channel and power level
-    WiFi.softAP(ssid, password, wifi_channel);
-    WiFi.setTxPower(WIFI_POWER_19_5dBm); // Set to maximum allowed power
-    WiFi.softAPConfig(IPAddress(192,168,4,1), IPAddress(192,168,4,1), IPAddress(255,255,255,0));
+#if SURVEY_CHANNEL
+    surveyChannel();
+#endif
+    wifiSupervisor.begin();
     Serial.println("Wi-Fi AP started");
     Serial.print("IP address: ");
     Serial.println(WiFi.softAPIP());
-    Serial.printf("WiFi channel: %d, Power: 19.5dBm\n", wifi_channel);
+    Serial.printf("WiFi channel: %u, Power: %.1f dBm\n", wifi_channel, txPower.powerDbm());
 
     server.on("/download", HTTP_GET, [](AsyncWebServerRequest *request) {
-        if (!SD.exists(lastRecordedFile)) {
-            request->send(404, "text/plain", "File not found");
+        noteRequest();
+        PooledResponse *response = new PooledResponse();
+        if (!response) {
+            request->send(503);  // Every slot busy
+            return;
+        }
+        if (!response->file()) {
+            response->text(404, "text/plain", "File not found");
+            request->send(response);
             Serial.println("File not found");
             enterDeepSleep();
         }
+        request->send(response);
+    });
 
-        File file = SD.open(lastRecordedFile, "r");
-        if (!file) {
-            request->send(500, "text/plain", "Failed to open file");
-            Serial.println("Failed to open file");
-            enterDeepSleep();
+    // Heap and pool state as JSON, built in the request arena
+    server.on("/heap", HTTP_GET, [](AsyncWebServerRequest *request) {
+        noteRequest();
+        PooledResponse *response = new PooledResponse();
+        if (!response) {
+            request->send(503);
+            return;
+        }
+        const size_t size = 256;
+        char *json = response->arena().allocateText(size);
+        snprintf(json, size,
+                 "{\"requests\":%u,\"free\":%u,\"largest\":%u,\"minFree\":%u,\"minLargest\":%u,"
+                 "\"poolPeak\":%u,\"poolFull\":%u,\"arenaHighWater\":%u}",
+                 heapWatch.requests, heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                 heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), heapWatch.minFree, heapWatch.minLargest,
+                 responsePool.peak(), responsePool.exhausted(), arenaHighWater);
+        response->text(200, "application/json", json);
+        request->send(response);
+    });
+
+    // Channel, TX power and the download throughput they gave
+    server.on("/radio", HTTP_GET, [](AsyncWebServerRequest *request) {
+        noteRequest();
+        PooledResponse *response = new PooledResponse();
+        if (!response) {
+            request->send(503);
+            return;
         }
+        const size_t size = 256;
+        char *json = response->arena().allocateText(size);
+        snprintf(json, size,
+                 "{\"channel\":%u,\"txPowerDbm\":%.1f,\"stations\":%u,\"weakestRssi\":%d,\"downlinkRssi\":%d,"
+                 "\"downloads\":%u,\"downloadBytes\":%llu,\"downloadKBps\":%u}",
+                 wifi_channel, txPower.powerDbm(), stationCount, weakestRssi, txPower.downlinkRssi(weakestRssi),
+                 downloads, downloadBytes, downloadMillis ? (uint32_t)(downloadBytes / downloadMillis) : 0);
+        response->text(200, "application/json", json);
+        request->send(response);
+    });
 
-        AsyncWebServerResponse *response = request->beginChunkedResponse(
-            "audio/wav",
-            [file](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
-                // Limit reading to our fixed chunk size
-                size_t bytesToRead = file.available() ? 
-                                     min(transfer_chunk_size, min(maxLen, static_cast<size_t>(file.available()))) : 0;
-                if (bytesToRead) {
-                    file.read(buffer, bytesToRead);
-                } else {
-                    file.close();
-                }
-                return bytesToRead;
-            });
-
-        response->addHeader("Connection", "close");
+    // Benchmarks: N MB from RAM over the network, N MB from the card with no
+    // network, and an upload sink; /bench shows the last result of each
+    server.on("/bench/network", HTTP_GET, [](AsyncWebServerRequest *request) {
+        noteRequest();
+        PooledResponse *response = new PooledResponse();
+        if (!response) {
+            request->send(503);
+            return;
+        }
+        response->synthetic(benchBytes(request));
+        request->send(response);
+    });
+
+    server.on("/bench/sd", HTTP_GET, [](AsyncWebServerRequest *request) {
+        noteRequest();
+        if (sdBenchRunning) {
+            sendText(request, 409, "SD benchmark already running");
+            return;
+        }
+        sdBenchRunning = true;
+        sdBenchRequest = benchBytes(request);
+        sendText(request, 202, "SD benchmark started, results in /bench");
+    });
+
+    server.on("/bench/upload", HTTP_POST, [](AsyncWebServerRequest *request) {
+        // Called once the whole body is in
+        noteRequest();
+        reportBench("upload", benchUpload);
+        sendText(request, 200, "Upload received, results in /bench");
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t length, size_t index, size_t total) {
+        unsigned long now = millis();
+        if (index == 0) {
+            benchUpload = {0, 0, 0};
+            uploadStart = uploadLastChunk = now;
+        }
+        uint32_t gap = now - uploadLastChunk;
+        if (gap > benchUpload.slowestMs) benchUpload.slowestMs = gap;
+        uploadLastChunk = now;
+        benchUpload.bytes += length;
+        benchUpload.millis = now - uploadStart;
+    });
+
+    // Registered last: "/bench" also matches the "/bench/..." URLs
+    server.on("/bench", HTTP_GET, [](AsyncWebServerRequest *request) {
+        noteRequest();
+        PooledResponse *response = new PooledResponse();
+        if (!response) {
+            request->send(503);
+            return;
+        }
+        const size_t size = 384;
+        char *json = response->arena().allocateText(size);
+        const BenchResult *results[] = {&benchNetwork, &benchSd, &benchUpload};
+        const char *names[] = {"network", "sd", "upload"};
+        int length = snprintf(json, size, "{\"chunk\":%u,\"sdRunning\":%s", transfer_chunk_size,
+                              sdBenchRunning ? "true" : "false");
+        for (int i = 0; i < 3; i++) {
+            const BenchResult &result = *results[i];
+            length += snprintf(json + length, size - length,
+                               ",\"%s\":{\"bytes\":%llu,\"ms\":%u,\"MBps\":%.2f,\"slowestMs\":%u}", names[i],
+                               result.bytes, result.millis, result.millis ? result.bytes / 1000.0 / result.millis : 0.0,
+                               result.slowestMs);
+        }
+        snprintf(json + length, size - length, "}");
+        response->text(200, "application/json", json);
         request->send(response);
     });
 
     server.on("/confirm", HTTP_GET, [](AsyncWebServerRequest *request) {
+        noteRequest();
+        confirmTime = millis();
         Serial.println("Received confirmation from client. Stopping server...");
         stopServer = true;
-        request->send(200, "text/plain", "Server shutting down");
+        sendText(request, 200, "Server shutting down");
     });   
 
     server.begin();
     Serial.println("Server started");
+#if RUN_SOAK_TEST
+    xTaskCreate(soakTask, "soak", 4096, NULL, 1, NULL);
+#endif
 
     serverStartTime = millis();
 }
@@ -156,7 +596,7 @@ void setup() {
 void loop() {
 
     esp_task_wdt_reset();  // Prevent watchdog reset
-    delay(1000);  // Wait 1 second before checking again
+    delay(10);  // Yield; Wi-Fi and shutdown are event driven
 
     // Check if 3 minutes have passed without receiving confirmation
     if (millis() - serverStartTime >= CONFIRMATION_TIMEOUT) {
@@ -164,18 +604,17 @@ void loop() {
         stopServer = true;
     }
 
-    // Monitor the Wi-Fi connection status
-    if (WiFi.status() != WL_CONNECTED) {
-        //Serial.println("Wi-Fi not connected. Trying to reconnect...");
-        WiFi.softAP(ssid, password, wifi_channel);
-        WiFi.setTxPower(WIFI_POWER_19_5dBm); // Set to maximum allowed power
-        WiFi.softAPConfig(IPAddress(192,168,4,1), IPAddress(192,168,4,1), IPAddress(255,255,255,0));        
-        delay(5000);  // Wait for the connection
+    wifiSupervisor.poll();
+    adaptTxPower();
+    if (sdBenchRequest) {
+        uint32_t bytes = sdBenchRequest;
+        sdBenchRequest = 0;
+        runSdBench(bytes);
     }
 
     if (stopServer) {
         Serial.println("Shutting down server...");
-        delay(1000);  // Wait a moment before shutting down
+        delay(100);  // Let the /confirm response go out
         server.end();
         WiFi.softAPdisconnect(true);
         WiFi.disconnect(true);
@@ -186,6 +625,13 @@ void loop() {
             Serial.println("AP is down");
         }
         Serial.println("Server stopped. Entering deep sleep...");
+        reportWiFiStats();
+        reportHeap();
+        if (benchNetwork.bytes) reportBench("network", benchNetwork);
+        if (benchSd.bytes) reportBench("SD", benchSd);
+        if (benchUpload.bytes) reportBench("upload", benchUpload);
+        if (confirmTime) Serial.printf("Confirm-to-sleep latency: %lu ms\n", millis() - confirmTime);
+        Serial.flush();
 
         // Set deep sleep time
        esp_sleep_enable_timer_wakeup(sleep_time_us);
@@ -0,0 +1,102 @@
+// Host run of lib/FlashLogStore on the RAM flash simulator (pio run -e native,
+// then .pio/build/native/program). Records many sessions shaped like
+// recordAudio() output, checks every payload, simulates a power loss and
+// reports wear spread, write amplification and flash busy time.
+
+#include <stdio.h>
+#include <string.h>
+#include "FlashLogStore.h"
+#include "SimFlash.h"
+
+static const uint32_t PARTITION_SIZE = 0x1A0000;  // recstore in partitions.csv
+static const uint32_t SAMPLE_RATE = 22050;
+static const uint32_t RECORD_SECONDS = 10;
+static const size_t BLOCK_BYTES = 1024;           // One DMA block of 16-bit mono
+static const int SESSIONS = 200;
+
+static uint8_t patternByte(uint32_t sequence, uint32_t offset) {
+    return (uint8_t)((offset * 31 + sequence * 7) ^ (offset >> 8));
+}
+
+static bool recordSession(FlashLogStore &store, uint32_t bytes, bool commit) {
+    static uint8_t block[BLOCK_BYTES];
+    uint32_t sequence = store.latest() ? store.latest()->sequence + 1 : 1;
+    store.reserve(bytes);
+    if (!store.beginRecord(sequence, SAMPLE_RATE, 1, 16)) return false;
+    for (uint32_t written = 0; written < bytes; written += BLOCK_BYTES) {
+        for (size_t i = 0; i < BLOCK_BYTES; i++) block[i] = patternByte(sequence, written + i);
+        if (!store.append(block, BLOCK_BYTES)) return false;
+    }
+    return commit ? store.commit() : true;
+}
+
+static bool verify(const FlashLogStore &store, const RecordInfo &record) {
+    uint32_t offset = 0;
+    while (offset < record.length) {
+        size_t length;
+        const uint8_t *bytes = store.span(record, offset, length);
+        for (size_t i = 0; i < length; i++) {
+            if (bytes[i] != patternByte(record.sequence, offset + i)) return false;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+int main() {
+    SimFlash flash(PARTITION_SIZE);
+    FlashLogStore store;
+    if (!store.begin(flash)) {
+        printf("begin failed\n");
+        return 1;
+    }
+
+    const uint32_t sessionBytes = RECORD_SECONDS * SAMPLE_RATE * 2;
+    int failures = 0;
+    for (int s = 0; s < SESSIONS; s++) {
+        if (!recordSession(store, sessionBytes, true) || !verify(store, *store.latest())) failures++;
+    }
+
+    uint32_t minErase = 0xFFFFFFFF, maxErase = 0;
+    for (uint32_t sector = 0; sector < flash.sectors(); sector++) {
+        if (flash.eraseCount(sector) < minErase) minErase = flash.eraseCount(sector);
+        if (flash.eraseCount(sector) > maxErase) maxErase = flash.eraseCount(sector);
+    }
+    double payload = (double)SESSIONS * sessionBytes;
+    double audioSeconds = (double)SESSIONS * RECORD_SECONDS;
+    printf("Sessions: %d x %u bytes, payload failures: %d\n", SESSIONS, sessionBytes, failures);
+    printf("Records kept: %u (%u dropped to reclaim space)\n", (unsigned)store.count(), store.stats().recordsDropped);
+    printf("Erase count per 4 KB sector: min %u, max %u\n", minErase, maxErase);
+    printf("Write amplification (pages programmed / payload): %.3f\n", flash.pagesProgrammed() * 256.0 / payload);
+    printf("Program calls per second of audio: %.1f\n", store.stats().writes / audioSeconds);
+    printf("Simulated flash busy time: %.1f ms per second of audio\n", flash.busyMicros() / 1000.0 / audioSeconds);
+
+    // Remount: the index is rebuilt from the sector headers alone
+    FlashLogStore remounted;
+    remounted.begin(flash);
+    bool sameIndex = remounted.count() == store.count();
+    for (size_t i = 0; sameIndex && i < store.count(); i++) {
+        sameIndex = remounted.record(i).sequence == store.record(i).sequence &&
+                    remounted.record(i).length == store.record(i).length && verify(remounted, remounted.record(i));
+    }
+    printf("Remount: %s\n", sameIndex ? "index and payloads match" : "MISMATCH");
+
+    // Power loss: the recording is never committed
+    const uint32_t partialBytes = 300 * 1024;
+    recordSession(remounted, partialBytes, false);
+    FlashLogStore recovered;
+    recovered.begin(flash);
+    const RecordInfo *last = recovered.latest();
+    // The last unflushed buffer never reached the flash
+    bool recoveredOk = last && last->length + FlashLogStore::BUFFER_SIZE >= partialBytes && verify(recovered, *last);
+    printf("Power loss: %u of %u bytes recovered, %s\n", last ? last->length : 0, partialBytes,
+           recoveredOk ? "payload intact" : "FAILED");
+
+    // A new recording after recovery must not disturb the recovered one
+    recordSession(recovered, sessionBytes, true);
+    const RecordInfo *previous = recovered.find(last ? last->sequence : 0);
+    bool afterOk = previous && verify(recovered, *previous) && verify(recovered, *recovered.latest());
+    printf("Append after recovery: %s\n", afterOk ? "ok" : "FAILED");
+
+    return failures || !sameIndex || !recoveredOk || !afterOk;
+}
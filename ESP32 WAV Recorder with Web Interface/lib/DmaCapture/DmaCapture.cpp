@@ -0,0 +1,77 @@
+#include "DmaCapture.h"
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+
+bool DmaCapture::begin(i2s_port_t port, int sck, int ws, int sd, uint32_t sampleRate, size_t channels,
+                       size_t framesPerBuffer, size_t bufferCount) {
+    _channels = channels;
+    _bufferCount = bufferCount;
+    _completed = 0;
+    _stats.blocks = 0;
+    _stats.dropped = 0;
+
+    i2s_chan_config_t channelConfig = I2S_CHANNEL_DEFAULT_CONFIG(port, I2S_ROLE_MASTER);
+    channelConfig.dma_desc_num = bufferCount;
+    channelConfig.dma_frame_num = framesPerBuffer;
+    if (i2s_new_channel(&channelConfig, NULL, &_channel) != ESP_OK) return false;
+
+    i2s_std_config_t config = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(sampleRate),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT,
+                                                        channels == 2 ? I2S_SLOT_MODE_STEREO : I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = (gpio_num_t)sck,
+            .ws = (gpio_num_t)ws,
+            .dout = I2S_GPIO_UNUSED,
+            .din = (gpio_num_t)sd,
+            .invert_flags = {.mclk_inv = false, .bclk_inv = false, .ws_inv = false},
+        },
+    };
+    if (channels == 1) config.slot_cfg.slot_mask = I2S_STD_SLOT_LEFT;
+    if (i2s_channel_init_std_mode(_channel, &config) != ESP_OK) return false;
+
+    // One slot per DMA buffer, so the callback never finds it full unless the
+    // consumer is a whole ring behind
+    _queue = xQueueCreate(bufferCount, sizeof(Block));
+    if (!_queue) return false;
+    i2s_event_callbacks_t callbacks = {};
+    callbacks.on_recv = onReceive;
+    return i2s_channel_register_event_callback(_channel, &callbacks, this) == ESP_OK;
+}
+
+bool DmaCapture::start() {
+    return _channel && i2s_channel_enable(_channel) == ESP_OK;
+}
+
+void DmaCapture::end() {
+    if (_channel) {
+        i2s_channel_disable(_channel);
+        i2s_del_channel(_channel);
+        _channel = NULL;
+    }
+    if (_queue) {
+        vQueueDelete(_queue);
+        _queue = NULL;
+    }
+}
+
+bool DmaCapture::next(Block &block, TickType_t wait) {
+    return _queue && xQueueReceive(_queue, &block, wait) == pdTRUE;
+}
+
+// ISR context. event->data points at the finished descriptor's buffer pointer.
+bool IRAM_ATTR DmaCapture::onReceive(i2s_chan_handle_t channel, i2s_event_data_t *event, void *context) {
+    DmaCapture *self = (DmaCapture *)context;
+    Block block;
+    block.data = *(int32_t **)event->data;
+    block.frames = event->size / (4 * self->_channels);
+    block.sequence = self->_completed;
+    self->_completed = block.sequence + 1;
+    self->_stats.blocks++;
+    BaseType_t woken = pdFALSE;
+    if (xQueueSendFromISR(self->_queue, &block, &woken) != pdTRUE) self->_stats.dropped++;
+    return woken == pdTRUE;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include "esp_idf_version.h"
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+#include "driver/i2s_std.h"
+#include "freertos/queue.h"
+
+// Event-driven I2S receive on the ESP-IDF 5 standard-mode channel API.
+//
+// The driver's on_recv callback fires as each DMA buffer completes and
+// queues a pointer to that buffer, so the consumer wakes on the DMA event
+// and processes the samples where the DMA left them: no i2s_channel_read(),
+// no copy into a user buffer. A block stays valid until the DMA ring wraps
+// back to it, i.e. while fewer than `bufferCount` newer buffers have
+// completed; stillValid() tells whether the consumer kept that pace.
+// Only built on ESP-IDF 5 (Arduino core 3); the legacy driver/i2s.h path
+// in main.cpp is used otherwise.
+//
+//   DmaCapture capture;
+//   capture.begin(I2S_NUM_0, sck, ws, sd, 22050, 1, 512, 8);
+//   capture.start();
+//   DmaCapture::Block block;
+//   while (capture.next(block, portMAX_DELAY)) { ... block.data, block.frames ... }
+
+class DmaCapture {
+public:
+    struct Block {
+        int32_t *data;      // Inside the DMA ring, 32-bit slots, interleaved
+        size_t frames;
+        uint32_t sequence;  // Completed-buffer count when it was handed over
+    };
+
+    struct Stats {
+        uint32_t blocks;    // Completed DMA buffers
+        uint32_t dropped;   // Not queued: the consumer was a whole ring behind
+    };
+
+    // 32-bit Philips slots; channels 1 = left only, 2 = left + right
+    bool begin(i2s_port_t port, int sck, int ws, int sd, uint32_t sampleRate, size_t channels,
+               size_t framesPerBuffer, size_t bufferCount);
+    bool start();
+    void end();
+
+    // Next completed DMA buffer, by reference
+    bool next(Block &block, TickType_t wait);
+    // False if the DMA may already be refilling the block
+    bool stillValid(const Block &block) const { return _completed - block.sequence < _bufferCount; }
+
+    const Stats &stats() const { return _stats; }
+
+private:
+    static bool onReceive(i2s_chan_handle_t channel, i2s_event_data_t *event, void *context);
+
+    i2s_chan_handle_t _channel = NULL;
+    QueueHandle_t _queue = NULL;
+    size_t _channels = 1;
+    size_t _bufferCount = 0;
+    volatile uint32_t _completed = 0;
+    Stats _stats = {0, 0};
+};
+
+#endif
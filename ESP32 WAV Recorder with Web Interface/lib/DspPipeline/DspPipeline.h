@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compile-time composed per-sample processing chain.
+//
+//   typedef dsp::Pipeline<dsp::Convert<11>, dsp::DcBlock<2, 8>, dsp::Gain<384, 8>, dsp::Clip16> Chain;
+//
+// Every stage is a small struct with `int32_t process(int32_t x, size_t channel)`.
+// Pipeline nests the stages as inline calls, so the compiler flattens the whole
+// chain into the body of the block kernel (lib/I2SKernels) and each DMA block is
+// converted, filtered and packed to 16-bit in a single in-place pass.
+// C++11 only (the ESP32 Arduino core builds with gnu++11).
+
+namespace dsp {
+
+// 32-bit I2S slot -> working integer sample
+template <int Shift>
+struct Convert {
+    inline int32_t process(int32_t x, size_t) { return x >> Shift; }
+};
+
+// One-pole DC blocker: y[n] = x[n] - x[n-1] + (1 - 2^-Pole) * y[n-1]
+// Pole 8 puts the corner around fs / 1600 (about 14 Hz at 22.05 kHz).
+template <size_t Channels, int Pole>
+struct DcBlock {
+    int32_t xPrev[Channels];
+    int32_t yPrev[Channels];
+
+    DcBlock() {
+        for (size_t c = 0; c < Channels; c++) {
+            xPrev[c] = 0;
+            yPrev[c] = 0;
+        }
+    }
+
+    inline int32_t process(int32_t x, size_t ch) {
+        int32_t y = x - xPrev[ch] + yPrev[ch] - (yPrev[ch] >> Pole);
+        xPrev[ch] = x;
+        yPrev[ch] = y;
+        return y;
+    }
+};
+
+// Fixed-point gain: x * Num / 2^Shift (Gain<384, 8> = 1.5x). DcBlock can
+// swing a full-scale input to twice its range, so the product is formed in
+// 64 bits (one extra multiply-high on the ESP32) and saturated to 32 bits.
+template <int32_t Num, int Shift>
+struct Gain {
+    static_assert(Num > 0 && Shift >= 0 && Shift < 32, "gain must be positive, shift below 32");
+    inline int32_t process(int32_t x, size_t) {
+        int64_t y = ((int64_t)x * Num) >> Shift;
+        if (y > INT32_MAX) return INT32_MAX;
+        if (y < INT32_MIN) return INT32_MIN;
+        return (int32_t)y;
+    }
+};
+
+// Saturate to the 16-bit range instead of wrapping
+struct Clip16 {
+    inline int32_t process(int32_t x, size_t) {
+        if (x > 32767) return 32767;
+        if (x < -32768) return -32768;
+        return x;
+    }
+};
+
+// Stage chain, nested so each call inlines into the next
+template <typename... Stages>
+struct Chain;
+
+template <>
+struct Chain<> {
+    inline int32_t apply(int32_t x, size_t) { return x; }
+};
+
+template <typename Head, typename... Tail>
+struct Chain<Head, Tail...> {
+    Head head;
+    Chain<Tail...> tail;
+    inline int32_t apply(int32_t x, size_t ch) { return tail.apply(head.process(x, ch), ch); }
+};
+
+// The pack stage: callable as the per-sample operator of the block kernels,
+// narrowing the chain output to the 16-bit word the kernel stores.
+template <typename... Stages>
+struct Pipeline {
+    Chain<Stages...> chain;
+    inline int16_t operator()(int32_t x, size_t ch) { return (int16_t)chain.apply(x, ch); }
+};
+
+} // namespace dsp
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "FlashLogStore.h"
+#include "esp_idf_version.h"
+#include "esp_partition.h"
+
+// IDF 5 moved partition mmap off the spi_flash API
+#if ESP_IDF_VERSION_MAJOR >= 5
+#define PARTITION_MMAP_DATA ESP_PARTITION_MMAP_DATA
+typedef esp_partition_mmap_handle_t partition_mmap_handle_t;
+#else
+#define PARTITION_MMAP_DATA SPI_FLASH_MMAP_DATA
+typedef spi_flash_mmap_handle_t partition_mmap_handle_t;
+#endif
+
+// FlashDevice on a raw data partition, memory-mapped once for reads
+class EspPartitionFlash : public FlashDevice {
+public:
+    // Data partition by label (see partitions.csv)
+    bool begin(const char *label) {
+        _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        if (!_partition) return false;
+        const void *mapped = NULL;
+        if (esp_partition_mmap(_partition, 0, _partition->size, PARTITION_MMAP_DATA, &mapped, &_handle) != ESP_OK) {
+            return false;
+        }
+        _mapped = (const uint8_t *)mapped;
+        return true;
+    }
+
+    uint32_t size() const { return _partition ? _partition->size : 0; }
+
+    bool write(uint32_t offset, const void *data, size_t length) {
+        return esp_partition_write(_partition, offset, data, length) == ESP_OK;
+    }
+
+    // Aligned 64 KB ranges use the block erase command
+    bool erase(uint32_t offset, uint32_t length) {
+        return esp_partition_erase_range(_partition, offset, length) == ESP_OK;
+    }
+
+    const uint8_t *map() { return _mapped; }
+
+private:
+    const esp_partition_t *_partition = NULL;
+    partition_mmap_handle_t _handle = 0;
+    const uint8_t *_mapped = NULL;
+};
@@ -0,0 +1,251 @@
+#include "FlashLogStore.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static const uint32_t MAGIC = 0x474F4C52;  // "RLOG"
+static const uint32_t UNWRITTEN = 0xFFFFFFFF;
+
+// Only used for the 20-byte record headers, so the bitwise form is enough
+static uint32_t crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+bool FlashLogStore::begin(FlashDevice &flash) {
+    _flash = &flash;
+    _map = flash.map();
+    _size = flash.size();
+    _count = 0;
+    _buffered = 0;
+    _recording = false;
+    _nextSequence = 1;
+    memset(&_stats, 0, sizeof(_stats));
+    if (!_map || _size == 0 || _size % ERASE_BLOCK != 0) return false;
+
+    // Rebuild the index from the sector headers
+    for (uint32_t offset = 0; offset < _size; offset += SECTOR) {
+        const Header *header = (const Header *)(_map + offset);
+        if (header->magic != MAGIC || header->state != UNWRITTEN) continue;
+        if (header->headerCrc != crc32((const uint8_t *)header, offsetof(Header, headerCrc))) continue;
+
+        RecordInfo info;
+        info.sequence = header->sequence;
+        info.start = offset;
+        info.length = header->length;
+        info.timestamp = header->timestamp;
+        info.sampleRate = header->sampleRate;
+        info.channels = header->channels;
+        info.bitsPerSample = header->bitsPerSample;
+        if (info.length == UNWRITTEN) {
+            // Interrupted before commit: keep what reached the flash
+            info.length = recover(offset);
+            program(offset + offsetof(Header, length), &info.length, sizeof(info.length));
+        }
+        insert(info);
+    }
+
+    if (_count) {
+        const RecordInfo &newest = _records[_count - 1];
+        uint32_t end = newest.start + sizeof(Header) + newest.length;
+        _head = ((end + SECTOR - 1) / SECTOR * SECTOR) % _size;
+        _nextSequence = newest.sequence + 1;
+    } else {
+        _head = 0;
+    }
+    // The block holding the head was erased as a whole before it was entered
+    _erasedAhead = _head % ERASE_BLOCK ? ERASE_BLOCK - _head % ERASE_BLOCK : 0;
+    return true;
+}
+
+bool FlashLogStore::reserve(uint32_t bytes) {
+    if (bytes + 2 * SECTOR + ERASE_BLOCK > _size) bytes = _size - 2 * SECTOR - ERASE_BLOCK;
+    return ensureErased(bytes);
+}
+
+bool FlashLogStore::beginRecord(uint32_t timestamp, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample) {
+    if (_recording || !_map) return false;
+    if (!ensureErased(sizeof(Header))) return false;
+
+    Header header;
+    header.magic = MAGIC;
+    header.sequence = _nextSequence;
+    header.timestamp = timestamp;
+    header.sampleRate = sampleRate;
+    header.channels = channels;
+    header.bitsPerSample = bitsPerSample;
+    header.headerCrc = crc32((const uint8_t *)&header, offsetof(Header, headerCrc));
+    header.length = UNWRITTEN;  // Programmed by commit()
+    header.state = UNWRITTEN;
+    if (!program(_head, &header, sizeof(header))) return false;
+
+    _current.sequence = _nextSequence++;
+    _current.start = _head;
+    _current.length = 0;
+    _current.timestamp = timestamp;
+    _current.sampleRate = sampleRate;
+    _current.channels = channels;
+    _current.bitsPerSample = bitsPerSample;
+    _head = (_head + sizeof(Header)) % _size;
+    _erasedAhead -= sizeof(Header);
+    _recording = true;
+    return true;
+}
+
+bool FlashLogStore::append(const void *data, size_t length) {
+    if (!_recording) return false;
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (length) {
+        size_t chunk = BUFFER_SIZE - _buffered;
+        if (chunk > length) chunk = length;
+        memcpy(_buffer + _buffered, bytes, chunk);
+        _buffered += chunk;
+        bytes += chunk;
+        length -= chunk;
+        if (_buffered == BUFFER_SIZE && !flush(false)) return false;
+    }
+    return true;
+}
+
+bool FlashLogStore::commit() {
+    if (!_recording) return false;
+    bool flushed = flush(true);
+    _recording = false;
+    program(_current.start + offsetof(Header, length), &_current.length, sizeof(_current.length));
+    insert(_current);
+
+    // Next record starts on a sector boundary; the padding is already erased
+    uint32_t pad = (SECTOR - _head % SECTOR) % SECTOR;
+    _head = (_head + pad) % _size;
+    _erasedAhead -= pad;
+    return flushed;
+}
+
+const RecordInfo *FlashLogStore::find(uint32_t sequence) const {
+    for (size_t i = 0; i < _count; i++) {
+        if (_records[i].sequence == sequence) return &_records[i];
+    }
+    return 0;
+}
+
+const uint8_t *FlashLogStore::span(const RecordInfo &record, uint32_t offset, size_t &length) const {
+    if (offset >= record.length) {
+        length = 0;
+        return 0;
+    }
+    uint32_t position = (record.start + sizeof(Header) + offset) % _size;
+    length = record.length - offset;
+    if (length > _size - position) length = _size - position;
+    return _map + position;
+}
+
+bool FlashLogStore::program(uint32_t offset, const void *data, size_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    if (offset + length > _size) {
+        size_t first = _size - offset;
+        if (!program(offset, bytes, first)) return false;
+        return program(0, bytes + first, length - first);
+    }
+    _stats.writes++;
+    _stats.bytesWritten += length;
+    return _flash->write(offset, bytes, length);
+}
+
+// Programs whole flash pages; the partial last page stays buffered unless `all`
+bool FlashLogStore::flush(bool all) {
+    size_t length = all ? _buffered : _buffered - (_head + _buffered) % PAGE;
+    if (!length) return true;
+    // Never let the erase frontier reach the start of the recording in progress
+    if (distance(_current.start, _head) + length + 2 * SECTOR + ERASE_BLOCK > _size) {
+        _buffered = 0;
+        return false;
+    }
+    if (!ensureErased(length)) return false;
+    if (!program(_head, _buffer, length)) return false;
+    _head = (_head + length) % _size;
+    _erasedAhead -= length;
+    _current.length += length;
+    _buffered -= length;
+    memmove(_buffer, _buffer + length, _buffered);
+    return true;
+}
+
+// Keep `bytes` plus two sectors erased ahead of the head, so the end of the
+// log is always followed by a fully erased sector (used by recover())
+bool FlashLogStore::ensureErased(uint32_t bytes) {
+    while (_erasedAhead < bytes + 2 * SECTOR) {
+        uint32_t block = (_head + _erasedAhead) % _size;
+        dropOverlapping(block, ERASE_BLOCK);
+        if (!_flash->erase(block, ERASE_BLOCK)) return false;
+        _stats.erases++;
+        _erasedAhead += ERASE_BLOCK;
+    }
+    return true;
+}
+
+// Drop indexed recordings that lose any byte to an erase. A header outside
+// the erased range is marked dropped so the next scan skips it.
+void FlashLogStore::dropOverlapping(uint32_t offset, uint32_t length) {
+    size_t kept = 0;
+    for (size_t i = 0; i < _count; i++) {
+        const RecordInfo &record = _records[i];
+        uint32_t recordLength = sizeof(Header) + record.length;
+        bool overlaps = distance(record.start, offset) < recordLength || distance(offset, record.start) < length;
+        if (!overlaps) {
+            _records[kept++] = record;
+            continue;
+        }
+        if (distance(offset, record.start) >= length) {
+            uint32_t dropped = 0;
+            program(record.start + offsetof(Header, state), &dropped, sizeof(dropped));
+        }
+        _stats.recordsDropped++;
+    }
+    _count = kept;
+}
+
+// Payload length of an uncommitted record: up to the last programmed byte
+// before the first fully erased sector
+uint32_t FlashLogStore::recover(uint32_t start) {
+    uint32_t end = sizeof(Header);
+    for (uint32_t walked = 0; walked < _size; walked += SECTOR) {
+        uint32_t sector = (start + walked) % _size;
+        const uint8_t *bytes = _map + sector;
+        int last = SECTOR - 1;
+        while (last >= 0 && bytes[last] == 0xFF) last--;
+        if (last < 0) break;
+        if (walked && ((const Header *)bytes)->magic == MAGIC) break;  // Next record
+        end = walked + last + 1;
+    }
+    return end > sizeof(Header) ? end - sizeof(Header) : 0;
+}
+
+// Sorted by sequence; beyond MAX_RECORDS the oldest is retired on flash too
+void FlashLogStore::insert(const RecordInfo &info) {
+    if (_count == MAX_RECORDS) {
+        if (info.sequence < _records[0].sequence) {
+            uint32_t dropped = 0;
+            program(info.start + offsetof(Header, state), &dropped, sizeof(dropped));
+            _stats.recordsDropped++;
+            return;
+        }
+        uint32_t dropped = 0;
+        program(_records[0].start + offsetof(Header, state), &dropped, sizeof(dropped));
+        _stats.recordsDropped++;
+        memmove(_records, _records + 1, (MAX_RECORDS - 1) * sizeof(RecordInfo));
+        _count--;
+    }
+    size_t i = _count;
+    while (i > 0 && _records[i - 1].sequence > info.sequence) {
+        _records[i] = _records[i - 1];
+        i--;
+    }
+    _records[i] = info;
+    _count++;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only circular recording log on a raw flash partition.
+//
+// Every recording starts on a 4 KB sector boundary with a 32-byte header,
+// followed by the raw PCM payload. The head only moves forward and wraps at
+// the end of the partition, so every sector is erased once per lap (wear is
+// spread evenly by construction). Erases happen in 64 KB blocks ahead of the
+// head; reserve() does them before capture starts so appends never stall on
+// an erase. Recordings whose space is reclaimed are dropped oldest-first.
+//
+// There is no filesystem metadata: the index is rebuilt at begin() by
+// scanning sector headers through the memory-mapped partition, and reads are
+// served straight from that mapping (zero-copy). A recording interrupted by
+// a power loss is recovered up to its last written byte.
+// Plain C++ (no Arduino headers): the flash itself is behind FlashDevice,
+// implemented by EspPartitionFlash on the ESP32 and SimFlash on the host.
+
+class FlashDevice {
+public:
+    virtual ~FlashDevice() {}
+    virtual uint32_t size() const = 0;
+    // NOR semantics: writing can only clear bits
+    virtual bool write(uint32_t offset, const void *data, size_t length) = 0;
+    // offset and length are multiples of FlashLogStore::ERASE_BLOCK
+    virtual bool erase(uint32_t offset, uint32_t length) = 0;
+    // The whole device mapped for reading
+    virtual const uint8_t *map() = 0;
+};
+
+struct RecordInfo {
+    uint32_t sequence;    // Increases by one per recording, never reused
+    uint32_t start;       // Offset of the record header
+    uint32_t length;      // Payload bytes
+    uint32_t timestamp;   // Caller-defined (e.g. seconds since boot or epoch)
+    uint32_t sampleRate;
+    uint16_t channels;
+    uint16_t bitsPerSample;
+};
+
+struct FlashLogStats {
+    uint32_t erases;          // 64 KB block erases
+    uint32_t writes;          // Program calls
+    uint64_t bytesWritten;    // Bytes programmed, headers included
+    uint32_t recordsDropped;  // Reclaimed to make room
+};
+
+class FlashLogStore {
+public:
+    static const uint32_t SECTOR = 4096;
+    static const uint32_t ERASE_BLOCK = 65536;
+    static const size_t MAX_RECORDS = 64;
+    static const size_t BUFFER_SIZE = 4096;
+    static const uint32_t PAGE = 256;  // Flash program granularity
+
+    bool begin(FlashDevice &flash);
+
+    // Erase ahead so the next `bytes` of appends need no erase
+    bool reserve(uint32_t bytes);
+
+    bool beginRecord(uint32_t timestamp, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample);
+    // Returns false once the recording would overrun its own start
+    bool append(const void *data, size_t length);
+    bool commit();
+
+    // Oldest first
+    size_t count() const { return _count; }
+    const RecordInfo &record(size_t index) const { return _records[index]; }
+    const RecordInfo *find(uint32_t sequence) const;
+    const RecordInfo *latest() const { return _count ? &_records[_count - 1] : 0; }
+
+    // Contiguous mapped bytes of a payload from `offset`; the length is cut
+    // at the end of the partition, so a wrapped recording takes two spans
+    const uint8_t *span(const RecordInfo &record, uint32_t offset, size_t &length) const;
+
+    uint32_t capacity() const { return _size; }
+    const FlashLogStats &stats() const { return _stats; }
+
+private:
+    struct __attribute__((packed)) Header {
+        uint32_t magic;         // "RLOG"
+        uint32_t sequence;
+        uint32_t timestamp;
+        uint32_t sampleRate;
+        uint16_t channels;
+        uint16_t bitsPerSample;
+        uint32_t headerCrc;     // Over the fields above
+        uint32_t length;        // 0xFFFFFFFF until committed
+        uint32_t state;         // 0xFFFFFFFF valid, 0 dropped
+    };
+
+    bool program(uint32_t offset, const void *data, size_t length);
+    bool flush(bool all);
+    bool ensureErased(uint32_t bytes);
+    void dropOverlapping(uint32_t offset, uint32_t length);
+    uint32_t recover(uint32_t start);
+    void insert(const RecordInfo &info);
+    uint32_t distance(uint32_t from, uint32_t to) const { return to >= from ? to - from : _size - from + to; }
+
+    FlashDevice *_flash;
+    const uint8_t *_map;
+    uint32_t _size;
+    uint32_t _head;          // Next byte to program
+    uint32_t _erasedAhead;   // Erased bytes from _head onwards
+    uint32_t _nextSequence;
+    bool _recording;
+    RecordInfo _current;
+    uint8_t _buffer[BUFFER_SIZE];
+    size_t _buffered;
+    RecordInfo _records[MAX_RECORDS];
+    size_t _count;
+    FlashLogStats _stats;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FlashLogStore.h"
+
+// RAM-backed NOR flash for host runs: programming only clears bits, erases
+// reset 64 KB blocks to 0xFF. Counts erases per 4 KB sector and accumulates
+// the time the same operations take on the ESP32's SPI flash (typical
+// W25Q32 figures: 0.4 ms per 256-byte page, 150 ms per 64 KB block erase).
+class SimFlash : public FlashDevice {
+public:
+    static const uint32_t PAGE = 256;
+    static const uint32_t PAGE_PROGRAM_US = 400;
+    static const uint32_t BLOCK_ERASE_US = 150000;
+
+    explicit SimFlash(uint32_t size) : _size(size), _busyMicros(0), _pagesProgrammed(0) {
+        _data = (uint8_t *)malloc(size);
+        memset(_data, 0xFF, size);
+        _eraseCounts = (uint32_t *)calloc(size / FlashLogStore::SECTOR, sizeof(uint32_t));
+    }
+
+    ~SimFlash() {
+        free(_data);
+        free(_eraseCounts);
+    }
+
+    uint32_t size() const { return _size; }
+
+    bool write(uint32_t offset, const void *data, size_t length) {
+        if (offset + length > _size) return false;
+        const uint8_t *bytes = (const uint8_t *)data;
+        for (size_t i = 0; i < length; i++) _data[offset + i] &= bytes[i];
+        // Every page touched costs one program cycle
+        uint32_t pages = (offset + length + PAGE - 1) / PAGE - offset / PAGE;
+        _pagesProgrammed += pages;
+        _busyMicros += (uint64_t)pages * PAGE_PROGRAM_US;
+        return true;
+    }
+
+    bool erase(uint32_t offset, uint32_t length) {
+        if (offset % FlashLogStore::ERASE_BLOCK || length % FlashLogStore::ERASE_BLOCK || offset + length > _size) {
+            return false;
+        }
+        memset(_data + offset, 0xFF, length);
+        for (uint32_t s = offset / FlashLogStore::SECTOR; s < (offset + length) / FlashLogStore::SECTOR; s++) {
+            _eraseCounts[s]++;
+        }
+        _busyMicros += (uint64_t)(length / FlashLogStore::ERASE_BLOCK) * BLOCK_ERASE_US;
+        return true;
+    }
+
+    const uint8_t *map() { return _data; }
+
+    uint32_t sectors() const { return _size / FlashLogStore::SECTOR; }
+    uint32_t eraseCount(uint32_t sector) const { return _eraseCounts[sector]; }
+    uint64_t busyMicros() const { return _busyMicros; }
+    uint64_t pagesProgrammed() const { return _pagesProgrammed; }
+
+private:
+    uint32_t _size;
+    uint8_t *_data;
+    uint32_t *_eraseCounts;
+    uint64_t _busyMicros;
+    uint64_t _pagesProgrammed;
+};
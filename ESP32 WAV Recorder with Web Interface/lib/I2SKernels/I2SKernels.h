@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Block kernels for turning 32-bit I2S DMA frames into 16-bit PCM.
+// The SPH0645LMH puts its 18 valid bits at the top of each 32-bit slot,
+// so every kernel takes the right shift that lands them in 16 bits.
+// All kernels are plain C++ (no Arduino headers) so they also build on the host.
+// Word stores assume a little-endian target (ESP32 / x86 host).
+//
+// Each kernel also has a templated form taking a per-sample operator
+// `int16_t op(int32_t sample, size_t channel)`, so a whole conversion chain
+// (see lib/DspPipeline) runs inside the same single pass over the block.
+
+namespace i2s_kernels {
+
+static inline int16_t to16(int32_t sample, int shift) {
+    return (int16_t)(sample >> shift);
+}
+
+// Plain shift, used by the non-templated kernels
+struct ShiftOp {
+    int shift;
+    inline int16_t operator()(int32_t sample, size_t) const { return to16(sample, shift); }
+};
+
+static inline uint32_t packWord(int16_t lo, int16_t hi) {
+    return (uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+}
+
+// Convert interleaved 32-bit samples to interleaved 16-bit samples.
+// Safe to run in place (out may alias in): output is written behind the input.
+template <typename Op>
+static inline void convertBlock(const int32_t *in, int16_t *out, size_t samples, size_t channels, Op &op) {
+    size_t i = 0;
+    if (channels == 1) {
+        // Four samples per iteration, stored as two 32-bit words
+        for (; i + 4 <= samples; i += 4) {
+            // Separate statements keep stateful stages in sample order
+            int16_t s0 = op(in[i], 0);
+            int16_t s1 = op(in[i + 1], 0);
+            int16_t s2 = op(in[i + 2], 0);
+            int16_t s3 = op(in[i + 3], 0);
+            uint32_t w0 = packWord(s0, s1);
+            uint32_t w1 = packWord(s2, s3);
+            memcpy(out + i, &w0, 4);
+            memcpy(out + i + 2, &w1, 4);
+        }
+    } else if (channels == 2) {
+        for (; i + 2 <= samples; i += 2) {
+            int16_t left = op(in[i], 0);
+            int16_t right = op(in[i + 1], 1);
+            uint32_t w = packWord(left, right);
+            memcpy(out + i, &w, 4);
+        }
+    }
+    for (; i < samples; i++) {
+        out[i] = op(in[i], i % channels);
+    }
+}
+
+static inline void convert32to16(const int32_t *in, int16_t *out, size_t samples, int shift) {
+    ShiftOp op = {shift};
+    convertBlock(in, out, samples, 1, op);
+}
+
+// Split interleaved 32-bit frames into one 16-bit plane per channel.
+// channelBase offsets the channel index passed to op (second port).
+template <typename Op>
+static inline void deinterleaveBlock(const int32_t *in, int16_t *const *planes,
+                                     size_t frames, size_t channels, size_t channelBase, Op &op) {
+    if (channels == 2) {
+        int16_t *left = planes[0];
+        int16_t *right = planes[1];
+        for (size_t f = 0; f < frames; f++) {
+            left[f] = op(in[2 * f], channelBase);
+            right[f] = op(in[2 * f + 1], channelBase + 1);
+        }
+        return;
+    }
+    for (size_t f = 0; f < frames; f++) {
+        for (size_t c = 0; c < channels; c++) {
+            planes[c][f] = op(in[f * channels + c], channelBase + c);
+        }
+    }
+}
+
+static inline void deinterleave32to16(const int32_t *in, int16_t *const *planes,
+                                      size_t frames, size_t channels, int shift) {
+    ShiftOp op = {shift};
+    deinterleaveBlock(in, planes, frames, channels, 0, op);
+}
+
+// Interleave two ports' 32-bit frames into one 16-bit frame stream:
+// out = [a0 .. a(chA-1), b0 .. b(chB-1)] per frame.
+template <typename Op>
+static inline void mergeBlock(const int32_t *a, size_t chA, const int32_t *b, size_t chB,
+                              int16_t *out, size_t frames, Op &op) {
+    const size_t outCh = chA + chB;
+    if (chA == 2 && chB == 2) {
+        for (size_t f = 0; f < frames; f++) {
+            int16_t s0 = op(a[2 * f], 0);
+            int16_t s1 = op(a[2 * f + 1], 1);
+            int16_t s2 = op(b[2 * f], 2);
+            int16_t s3 = op(b[2 * f + 1], 3);
+            uint32_t wa = packWord(s0, s1);
+            uint32_t wb = packWord(s2, s3);
+            memcpy(out + f * 4, &wa, 4);
+            memcpy(out + f * 4 + 2, &wb, 4);
+        }
+        return;
+    }
+    for (size_t f = 0; f < frames; f++) {
+        int16_t *frame = out + f * outCh;
+        for (size_t c = 0; c < chA; c++) frame[c] = op(a[f * chA + c], c);
+        for (size_t c = 0; c < chB; c++) frame[chA + c] = op(b[f * chB + c], chA + c);
+    }
+}
+
+static inline void merge32to16(const int32_t *a, size_t chA, const int32_t *b, size_t chB,
+                               int16_t *out, size_t frames, int shift) {
+    ShiftOp op = {shift};
+    mergeBlock(a, chA, b, chB, out, frames, op);
+}
+
+// Swap left/right in place for boards whose DMA delivers R before L.
+static inline void swapPairs32(int32_t *frames, size_t count) {
+    for (size_t f = 0; f < count; f++) {
+        int32_t t = frames[2 * f];
+        frames[2 * f] = frames[2 * f + 1];
+        frames[2 * f + 1] = t;
+    }
+}
+
+} // namespace i2s_kernels
@@ -1,9 +1,13 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <driver/i2s.h>
 #include <LittleFS.h>
 #include <WebServer.h>
 #include "soc/i2s_reg.h"
+#include "esp_idf_version.h"
+#include <I2SKernels.h>
+#include <DspPipeline.h>
+#include <FlashLogStore.h>
+#include <EspPartitionFlash.h>
 
 // WiFi credentials
 const char* ssid = "ESP32_Recorder";
@@ -14,21 +18,110 @@ const char* password = "12345678";
 #define I2S_WS  25  // LRCLK
 #define I2S_SD  22  // DOUT
 
+// Second I2S bus (optional, two more SPH0645LMH on I2S_NUM_1)
+#define I2S1_SCK 14
+#define I2S1_WS  15
+#define I2S1_SD  32
+
 // I2S Configuration
 #define SAMPLE_RATE 22050
 #define SAMPLE_BITS 16
+#define SAMPLE_SHIFT 11        // 32-bit slot -> 16-bit sample
+#define MIC_CHANNELS 1         // 1 = LEFT only, 2 = LEFT + RIGHT mics on the same bus
+#define USE_SECOND_PORT 0      // 1 = also capture MIC_CHANNELS mics on I2S_NUM_1
+#define PER_CHANNEL_FILES 0    // 1 = one mono WAV per mic instead of one multi-channel WAV
+#define SWAP_LR 0              // 1 if the board delivers RIGHT before LEFT
+#if MIC_CHANNELS == 2
+#define I2S_CHANNEL I2S_CHANNEL_FMT_RIGHT_LEFT
+#else
 #define I2S_CHANNEL I2S_CHANNEL_FMT_ONLY_LEFT  // SPH0645LMH outputs on LEFT
-#define BUFFER_SIZE 512
+#endif
+#define PORT_COUNT (USE_SECOND_PORT ? 2 : 1)
+#define TOTAL_CHANNELS (MIC_CHANNELS * PORT_COUNT)
+#define BUFFER_SIZE 512        // 32-bit samples per port per read
+#define FRAMES_PER_READ (BUFFER_SIZE / MIC_CHANNELS)
 #define RECORD_TIME 10  // seconds
+#define DMA_BUFFER_COUNT 8
+
+// Capture backend: 1 = ESP-IDF 5 i2s_std channel, DMA buffers handed over by the
+// on_recv callback (lib/DmaCapture); 0 = legacy driver/i2s.h with a blocking i2s_read
+#ifndef I2S_STD_CAPTURE
+#define I2S_STD_CAPTURE (ESP_IDF_VERSION_MAJOR >= 5)
+#endif
+// 1 = idle probe on the capture core, reported as CPU per second of audio.
+// For comparing the backends only: the probe keeps the core busy while recording
+#ifndef MEASURE_CAPTURE_CPU
+#define MEASURE_CAPTURE_CPU 0
+#endif
+#if I2S_STD_CAPTURE
+#include <DmaCapture.h>
+#else
+#include <driver/i2s.h>
+#endif
+
+// Recording store
+#define USE_FLASH_LOG 1        // 1 = raw "recstore" partition log instead of LittleFS files
+#define RECORD_PARTITION "recstore"
+#define RUN_STORE_BENCHMARK 0  // 1 = compare LittleFS vs flash log write/read timing at boot
+#if USE_FLASH_LOG && PER_CHANNEL_FILES
+#error "PER_CHANNEL_FILES needs LittleFS; set USE_FLASH_LOG 0"
+#endif
+
+// Sample conversion chain (fused into one pass per DMA block)
+#define DC_BLOCK 1             // Remove the SPH0645 DC offset
+#define DC_BLOCK_POLE 8        // Corner ~ fs / 1600
+#define GAIN_Q8 256            // Gain in 1/256 steps (256 = 1.0x)
+#define RUN_DSP_BENCHMARK 0    // 1 = compare fused pipeline vs two-buffer loop at boot
+
+#if DC_BLOCK
+typedef dsp::Pipeline<dsp::Convert<SAMPLE_SHIFT>, dsp::DcBlock<TOTAL_CHANNELS, DC_BLOCK_POLE>,
+                      dsp::Gain<GAIN_Q8, 8>, dsp::Clip16> CapturePipeline;
+#else
+typedef dsp::Pipeline<dsp::Convert<SAMPLE_SHIFT>, dsp::Gain<GAIN_Q8, 8>, dsp::Clip16> CapturePipeline;
+#endif
+CapturePipeline capturePipeline;
 
 const char* fileName = "/audio.wav";
 WebServer server(80);
 
+EspPartitionFlash recordFlash;
+FlashLogStore recordStore;
+
+#if I2S_STD_CAPTURE
+DmaCapture capture0;
+#if USE_SECOND_PORT
+DmaCapture capture1;
+#endif
+#endif
+
+// Capture benchmark (filled by recordAudio)
+struct CaptureStats {
+    uint32_t blocks;
+    uint64_t frames;
+    uint64_t kernelCycles;
+    uint64_t writeMicros;
+    uint32_t elapsedMillis;
+    uint32_t lateBlocks;      // DMA ring wrapped onto a block before it was processed (i2s_std)
+    float cpuLoad;            // Capture core busy fraction from the idle probe, -1 if not measured
+    uint32_t storeErrors;     // Failed flash log reserve/append/commit; a failed append ends the recording
+};
+CaptureStats captureStats;
+
 // Function declarations
 void initializeWiFi();
-void initializeI2S();
+#if I2S_STD_CAPTURE
+void initializeCapture(DmaCapture &capture, i2s_port_t port, int sck, int ws, int sd);
+#else
+void initializeI2S(i2s_port_t port, int sck, int ws, int sd);
+#endif
 void recordAudio();
-void writeWAVHeader(File& file, int sampleRate, int bitsPerSample, int dataSize);
+void reportCaptureStats();
+void benchmarkPipeline();
+void benchmarkStorage();
+void sendFlashRecord(const RecordInfo &record);
+void fillWAVHeader(uint8_t *header, int sampleRate, int bitsPerSample, int numChannels, uint32_t dataSize);
+String channelFileName(int channel);
+void writeWAVHeader(File& file, int sampleRate, int bitsPerSample, int numChannels, int dataSize);
 void updateWAVHeader(File& file);
 
 void setup() {
@@ -39,24 +132,99 @@ void setup() {
         return;
     }
 
+#if USE_FLASH_LOG
+    if (!recordFlash.begin(RECORD_PARTITION) || !recordStore.begin(recordFlash)) {
+        Serial.println("Flash log partition not found (check partitions.csv)!");
+        return;
+    }
+    Serial.printf("Flash log: %u recording(s) in %u KB\n", recordStore.count(), recordStore.capacity() / 1024);
+#endif
+
+#if RUN_DSP_BENCHMARK
+    benchmarkPipeline();
+#endif
+#if RUN_STORE_BENCHMARK && USE_FLASH_LOG
+    benchmarkStorage();
+#endif
+
     initializeWiFi();
-    initializeI2S();
+#if I2S_STD_CAPTURE
+    initializeCapture(capture0, I2S_NUM_0, I2S_SCK, I2S_WS, I2S_SD);
+#if USE_SECOND_PORT
+    initializeCapture(capture1, I2S_NUM_1, I2S1_SCK, I2S1_WS, I2S1_SD);
+#endif
+#else
+    initializeI2S(I2S_NUM_0, I2S_SCK, I2S_WS, I2S_SD);
+#if USE_SECOND_PORT
+    initializeI2S(I2S_NUM_1, I2S1_SCK, I2S1_WS, I2S1_SD);
+#endif
+#endif
     recordAudio();
+    reportCaptureStats();
 
     // Web server setup
     server.on("/", HTTP_GET, []() {
+#if PER_CHANNEL_FILES
+        String page = "<h1>ESP32 WAV Recorder</h1>";
+        for (int c = 0; c < TOTAL_CHANNELS; c++) {
+            page += "<a href='/download?ch=" + String(c + 1) + "'>Download channel " + String(c + 1) + "</a><br>";
+        }
+        server.send(200, "text/html", page);
+#elif USE_FLASH_LOG
+        String page = "<h1>ESP32 WAV Recorder</h1>";
+        for (size_t i = recordStore.count(); i > 0; i--) {
+            const RecordInfo &record = recordStore.record(i - 1);
+            page += "<a href='/download?id=" + String(record.sequence) + "'>Recording " + String(record.sequence) +
+                    "</a> (" + String(record.length / 1024) + " KB)<br>";
+        }
+        server.send(200, "text/html", page);
+#else
         server.send(200, "text/html", "<h1>ESP32 WAV Recorder</h1><a href='/download'>Download Recorded WAV</a>");
+#endif
     });
 
     server.on("/download", HTTP_GET, []() {
+#if USE_FLASH_LOG
+        const RecordInfo *record = server.hasArg("id") ? recordStore.find(server.arg("id").toInt()) : recordStore.latest();
+        if (!record) {
+            server.send(404, "text/plain", "Recording not found!");
+            return;
+        }
+        sendFlashRecord(*record);
+#else
+#if PER_CHANNEL_FILES
+        int channel = server.hasArg("ch") ? server.arg("ch").toInt() - 1 : 0;
+        if (channel < 0 || channel >= TOTAL_CHANNELS) {
+            server.send(400, "text/plain", "Invalid channel");
+            return;
+        }
+        File file = LittleFS.open(channelFileName(channel), "r");
+#else
         File file = LittleFS.open(fileName, "r");
+#endif
         if (!file) {
             server.send(404, "text/plain", "File not found!");
             return;
         }
         server.streamFile(file, "audio/wav");
         file.close();
+#endif
+    });
+
+#if USE_FLASH_LOG
+    server.on("/records", HTTP_GET, []() {
+        String json = "[";
+        for (size_t i = 0; i < recordStore.count(); i++) {
+            const RecordInfo &record = recordStore.record(i);
+            if (i) json += ",";
+            json += "{\"id\":" + String(record.sequence) + ",\"bytes\":" + String(record.length) +
+                    ",\"rate\":" + String(record.sampleRate) + ",\"channels\":" + String(record.channels) +
+                    ",\"time\":" + String(record.timestamp) + "}";
+        }
+        json += "]";
+        server.send(200, "application/json", json);
     });
+#endif
 
     server.begin();
     Serial.println("HTTP server started.");
@@ -73,7 +241,18 @@ void initializeWiFi() {
     Serial.println(WiFi.softAPIP());
 }
 
-void initializeI2S() {
+#if I2S_STD_CAPTURE
+void initializeCapture(DmaCapture &capture, i2s_port_t port, int sck, int ws, int sd) {
+    if (!capture.begin(port, sck, ws, sd, SAMPLE_RATE, MIC_CHANNELS, FRAMES_PER_READ, DMA_BUFFER_COUNT)) {
+        Serial.println("I2S channel setup failed!");
+        return;
+    }
+    // Same SPH0645 timing fix as the legacy path, before the channel starts
+    REG_SET_BIT(I2S_TIMING_REG(port), BIT(9));
+    capture.start();
+}
+#else
+void initializeI2S(i2s_port_t port, int sck, int ws, int sd) {
     i2s_config_t i2s_config = {
         .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
         .sample_rate = SAMPLE_RATE,
@@ -85,54 +264,418 @@ void initializeI2S() {
         .dma_buf_len = BUFFER_SIZE,
         .use_apll = false,
     };
-    i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
+    i2s_driver_install(port, &i2s_config, 0, NULL);
 
     i2s_pin_config_t pin_config = {
-        .bck_io_num = I2S_SCK,
-        .ws_io_num = I2S_WS,
+        .bck_io_num = sck,
+        .ws_io_num = ws,
         .data_out_num = I2S_PIN_NO_CHANGE,
-        .data_in_num = I2S_SD,
+        .data_in_num = sd,
     };
     
-    REG_SET_BIT(I2S_TIMING_REG(I2S_NUM_0), BIT(9));
-    REG_SET_BIT(I2S_CONF_REG(I2S_NUM_0), I2S_RX_MSB_SHIFT);
-    i2s_set_pin(I2S_NUM_0, &pin_config);
+    REG_SET_BIT(I2S_TIMING_REG(port), BIT(9));
+    REG_SET_BIT(I2S_CONF_REG(port), I2S_RX_MSB_SHIFT);
+    i2s_set_pin(port, &pin_config);
+}
+#endif
+
+String channelFileName(int channel) {
+    return "/audio_ch" + String(channel + 1) + ".wav";
+}
+
+#if I2S_STD_CAPTURE
+// Wait for the next DMA block of every port and take it by reference; returns frames captured
+static size_t nextBlocks(DmaCapture::Block &block0, DmaCapture::Block &block1) {
+    capture0.next(block0, portMAX_DELAY);
+    size_t frames = block0.frames;
+#if USE_SECOND_PORT
+    capture1.next(block1, portMAX_DELAY);
+    frames = min(frames, block1.frames);
+#endif
+#if SWAP_LR && MIC_CHANNELS == 2
+    i2s_kernels::swapPairs32(block0.data, frames);
+#if USE_SECOND_PORT
+    i2s_kernels::swapPairs32(block1.data, frames);
+#endif
+#endif
+    return frames;
 }
+#else
+// Read the same number of frames from every port; returns frames captured
+static size_t readFrames(int32_t *port0, int32_t *port1) {
+    size_t bytesRead = 0;
+    i2s_read(I2S_NUM_0, port0, FRAMES_PER_READ * MIC_CHANNELS * 4, &bytesRead, portMAX_DELAY);
+    size_t frames = bytesRead / (MIC_CHANNELS * 4);
+#if USE_SECOND_PORT
+    size_t bytesRead1 = 0;
+    i2s_read(I2S_NUM_1, port1, frames * MIC_CHANNELS * 4, &bytesRead1, portMAX_DELAY);
+    frames = min(frames, bytesRead1 / (MIC_CHANNELS * 4));
+#endif
+#if SWAP_LR && MIC_CHANNELS == 2
+    i2s_kernels::swapPairs32(port0, frames);
+#if USE_SECOND_PORT
+    i2s_kernels::swapPairs32(port1, frames);
+#endif
+#endif
+    return frames;
+}
+#endif
+
+#if MEASURE_CAPTURE_CPU
+// Idle probe: spins at priority 1 on the capture core. recordAudio() runs above
+// it, so every loop it misses went to capture work (task, driver and ISRs),
+// which counts the legacy i2s_read copy and the DMA callbacks alike.
+#define CPU_PROBE_CALIBRATION_MS 200
+volatile uint32_t cpuProbeLoops = 0;
+
+void cpuProbeTask(void *parameter) {
+    for (;;) cpuProbeLoops = cpuProbeLoops + 1;
+}
+#endif
 
 void recordAudio() {
-    Serial.println("Recording audio...");
+    Serial.printf("Recording audio: %d channel(s) on %d port(s)...\n", TOTAL_CHANNELS, PORT_COUNT);
+    memset(&captureStats, 0, sizeof(captureStats));
+    captureStats.cpuLoad = -1;
+
+#if PER_CHANNEL_FILES
+    File files[TOTAL_CHANNELS];
+    for (int c = 0; c < TOTAL_CHANNELS; c++) {
+        files[c] = LittleFS.open(channelFileName(c), FILE_WRITE);
+        if (!files[c]) {
+            Serial.println("Failed to open file!");
+            return;
+        }
+        writeWAVHeader(files[c], SAMPLE_RATE, SAMPLE_BITS, 1, RECORD_TIME * SAMPLE_RATE * (SAMPLE_BITS / 8));
+    }
+#elif USE_FLASH_LOG
+    // Erase the whole recording's space first so appends never wait on a block erase
+    if (!recordStore.reserve(RECORD_TIME * SAMPLE_RATE * TOTAL_CHANNELS * (SAMPLE_BITS / 8))) {
+        Serial.println("Flash log erase failed, appends will erase as they go");
+        captureStats.storeErrors++;
+    }
+    if (!recordStore.beginRecord(millis() / 1000, SAMPLE_RATE, TOTAL_CHANNELS, SAMPLE_BITS)) {
+        Serial.println("Failed to start flash log record!");
+        return;
+    }
+#else
     File file = LittleFS.open(fileName, FILE_WRITE);
     if (!file) {
         Serial.println("Failed to open file!");
         return;
     }
 
-    writeWAVHeader(file, SAMPLE_RATE, SAMPLE_BITS, RECORD_TIME * SAMPLE_RATE * (SAMPLE_BITS / 8));
-    
-    size_t bytesRead;
-    int32_t buffer32[BUFFER_SIZE];  // Read as 32-bit
-    int16_t buffer16[BUFFER_SIZE];  // Convert to 16-bit
+    writeWAVHeader(file, SAMPLE_RATE, SAMPLE_BITS, TOTAL_CHANNELS, RECORD_TIME * SAMPLE_RATE * TOTAL_CHANNELS * (SAMPLE_BITS / 8));
+#endif
+
+#if I2S_STD_CAPTURE
+    DmaCapture::Block block0, block1 = {NULL, 0, 0};
+#if USE_SECOND_PORT
+    static int16_t buffer16[BUFFER_SIZE * 2] __attribute__((aligned(4)));  // Merged 16-bit frames
+#endif
+#else
+    static int32_t buffer32[BUFFER_SIZE];  // Read as 32-bit, port 0
+#if USE_SECOND_PORT
+    static int32_t buffer32b[BUFFER_SIZE]; // Port 1
+    static int16_t buffer16[BUFFER_SIZE * 2] __attribute__((aligned(4)));  // Merged 16-bit frames
+#else
+    int32_t *buffer32b = NULL;
+#endif
+#endif
+#if PER_CHANNEL_FILES
+    static int16_t planes16[TOTAL_CHANNELS][FRAMES_PER_READ];
+    int16_t *planes[TOTAL_CHANNELS];
+    for (int c = 0; c < TOTAL_CHANNELS; c++) planes[c] = planes16[c];
+#endif
+
+#if MEASURE_CAPTURE_CPU
+    // Calibrate the probe alone, then keep this task above it while recording
+    TaskHandle_t probe = NULL;
+    xTaskCreatePinnedToCore(cpuProbeTask, "cpuProbe", 2048, NULL, 1, &probe, xPortGetCoreID());
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    vTaskPrioritySet(NULL, priority + 1);
+    uint32_t probeStart = cpuProbeLoops;
+    delay(CPU_PROBE_CALIBRATION_MS);
+    float idleLoopsPerMs = (float)(cpuProbeLoops - probeStart) / CPU_PROBE_CALIBRATION_MS;
+    probeStart = cpuProbeLoops;
+#endif
     unsigned long startMillis = millis();
     unsigned long elapsedMillis = 0;
 
     while (elapsedMillis < RECORD_TIME * 1000) {
-        i2s_read(I2S_NUM_0, buffer32, sizeof(buffer32), &bytesRead, portMAX_DELAY);
-        size_t samples = bytesRead / 4;  // 32-bit samples
+#if I2S_STD_CAPTURE
+        size_t frames = nextBlocks(block0, block1);
+        int32_t *buffer32 = block0.data;   // Converted in place inside the DMA buffer
+#if USE_SECOND_PORT
+        int32_t *buffer32b = block1.data;
+#endif
+#else
+        size_t frames = readFrames(buffer32, buffer32b);
+#endif
 
-        for (size_t i = 0; i < samples; i++) {
-            buffer16[i] = buffer32[i] >> 11;  // Convert 32-bit to 16-bit
-        }
+        uint32_t kernelStart = ESP.getCycleCount();
+#if PER_CHANNEL_FILES
+        i2s_kernels::deinterleaveBlock(buffer32, planes, frames, MIC_CHANNELS, 0, capturePipeline);
+#if USE_SECOND_PORT
+        i2s_kernels::deinterleaveBlock(buffer32b, planes + MIC_CHANNELS, frames, MIC_CHANNELS, MIC_CHANNELS, capturePipeline);
+#endif
+#elif USE_SECOND_PORT
+        i2s_kernels::mergeBlock(buffer32, MIC_CHANNELS, buffer32b, MIC_CHANNELS, buffer16, frames, capturePipeline);
+#else
+        int16_t *buffer16 = (int16_t *)buffer32;  // Convert in place
+        i2s_kernels::convertBlock(buffer32, buffer16, frames * MIC_CHANNELS, MIC_CHANNELS, capturePipeline);
+#endif
+        captureStats.kernelCycles += ESP.getCycleCount() - kernelStart;
 
-        file.write((uint8_t*)buffer16, samples * 2);
+        unsigned long writeStart = micros();
+#if PER_CHANNEL_FILES
+        for (int c = 0; c < TOTAL_CHANNELS; c++) {
+            files[c].write((uint8_t*)planes[c], frames * 2);
+        }
+#elif USE_FLASH_LOG
+        if (!recordStore.append(buffer16, frames * TOTAL_CHANNELS * 2)) {
+            // Overrun or flash error: keep what is written, like the SD recorders
+            Serial.printf("Flash log append failed after %lu ms, ending the recording\n", millis() - startMillis);
+            captureStats.storeErrors++;
+            break;
+        }
+#else
+        file.write((uint8_t*)buffer16, frames * TOTAL_CHANNELS * 2);
+#endif
+        captureStats.writeMicros += micros() - writeStart;
+#if I2S_STD_CAPTURE
+        if (!capture0.stillValid(block0)) captureStats.lateBlocks++;
+#if USE_SECOND_PORT
+        if (!capture1.stillValid(block1)) captureStats.lateBlocks++;
+#endif
+#endif
+        captureStats.blocks++;
+        captureStats.frames += frames;
         elapsedMillis = millis() - startMillis;
     }
+    captureStats.elapsedMillis = elapsedMillis;
+#if MEASURE_CAPTURE_CPU
+    uint32_t probeLoops = cpuProbeLoops - probeStart;
+    vTaskDelete(probe);
+    vTaskPrioritySet(NULL, priority);
+    captureStats.cpuLoad = 1.0f - probeLoops / (idleLoopsPerMs * elapsedMillis);
+#endif
 
+#if PER_CHANNEL_FILES
+    for (int c = 0; c < TOTAL_CHANNELS; c++) {
+        updateWAVHeader(files[c]);
+        files[c].close();
+    }
+#elif USE_FLASH_LOG
+    if (!recordStore.commit()) {
+        Serial.println("Flash log commit failed, the recording may be short");
+        captureStats.storeErrors++;
+    }
+#else
     updateWAVHeader(file);
     file.close();
+#endif
     Serial.println("Recording complete.");
 }
 
-void writeWAVHeader(File& file, int sampleRate, int bitsPerSample, int dataSize) {
+// Compare achieved against required aggregate sample rate
+void reportCaptureStats() {
+    if (captureStats.blocks == 0) return;
+    float seconds = captureStats.elapsedMillis / 1000.0;
+    float requiredRate = (float)SAMPLE_RATE * TOTAL_CHANNELS;
+    float achievedRate = captureStats.frames * TOTAL_CHANNELS / seconds;
+    float kernelMicros = (float)captureStats.kernelCycles / ESP.getCpuFreqMHz();
+    float kernelNsPerSample = kernelMicros * 1000.0 / (captureStats.frames * TOTAL_CHANNELS);
+    float blockMicros = 1e6 * FRAMES_PER_READ / SAMPLE_RATE;
+
+    Serial.println("===== Capture Benchmark =====");
+    Serial.printf("Required aggregate rate: %.0f samples/s\n", requiredRate);
+    Serial.printf("Achieved aggregate rate: %.0f samples/s (%.1f%%)\n", achievedRate, 100.0 * achievedRate / requiredRate);
+    Serial.printf("Kernel: %.1f ns/sample, %.1f us/block\n", kernelNsPerSample, kernelMicros / captureStats.blocks);
+    Serial.printf("Write: %.1f us/block\n", (float)captureStats.writeMicros / captureStats.blocks);
+    Serial.printf("Block budget: %.1f us, CPU load (kernel + write): %.1f%%\n", blockMicros,
+                  100.0 * (kernelMicros + captureStats.writeMicros) / (seconds * 1e6));
+#if I2S_STD_CAPTURE
+    Serial.printf("Backend: i2s_std DMA callbacks, %u blocks dropped, %u processed late\n",
+                  capture0.stats().dropped, captureStats.lateBlocks);
+#else
+    Serial.println("Backend: legacy i2s_read");
+#endif
+    if (captureStats.cpuLoad >= 0) {
+        Serial.printf("Capture core busy: %.2f%% = %.0f us CPU per second of audio\n",
+                      100.0 * captureStats.cpuLoad, 1e6 * captureStats.cpuLoad);
+    }
+    if (captureStats.storeErrors) {
+        Serial.printf("WARNING: %u flash log error(s), recording ended after %.1f s of %d s\n",
+                      captureStats.storeErrors, seconds, RECORD_TIME);
+    }
+    Serial.println(achievedRate >= 0.99 * requiredRate ? "Aggregate rate sustained" : "WARNING: capture fell behind");
+}
+
+// Cycles per sample of the original two-buffer loop vs the fused in-place pipeline
+void benchmarkPipeline() {
+    const int rounds = 200;
+    const size_t samples = BUFFER_SIZE;
+    static int32_t source[BUFFER_SIZE];
+    static int32_t work[BUFFER_SIZE];
+    static int16_t buffer16[BUFFER_SIZE];
+    for (size_t i = 0; i < samples; i++) {
+        source[i] = (int32_t)esp_random();
+    }
+
+    // Two-buffer loop as recordAudio() used to do it (shift only)
+    uint32_t legacyCycles = 0;
+    for (int r = 0; r < rounds; r++) {
+        memcpy(work, source, sizeof(work));
+        uint32_t start = ESP.getCycleCount();
+        for (size_t i = 0; i < samples; i++) {
+            buffer16[i] = work[i] >> SAMPLE_SHIFT;
+        }
+        legacyCycles += ESP.getCycleCount() - start;
+    }
+
+    // Two-buffer loop plus separate DC-block, gain and clip passes
+    uint32_t multiPassCycles = 0;
+    int32_t xPrev = 0, yPrev = 0;
+    for (int r = 0; r < rounds; r++) {
+        memcpy(work, source, sizeof(work));
+        uint32_t start = ESP.getCycleCount();
+        for (size_t i = 0; i < samples; i++) work[i] >>= SAMPLE_SHIFT;
+        for (size_t i = 0; i < samples; i++) {
+            int32_t y = work[i] - xPrev + yPrev - (yPrev >> DC_BLOCK_POLE);
+            xPrev = work[i];
+            yPrev = y;
+            work[i] = y;
+        }
+        for (size_t i = 0; i < samples; i++) {
+            int64_t y = ((int64_t)work[i] * GAIN_Q8) >> 8;
+            work[i] = y > INT32_MAX ? INT32_MAX : (y < INT32_MIN ? INT32_MIN : (int32_t)y);
+        }
+        for (size_t i = 0; i < samples; i++) {
+            buffer16[i] = work[i] > 32767 ? 32767 : (work[i] < -32768 ? -32768 : work[i]);
+        }
+        multiPassCycles += ESP.getCycleCount() - start;
+    }
+
+    // Fused pipeline, in place
+    uint32_t fusedCycles = 0;
+    dsp::Pipeline<dsp::Convert<SAMPLE_SHIFT>, dsp::DcBlock<1, DC_BLOCK_POLE>, dsp::Gain<GAIN_Q8, 8>, dsp::Clip16> pipeline;
+    for (int r = 0; r < rounds; r++) {
+        memcpy(work, source, sizeof(work));
+        uint32_t start = ESP.getCycleCount();
+        i2s_kernels::convertBlock(work, (int16_t *)work, samples, 1, pipeline);
+        fusedCycles += ESP.getCycleCount() - start;
+    }
+
+    float total = (float)rounds * samples;
+    Serial.println("===== DSP Pipeline Benchmark =====");
+    Serial.printf("Two-buffer shift loop:        %.2f cycles/sample\n", legacyCycles / total);
+    Serial.printf("Multi-pass DC + gain + clip:  %.2f cycles/sample\n", multiPassCycles / total);
+    Serial.printf("Fused in-place pipeline:      %.2f cycles/sample\n", fusedCycles / total);
+}
+
+// WAV header is synthesised; the payload goes out straight from the mapped partition
+void sendFlashRecord(const RecordInfo &record) {
+    uint8_t header[44];
+    fillWAVHeader(header, record.sampleRate, record.bitsPerSample, record.channels, record.length);
+    server.setContentLength(sizeof(header) + record.length);
+    server.send(200, "audio/wav", "");
+    server.sendContent((const char *)header, sizeof(header));
+    for (uint32_t offset = 0; offset < record.length;) {
+        size_t length;
+        const uint8_t *data = recordStore.span(record, offset, length);
+        server.sendContent((const char *)data, length);
+        offset += length;
+    }
+}
+
+// Write and read timing of the same data through LittleFS and the flash log.
+// Leaves a short benchmark recording in the log.
+void benchmarkStorage() {
+    const int blocks = 128;
+    const size_t blockSize = 1024;
+    static uint8_t block[blockSize];
+    for (size_t i = 0; i < blockSize; i++) block[i] = esp_random();
+
+    // LittleFS
+    uint32_t fsMaxWrite = 0;
+    unsigned long start = micros();
+    File file = LittleFS.open("/bench.bin", FILE_WRITE);
+    for (int b = 0; b < blocks; b++) {
+        unsigned long t = micros();
+        file.write(block, blockSize);
+        fsMaxWrite = max(fsMaxWrite, (uint32_t)(micros() - t));
+    }
+    file.close();
+    uint32_t fsWrite = micros() - start;
+    start = micros();
+    file = LittleFS.open("/bench.bin", "r");
+    while (file.read(block, blockSize) > 0) {}
+    file.close();
+    uint32_t fsRead = micros() - start;
+    LittleFS.remove("/bench.bin");
+
+    // Flash log, erased up front as recordAudio() does
+    uint32_t logMaxWrite = 0;
+    start = micros();
+    recordStore.reserve(blocks * blockSize);
+    uint32_t logErase = micros() - start;
+    start = micros();
+    recordStore.beginRecord(millis() / 1000, SAMPLE_RATE, 1, SAMPLE_BITS);
+    for (int b = 0; b < blocks; b++) {
+        unsigned long t = micros();
+        recordStore.append(block, blockSize);
+        logMaxWrite = max(logMaxWrite, (uint32_t)(micros() - t));
+    }
+    recordStore.commit();
+    uint32_t logWrite = micros() - start;
+    start = micros();
+    const RecordInfo &record = *recordStore.latest();
+    uint32_t sum = 0;
+    for (uint32_t offset = 0; offset < record.length;) {
+        size_t length;
+        const uint8_t *data = recordStore.span(record, offset, length);
+        for (size_t i = 0; i < length; i += 4) sum += data[i];  // Touch the mapped bytes
+        offset += length;
+    }
+    uint32_t logRead = micros() - start;
+
+    float kb = blocks * blockSize / 1024.0;
+    Serial.println("===== Storage Benchmark =====");
+    Serial.printf("LittleFS:  write %.0f KB/s (max %u us/block), read %.0f KB/s\n",
+                  kb * 1e6 / fsWrite, fsMaxWrite, kb * 1e6 / fsRead);
+    Serial.printf("Flash log: write %.0f KB/s (max %u us/block), read %.0f KB/s, pre-erase %u ms (checksum %u)\n",
+                  kb * 1e6 / logWrite, logMaxWrite, kb * 1e6 / logRead, logErase / 1000, sum);
+    const FlashLogStats &stats = recordStore.stats();
+    Serial.printf("Flash log: %u block erases, %u program calls, %u recordings dropped\n",
+                  stats.erases, stats.writes, stats.recordsDropped);
+}
+
+void fillWAVHeader(uint8_t *header, int sampleRate, int bitsPerSample, int numChannels, uint32_t dataSize) {
+    uint32_t fileSizeMinus8 = dataSize + 36;
+    uint32_t subChunk1Size = 16;
+    uint16_t audioFormat = 1;
+    uint16_t channels = numChannels;
+    uint32_t rate = sampleRate;
+    uint32_t byteRate = sampleRate * numChannels * bitsPerSample / 8;
+    uint16_t blockAlign = numChannels * bitsPerSample / 8;
+    uint16_t bits = bitsPerSample;
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 4, &fileSizeMinus8, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    memcpy(header + 16, &subChunk1Size, 4);
+    memcpy(header + 20, &audioFormat, 2);
+    memcpy(header + 22, &channels, 2);
+    memcpy(header + 24, &rate, 4);
+    memcpy(header + 28, &byteRate, 4);
+    memcpy(header + 32, &blockAlign, 2);
+    memcpy(header + 34, &bits, 2);
+    memcpy(header + 36, "data", 4);
+    memcpy(header + 40, &dataSize, 4);
+}
+
+
+void writeWAVHeader(File& file, int sampleRate, int bitsPerSample, int numChannels, int dataSize) {
     file.write((uint8_t*)"RIFF", 4);
     uint32_t fileSizeMinus8 = dataSize + 36;
     file.write((uint8_t*)&fileSizeMinus8, 4);
@@ -141,9 +684,9 @@ void writeWAVHeader(File& file, int sampleRate, int bitsPerSample, int dataSize)
     uint32_t subChunk1Size = 16;
     file.write((uint8_t*)&subChunk1Size, 4);
     uint16_t audioFormat = 1;
-    uint16_t numChannels = 1;
+    uint16_t channels = numChannels;
     file.write((uint8_t*)&audioFormat, 2);
-    file.write((uint8_t*)&numChannels, 2);
+    file.write((uint8_t*)&channels, 2);
     file.write((uint8_t*)&sampleRate, 4);
     uint32_t byteRate = sampleRate * numChannels * bitsPerSample / 8;
     uint16_t blockAlign = numChannels * bitsPerSample / 8;
@@ -1,40 +1,54 @@
-#include "driver/i2s.h"
-#include "soc/i2s_reg.h"
-
-#define BUFLEN 256
-
-static const i2s_port_t i2s_num = I2S_NUM_0; // i2s port number
-
-static const i2s_config_t i2s_config = {
-     .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
-     .sample_rate = 22050,
-     .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
-     .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
-     .communication_format = (i2s_comm_format_t)(I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB),
-     .intr_alloc_flags = 0, // default interrupt priority
-     .dma_buf_count = 8,
-     .dma_buf_len = 64,
-     .use_apll = false
-};
-
-static const i2s_pin_config_t pin_config = {
-    .bck_io_num = 26,
-    .ws_io_num = 25,
-    .data_out_num = I2S_PIN_NO_CHANGE,
-    .data_in_num = 22
-};
-
-void setup() { 
-   pinMode(22, INPUT);
-   i2s_driver_install(i2s_num, &i2s_config, 0, NULL);   //install and start i2s driver
-   REG_SET_BIT(  I2S_TIMING_REG(i2s_num),BIT(9));   /*  #include "soc/i2s_reg.h"   I2S_NUM -> 0 or 1*/
-   REG_SET_BIT( I2S_CONF_REG(i2s_num), I2S_RX_MSB_SHIFT);
-   i2s_set_pin(i2s_num, &pin_config);
+#include "driver/i2s_std.h"
+#include "freertos/queue.h"
+
+// ESP-IDF 5 (Arduino core 3): DMA completion callback instead of polling.
+// The callback queues a pointer to each finished DMA buffer; loop() blocks on
+// the queue and reads the samples in place. See lib/DmaCapture for the full version.
+
+#define BUFLEN 64   // frames per DMA buffer
+#define BUFCOUNT 8
+
+static i2s_chan_handle_t rx_chan;
+static QueueHandle_t dma_queue;
+
+static bool IRAM_ATTR on_recv(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx) {
+    int32_t *buf = *(int32_t **)event->data;   // finished DMA buffer, no copy
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(dma_queue, &buf, &woken);
+    return woken == pdTRUE;
 }
 
-int32_t audio_buf[BUFLEN];
+void setup() {
+    dma_queue = xQueueCreate(BUFCOUNT, sizeof(int32_t *));
+
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = BUFCOUNT;
+    chan_cfg.dma_frame_num = BUFLEN;
+    i2s_new_channel(&chan_cfg, NULL, &rx_chan);
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(22050),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = GPIO_NUM_26,
+            .ws = GPIO_NUM_25,
+            .dout = I2S_GPIO_UNUSED,
+            .din = GPIO_NUM_22,
+            .invert_flags = {.mclk_inv = false, .bclk_inv = false, .ws_inv = false},
+        },
+    };
+    i2s_channel_init_std_mode(rx_chan, &std_cfg);
+
+    i2s_event_callbacks_t cbs = {};
+    cbs.on_recv = on_recv;
+    i2s_channel_register_event_callback(rx_chan, &cbs, NULL);
+    i2s_channel_enable(rx_chan);
+}
 
 void loop() {
-    int bytes_read = i2s_read_bytes(i2s_num, audio_buf, sizeof(audio_buf), 0);
-    // have fun with your data
-}
\ No newline at end of file
+    int32_t *audio_buf;
+    if (xQueueReceive(dma_queue, &audio_buf, portMAX_DELAY) == pdTRUE) {
+        // have fun with your data: BUFLEN left/right frames, valid until the ring wraps
+    }
+}
@@ -0,0 +1,391 @@
+// Receives the recorder's RTP multicast stream on Linux and measures it:
+// network loss (sequence gaps), capture gaps (timestamp jumps), interarrival
+// jitter (RFC 3550) and end-to-end latency from capture to arrival.
+//
+// Latency needs the recorder's uptime clock: clock probes go to the RTP port
+// + 1 twice a second, and the offset from the probe with the shortest round
+// trip is applied to the capture time carried in every packet.
+//
+//   program [--group 239.69.0.1] [--port 5004] [--iface 192.168.4.2]
+//           [--recorder 192.168.4.1] [--seconds 30] [--wav out.wav]
+//           [--simulate DELAY_MS]
+//
+// --simulate sends a tone from a local fake recorder (clock offset and an
+// extra network delay included) to check the measurements without hardware.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "RtpAudio.h"
+#include "WavHeader.h"
+
+static const uint32_t SAMPLE_RATE = 44100;
+static const int PROBE_INTERVAL_MS = 500;
+static const int64_t SIMULATED_CLOCK_OFFSET = 123456789;  // Fake recorder uptime vs local clock
+
+static int64_t nowMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+struct Options {
+    const char *group;
+    uint16_t port;
+    const char *iface;
+    const char *recorder;
+    int seconds;
+    const char *wavPath;
+    int simulateDelayMs;  // < 0: no simulation
+};
+
+// Best clock probe so far: the one with the shortest round trip
+struct ClockSync {
+    bool valid;
+    int64_t offset;  // Recorder uptime minus local clock
+    int64_t rtt;
+    uint32_t replies;
+};
+
+struct StreamStats {
+    bool started;
+    uint32_t ssrc;
+    uint8_t payloadType;
+    uint16_t nextSequence;
+    uint32_t nextTimestamp;
+    uint32_t received;
+    uint32_t lost;           // Missing sequence numbers
+    uint32_t late;           // Out of order or duplicate
+    uint32_t gaps;           // Capture gaps (timestamp jumps)
+    uint64_t gapSamples;
+    double jitter;           // RFC 3550 interarrival jitter, in timestamp units
+    int64_t lastTransit;
+    std::vector<int64_t> latencies;  // Microseconds, once the clock is synced
+};
+
+// WAV writer; lost packets and capture gaps are filled with silence so the
+// file stays aligned with the recorder's timeline. Past 4 GB (about 13.5
+// hours) the header is written as RF64.
+struct WavOutput {
+    FILE *file;
+    uint64_t samples;
+
+    void open(const char *path) {
+        file = path ? fopen(path, "wb") : NULL;
+        samples = 0;
+        if (file) fseek(file, wav::HEADER_BYTES, SEEK_SET);
+    }
+
+    void write(const int16_t *data, size_t count) {
+        if (!file) return;
+        fwrite(data, sizeof(int16_t), count, file);
+        samples += count;
+    }
+
+    void silence(uint32_t count) {
+        static const int16_t zeros[1024] = {0};
+        while (count) {
+            uint32_t length = count < 1024 ? count : 1024;
+            write(zeros, length);
+            count -= length;
+        }
+    }
+
+    void close() {
+        if (!file) return;
+        uint8_t header[wav::HEADER_BYTES];
+        wav::fillHeader(header, SAMPLE_RATE, 1, 16, samples * 2);
+        fseek(file, 0, SEEK_SET);
+        fwrite(header, 1, sizeof(header), file);
+        fclose(file);
+        file = NULL;
+    }
+};
+
+static rtp::Encoding encodingOf(uint8_t payloadType) {
+    return payloadType == rtp::PT_L16_44100_MONO ? rtp::L16 : rtp::DVI4;
+}
+
+static void handlePacket(const uint8_t *data, size_t length, int64_t arrival, const ClockSync &clock,
+                         StreamStats &stream, WavOutput &wav) {
+    rtp::Packet packet;
+    if (!rtp::parse(data, length, packet)) return;
+    rtp::Encoding encoding = encodingOf(packet.payloadType);
+    uint32_t samples = rtp::sampleCount(packet, encoding);
+
+    if (!stream.started || packet.ssrc != stream.ssrc) {
+        if (stream.started) printf("SSRC changed to %08x (recorder restarted)\n", packet.ssrc);
+        stream.started = true;
+        stream.ssrc = packet.ssrc;
+        stream.payloadType = packet.payloadType;
+        stream.nextSequence = packet.sequence;
+        stream.nextTimestamp = packet.timestamp;
+        stream.lastTransit = 0;
+    }
+
+    int16_t delta = (int16_t)(packet.sequence - stream.nextSequence);
+    if (delta < 0) {
+        stream.late++;  // Already played past it
+        return;
+    }
+    stream.lost += delta;
+    stream.received++;
+
+    // Sequence numbers only count sent packets; a timestamp beyond the
+    // packets lost on the network is audio the recorder never captured
+    int32_t jump = (int32_t)(packet.timestamp - stream.nextTimestamp);
+    int32_t networkSamples = delta * (int32_t)samples;
+    if (jump > networkSamples) {
+        stream.gaps++;
+        stream.gapSamples += jump - networkSamples;
+    }
+    if (jump > 0) wav.silence(jump);
+    stream.nextSequence = packet.sequence + 1;
+    stream.nextTimestamp = packet.timestamp + samples;
+
+    // RFC 3550 A.8, in timestamp units
+    int64_t transit = arrival * SAMPLE_RATE / 1000000 - packet.timestamp;
+    if (stream.lastTransit) {
+        int64_t d = transit - stream.lastTransit;
+        stream.jitter += (fabs((double)d) - stream.jitter) / 16;
+    }
+    stream.lastTransit = transit;
+
+    if (clock.valid && packet.hasCaptureMicros) {
+        stream.latencies.push_back(arrival + clock.offset - packet.captureMicros);
+    }
+
+    int16_t decoded[rtp::MAX_PACKET_SAMPLES * 2];
+    size_t count = rtp::decode(packet, encoding, decoded, sizeof(decoded) / sizeof(decoded[0]));
+    wav.write(decoded, count);
+}
+
+static void handleProbeReply(const uint8_t *data, size_t length, int64_t arrival, ClockSync &clock) {
+    rtp::ClockProbe probe;
+    if (length != sizeof(probe) || memcmp(data, "RTPC", 4) != 0) return;
+    memcpy(&probe, data, sizeof(probe));
+    int64_t sent = (int64_t)probe.clientMicros;
+    int64_t rtt = (arrival - sent) - (int64_t)(probe.serverSendMicros - probe.serverReceiveMicros);
+    int64_t offset = ((int64_t)probe.serverReceiveMicros - sent + (int64_t)probe.serverSendMicros - arrival) / 2;
+    clock.replies++;
+    if (!clock.valid || rtt < clock.rtt) {
+        clock.valid = true;
+        clock.rtt = rtt;
+        clock.offset = offset;
+    }
+}
+
+static int64_t percentile(std::vector<int64_t> values, double fraction) {
+    if (values.empty()) return 0;
+    size_t index = (size_t)(fraction * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void report(const char *label, const StreamStats &stream, const ClockSync &clock) {
+    uint32_t expected = stream.received + stream.lost;
+    printf("%s: %u packets, %u lost (%.2f%%), %u late, %u capture gaps (%llu samples), jitter %.2f ms",
+           label, stream.received, stream.lost, expected ? 100.0 * stream.lost / expected : 0.0, stream.late,
+           stream.gaps, (unsigned long long)stream.gapSamples, stream.jitter * 1000 / SAMPLE_RATE);
+    if (!stream.latencies.empty()) {
+        printf(", latency p50 %.1f / p95 %.1f / max %.1f ms (clock rtt %.1f ms)",
+               percentile(stream.latencies, 0.5) / 1000.0, percentile(stream.latencies, 0.95) / 1000.0,
+               *std::max_element(stream.latencies.begin(), stream.latencies.end()) / 1000.0, clock.rtt / 1000.0);
+    } else if (!clock.valid) {
+        printf(", latency unknown (no clock probe reply yet)");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Fake recorder for --simulate: a tone packetized like the firmware, sent to
+// the group with an extra delay, and clock probes answered on a shifted clock
+struct Simulation {
+    Options options;
+    volatile bool running;
+};
+
+struct SimulatedSender {
+    int socketFd;
+    struct sockaddr_in target;
+};
+
+static void simulatedSink(const uint8_t *packet, size_t length, void *context) {
+    SimulatedSender *sender = (SimulatedSender *)context;
+    sendto(sender->socketFd, packet, length, 0, (struct sockaddr *)&sender->target, sizeof(sender->target));
+}
+
+static void *simulateRecorder(void *argument) {
+    Simulation *simulation = (Simulation *)argument;
+    const Options &options = simulation->options;
+    SimulatedSender sender;
+    sender.socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sender.target, 0, sizeof(sender.target));
+    sender.target.sin_family = AF_INET;
+    sender.target.sin_port = htons(options.port);
+    inet_pton(AF_INET, options.group, &sender.target.sin_addr);
+    unsigned char loop = 1;
+    setsockopt(sender.socketFd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    int probeFd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in probeAddress;
+    memset(&probeAddress, 0, sizeof(probeAddress));
+    probeAddress.sin_family = AF_INET;
+    probeAddress.sin_port = htons(options.port + 1);
+    inet_pton(AF_INET, options.recorder, &probeAddress.sin_addr);
+    bind(probeFd, (struct sockaddr *)&probeAddress, sizeof(probeAddress));
+
+    rtp::Packetizer packetizer;
+    packetizer.begin(rtp::DVI4, SAMPLE_RATE, SAMPLE_RATE / 100, 0x5EED, 100, 1000, simulatedSink, &sender);
+    const size_t SLICE = 256;  // One DMA buffer
+    int16_t samples[SLICE];
+    uint64_t produced = 0;
+    int64_t start = nowMicros();
+    while (simulation->running) {
+        for (size_t i = 0; i < SLICE; i++) {
+            samples[i] = (int16_t)(8000 * sin(2 * M_PI * 440 * (double)(produced + i) / SAMPLE_RATE));
+        }
+        produced += SLICE;
+        // Wait until the slice would be complete, plus the simulated network
+        // delay, answering clock probes as they come in
+        int64_t captured = start + (int64_t)(produced * 1000000 / SAMPLE_RATE);
+        int64_t wake = captured + options.simulateDelayMs * 1000;
+        for (int64_t now = nowMicros(); now < wake; now = nowMicros()) {
+            struct pollfd fd = {probeFd, POLLIN, 0};
+            if (poll(&fd, 1, (int)((wake - now + 999) / 1000)) <= 0) continue;
+            rtp::ClockProbe probe;
+            struct sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+            if (recvfrom(probeFd, &probe, sizeof(probe), 0, (struct sockaddr *)&from, &fromLength) != sizeof(probe)) {
+                continue;
+            }
+            probe.serverReceiveMicros = nowMicros() + SIMULATED_CLOCK_OFFSET;
+            probe.serverSendMicros = probe.serverReceiveMicros;
+            sendto(probeFd, &probe, sizeof(probe), 0, (struct sockaddr *)&from, fromLength);
+        }
+        packetizer.push(samples, SLICE, captured + SIMULATED_CLOCK_OFFSET);
+    }
+    close(sender.socketFd);
+    close(probeFd);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    Options options = {"239.69.0.1", 5004, NULL, "192.168.4.1", 30, NULL, -1};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--group") == 0) options.group = argv[i + 1];
+        else if (strcmp(argv[i], "--port") == 0) options.port = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--iface") == 0) options.iface = argv[i + 1];
+        else if (strcmp(argv[i], "--recorder") == 0) options.recorder = argv[i + 1];
+        else if (strcmp(argv[i], "--seconds") == 0) options.seconds = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--wav") == 0) options.wavPath = argv[i + 1];
+        else if (strcmp(argv[i], "--simulate") == 0) options.simulateDelayMs = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (options.simulateDelayMs >= 0) options.recorder = "127.0.0.1";
+
+    // RTP socket, joined to the group when it is a multicast address
+    int rtpFd = socket(AF_INET, SOCK_DGRAM, 0);
+    int reuse = 1;
+    setsockopt(rtpFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(options.port);
+    if (bind(rtpFd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("bind");
+        return 1;
+    }
+    struct ip_mreq membership;
+    inet_pton(AF_INET, options.group, &membership.imr_multiaddr);
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (options.iface) inet_pton(AF_INET, options.iface, &membership.imr_interface);
+    if (IN_MULTICAST(ntohl(membership.imr_multiaddr.s_addr)) &&
+        setsockopt(rtpFd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+        perror("IP_ADD_MEMBERSHIP");
+        return 1;
+    }
+
+    int probeFd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in recorder;
+    memset(&recorder, 0, sizeof(recorder));
+    recorder.sin_family = AF_INET;
+    recorder.sin_port = htons(options.port + 1);
+    inet_pton(AF_INET, options.recorder, &recorder.sin_addr);
+
+    Simulation simulation;
+    simulation.options = options;
+    simulation.running = true;
+    pthread_t simulator;
+    if (options.simulateDelayMs >= 0) pthread_create(&simulator, NULL, simulateRecorder, &simulation);
+
+    printf("Listening on %s:%u, clock probes to %s:%u, for %d s\n", options.group, options.port, options.recorder,
+           options.port + 1, options.seconds);
+    StreamStats stream;
+    stream.started = false;
+    stream.received = stream.lost = stream.late = stream.gaps = 0;
+    stream.gapSamples = 0;
+    stream.jitter = 0;
+    ClockSync clock = {false, 0, 0, 0};
+    WavOutput wav;
+    wav.open(options.wavPath);
+
+    int64_t start = nowMicros();
+    int64_t nextProbe = start, nextReport = start + 1000000;
+    uint8_t buffer[2048];
+    while (nowMicros() - start < (int64_t)options.seconds * 1000000) {
+        int64_t now = nowMicros();
+        if (now >= nextProbe) {
+            rtp::ClockProbe probe;
+            memset(&probe, 0, sizeof(probe));
+            memcpy(probe.magic, "RTPC", 4);
+            probe.clientMicros = nowMicros();
+            sendto(probeFd, &probe, sizeof(probe), 0, (struct sockaddr *)&recorder, sizeof(recorder));
+            nextProbe = now + PROBE_INTERVAL_MS * 1000;
+        }
+        if (now >= nextReport) {
+            report("Running", stream, clock);
+            nextReport += 1000000;
+        }
+
+        struct pollfd fds[2] = {{rtpFd, POLLIN, 0}, {probeFd, POLLIN, 0}};
+        if (poll(fds, 2, 50) <= 0) continue;
+        if (fds[0].revents & POLLIN) {
+            ssize_t length = recv(rtpFd, buffer, sizeof(buffer), 0);
+            if (length > 0) handlePacket(buffer, length, nowMicros(), clock, stream, wav);
+        }
+        if (fds[1].revents & POLLIN) {
+            ssize_t length = recv(probeFd, buffer, sizeof(buffer), 0);
+            if (length > 0) handleProbeReply(buffer, length, nowMicros(), clock);
+        }
+    }
+
+    if (options.simulateDelayMs >= 0) {
+        simulation.running = false;
+        pthread_join(simulator, NULL);
+    }
+    wav.close();
+    report("Total", stream, clock);
+    if (stream.started) {
+        printf("SSRC %08x, payload type %u (%s), %u clock probe replies, offset %lld us\n", stream.ssrc,
+               stream.payloadType, encodingOf(stream.payloadType) == rtp::L16 ? "L16" : "DVI4", clock.replies,
+               (long long)clock.offset);
+    }
+    close(rtpFd);
+    close(probeFd);
+    return stream.received ? 0 : 1;
+}
@@ -0,0 +1,741 @@
+// Pulls the pending recordings of many recorders at once ("ESP32 Audio
+// Recorder with Wi-Fi File Transfer") and checks every file before keeping it.
+//
+// Each recorder gets its own worker: GET /list, then /download?id=N for every
+// listed segment that is not in the output directory yet, one at a time
+// (the recorder's SD card is also busy recording). Interrupted downloads are
+// kept as .part files and resumed with a Range request. A finished file is
+// kept only if its size and CRC-32 match /list, otherwise it is fetched again.
+// Once everything listed is in, the worker sends /confirm so the recorder
+// can go back to sleep.
+//
+//   program [--dir recordings] [--jobs 8] [--port 80] [--scan 192.168.4.1-254]
+//           [--no-confirm] [--simulate N] [host[:port] ...]
+//
+// --scan probes an address range (quietly skipping addresses that do not
+// answer). --simulate starts N local fake recorders, with dropped connections
+// and a corrupted transfer, and syncs from them to check the client without
+// hardware.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "WavHeader.h"
+
+static const int CONNECT_TIMEOUT_MS = 1000;
+static const int IO_TIMEOUT_MS = 10000;     // Downloads pause while the recorder's writer has the SD card
+static const size_t READ_SIZE = 16384;      // Same as the access point firmware's transfer_chunk_size
+static const int MAX_ATTEMPTS = 4;          // Per recording: resumes and checksum retries together
+static const int RETRY_DELAY_MS = 500;
+
+// Fake recorders (--simulate)
+static const uint16_t SIMULATED_BASE_PORT = 18080;
+static const int SIMULATED_FILES = 3;
+static const uint32_t SIMULATED_SECONDS = 3;     // Per file, 44.1 kHz mono 16-bit
+static const uint32_t SIMULATED_KBPS = 600;      // Per recorder, about what one soft AP download gets
+
+static double nowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// CRC-32, zlib polynomial, as in /list
+static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static bool fileCrc32(const std::string &path, uint64_t &size, uint32_t &crc) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    static __thread uint8_t buffer[65536];
+    size = 0;
+    crc = 0;
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        crc = crc32Update(crc, buffer, length);
+        size += length;
+    }
+    fclose(file);
+    return true;
+}
+
+static int64_t fileSize(const std::string &path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? (int64_t)info.st_size : -1;
+}
+
+struct Endpoint {
+    std::string host;
+    uint16_t port;
+    bool scanned;  // From --scan: no report if nothing answers
+};
+
+// ---------------------------------------------------------------------------
+// HTTP client: one GET per connection (the recorder closes after each response)
+
+struct HttpResponse {
+    int status;              // -1: no response
+    int64_t contentLength;   // -1: until the connection closes
+    uint64_t rangeStart;     // From Content-Range on a 206
+    uint64_t received;       // Body bytes
+    bool complete;           // The whole announced body arrived
+};
+
+// Called once per received piece of the body; false aborts the transfer
+typedef bool (*BodySink)(const uint8_t *data, size_t length, const HttpResponse &response, void *context);
+
+static int connectTo(const Endpoint &endpoint) {
+    struct addrinfo hints = {}, *addresses = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char port[8];
+    snprintf(port, sizeof(port), "%u", endpoint.port);
+    if (getaddrinfo(endpoint.host.c_str(), port, &hints, &addresses) != 0) return -1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        freeaddrinfo(addresses);
+        return -1;
+    }
+    // Non-blocking connect so unanswered scan addresses cost CONNECT_TIMEOUT_MS, not the kernel's minutes
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int rc = connect(fd, addresses->ai_addr, addresses->ai_addrlen);
+    freeaddrinfo(addresses);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd waiter = {fd, POLLOUT, 0};
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (poll(&waiter, 1, CONNECT_TIMEOUT_MS) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 &&
+            error == 0) {
+            rc = 0;
+        }
+    }
+    if (rc != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, 0);
+    struct timeval timeout = {IO_TIMEOUT_MS / 1000, (IO_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+static const char *findHeader(const char *headers, const char *name) {
+    size_t length = strlen(name);
+    for (const char *line = strstr(headers, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, length) == 0 && line[2 + length] == ':') return line + 3 + length;
+    }
+    return NULL;
+}
+
+// rangeStart > 0 asks for the rest of the resource from that byte
+static HttpResponse httpGet(const Endpoint &endpoint, const std::string &path, uint64_t rangeStart, BodySink sink,
+                            void *context) {
+    HttpResponse response = {-1, -1, 0, 0, false};
+    int fd = connectTo(endpoint);
+    if (fd < 0) return response;
+
+    char request[512];
+    int requestLength = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n",
+                                 path.c_str(), endpoint.host.c_str());
+    if (rangeStart) {
+        requestLength += snprintf(request + requestLength, sizeof(request) - requestLength,
+                                  "Range: bytes=%llu-\r\n", (unsigned long long)rangeStart);
+    }
+    requestLength += snprintf(request + requestLength, sizeof(request) - requestLength, "\r\n");
+    if (send(fd, request, requestLength, MSG_NOSIGNAL) != requestLength) {
+        close(fd);
+        return response;
+    }
+
+    static __thread uint8_t buffer[READ_SIZE + 1];
+    size_t filled = 0;
+    char *bodyStart = NULL;
+    while (!bodyStart) {
+        ssize_t length = recv(fd, buffer + filled, READ_SIZE - filled, 0);
+        if (length <= 0) {
+            close(fd);
+            return response;
+        }
+        filled += length;
+        buffer[filled] = 0;
+        bodyStart = strstr((char *)buffer, "\r\n\r\n");
+        if (!bodyStart && filled == READ_SIZE) {
+            close(fd);
+            return response;
+        }
+    }
+    bodyStart[2] = 0;  // Headers end with their own CRLF, for findHeader()
+    if (sscanf((char *)buffer, "HTTP/%*s %d", &response.status) != 1) {
+        response.status = -1;
+        close(fd);
+        return response;
+    }
+    const char *value = findHeader((char *)buffer, "Content-Length");
+    if (value) response.contentLength = strtoll(value, NULL, 10);
+    value = findHeader((char *)buffer, "Content-Range");
+    unsigned long long first;
+    if (value && sscanf(value, " bytes %llu-", &first) == 1) response.rangeStart = first;
+
+    size_t headerLength = (uint8_t *)bodyStart + 4 - buffer;
+    size_t length = filled - headerLength;
+    bool keepGoing = true;
+    for (;;) {
+        if (response.contentLength >= 0 && response.received + length > (uint64_t)response.contentLength) {
+            length = response.contentLength - response.received;
+        }
+        if (length > 0) {
+            keepGoing = sink(buffer + headerLength, length, response, context);
+            response.received += length;
+        }
+        headerLength = 0;  // Later reads are all body
+        if (!keepGoing || (response.contentLength >= 0 && response.received == (uint64_t)response.contentLength)) break;
+        ssize_t bytes = recv(fd, buffer, READ_SIZE, 0);
+        if (bytes <= 0) {
+            if (bytes == 0 && response.contentLength < 0) response.complete = true;
+            break;
+        }
+        filled = bytes;
+        length = bytes;
+    }
+    if (keepGoing && response.contentLength >= 0 && response.received == (uint64_t)response.contentLength) {
+        response.complete = true;
+    }
+    close(fd);
+    return response;
+}
+
+static bool appendToString(const uint8_t *data, size_t length, const HttpResponse &, void *context) {
+    ((std::string *)context)->append((const char *)data, length);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Sync
+
+struct Recording {
+    int id;
+    uint64_t size;
+    uint32_t crc;
+    bool hasCrc;
+};
+
+// The recorder's own JSON, so a few fixed keys are enough
+static bool parseList(const std::string &json, std::string &device, std::vector<Recording> &recordings) {
+    const char *text = json.c_str();
+    const char *key = strstr(text, "\"device\":\"");
+    if (key) {
+        key += 10;
+        const char *end = strchr(key, '"');
+        if (end) device.assign(key, end - key);
+    }
+    const char *segments = strstr(text, "\"segments\":[");
+    if (!segments) return false;
+    for (const char *item = strchr(segments, '{'); item; item = strchr(item + 1, '{')) {
+        const char *end = strchr(item, '}');
+        if (!end) return false;
+        std::string object(item, end - item);
+        Recording recording = {0, 0, 0, false};
+        const char *field;
+        if ((field = strstr(object.c_str(), "\"id\":"))) recording.id = atoi(field + 5);
+        if ((field = strstr(object.c_str(), "\"size\":"))) recording.size = strtoull(field + 7, NULL, 10);
+        if ((field = strstr(object.c_str(), "\"crc\":\""))) {
+            recording.crc = strtoul(field + 7, NULL, 16);
+            recording.hasCrc = true;
+        }
+        if (recording.id > 0) recordings.push_back(recording);
+        item = end;
+    }
+    return true;
+}
+
+struct DeviceReport {
+    Endpoint endpoint;
+    std::string device;
+    bool reached;
+    bool duplicate;         // Same recorder already handled through another address
+    std::string error;
+    int listed;
+    int pending;
+    int downloaded;
+    int failed;
+    int resumed;            // Downloads continued with a Range request
+    int checksumRetries;
+    uint64_t bytes;         // Body bytes received this run
+    double seconds;
+    bool confirmed;
+};
+
+struct DownloadState {
+    FILE *file;
+    uint64_t offset;        // Bytes already in the .part file
+    bool started;
+    bool failed;
+};
+
+static bool writeDownload(const uint8_t *data, size_t length, const HttpResponse &response, void *context) {
+    DownloadState &state = *(DownloadState *)context;
+    if (!state.started) {
+        state.started = true;
+        // A recorder that ignores Range sends the whole file: start the part over
+        if (state.offset && (response.status != 206 || response.rangeStart != state.offset)) {
+            if (ftruncate(fileno(state.file), 0) != 0 || fseek(state.file, 0, SEEK_SET) != 0) return false;
+            state.offset = 0;
+        }
+    }
+    if (fwrite(data, 1, length, state.file) != length) {
+        state.failed = true;
+        return false;
+    }
+    return true;
+}
+
+static bool downloadRecording(const Endpoint &endpoint, const std::string &directory, const Recording &recording,
+                              DeviceReport &report) {
+    char name[32];
+    snprintf(name, sizeof(name), "/record_%d.wav", recording.id);
+    std::string finalPath = directory + name, partPath = finalPath + ".part";
+    char path[48];
+    snprintf(path, sizeof(path), "/download?id=%d", recording.id);
+
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+        if (attempt) usleep(RETRY_DELAY_MS * 1000);
+        int64_t have = fileSize(partPath);
+        if (have < 0 || (uint64_t)have > recording.size) have = 0;
+        if ((uint64_t)have < recording.size || recording.size == 0) {
+            FILE *file = fopen(partPath.c_str(), have ? "r+b" : "wb");
+            if (!file) {
+                report.error = "cannot write " + partPath;
+                return false;
+            }
+            fseek(file, have, SEEK_SET);
+            if (have) report.resumed++;
+            DownloadState state = {file, (uint64_t)have, false, false};
+            HttpResponse response = httpGet(endpoint, path, have, writeDownload, &state);
+            fclose(file);
+            report.bytes += response.received;
+            if (state.failed) {
+                report.error = "write failed for " + partPath;
+                return false;
+            }
+            if (response.status == 404 || response.status == 409) {
+                unlink(partPath.c_str());
+                return false;  // Gone, or still being recorded: not an error of this run
+            }
+            if (!response.complete || (response.status != 200 && response.status != 206)) continue;  // Resume
+        }
+
+        uint64_t size;
+        uint32_t crc;
+        if (!fileCrc32(partPath, size, crc)) continue;
+        if (size == recording.size && (!recording.hasCrc || crc == recording.crc)) {
+            return rename(partPath.c_str(), finalPath.c_str()) == 0;
+        }
+        fprintf(stderr, "%s: record_%d.wav is %llu bytes, CRC32 %08x, expected %llu / %08x; fetching again\n",
+                report.device.c_str(), recording.id, (unsigned long long)size, crc,
+                (unsigned long long)recording.size, recording.crc);
+        report.checksumRetries++;
+        unlink(partPath.c_str());
+    }
+    return false;
+}
+
+// Device names are MAC addresses; keep them usable as directory names
+static std::string directoryName(const std::string &device) {
+    std::string name = device;
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == ':' || name[i] == '/') name[i] = '-';
+    }
+    return name;
+}
+
+struct SyncJob {
+    std::vector<Endpoint> endpoints;
+    std::vector<DeviceReport> reports;
+    std::string directory;
+    bool confirm;
+    size_t next;
+    std::set<std::string> devices;  // Recorders claimed by a worker
+    pthread_mutex_t mutex;
+};
+
+static void syncDevice(SyncJob &job, DeviceReport &report) {
+    double start = nowSeconds();
+    std::string json;
+    HttpResponse list = httpGet(report.endpoint, "/list", 0, appendToString, &json);
+    std::vector<Recording> recordings;
+    if (list.status != 200 || !list.complete || !parseList(json, report.device, recordings)) {
+        report.error = list.status < 0 ? "no answer" : "no recording list";
+        return;
+    }
+    report.reached = true;
+    if (report.device.empty()) report.device = report.endpoint.host + "-" + std::to_string(report.endpoint.port);
+
+    pthread_mutex_lock(&job.mutex);
+    report.duplicate = !job.devices.insert(report.device).second;
+    pthread_mutex_unlock(&job.mutex);
+    if (report.duplicate) return;
+
+    std::string directory = job.directory + "/" + directoryName(report.device);
+    mkdir(job.directory.c_str(), 0755);
+    mkdir(directory.c_str(), 0755);
+
+    report.listed = recordings.size();
+    for (size_t i = 0; i < recordings.size(); i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/record_%d.wav", recordings[i].id);
+        if (fileSize(directory + name) >= 0) continue;  // Verified on an earlier run
+        report.pending++;
+        if (downloadRecording(report.endpoint, directory, recordings[i], report)) {
+            report.downloaded++;
+        } else {
+            report.failed++;
+        }
+        if (!report.error.empty()) break;
+    }
+    report.seconds = nowSeconds() - start;
+
+    if (job.confirm && report.failed == 0 && report.error.empty()) {
+        std::string reply;
+        HttpResponse confirm = httpGet(report.endpoint, "/confirm", 0, appendToString, &reply);
+        report.confirmed = confirm.status == 200;
+    }
+}
+
+static void *syncWorker(void *argument) {
+    SyncJob &job = *(SyncJob *)argument;
+    for (;;) {
+        pthread_mutex_lock(&job.mutex);
+        size_t index = job.next++;
+        pthread_mutex_unlock(&job.mutex);
+        if (index >= job.reports.size()) return NULL;
+        syncDevice(job, job.reports[index]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Fake recorders for --simulate: /list, /download with Range and /confirm as
+// the firmware serves them, throttled to SIMULATED_KBPS. Every recorder drops
+// its first download halfway (the client must resume it), and recorder 0
+// flips a byte in its first download of file 2 (the client must notice and
+// fetch it again).
+
+struct FakeRecorder {
+    int index;
+    int listenFd;
+    uint16_t port;
+    std::vector<std::vector<uint8_t> > files;
+    std::vector<uint32_t> crcs;
+    bool dropPending;
+    bool corruptPending;
+    volatile bool confirmed;
+    volatile bool stop;
+    pthread_t thread;
+};
+
+static void sendAll(int fd, const void *data, size_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (length > 0) {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent <= 0) return;
+        bytes += sent;
+        length -= sent;
+    }
+}
+
+static void sendText(int fd, int status, const char *reason, const char *type, const std::string &body) {
+    char header[256];
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                          status, reason, type, body.size());
+    sendAll(fd, header, length);
+    sendAll(fd, body.data(), body.size());
+}
+
+static void serveFakeRequest(FakeRecorder &recorder, int fd) {
+    char request[2048];
+    size_t filled = 0;
+    request[0] = 0;
+    while (filled < sizeof(request) - 1 && !strstr(request, "\r\n\r\n")) {
+        ssize_t length = recv(fd, request + filled, sizeof(request) - 1 - filled, 0);
+        if (length <= 0) return;
+        filled += length;
+        request[filled] = 0;
+    }
+    char path[256];
+    if (sscanf(request, "GET %255s", path) != 1) return;
+
+    if (strcmp(path, "/list") == 0) {
+        char item[160];
+        snprintf(item, sizeof(item), "{\"device\":\"sim-%d\",\"recording\":%d,\"segments\":[", recorder.index,
+                 (int)recorder.files.size() + 1);
+        std::string json = item;
+        for (size_t i = 0; i < recorder.files.size(); i++) {
+            snprintf(item, sizeof(item), "%s{\"id\":%d,\"file\":\"/record_%d.wav\",\"size\":%zu,\"crc\":\"%08x\"}",
+                     i ? "," : "", (int)i + 1, (int)i + 1, recorder.files[i].size(), recorder.crcs[i]);
+            json += item;
+        }
+        json += "]}";
+        sendText(fd, 200, "OK", "application/json", json);
+        return;
+    }
+    if (strcmp(path, "/confirm") == 0) {
+        recorder.confirmed = true;
+        sendText(fd, 200, "OK", "text/plain", "Server shutting down");
+        return;
+    }
+    int id;
+    if (sscanf(path, "/download?id=%d", &id) != 1 || id < 1 || id > (int)recorder.files.size()) {
+        sendText(fd, 404, "Not Found", "text/plain", "File not found");
+        return;
+    }
+
+    const std::vector<uint8_t> &file = recorder.files[id - 1];
+    uint64_t first = 0;
+    const char *range = findHeader(request, "Range");
+    bool ranged = range && sscanf(range, " bytes=%llu-", (unsigned long long *)&first) == 1 && first < file.size();
+    if (!ranged) first = 0;
+    size_t length = file.size() - first;
+    char header[256];
+    int headerLength;
+    if (ranged) {
+        headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 206 Partial Content\r\nContent-Type: audio/wav\r\nContent-Length: %zu\r\n"
+                                "Content-Range: bytes %llu-%zu/%zu\r\nAccept-Ranges: bytes\r\nConnection: close\r\n\r\n",
+                                length, (unsigned long long)first, file.size() - 1, file.size());
+    } else {
+        headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 200 OK\r\nContent-Type: audio/wav\r\nContent-Length: %zu\r\n"
+                                "Accept-Ranges: bytes\r\nConnection: close\r\n\r\n", length);
+    }
+    sendAll(fd, header, headerLength);
+
+    bool drop = recorder.dropPending && !ranged;
+    bool corrupt = recorder.corruptPending && id == 2;
+    recorder.dropPending = recorder.dropPending && !drop;
+    recorder.corruptPending = recorder.corruptPending && !corrupt;
+    const size_t chunk = 4096;
+    double start = nowSeconds();
+    for (size_t sent = 0; sent < length; sent += chunk) {
+        if (drop && sent >= length / 2) return;  // Connection lost mid-file
+        uint8_t piece[chunk];
+        size_t pieceLength = length - sent < chunk ? length - sent : chunk;
+        memcpy(piece, &file[first + sent], pieceLength);
+        if (corrupt && sent == 0) piece[pieceLength - 1] ^= 0x40;
+        sendAll(fd, piece, pieceLength);
+        double due = start + (sent + pieceLength) / (SIMULATED_KBPS * 1024.0);
+        double wait = due - nowSeconds();
+        if (wait > 0) usleep(wait * 1e6);
+    }
+}
+
+static void *fakeRecorderThread(void *argument) {
+    FakeRecorder &recorder = *(FakeRecorder *)argument;
+    while (!recorder.stop) {
+        struct pollfd waiter = {recorder.listenFd, POLLIN, 0};
+        if (poll(&waiter, 1, 100) != 1) continue;
+        int fd = accept(recorder.listenFd, NULL, NULL);
+        if (fd < 0) continue;
+        serveFakeRequest(recorder, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+// Tone recordings with a per-recorder pitch, so every file differs
+static void makeFakeFiles(FakeRecorder &recorder) {
+    const uint32_t sampleRate = 44100;
+    for (int f = 0; f < SIMULATED_FILES; f++) {
+        uint32_t samples = SIMULATED_SECONDS * sampleRate + f * 1000;
+        std::vector<uint8_t> file(wav::HEADER_BYTES + samples * 2);
+        wav::fillHeader(&file[0], sampleRate, 1, 16, samples * 2);
+        double frequency = 220.0 * (recorder.index + 1) + 55.0 * f;
+        for (uint32_t i = 0; i < samples; i++) {
+            int16_t sample = (int16_t)(8000 * sin(2 * M_PI * frequency * i / sampleRate));
+            wav::putLE(&file[wav::HEADER_BYTES + 2 * i], (uint16_t)sample, 2);
+        }
+        recorder.crcs.push_back(crc32Update(0, &file[0], file.size()));
+        recorder.files.push_back(file);
+    }
+}
+
+static bool startFakeRecorder(FakeRecorder &recorder, int index) {
+    recorder.index = index;
+    recorder.port = SIMULATED_BASE_PORT + index;
+    recorder.dropPending = true;
+    recorder.corruptPending = index == 0;
+    recorder.confirmed = false;
+    recorder.stop = false;
+    makeFakeFiles(recorder);
+
+    recorder.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(recorder.listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(recorder.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(recorder.listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(recorder.listenFd, 8) != 0) {
+        perror("fake recorder");
+        close(recorder.listenFd);
+        return false;
+    }
+    return pthread_create(&recorder.thread, NULL, fakeRecorderThread, &recorder) == 0;
+}
+
+// ---------------------------------------------------------------------------
+
+// "a.b.c.X-Y" or a single address
+static bool addScan(const char *spec, uint16_t port, std::vector<Endpoint> &endpoints) {
+    unsigned a, b, c, first, last;
+    int fields = sscanf(spec, "%u.%u.%u.%u-%u", &a, &b, &c, &first, &last);
+    if (fields < 4 || a > 255 || b > 255 || c > 255 || first > 255) return false;
+    if (fields == 4) last = first;
+    if (last < first || last > 255) return false;
+    for (unsigned host = first; host <= last; host++) {
+        char address[16];
+        snprintf(address, sizeof(address), "%u.%u.%u.%u", a, b, c, host);
+        Endpoint endpoint = {address, port, true};
+        endpoints.push_back(endpoint);
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: program [--dir recordings] [--jobs 8] [--port 80] [--scan a.b.c.X-Y] [--no-confirm]\n"
+                    "               [--simulate N] [host[:port] ...]\n");
+}
+
+int main(int argc, char **argv) {
+    SyncJob job;
+    job.directory = "recordings";
+    job.confirm = true;
+    job.next = 0;
+    pthread_mutex_init(&job.mutex, NULL);
+    int jobs = 8;
+    uint16_t port = 80;
+    int simulate = 0;
+    std::vector<const char *> hosts, scans;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--dir") && hasValue) job.directory = argv[++i];
+        else if (!strcmp(argv[i], "--jobs") && hasValue) jobs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--port") && hasValue) port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--scan") && hasValue) scans.push_back(argv[++i]);
+        else if (!strcmp(argv[i], "--no-confirm")) job.confirm = false;
+        else if (!strcmp(argv[i], "--simulate") && hasValue) simulate = atoi(argv[++i]);
+        else if (argv[i][0] != '-') hosts.push_back(argv[i]);
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (jobs < 1) jobs = 1;
+
+    std::vector<FakeRecorder> fakes(simulate > 0 ? simulate : 0);
+    for (int i = 0; i < simulate; i++) {
+        if (!startFakeRecorder(fakes[i], i)) return 1;
+        Endpoint endpoint = {"127.0.0.1", fakes[i].port, false};
+        job.endpoints.push_back(endpoint);
+    }
+    for (size_t i = 0; i < hosts.size(); i++) {
+        std::string host = hosts[i];
+        Endpoint endpoint = {host, port, false};
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos) {
+            endpoint.host = host.substr(0, colon);
+            endpoint.port = atoi(host.c_str() + colon + 1);
+        }
+        job.endpoints.push_back(endpoint);
+    }
+    for (size_t i = 0; i < scans.size(); i++) {
+        if (!addScan(scans[i], port, job.endpoints)) {
+            fprintf(stderr, "Bad --scan range: %s\n", scans[i]);
+            return 2;
+        }
+    }
+    if (job.endpoints.empty()) {
+        usage();
+        return 2;
+    }
+
+    for (size_t i = 0; i < job.endpoints.size(); i++) {
+        DeviceReport report = {job.endpoints[i], "", false, false, "", 0, 0, 0, 0, 0, 0, 0, 0.0, false};
+        job.reports.push_back(report);
+    }
+    double start = nowSeconds();
+    std::vector<pthread_t> workers(jobs < (int)job.endpoints.size() ? jobs : job.endpoints.size());
+    for (size_t i = 0; i < workers.size(); i++) pthread_create(&workers[i], NULL, syncWorker, &job);
+    for (size_t i = 0; i < workers.size(); i++) pthread_join(workers[i], NULL);
+    double elapsed = nowSeconds() - start;
+
+    int devices = 0, files = 0, failures = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < job.reports.size(); i++) {
+        const DeviceReport &report = job.reports[i];
+        const char *host = report.endpoint.host.c_str();
+        if (!report.reached) {
+            if (!report.endpoint.scanned) {
+                printf("%s:%u: %s\n", host, report.endpoint.port, report.error.c_str());
+                failures++;
+            }
+            continue;
+        }
+        if (report.duplicate) continue;
+        devices++;
+        files += report.downloaded;
+        bytes += report.bytes;
+        if (report.failed || !report.error.empty()) failures++;
+        printf("%s (%s:%u): %d listed, %d pending, %d downloaded, %d failed (%d resumed, %d checksum retries), "
+               "%.1f kB in %.2f s, %.1f kB/s%s%s%s\n",
+               report.device.c_str(), host, report.endpoint.port, report.listed, report.pending, report.downloaded,
+               report.failed, report.resumed, report.checksumRetries, report.bytes / 1024.0, report.seconds,
+               report.seconds > 0 ? report.bytes / 1024.0 / report.seconds : 0.0,
+               report.confirmed ? ", confirmed" : "", report.error.empty() ? "" : ", ", report.error.c_str());
+    }
+    printf("Total: %d recorder(s), %d file(s), %.1f kB in %.2f s, %.1f kB/s aggregate\n", devices, files,
+           bytes / 1024.0, elapsed, elapsed > 0 ? bytes / 1024.0 / elapsed : 0.0);
+
+    if (simulate > 0) {
+        int confirmed = 0;
+        for (int i = 0; i < simulate; i++) {
+            confirmed += fakes[i].confirmed;
+            fakes[i].stop = true;
+            pthread_join(fakes[i].thread, NULL);
+            close(fakes[i].listenFd);
+        }
+        printf("Simulation: %d/%d fake recorders confirmed\n", confirmed, simulate);
+        if (job.confirm && confirmed != simulate) failures++;
+    }
+    return failures ? 1 : 0;
+}